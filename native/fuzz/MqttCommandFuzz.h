@@ -0,0 +1,140 @@
+/*
+  MqttCommandFuzz.h - One fuzz iteration over the MQTT command path
+  The same steps as mqttCallback() in app_main.cpp for an inverter command:
+  MqttCommand::subtopic/value, the TopicDispatcher built from registerCommands()
+  (GrowattTaskFactory, the MultiGrowattInverter address prefix), then read() +
+  getData() to run the task
+
+  Shared by the libFuzzer/AFL++ entry point (fuzz_mqtt_command.cpp) and the native
+  tests. It replaces operator new to count allocations (AllocCounter.h), so include
+  it in ONE translation unit only.
+
+  Input layout: the first byte picks the inverter (bit 0: MultiGrowattInverter at 1 and 2,
+  otherwise a single GrowattInverter) and whether the topic gets the base topic prefix
+  (bit 1), then the topic up to the first '\n' and the payload after it
+
+  Aborts when a message leaks memory, allocates more than MQTT_FUZZ_MAX_ALLOC_BYTES
+  plus MQTT_FUZZ_ALLOC_BYTES_PER_TOPIC_BYTE per topic byte, or when the value handed
+  to the inverter is longer than MQTT_COMMAND_VALUE_MAX_LEN
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef MQTT_COMMAND_FUZZ_H
+#define MQTT_COMMAND_FUZZ_H
+
+#include <Arduino.h>
+#include <AllocCounter.h>
+#include <MemoryStream.h>
+#include <string>
+#include "MqttCommand.h"
+#include "growatt/GrowattInverter.h"
+#include "growatt/MultiGrowattInverter.h"
+
+#define MQTT_FUZZ_BASE_TOPIC "energy/growatt"
+
+// inverters, dispatch table, task and the strings around them
+#define MQTT_FUZZ_MAX_ALLOC_BYTES 8192
+// the topic is copied a few times on the way
+#define MQTT_FUZZ_ALLOC_BYTES_PER_TOPIC_BYTE 16
+
+class MqttFuzzGrowattFactory : public MultiGrowattInverterInnerFactory {
+    public:
+        virtual Inverter *createInverter(Stream *serial, int modbusAddress, bool enableRemoteCommands, bool isTL) {
+            return new GrowattInverter(serial, false, modbusAddress, enableRemoteCommands, isTL);
+        }
+};
+
+// what mqttCallback() does with a message that is not for the LED or the profiler
+inline bool mqttCommandDispatch(TopicDispatcher &commands, const char *baseTopic, const char *topic, const byte *payload, unsigned int length) {
+    const char *subTopic = MqttCommand::subtopic(baseTopic, topic);
+    char value[MQTT_COMMAND_VALUE_MAX_LEN + 1];
+    return commands.dispatch(subTopic, MqttCommand::value(payload, length, value));
+}
+
+// the dispatch table setupInverter() builds
+inline void mqttCommandRegister(TopicDispatcher &commands, Inverter *inverter) {
+    commands.clear();
+    inverter->registerCommands(commands, "");
+    commands.build();
+}
+
+// inverters at 1 and 2 with every holding register the tasks touch, so the
+// writes change values instead of growing the register maps
+inline void mqttCommandFuzzSetupBus() {
+    for (uint8_t addr = 1; addr <= 2; addr++) {
+        if (ModbusBus.slaves.count(addr) == 0) {
+            NativeModbusSlave &s = ModbusBus.slave(addr);
+            for (uint16_t r = 0; r < 1200; r++) {
+                s.holdingRegisters[r] = 0;
+            }
+        }
+    }
+}
+
+// returns true when the message became a task
+inline bool mqttCommandFuzzOne(const uint8_t *data, size_t size) {
+    if (size < 1) {
+        return false;
+    }
+
+    mqttCommandFuzzSetupBus();
+    MemoryStream serial;
+
+    const uint8_t *end = data + size;
+    const uint8_t *topicStart = data + 1;
+    const uint8_t *topicEnd = std::find(topicStart, end, '\n');
+    const uint8_t *payload = topicEnd == end ? end : topicEnd + 1;
+
+    // topics are C strings, a NUL ends them like it does on the ESP
+    std::string topic((data[0] & 0x02) ? MQTT_FUZZ_BASE_TOPIC "/" : "");
+    topic.append((const char *) topicStart, topicEnd - topicStart);
+    size_t topicLen = strlen(topic.c_str());
+
+    bool accepted = false;
+    AllocCounter allocs;
+    {
+        Inverter *inverter;
+        if (data[0] & 0x01) {
+            inverter = new MultiGrowattInverter(&serial, false, { 1, 2 }, true, false, new MqttFuzzGrowattFactory());
+        } else {
+            inverter = new GrowattInverter(&serial, false, 1, true, false);
+        }
+
+        TopicDispatcher commands;
+        mqttCommandRegister(commands, inverter);
+
+        char value[MQTT_COMMAND_VALUE_MAX_LEN + 1];
+        if (strlen(MqttCommand::value(payload, end - payload, value)) > MQTT_COMMAND_VALUE_MAX_LEN) {
+            abort();
+        }
+
+        mqttCommandDispatch(commands, MQTT_FUZZ_BASE_TOPIC, topic.c_str(), payload, end - payload);
+
+        // a task runs on the first read of its inverter and reports its result
+        int reads = (data[0] & 0x01) ? 2 : 1;
+        for (int i = 0; i < reads; i++) {
+            inverter->read();
+            if (inverter->isDataValid()) {
+                InverterData result = inverter->getData();
+                for (const auto &entry : result) {
+                    accepted |= entry.first.endsWith("/result");
+                }
+            }
+        }
+
+        delete inverter;
+    }
+
+    if (allocs.liveSince() != 0) {
+        abort();
+    }
+    if (allocs.bytesSince() > MQTT_FUZZ_MAX_ALLOC_BYTES + MQTT_FUZZ_ALLOC_BYTES_PER_TOPIC_BYTE * topicLen) {
+        abort();
+    }
+
+    return accepted;
+}
+
+#endif
@@ -0,0 +1,65 @@
+/*
+  SoyosourceFuzz.h - One fuzz iteration over the Soyosource display parser
+  Shared by the libFuzzer/AFL++ entry point (fuzz_soyosource.cpp) and the native
+  tests, which replay generated streams through it on every run
+
+  Input layout: the first byte sets the chunk size fed to loop() at a time (1..64),
+  every chunk starting with 0xFF also lets 60ms pass first, so the fuzzer reaches
+  the partial frame timeout too
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef SOYOSOURCE_FUZZ_H
+#define SOYOSOURCE_FUZZ_H
+
+#include <Arduino.h>
+#include <MemoryStream.h>
+#include <set>
+#include "soyosource/SoyosourceGTNInverter.h"
+
+// fields the driver may publish, anything else is a parser bug
+static const std::set<String> SOYOSOURCE_FUZZ_FIELDS = {
+    "PacMeter", "Mode", "ModeString", "Error", "MeterConnected", "OperationStatusId", "OperationStatus",
+    "ErrorBitmask", "ErrorString", "Vbat", "Ibat", "Pbat", "Pac", "Vac", "Fac", "Temp", "Etotal",
+    "BadFrameCount", "BadSource", "BadFunction"
+};
+
+// returns the number of status frames decoded
+inline uint32_t soyosourceFuzzOne(const uint8_t *data, size_t size) {
+    if (size < 1) {
+        return 0;
+    }
+
+    MemoryStream serial;
+    SoyosourceGTNInverter inverter(&serial, false);
+    size_t chunk = 1 + data[0] % 64;
+    uint32_t decoded = 0;
+
+    for (size_t at = 1; at < size; at += chunk) {
+        size_t n = std::min(chunk, size - at);
+        if (data[at] == 0xFF) {
+            delay(60);
+        }
+        serial.feed(data + at, n);
+        inverter.loop();
+
+        if (inverter.isDataValid()) {
+            InverterData values = inverter.getData();
+            for (const auto &entry : values) {
+                if (SOYOSOURCE_FUZZ_FIELDS.count(entry.first) == 0) {
+                    abort();
+                }
+            }
+            if (inverter.isDataValid()) {
+                abort();
+            }
+            decoded++;
+        }
+    }
+
+    return decoded;
+}
+
+#endif
@@ -0,0 +1,14 @@
+/*
+  fuzz_mqtt_command.cpp - libFuzzer / AFL++ entry point for the MQTT command path
+  Build and run instructions in BUILD.md
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include "MqttCommandFuzz.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    mqttCommandFuzzOne(data, size);
+    return 0;
+}
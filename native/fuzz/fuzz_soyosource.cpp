@@ -0,0 +1,14 @@
+/*
+  fuzz_soyosource.cpp - libFuzzer / AFL++ entry point for the Soyosource parser
+  Build and run instructions in BUILD.md
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include "SoyosourceFuzz.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    soyosourceFuzzOne(data, size);
+    return 0;
+}
@@ -0,0 +1,224 @@
+/*
+  Arduino.h - Native (host) shim of the ESP8266 Arduino core
+  Just enough of Print, Stream, time and ESP to build the drivers and the MQTT
+  publisher on Linux for the unit tests and benchmarks (pio test -e native)
+
+  millis()/micros() follow the host clock plus a virtual offset: delay() and
+  NativeClock::advance() move the offset instead of sleeping, so tests that go
+  through the 1 second Growatt write delays or polling intervals run instantly
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <functional>
+#include "WString.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+// flash access is plain memory access on the host
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define ICACHE_RAM_ATTR
+#define IRAM_ATTR
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define memcpy_P memcpy
+#define snprintf_P snprintf
+#define vsnprintf_P vsnprintf
+
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+#define highByte(w) ((uint8_t) ((w) >> 8))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+
+class NativeClock {
+    public:
+        static unsigned long micros() {
+            auto elapsed = std::chrono::steady_clock::now() - start();
+            return (unsigned long) (std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() + offsetMicros());
+        }
+
+        // moves the virtual clock forward, seen by millis() and micros()
+        static void advance(unsigned long ms) {
+            offsetMicros() += (int64_t) ms * 1000;
+        }
+
+    private:
+        static std::chrono::steady_clock::time_point &start() {
+            static std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+            return t;
+        }
+
+        static int64_t &offsetMicros() {
+            static int64_t offset = 0;
+            return offset;
+        }
+};
+
+inline unsigned long micros() { return NativeClock::micros(); }
+inline unsigned long millis() { return NativeClock::micros() / 1000; }
+inline void delay(unsigned long ms) { NativeClock::advance(ms); }
+inline void delayMicroseconds(unsigned int) {}
+inline void yield() {}
+
+inline long random(long howbig) { return howbig <= 0 ? 0 : rand() % howbig; }
+inline long random(long howsmall, long howbig) { return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall); }
+inline void randomSeed(unsigned long seed) { srand(seed); }
+
+// no SNTP on the host, tests set the clock with WallClock::setTime()
+inline void configTime(int, int, const char *, const char * = nullptr, const char * = nullptr) {}
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return HIGH; }
+
+class Print;
+
+class Printable {
+    public:
+        virtual ~Printable() {}
+        virtual size_t printTo(Print &p) const = 0;
+};
+
+class Print {
+    public:
+        virtual ~Print() {}
+
+        virtual size_t write(uint8_t c) = 0;
+        virtual size_t write(const uint8_t *buffer, size_t size) {
+            size_t n = 0;
+            while (size--) {
+                if (write(*buffer++) == 0) break;
+                n++;
+            }
+            return n;
+        }
+        size_t write(const char *str) { return str ? write((const uint8_t *) str, strlen(str)) : 0; }
+        size_t write(const char *buffer, size_t size) { return write((const uint8_t *) buffer, size); }
+        virtual int availableForWrite() { return 0; }
+        virtual void flush() {}
+
+        __attribute__((format(printf, 2, 3))) size_t printf(const char *format, ...) {
+            char buf[256];
+            va_list arg;
+            va_start(arg, format);
+            int len = vsnprintf(buf, sizeof(buf), format, arg);
+            va_end(arg);
+            return len < 0 ? 0 : write((const uint8_t *) buf, len < (int) sizeof(buf) ? len : sizeof(buf) - 1);
+        }
+
+        size_t print(const __FlashStringHelper *str) { return write(reinterpret_cast<const char *>(str)); }
+        size_t print(const String &str) { return write((const uint8_t *) str.c_str(), str.length()); }
+        size_t print(const char *str) { return write(str); }
+        size_t print(char c) { return write((uint8_t) c); }
+        size_t print(unsigned char value, int base = DEC) { return print(String(value, base)); }
+        size_t print(int value, int base = DEC) { return print(String(value, base)); }
+        size_t print(unsigned int value, int base = DEC) { return print(String(value, base)); }
+        size_t print(long value, int base = DEC) { return print(String(value, base)); }
+        size_t print(unsigned long value, int base = DEC) { return print(String(value, base)); }
+        size_t print(double value, int digits = 2) { return print(String(value, digits)); }
+        size_t print(const Printable &p) { return p.printTo(*this); }
+
+        size_t println() { return write("\r\n"); }
+        template <typename T> size_t println(const T &value) { size_t n = print(value); return n + println(); }
+        template <typename T> size_t println(const T &value, int format) { size_t n = print(value, format); return n + println(); }
+};
+
+class Stream : public Print {
+    public:
+        Stream() : timeout(1000) {}
+
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() = 0;
+
+        void setTimeout(unsigned long timeout) { this->timeout = timeout; }
+
+        size_t readBytes(char *buffer, size_t length) {
+            size_t count = 0;
+            while (count < length) {
+                int c = timedRead();
+                if (c < 0) break;
+                *buffer++ = (char) c;
+                count++;
+            }
+            return count;
+        }
+        size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *) buffer, length); }
+
+    protected:
+        unsigned long timeout;
+
+        int timedRead() {
+            unsigned long start = millis();
+            do {
+                int c = read();
+                if (c >= 0) return c;
+            } while (millis() - start < timeout);
+            return -1;
+        }
+};
+
+class HardwareSerial : public Stream {
+    public:
+        void begin(unsigned long) {}
+        virtual int available() { return 0; }
+        virtual int read() { return -1; }
+        virtual int peek() { return -1; }
+        virtual size_t write(uint8_t c) { fputc(c, stdout); return 1; }
+        using Print::write;
+};
+
+inline HardwareSerial Serial;
+
+class EspClass {
+    public:
+        uint32_t getChipId() { return 0x00c0ffee; }
+        uint32_t getFreeHeap() { return 40000; }
+        uint32_t getMaxFreeBlockSize() { return 30000; }
+        uint8_t getHeapFragmentation() { return 0; }
+        uint8_t getCpuFreqMHz() { return 80; }
+        uint32_t getCycleCount() { return (uint32_t) (micros() * getCpuFreqMHz()); }
+        void restart() {}
+
+        // 128 blocks of 4 bytes, kept for the whole test run like across a soft reset
+        uint32_t rtcMemory[128] = {};
+        bool rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size) {
+            if (offset * 4 + size > sizeof(rtcMemory)) return false;
+            memcpy(data, rtcMemory + offset, size);
+            return true;
+        }
+        bool rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size) {
+            if (offset * 4 + size > sizeof(rtcMemory)) return false;
+            memcpy(rtcMemory + offset, data, size);
+            return true;
+        }
+};
+
+inline EspClass ESP;
+
+#endif
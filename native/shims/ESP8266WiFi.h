@@ -0,0 +1,98 @@
+/*
+  ESP8266WiFi.h - Native (host) shim of the ESP8266 WiFi library
+  There is no network on the host: TCP connects go through when NativeNetwork
+  says the host is reachable (the fake broker in PubSubClient.h decides for its
+  port) and otherwise take the client timeout, like a SYN nobody answers.
+  WiFiServer never has a client. The station reports fixed values
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef NATIVE_ESP8266WIFI_H
+#define NATIVE_ESP8266WIFI_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+#define WL_CONNECTED 3
+
+class NativeNetwork {
+    public:
+        std::function<bool(uint16_t port)> reachable = [](uint16_t) { return true; };
+        uint32_t tcpConnects = 0;
+        // free space in the TCP send buffer of every client, two segments like lwIP
+        int sendBuffer = 2 * 1460;
+};
+
+inline NativeNetwork Network;
+
+class WiFiClient : public Stream {
+    public:
+        virtual int connect(IPAddress, uint16_t port) { return connectTo(port); }
+        virtual int connect(const char *, uint16_t port) { return connectTo(port); }
+        virtual uint8_t connected() { return open && Network.reachable(port); }
+        virtual void stop() { open = false; }
+        virtual int available() { return 0; }
+        virtual int read() { return -1; }
+        virtual int read(uint8_t *, size_t) { return -1; }
+        virtual int peek() { return -1; }
+        virtual size_t write(uint8_t) { return 0; }
+        virtual size_t write(const uint8_t *, size_t) { return 0; }
+        using Print::write;
+        virtual int availableForWrite() { return Network.sendBuffer; }
+        void setNoDelay(bool) {}
+        operator bool() { return connected(); }
+
+    private:
+        bool open = false;
+        uint16_t port = 0;
+
+        int connectTo(uint16_t port) {
+            Network.tcpConnects++;
+            this->port = port;
+            open = Network.reachable(port);
+            if (!open) {
+                delay(timeout);
+            }
+            return open ? 1 : 0;
+        }
+};
+
+// listens nowhere, the tests hand their clients to the servers directly
+class WiFiServer {
+    public:
+        WiFiServer(uint16_t port) {}
+        void begin() {}
+        void stop() {}
+        void setNoDelay(bool) {}
+        bool hasClient() { return false; }
+        WiFiClient available() { return WiFiClient(); }
+};
+
+class ESP8266WiFiClass {
+    public:
+        int status() { return WL_CONNECTED; }
+        bool isConnected() { return true; }
+        // a name the tests want to fail, and the lookups done
+        const char *unresolvable = NULL;
+        uint32_t lookups = 0;
+
+        // numeric addresses as they are, any other name is the local host
+        int hostByName(const char *host, IPAddress &result, uint32_t timeout = 10000) {
+            lookups++;
+            if (unresolvable != NULL && strcmp(host, unresolvable) == 0) {
+                return 0;
+            }
+            if (!result.fromString(host)) {
+                result = IPAddress(127, 0, 0, 1);
+            }
+            return 1;
+        }
+        IPAddress localIP() { return IPAddress(192, 168, 4, 2); }
+        int32_t RSSI() { return -60; }
+};
+
+inline ESP8266WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,181 @@
+/*
+  FS.h - Native (host) shim of the ESP8266 SPIFFS file system
+  Files live in memory (SPIFFS.files), with a capacity so a full flash can be
+  tested, and counters of the opens and bytes written to compare flash wear
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef NATIVE_FS_H
+#define NATIVE_FS_H
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+
+enum SeekMode {
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+};
+
+struct FSInfo {
+    size_t totalBytes;
+    size_t usedBytes;
+    size_t blockSize;
+    size_t pageSize;
+    size_t maxOpenFiles;
+    size_t maxPathLength;
+};
+
+class FS;
+
+class File {
+    public:
+        File() : fs(NULL), pos(0) {}
+        File(FS *fs, const std::string &path, size_t pos) : fs(fs), path(path), pos(pos) {}
+
+        operator bool() const;
+        size_t write(const uint8_t *buf, size_t size);
+        size_t write(uint8_t c) { return write(&c, 1); }
+        size_t read(uint8_t *buf, size_t size);
+        int read() { uint8_t c; return read(&c, 1) == 1 ? c : -1; }
+        bool seek(uint32_t pos, SeekMode mode = SeekSet);
+        size_t position() const { return pos; }
+        size_t size() const;
+        const char *name() const { return path.c_str(); }
+        void close() { fs = NULL; }
+
+    private:
+        FS *fs;
+        std::string path;
+        size_t pos;
+};
+
+class Dir {
+    public:
+        Dir() : fs(NULL), started(false) {}
+        Dir(FS *fs, const std::string &prefix) : fs(fs), prefix(prefix), started(false) {}
+
+        bool next();
+        String fileName() const { return String(current.c_str()); }
+        size_t fileSize() const;
+
+    private:
+        FS *fs;
+        std::string prefix;
+        std::string current;
+        bool started;
+};
+
+class FS {
+    public:
+        std::map<std::string, std::vector<uint8_t>> files;
+        size_t totalBytes = 256 * 1024;
+        uint32_t opens = 0;
+        uint64_t bytesWritten = 0;
+
+        void reset() {
+            files.clear();
+            totalBytes = 256 * 1024;
+            opens = 0;
+            bytesWritten = 0;
+        }
+
+        size_t usedBytes() const {
+            size_t used = 0;
+            for (const auto &f : files) used += f.second.size();
+            return used;
+        }
+
+        bool begin() { return true; }
+        bool format() { files.clear(); return true; }
+        bool exists(const char *path) const { return files.count(path) > 0; }
+        bool remove(const char *path) { return files.erase(path) > 0; }
+
+        // "r", "w" and "a", no read/write modes
+        File open(const char *path, const char *mode) {
+            opens++;
+            if (mode[0] == 'r') {
+                return exists(path) ? File(this, path, 0) : File();
+            }
+            std::vector<uint8_t> &data = files[path];
+            if (mode[0] == 'w') {
+                data.clear();
+            }
+            return File(this, path, data.size());
+        }
+
+        // every file whose name starts with the prefix, SPIFFS has no real directories
+        Dir openDir(const char *prefix) { return Dir(this, prefix); }
+
+        bool info(FSInfo &info) {
+            info.totalBytes = totalBytes;
+            info.usedBytes = usedBytes();
+            info.blockSize = 8192;
+            info.pageSize = 256;
+            info.maxOpenFiles = 5;
+            info.maxPathLength = 32;
+            return true;
+        }
+};
+
+inline File::operator bool() const {
+    return fs != NULL && fs->files.count(path) > 0;
+}
+
+inline size_t File::write(const uint8_t *buf, size_t size) {
+    if (!*this) return 0;
+    size_t used = fs->usedBytes();
+    size_t room = used < fs->totalBytes ? fs->totalBytes - used : 0;
+    size = size < room ? size : room;
+
+    std::vector<uint8_t> &data = fs->files[path];
+    data.insert(data.begin() + pos, buf, buf + size);
+    pos += size;
+    fs->bytesWritten += size;
+    return size;
+}
+
+inline size_t File::read(uint8_t *buf, size_t size) {
+    if (!*this) return 0;
+    const std::vector<uint8_t> &data = fs->files[path];
+    size_t n = pos < data.size() ? data.size() - pos : 0;
+    n = size < n ? size : n;
+    memcpy(buf, data.data() + pos, n);
+    pos += n;
+    return n;
+}
+
+inline bool File::seek(uint32_t offset, SeekMode mode) {
+    if (!*this) return false;
+    size_t base = mode == SeekSet ? 0 : mode == SeekCur ? pos : size();
+    if (base + offset > size()) return false;
+    pos = base + offset;
+    return true;
+}
+
+inline size_t File::size() const {
+    return *this ? fs->files.at(path).size() : 0;
+}
+
+inline bool Dir::next() {
+    if (fs == NULL) return false;
+    auto it = started ? fs->files.upper_bound(current) : fs->files.lower_bound(prefix);
+    started = true;
+    if (it == fs->files.end() || it->first.compare(0, prefix.size(), prefix) != 0) {
+        fs = NULL;
+        return false;
+    }
+    current = it->first;
+    return true;
+}
+
+inline size_t Dir::fileSize() const {
+    return fs != NULL && fs->files.count(current) ? fs->files.at(current).size() : 0;
+}
+
+inline FS SPIFFS;
+
+#endif
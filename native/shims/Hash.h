@@ -0,0 +1,62 @@
+/*
+  Hash.h - Native (host) shim of the ESP8266 core hash functions
+  Only sha1() into a 20 byte digest, as used for the WebSocket handshake
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef NATIVE_HASH_H
+#define NATIVE_HASH_H
+
+#include <stdint.h>
+#include <string.h>
+
+inline void sha1(const uint8_t *data, uint32_t size, uint8_t hash[20]) {
+    uint32_t h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+    uint64_t bits = (uint64_t) size * 8;
+    // message, 0x80, zeros, 64 bit length: whole 64 byte blocks
+    uint32_t total = ((size + 8) / 64 + 1) * 64;
+
+    for (uint32_t block = 0; block < total; block += 64) {
+        uint8_t chunk[64];
+        for (uint32_t i = 0; i < 64; i++) {
+            uint32_t pos = block + i;
+            if (pos < size) chunk[i] = data[pos];
+            else if (pos == size) chunk[i] = 0x80;
+            else if (pos >= total - 8) chunk[i] = (uint8_t) (bits >> ((total - 1 - pos) * 8));
+            else chunk[i] = 0;
+        }
+
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t) chunk[i * 4] << 24 | (uint32_t) chunk[i * 4 + 1] << 16 | (uint32_t) chunk[i * 4 + 2] << 8 | chunk[i * 4 + 3];
+        }
+        for (int i = 16; i < 80; i++) {
+            uint32_t x = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+            w[i] = x << 1 | x >> 31;
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) { f = (b & c) | (~b & d); k = 0x5a827999; }
+            else if (i < 40) { f = b ^ c ^ d; k = 0x6ed9eba1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdc; }
+            else { f = b ^ c ^ d; k = 0xca62c1d6; }
+            uint32_t t = (a << 5 | a >> 27) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = b << 30 | b >> 2;
+            b = a;
+            a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+
+    for (int i = 0; i < 20; i++) {
+        hash[i] = (uint8_t) (h[i / 4] >> (24 - (i % 4) * 8));
+    }
+}
+
+#endif
@@ -0,0 +1,44 @@
+/*
+  IPAddress.h - Native (host) shim of the Arduino IPAddress class
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef NATIVE_IPADDRESS_H
+#define NATIVE_IPADDRESS_H
+
+#include <Arduino.h>
+
+class IPAddress : public Printable {
+    public:
+        IPAddress() : address(0) {}
+        IPAddress(uint32_t address) : address(address) {}
+        IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : address(a | (b << 8) | (c << 16) | ((uint32_t) d << 24)) {}
+
+        operator uint32_t() const { return address; }
+        bool isSet() const { return address != 0; }
+
+        bool fromString(const char *str) {
+            unsigned int a, b, c, d;
+            if (sscanf(str, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+                return false;
+            }
+            address = a | (b << 8) | (c << 16) | (d << 24);
+            return true;
+        }
+        bool fromString(const String &str) { return fromString(str.c_str()); }
+
+        String toString() const {
+            char buf[16];
+            snprintf(buf, sizeof(buf), "%u.%u.%u.%u", address & 0xff, (address >> 8) & 0xff, (address >> 16) & 0xff, address >> 24);
+            return String(buf);
+        }
+
+        virtual size_t printTo(Print &p) const { return p.print(toString()); }
+
+    private:
+        uint32_t address;
+};
+
+#endif
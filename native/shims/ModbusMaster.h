@@ -0,0 +1,237 @@
+/*
+  ModbusMaster.h - Native (host) shim of the ModbusMaster library
+  Same API and result codes as ModbusMaster 2.0.1 but, by default, requests are
+  served from an in-process register image (ModbusBus) instead of RTU frames on
+  the Stream, so the drivers can be tested against known inverter registers
+
+  ModbusBus.slave(addr) creates a slave, unknown slaves time out and failNext()
+  makes the next requests fail with a given exception or error code
+
+  With ModbusBus.rtu set, requests are real RTU frames on the Stream like the
+  library does, to talk to a simulated slave (see native/sim/GrowattSlaveSim.h)
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef NATIVE_MODBUSMASTER_H
+#define NATIVE_MODBUSMASTER_H
+
+#include <Arduino.h>
+#include <map>
+
+// CRC-16/MODBUS, same as util/crc16.h in ModbusMaster
+inline uint16_t modbusCRC16(const uint8_t *data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = crc & 1 ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+class NativeModbusSlave {
+    public:
+        std::map<uint16_t, uint16_t> inputRegisters;
+        std::map<uint16_t, uint16_t> holdingRegisters;
+        // an input read past it answers an illegal data address, like a model without the battery registers
+        uint16_t lastInputRegister = 0xffff;
+
+        uint16_t input(uint16_t addr) const { auto it = inputRegisters.find(addr); return it == inputRegisters.end() ? 0 : it->second; }
+        uint16_t holding(uint16_t addr) const { auto it = holdingRegisters.find(addr); return it == holdingRegisters.end() ? 0 : it->second; }
+
+        // sets a 32 bit value on two consecutive registers, high word first
+        void setInput32(uint16_t addr, uint32_t value) { inputRegisters[addr] = value >> 16; inputRegisters[addr + 1] = value & 0xffff; }
+};
+
+class NativeModbusBus {
+    public:
+        std::map<uint8_t, NativeModbusSlave> slaves;
+        bool rtu = false;
+        uint16_t responseTimeoutMs = 2000;
+        uint8_t failCode = 0;
+        uint32_t failCount = 0;
+        uint32_t requests = 0;
+        uint32_t registersRead = 0;
+        uint32_t registersWritten = 0;
+
+        NativeModbusSlave &slave(uint8_t addr) { return slaves[addr]; }
+
+        // the next count requests return code instead of being served
+        void failNext(uint8_t code, uint32_t count = 1) { failCode = code; failCount = count; }
+
+        void reset() {
+            slaves.clear();
+            rtu = false;
+            responseTimeoutMs = 2000;
+            failCode = 0;
+            failCount = 0;
+            requests = 0;
+            registersRead = 0;
+            registersWritten = 0;
+        }
+};
+
+inline NativeModbusBus ModbusBus;
+
+class ModbusMaster {
+    public:
+        static const uint8_t ku8MBIllegalFunction = 0x01;
+        static const uint8_t ku8MBIllegalDataAddress = 0x02;
+        static const uint8_t ku8MBIllegalDataValue = 0x03;
+        static const uint8_t ku8MBSlaveDeviceFailure = 0x04;
+        static const uint8_t ku8MBSuccess = 0x00;
+        static const uint8_t ku8MBInvalidSlaveID = 0xE0;
+        static const uint8_t ku8MBInvalidFunction = 0xE1;
+        static const uint8_t ku8MBResponseTimedOut = 0xE2;
+        static const uint8_t ku8MBInvalidCRC = 0xE3;
+
+        ModbusMaster() : slaveAddr(0), serial(NULL) { clearResponseBuffer(); clearTransmitBuffer(); }
+
+        void begin(uint8_t slave, Stream &serial) { this->slaveAddr = slave; this->serial = &serial; }
+        void preTransmission(void (*)()) {}
+        void postTransmission(void (*)()) {}
+        void idle(void (*)()) {}
+
+        uint16_t getResponseBuffer(uint8_t index) { return index < ku8MaxBufferSize ? responseBuffer[index] : 0xFFFF; }
+        void clearResponseBuffer() { memset(responseBuffer, 0, sizeof(responseBuffer)); }
+        uint8_t setTransmitBuffer(uint8_t index, uint16_t value) {
+            if (index >= ku8MaxBufferSize) return ku8MBIllegalDataAddress;
+            transmitBuffer[index] = value;
+            return ku8MBSuccess;
+        }
+        void clearTransmitBuffer() { memset(transmitBuffer, 0, sizeof(transmitBuffer)); }
+
+        uint8_t readInputRegisters(uint16_t readAddress, uint16_t readQty) { return transaction(ku8MBReadInputRegisters, readAddress, readQty); }
+        uint8_t readHoldingRegisters(uint16_t readAddress, uint16_t readQty) { return transaction(ku8MBReadHoldingRegisters, readAddress, readQty); }
+        uint8_t writeSingleRegister(uint16_t writeAddress, uint16_t writeValue) {
+            transmitBuffer[0] = writeValue;
+            return transaction(ku8MBWriteSingleRegister, writeAddress, 1);
+        }
+        uint8_t writeMultipleRegisters(uint16_t writeAddress, uint16_t writeQty) { return transaction(ku8MBWriteMultipleRegisters, writeAddress, writeQty); }
+
+    private:
+        static const uint8_t ku8MaxBufferSize = 64;
+        static const uint8_t ku8MBReadHoldingRegisters = 0x03;
+        static const uint8_t ku8MBReadInputRegisters = 0x04;
+        static const uint8_t ku8MBWriteSingleRegister = 0x06;
+        static const uint8_t ku8MBWriteMultipleRegisters = 0x10;
+
+        uint8_t slaveAddr;
+        Stream *serial;
+        uint16_t responseBuffer[ku8MaxBufferSize];
+        uint16_t transmitBuffer[ku8MaxBufferSize];
+
+        static bool isRead(uint8_t function) { return function == ku8MBReadHoldingRegisters || function == ku8MBReadInputRegisters; }
+
+        uint8_t transaction(uint8_t function, uint16_t address, uint16_t qty) {
+            ModbusBus.requests++;
+
+            if (ModbusBus.failCount > 0) {
+                ModbusBus.failCount--;
+                return ModbusBus.failCode;
+            }
+            if (qty == 0 || qty > ku8MaxBufferSize) {
+                return ku8MBIllegalDataValue;
+            }
+            if (ModbusBus.rtu) {
+                return rtuTransaction(function, address, qty);
+            }
+
+            auto it = ModbusBus.slaves.find(slaveAddr);
+            if (it == ModbusBus.slaves.end()) {
+                return ku8MBResponseTimedOut;
+            }
+            NativeModbusSlave &slave = it->second;
+
+            if (function == ku8MBReadInputRegisters && (uint32_t) address + qty - 1 > slave.lastInputRegister) {
+                return ku8MBIllegalDataAddress;
+            }
+            if (isRead(function)) {
+                for (uint16_t i = 0; i < qty; i++) {
+                    responseBuffer[i] = function == ku8MBReadHoldingRegisters ? slave.holding(address + i) : slave.input(address + i);
+                }
+                ModbusBus.registersRead += qty;
+            } else {
+                for (uint16_t i = 0; i < qty; i++) {
+                    slave.holdingRegisters[address + i] = transmitBuffer[i];
+                }
+                ModbusBus.registersWritten += qty;
+            }
+
+            return ku8MBSuccess;
+        }
+
+        uint8_t rtuTransaction(uint8_t function, uint16_t address, uint16_t qty) {
+            uint8_t frame[256];
+            uint8_t len = 0;
+
+            frame[len++] = slaveAddr;
+            frame[len++] = function;
+            frame[len++] = highByte(address);
+            frame[len++] = lowByte(address);
+            if (function == ku8MBWriteSingleRegister) {
+                frame[len++] = highByte(transmitBuffer[0]);
+                frame[len++] = lowByte(transmitBuffer[0]);
+            } else {
+                frame[len++] = highByte(qty);
+                frame[len++] = lowByte(qty);
+            }
+            if (function == ku8MBWriteMultipleRegisters) {
+                frame[len++] = qty * 2;
+                for (uint16_t i = 0; i < qty; i++) {
+                    frame[len++] = highByte(transmitBuffer[i]);
+                    frame[len++] = lowByte(transmitBuffer[i]);
+                }
+            }
+            uint16_t crc = modbusCRC16(frame, len);
+            frame[len++] = lowByte(crc);
+            frame[len++] = highByte(crc);
+
+            // flush the receive buffer and send
+            while (serial->read() != -1);
+            serial->write(frame, len);
+            serial->flush();
+
+            // slave, function, then the byte count and data or the echoed address and value, and the CRC
+            // a byte count of 255 from a broken slave is 260 bytes
+            uint8_t response[5 + 255];
+            uint16_t expected = 5;
+            uint16_t got = 0;
+            unsigned long start = millis();
+            while (got < expected) {
+                int c = serial->read();
+                if (c < 0) {
+                    if (millis() - start > ModbusBus.responseTimeoutMs) return ku8MBResponseTimedOut;
+                    continue;
+                }
+                response[got++] = c;
+
+                if (got == 2 && (response[1] & 0x80) == 0) {
+                    expected = isRead(function) ? 5 : 8;
+                } else if (got == 3 && (response[1] & 0x80) == 0 && isRead(function)) {
+                    expected = 5 + response[2];
+                }
+            }
+
+            if (response[0] != slaveAddr) return ku8MBInvalidSlaveID;
+            if ((response[1] & 0x7F) != function) return ku8MBInvalidFunction;
+            if (modbusCRC16(response, got - 2) != (response[got - 2] | (response[got - 1] << 8))) return ku8MBInvalidCRC;
+            if (response[1] & 0x80) return response[2];
+
+            if (isRead(function)) {
+                for (uint16_t i = 0; i < qty && i < response[2] / 2; i++) {
+                    responseBuffer[i] = (response[3 + 2 * i] << 8) | response[4 + 2 * i];
+                }
+                ModbusBus.registersRead += qty;
+            } else {
+                ModbusBus.registersWritten += qty;
+            }
+
+            return ku8MBSuccess;
+        }
+};
+
+#endif
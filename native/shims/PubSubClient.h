@@ -0,0 +1,159 @@
+/*
+  PubSubClient.h - Native (host) shim of the PubSubClient MQTT library
+  The client talks to an in-process fake broker (MqttBroker) that records what
+  is published and subscribed, can be taken down to test reconnections and can
+  deliver messages to the callback as if they came from the network
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef NATIVE_PUBSUBCLIENT_H
+#define NATIVE_PUBSUBCLIENT_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <algorithm>
+
+#define MQTT_CONNECTION_TIMEOUT     -4
+#define MQTT_CONNECTION_LOST        -3
+#define MQTT_CONNECT_FAILED         -2
+#define MQTT_DISCONNECTED           -1
+#define MQTT_CONNECTED               0
+#define MQTT_CONNECT_BAD_PROTOCOL    1
+#define MQTT_CONNECT_BAD_CLIENT_ID   2
+#define MQTT_CONNECT_UNAVAILABLE     3
+#define MQTT_CONNECT_BAD_CREDENTIALS 4
+#define MQTT_CONNECT_UNAUTHORIZED    5
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+struct NativeMqttMessage {
+    String topic;
+    String payload;
+    bool retained;
+};
+
+class NativeMqttBroker {
+    public:
+        NativeMqttBroker() {
+            // TCP connects to the broker go through while it is available
+            Network.reachable = [this](uint16_t) { return available; };
+        }
+
+        bool available = true;
+        uint32_t connections = 0;
+        std::vector<NativeMqttMessage> published;
+        std::vector<String> subscriptions;
+        MQTT_CALLBACK_SIGNATURE;
+
+        void reset() {
+            available = true;
+            connections = 0;
+            published.clear();
+            subscriptions.clear();
+            callback = nullptr;
+        }
+
+        // last payload published on the topic, NULL if never published
+        const String *lastPayload(const String &topic) const {
+            for (auto it = published.rbegin(); it != published.rend(); ++it) {
+                if (it->topic == topic) return &it->payload;
+            }
+            return NULL;
+        }
+
+        // sends a message to the client, if it is subscribed to the topic
+        bool deliver(const char *topic, const char *payload) {
+            if (!callback || std::find(subscriptions.begin(), subscriptions.end(), String(topic)) == subscriptions.end()) {
+                return false;
+            }
+            std::vector<char> t(topic, topic + strlen(topic) + 1);
+            std::vector<uint8_t> p(payload, payload + strlen(payload));
+            callback(t.data(), p.data(), p.size());
+            return true;
+        }
+};
+
+inline NativeMqttBroker MqttBroker;
+
+class PubSubClient {
+    public:
+        PubSubClient() {}
+        PubSubClient(WiFiClient &client) : client(&client) {}
+
+        PubSubClient &setServer(const char *, uint16_t) { return *this; }
+        PubSubClient &setServer(IPAddress, uint16_t) { return *this; }
+        PubSubClient &setClient(WiFiClient &client) { this->client = &client; return *this; }
+        PubSubClient &setCallback(MQTT_CALLBACK_SIGNATURE) { this->callback = callback; return *this; }
+        PubSubClient &setKeepAlive(uint16_t) { return *this; }
+        PubSubClient &setSocketTimeout(uint16_t) { return *this; }
+        bool setBufferSize(uint16_t size) { bufferSize = size; return true; }
+        uint16_t getBufferSize() { return bufferSize; }
+
+        bool connect(const char *id, const char *willTopic, uint8_t willQos, bool willRetain, const char *willMessage) {
+            return connect(id, NULL, NULL, willTopic, willQos, willRetain, willMessage);
+        }
+        // like the library, the TCP connection is only opened when it is not open yet
+        bool connect(const char *, const char *, const char *, const char *, uint8_t, bool, const char *, bool = true) {
+            if (client != NULL && !client->connected() && !client->connect("broker", 1883)) {
+                currentState = MQTT_CONNECT_FAILED;
+                return false;
+            }
+            if (!MqttBroker.available) {
+                currentState = MQTT_CONNECTION_TIMEOUT;
+                return false;
+            }
+            MqttBroker.connections++;
+            MqttBroker.subscriptions.clear();
+            MqttBroker.callback = callback;
+            currentState = MQTT_CONNECTED;
+            return true;
+        }
+        void disconnect() {
+            currentState = MQTT_DISCONNECTED;
+            if (client != NULL) client->stop();
+        }
+
+        bool connected() {
+            if (currentState == MQTT_CONNECTED && !MqttBroker.available) {
+                currentState = MQTT_CONNECTION_LOST;
+                if (client != NULL) client->stop();
+            }
+            return currentState == MQTT_CONNECTED;
+        }
+        int state() { return currentState; }
+        bool loop() { return connected(); }
+
+        bool publish(const char *topic, const char *payload) { return publish(topic, payload, false); }
+        bool publish(const char *topic, const char *payload, bool retained) {
+            return publish(topic, (const uint8_t *) payload, payload ? strlen(payload) : 0, retained);
+        }
+        bool publish(const char *topic, const uint8_t *payload, unsigned int length, bool retained) {
+            if (!connected() || strlen(topic) + length + 7 > bufferSize) {
+                return false;
+            }
+            MqttBroker.published.push_back({ String(topic), String((const char *) payload, length), retained });
+            return true;
+        }
+
+        bool subscribe(const char *topic) {
+            if (!connected()) return false;
+            MqttBroker.subscriptions.push_back(String(topic));
+            return true;
+        }
+        bool unsubscribe(const char *topic) {
+            if (!connected()) return false;
+            auto &subs = MqttBroker.subscriptions;
+            subs.erase(std::remove(subs.begin(), subs.end(), String(topic)), subs.end());
+            return true;
+        }
+
+    private:
+        WiFiClient *client = NULL;
+        MQTT_CALLBACK_SIGNATURE = nullptr;
+        uint16_t bufferSize = 256;
+        int currentState = MQTT_DISCONNECTED;
+};
+
+#endif
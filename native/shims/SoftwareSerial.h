@@ -0,0 +1,30 @@
+/*
+  SoftwareSerial.h - Native (host) shim of EspSoftwareSerial
+  A port with nothing connected: writes are dropped and nothing is ever received
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef NATIVE_SOFTWARESERIAL_H
+#define NATIVE_SOFTWARESERIAL_H
+
+#include <Arduino.h>
+
+class SoftwareSerial : public Stream {
+    public:
+        SoftwareSerial() {}
+        SoftwareSerial(int8_t, int8_t, bool = false) {}
+
+        void begin(uint32_t) {}
+        void begin(uint32_t, int, int8_t, int8_t, bool = false) {}
+        void enableTx(bool) {}
+
+        virtual int available() { return 0; }
+        virtual int read() { return -1; }
+        virtual int peek() { return -1; }
+        virtual size_t write(uint8_t) { return 1; }
+        using Print::write;
+};
+
+#endif
@@ -0,0 +1,16 @@
+/*
+  StackThunk.h - Native (host) shim of the ESP8266 BearSSL second stack
+  BearSSL runs on the host stack here, nothing is measured
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef NATIVE_STACKTHUNK_H
+#define NATIVE_STACKTHUNK_H
+
+#include <stdint.h>
+
+inline uint32_t stack_thunk_get_max_usage() { return 0; }
+
+#endif
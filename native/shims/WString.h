@@ -0,0 +1,152 @@
+/*
+  WString.h - Native (host) shim of the Arduino String class
+  Only what this project and its libraries use, backed by std::string
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef NATIVE_WSTRING_H
+#define NATIVE_WSTRING_H
+
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// flash strings live in RAM on the host
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+#define FPSTR(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+
+class String {
+    public:
+        String() {}
+        String(const char *cstr) : s(cstr ? cstr : "") {}
+        String(const char *cstr, unsigned int length) : s(cstr, length) {}
+        String(const std::string &str) : s(str) {}
+        String(const __FlashStringHelper *str) : s(reinterpret_cast<const char *>(str)) {}
+        explicit String(char c) : s(1, c) {}
+        explicit String(unsigned char value, unsigned char base = DEC) { setUnsigned(value, base); }
+        explicit String(int value, unsigned char base = DEC) { setSigned(value, base); }
+        explicit String(unsigned int value, unsigned char base = DEC) { setUnsigned(value, base); }
+        explicit String(long value, unsigned char base = DEC) { setSigned(value, base); }
+        explicit String(unsigned long value, unsigned char base = DEC) { setUnsigned(value, base); }
+        explicit String(float value, unsigned char decimalPlaces = 2) { setFloat(value, decimalPlaces); }
+        explicit String(double value, unsigned char decimalPlaces = 2) { setFloat(value, decimalPlaces); }
+
+        const char *c_str() const { return s.c_str(); }
+        unsigned int length() const { return s.size(); }
+        bool isEmpty() const { return s.empty(); }
+        bool reserve(unsigned int size) { s.reserve(size); return true; }
+
+        bool concat(const String &str) { s += str.s; return true; }
+        bool concat(const char *cstr) { if (!cstr) return false; s += cstr; return true; }
+        bool concat(const char *cstr, unsigned int length) { if (!cstr) return false; s.append(cstr, length); return true; }
+        bool concat(char c) { s += c; return true; }
+        bool concat(unsigned char value) { return concat(String(value)); }
+        bool concat(int value) { return concat(String(value)); }
+        bool concat(unsigned int value) { return concat(String(value)); }
+        bool concat(long value) { return concat(String(value)); }
+        bool concat(unsigned long value) { return concat(String(value)); }
+        bool concat(float value) { return concat(String(value)); }
+        bool concat(double value) { return concat(String(value)); }
+        bool concat(const __FlashStringHelper *str) { return concat(reinterpret_cast<const char *>(str)); }
+
+        template <typename T> String &operator+=(const T &value) { concat(value); return *this; }
+
+        bool equals(const String &str) const { return s == str.s; }
+        bool operator==(const String &str) const { return s == str.s; }
+        bool operator==(const char *cstr) const { return s == (cstr ? cstr : ""); }
+        bool operator==(const __FlashStringHelper *str) const { return s == reinterpret_cast<const char *>(str); }
+        bool operator!=(const String &str) const { return s != str.s; }
+        bool operator!=(const char *cstr) const { return !(*this == cstr); }
+        bool operator<(const String &str) const { return s < str.s; }
+        bool equalsIgnoreCase(const String &str) const { return strcasecmp(s.c_str(), str.s.c_str()) == 0; }
+
+        char charAt(unsigned int index) const { return index < s.size() ? s[index] : 0; }
+        void setCharAt(unsigned int index, char c) { if (index < s.size()) s[index] = c; }
+        char operator[](unsigned int index) const { return charAt(index); }
+        char &operator[](unsigned int index) { static char dummy; return index < s.size() ? s[index] : (dummy = 0); }
+
+        int indexOf(char c, unsigned int from = 0) const { return pos(s.find(c, from)); }
+        int indexOf(const String &str, unsigned int from = 0) const { return pos(s.find(str.s, from)); }
+        int lastIndexOf(char c) const { return pos(s.rfind(c)); }
+        int lastIndexOf(const String &str) const { return pos(s.rfind(str.s)); }
+        bool startsWith(const String &prefix) const { return s.compare(0, prefix.s.size(), prefix.s) == 0; }
+        bool endsWith(const String &suffix) const { return s.size() >= suffix.s.size() && s.compare(s.size() - suffix.s.size(), suffix.s.size(), suffix.s) == 0; }
+
+        String substring(unsigned int from) const { return from >= s.size() ? String() : String(s.substr(from)); }
+        String substring(unsigned int from, unsigned int to) const {
+            if (from > to) std::swap(from, to);
+            if (from >= s.size()) return String();
+            return String(s.substr(from, std::min<size_t>(to, s.size()) - from));
+        }
+
+        void replace(const String &find, const String &replacement) {
+            if (find.s.empty()) return;
+            size_t at = 0;
+            while ((at = s.find(find.s, at)) != std::string::npos) {
+                s.replace(at, find.s.size(), replacement.s);
+                at += replacement.s.size();
+            }
+        }
+        void replace(char find, char replacement) { std::replace(s.begin(), s.end(), find, replacement); }
+        void remove(unsigned int index) { if (index < s.size()) s.erase(index); }
+        void remove(unsigned int index, unsigned int count) { if (index < s.size()) s.erase(index, count); }
+        void toLowerCase() { for (auto &c : s) c = tolower(c); }
+        void toUpperCase() { for (auto &c : s) c = toupper(c); }
+        void trim() {
+            size_t first = s.find_first_not_of(" \t\r\n\f\v");
+            size_t last = s.find_last_not_of(" \t\r\n\f\v");
+            s = first == std::string::npos ? std::string() : s.substr(first, last - first + 1);
+        }
+
+        long toInt() const { return atol(s.c_str()); }
+        float toFloat() const { return atof(s.c_str()); }
+        double toDouble() const { return atof(s.c_str()); }
+
+    private:
+        std::string s;
+
+        static int pos(size_t p) { return p == std::string::npos ? -1 : (int) p; }
+
+        void setUnsigned(unsigned long value, unsigned char base) {
+            char buf[8 * sizeof(long) + 1];
+            char *p = &buf[sizeof(buf) - 1];
+            *p = '\0';
+            do {
+                unsigned long digit = value % base;
+                *--p = digit < 10 ? '0' + digit : 'a' + digit - 10;
+                value /= base;
+            } while (value);
+            s = p;
+        }
+
+        void setSigned(long value, unsigned char base) {
+            if (base == DEC && value < 0) {
+                setUnsigned(-(unsigned long) value, base);
+                s.insert(s.begin(), '-');
+            } else {
+                setUnsigned(base == DEC ? value : (unsigned long) (unsigned int) value, base);
+            }
+        }
+
+        void setFloat(double value, unsigned char decimalPlaces) {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, value);
+            s = buf;
+        }
+};
+
+template <typename T> inline String operator+(const String &lhs, const T &rhs) { String r(lhs); r.concat(rhs); return r; }
+inline String operator+(const char *lhs, const String &rhs) { String r(lhs); r.concat(rhs); return r; }
+
+#endif
@@ -0,0 +1,113 @@
+/*
+  WiFiClientSecure.h - Native (host) shim of the ESP8266 BearSSL client
+  Handshakes with TlsServer: the fingerprint must match its certificate, a
+  full handshake costs fullHandshakeMillis of the virtual clock and a resumed
+  one resumedHandshakeMillis. Forgetting the sessions (broker restart) makes
+  the next handshake a full one again
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef NATIVE_WIFICLIENTSECURE_H
+#define NATIVE_WIFICLIENTSECURE_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+class NativeTlsServer {
+    public:
+        uint8_t fingerprint[20];
+        bool maxFragmentLength = true;
+        uint32_t fullHandshakeMillis = 1800;
+        uint32_t resumedHandshakeMillis = 120;
+        uint32_t sessionEpoch = 1;
+
+        uint32_t handshakes = 0;
+        uint32_t resumed = 0;
+        uint32_t probes = 0;
+        int rxBufferSize = 0;
+
+        NativeTlsServer() { reset(); }
+
+        void reset() {
+            for (uint8_t i = 0; i < sizeof(fingerprint); i++) fingerprint[i] = 0xa0 + i;
+            maxFragmentLength = true;
+            fullHandshakeMillis = 1800;
+            resumedHandshakeMillis = 120;
+            sessionEpoch++;
+            handshakes = 0;
+            resumed = 0;
+            probes = 0;
+            rxBufferSize = 0;
+        }
+
+        void forgetSessions() { sessionEpoch++; }
+};
+
+inline NativeTlsServer TlsServer;
+
+namespace BearSSL {
+
+class Session {
+    public:
+        uint32_t epoch = 0;
+};
+
+class WiFiClientSecure : public WiFiClient {
+    public:
+        // "a0:a1:..." or "a0a1...", like the core
+        bool setFingerprint(const char *fpStr) {
+            uint8_t n = 0;
+            const char *p = fpStr;
+            while (*p && n < sizeof(fp)) {
+                while (*p == ':' || *p == ' ') p++;
+                if (!isxdigit(p[0]) || !isxdigit(p[1])) return false;
+                char hex[3] = { p[0], p[1], '\0' };
+                fp[n++] = strtoul(hex, NULL, 16);
+                p += 2;
+            }
+            return n == sizeof(fp) && *p == '\0';
+        }
+        void setSession(Session *session) { this->session = session; }
+        void setBufferSizes(int recv, int) { rxBufferSize = recv; }
+
+        static bool probeMaxFragmentLength(IPAddress, uint16_t port, uint16_t) {
+            TlsServer.probes++;
+            Network.tcpConnects++;
+            return Network.reachable(port) && TlsServer.maxFragmentLength;
+        }
+
+        virtual int connect(IPAddress address, uint16_t port) {
+            if (!WiFiClient::connect(address, port)) {
+                return 0;
+            }
+            if (memcmp(fp, TlsServer.fingerprint, sizeof(fp)) != 0) {
+                stop();
+                return 0;
+            }
+
+            TlsServer.handshakes++;
+            TlsServer.rxBufferSize = rxBufferSize;
+            if (session != NULL && session->epoch == TlsServer.sessionEpoch) {
+                TlsServer.resumed++;
+                delay(TlsServer.resumedHandshakeMillis);
+            } else {
+                delay(TlsServer.fullHandshakeMillis);
+            }
+            if (session != NULL) {
+                session->epoch = TlsServer.sessionEpoch;
+            }
+            return 1;
+        }
+        using WiFiClient::connect;
+
+    private:
+        uint8_t fp[20] = {};
+        Session *session = NULL;
+        int rxBufferSize = 16384;
+};
+
+}
+
+#endif
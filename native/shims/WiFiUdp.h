@@ -0,0 +1,69 @@
+/*
+  WiFiUdp.h - Native (host) shim of the ESP8266 WiFiUDP class, sending only
+  Unlike the TCP clients these are real datagrams on a host socket, so a test
+  can read them back from a UDP socket it binds on 127.0.0.1
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef NATIVE_WIFIUDP_H
+#define NATIVE_WIFIUDP_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <ESP8266WiFi.h>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+class WiFiUDP : public Print {
+    public:
+        ~WiFiUDP() { stop(); }
+
+        int beginPacket(IPAddress ip, uint16_t port) {
+            if (fd < 0) {
+                fd = socket(AF_INET, SOCK_DGRAM, 0);
+                if (fd < 0) return 0;
+            }
+            to = {};
+            to.sin_family = AF_INET;
+            to.sin_port = htons(port);
+            // IPAddress keeps the bytes in network order
+            to.sin_addr.s_addr = (uint32_t) ip;
+            packet.clear();
+            return 1;
+        }
+
+        int beginPacket(const char *host, uint16_t port) {
+            IPAddress ip;
+            if (WiFi.hostByName(host, ip) != 1) return 0;
+            return beginPacket(ip, port);
+        }
+
+        virtual size_t write(uint8_t c) { return write(&c, 1); }
+        virtual size_t write(const uint8_t *buf, size_t size) {
+            packet.insert(packet.end(), buf, buf + size);
+            return size;
+        }
+        using Print::write;
+
+        int endPacket() {
+            if (fd < 0) return 0;
+            ssize_t n = sendto(fd, packet.data(), packet.size(), 0, (const struct sockaddr *) &to, sizeof(to));
+            return n == (ssize_t) packet.size() ? 1 : 0;
+        }
+
+        void stop() {
+            if (fd >= 0) close(fd);
+            fd = -1;
+        }
+
+    private:
+        int fd = -1;
+        struct sockaddr_in to = {};
+        std::vector<uint8_t> packet;
+};
+
+#endif
@@ -0,0 +1,36 @@
+/*
+  coredecls.h - Native (host) shim of the ESP8266 core declarations
+  crc32(), the same CRC-32 (poly 0x04c11db7, msb first, no final xor) as the core,
+  and settimeofday_cb(), there is no SNTP here so the callback never runs
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef NATIVE_COREDECLS_H
+#define NATIVE_COREDECLS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+inline uint32_t crc32(const void *data, size_t length, uint32_t crc = 0xffffffff) {
+    const uint8_t *p = (const uint8_t *) data;
+    while (length--) {
+        uint8_t c = *p++;
+        for (uint32_t i = 0x80; i > 0; i >>= 1) {
+            bool bit = crc & 0x80000000;
+            if (c & i) {
+                bit = !bit;
+            }
+            crc <<= 1;
+            if (bit) {
+                crc ^= 0x04c11db7;
+            }
+        }
+    }
+    return crc;
+}
+
+inline void settimeofday_cb(void (*cb)(void)) {}
+
+#endif
@@ -0,0 +1,22 @@
+/*
+  uptime_formatter.h - Native (host) shim of the Uptime Library formatter
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef NATIVE_UPTIME_FORMATTER_H
+#define NATIVE_UPTIME_FORMATTER_H
+
+#include <Arduino.h>
+
+namespace uptime_formatter {
+    inline String getUptime() {
+        unsigned long secs = millis() / 1000;
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%lu days, %lu hours, %lu minutes, %lu seconds", secs / 86400, (secs / 3600) % 24, (secs / 60) % 60, secs % 60);
+        return String(buf);
+    }
+}
+
+#endif
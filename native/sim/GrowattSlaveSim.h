@@ -0,0 +1,325 @@
+/*
+  GrowattSlaveSim.h - Simulated Growatt inverters on a Modbus RTU bus (host only)
+  Serves input and holding register images over a pseudo-terminal with the
+  timing of a real serial line, for end-to-end tests and throughput benchmarks
+  of the Growatt drivers with ModbusBus.rtu set
+
+  - slave(addr) adds an inverter seeded with plausible SPH input registers
+  - loadHoldingDump() loads holding registers from a docs/read-hold-*-a<addr>-l<len>.txt dump
+  - failNext() and setFaultRates() inject timeouts, CRC errors and exceptions
+  - every response waits for the wire time of request + response at the bus baud rate
+
+  Configure the register images and faults before start() or while the bus is idle.
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef GROWATT_SLAVE_SIM_H
+#define GROWATT_SLAVE_SIM_H
+
+#include <Arduino.h>
+#include <ModbusMaster.h>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <regex>
+#include <thread>
+#include "PtyStream.h"
+#include "SimFaults.h"
+
+struct GrowattSlaveSimStats {
+    uint32_t requests = 0;
+    uint32_t responses = 0;
+    uint32_t timeouts = 0;
+    uint32_t crcErrors = 0;
+    uint32_t exceptions = 0;
+    uint64_t wireBytes = 0;
+    uint64_t wireMicros = 0;
+};
+
+class GrowattSlaveSim {
+    public:
+        GrowattSlaveSim(uint32_t baud = 9600) : baud(baud), running(false), stream(NULL),
+            nextFault(SIM_FAULT_NONE), nextFaultCount(0), exceptionCode(ModbusMaster::ku8MBSlaveDeviceFailure),
+            timeoutRate(0), crcRate(0), exceptionRate(0), extraDelayMicros(0) {}
+
+        ~GrowattSlaveSim() {
+            stop();
+            delete stream;
+        }
+
+        // adds (or returns) the inverter at addr, new ones get the default SPH input registers
+        NativeModbusSlave &slave(uint8_t addr) {
+            std::lock_guard<std::mutex> lock(mutex);
+            bool isNew = slaves.find(addr) == slaves.end();
+            NativeModbusSlave &s = slaves[addr];
+            if (isNew) {
+                seedSph(s);
+            }
+            return s;
+        }
+
+        // the dump file name gives the start address and length: read-hold-01-a1070-l49-bat-first.txt
+        bool loadHoldingDump(uint8_t addr, const char *path) {
+            std::cmatch m;
+            if (!std::regex_search(path, m, std::regex("-a([0-9]+)-l([0-9]+)"))) {
+                return false;
+            }
+            uint16_t start = atoi(m[1].str().c_str());
+            size_t length = atoi(m[2].str().c_str());
+
+            std::ifstream file(path);
+            std::string line;
+            while (std::getline(file, line)) {
+                // the full dump is the line with exactly length hex values
+                std::vector<uint16_t> values;
+                size_t at = 0;
+                bool ok = !line.empty();
+                while (ok && at <= line.size()) {
+                    size_t end = line.find(':', at);
+                    std::string token = line.substr(at, end == std::string::npos ? std::string::npos : end - at);
+                    ok = !token.empty() && token.size() <= 4 && token.find_first_not_of("0123456789abcdefABCDEF") == std::string::npos;
+                    if (ok) values.push_back(strtoul(token.c_str(), NULL, 16));
+                    if (end == std::string::npos) break;
+                    at = end + 1;
+                }
+
+                if (ok && values.size() == length) {
+                    NativeModbusSlave &s = slave(addr);
+                    std::lock_guard<std::mutex> lock(mutex);
+                    for (size_t i = 0; i < length; i++) {
+                        s.holdingRegisters[start + i] = values[i];
+                    }
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // the next count requests get the fault instead of a normal response
+        void failNext(uint8_t fault, uint32_t count = 1, uint8_t exceptionCode = ModbusMaster::ku8MBSlaveDeviceFailure) {
+            std::lock_guard<std::mutex> lock(mutex);
+            this->nextFault = fault;
+            this->nextFaultCount = count;
+            this->exceptionCode = exceptionCode;
+        }
+
+        // random faults, probabilities from 0.0 to 1.0 per request
+        void setFaultRates(float timeout, float crc, float exception, uint32_t seed = 1) {
+            std::lock_guard<std::mutex> lock(mutex);
+            timeoutRate = timeout;
+            crcRate = crc;
+            exceptionRate = exception;
+            rng.seed(seed);
+        }
+
+        // slave turnaround on top of the wire time
+        void setExtraDelay(uint32_t micros) { extraDelayMicros = micros; }
+
+        bool start() {
+            if (!pty.isOpen()) {
+                return false;
+            }
+            if (stream == NULL) {
+                stream = new PtyStream(pty.slaveFd);
+            }
+            running = true;
+            worker = std::thread(&GrowattSlaveSim::run, this);
+            return true;
+        }
+
+        void stop() {
+            if (running) {
+                running = false;
+                worker.join();
+            }
+        }
+
+        // the driver side of the bus
+        Stream &getStream() { return *stream; }
+        // the pty path, for tools outside the test program
+        const String &getPortName() const { return pty.slaveName; }
+        uint32_t getBaud() const { return baud; }
+
+        GrowattSlaveSimStats getStats() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return stats;
+        }
+
+        void resetStats() {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats = GrowattSlaveSimStats();
+        }
+
+        static void seedSph(NativeModbusSlave &s) {
+            s.inputRegisters[0] = 1;            // status: normal
+            s.inputRegisters[3] = 3512;         // Vpv1 351.2V
+            s.inputRegisters[4] = 42;           // Ipv1 4.2A
+            s.setInput32(5, 14755);             // Ppv1 1475.5W
+            s.inputRegisters[7] = 3380;         // Vpv2
+            s.inputRegisters[8] = 35;           // Ipv2
+            s.setInput32(9, 11830);             // Ppv2
+            s.setInput32(35, 25120);            // Pac 2512.0W
+            s.inputRegisters[37] = 5001;        // Fac 50.01Hz
+            s.inputRegisters[38] = 2301;        // Vac1
+            s.inputRegisters[39] = 109;         // Iac1
+            s.setInput32(40, 25120);            // Pac1
+            s.setInput32(53, 187);              // Etoday 18.7kWh
+            s.setInput32(55, 123456);           // Etotal
+            s.setInput32(57, 98765);            // Ttotal
+            s.inputRegisters[93] = 412;         // inverter temperature
+            s.inputRegisters[94] = 398;         // IPM temperature
+            s.inputRegisters[95] = 377;         // boost temperature
+            s.inputRegisters[118] = 1;          // priority: battery first
+            s.inputRegisters[119] = 1;          // lithium battery
+            s.setInput32(1009, 0);              // Pdischarge
+            s.setInput32(1011, 8000);           // Pcharge 800.0W
+            s.inputRegisters[1013] = 524;       // Vbat 52.4V
+            s.inputRegisters[1014] = 87;        // SOC 87%
+            s.inputRegisters[1067] = 5000;      // EPS Fac
+            s.inputRegisters[1068] = 2300;      // EPS Vac1
+        }
+
+    private:
+        uint32_t baud;
+        PtyPair pty;
+        std::atomic<bool> running;
+        std::thread worker;
+        std::mutex mutex;
+        PtyStream *stream;
+
+        std::map<uint8_t, NativeModbusSlave> slaves;
+        uint8_t nextFault;
+        uint32_t nextFaultCount;
+        uint8_t exceptionCode;
+        float timeoutRate;
+        float crcRate;
+        float exceptionRate;
+        std::mt19937 rng;
+        std::atomic<uint32_t> extraDelayMicros;
+        GrowattSlaveSimStats stats;
+
+        void run() {
+            std::vector<uint8_t> rx;
+
+            while (running) {
+                struct pollfd pfd = { pty.masterFd, POLLIN, 0 };
+                if (poll(&pfd, 1, 20) <= 0) {
+                    // inter-frame silence, drop partial frames
+                    rx.clear();
+                    continue;
+                }
+
+                uint8_t buf[256];
+                ssize_t n = ::read(pty.masterFd, buf, sizeof(buf));
+                if (n <= 0) continue;
+                rx.insert(rx.end(), buf, buf + n);
+
+                size_t frameLen = requestLength(rx);
+                if (frameLen == 0 || rx.size() < frameLen) {
+                    continue;
+                }
+
+                std::vector<uint8_t> request(rx.begin(), rx.begin() + frameLen);
+                rx.erase(rx.begin(), rx.begin() + frameLen);
+                if (modbusCRC16(request.data(), frameLen - 2) != (request[frameLen - 2] | (request[frameLen - 1] << 8))) {
+                    // corrupted requests are ignored by the slaves
+                    continue;
+                }
+
+                std::vector<uint8_t> response;
+                uint8_t fault = handle(request, response);
+
+                uint64_t wireMicros = (uint64_t) (request.size() + response.size()) * SIM_BITS_PER_BYTE * 1000000 / baud;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stats.wireBytes += request.size() + response.size();
+                    stats.wireMicros += wireMicros;
+                    if (fault == SIM_FAULT_TIMEOUT) stats.timeouts++;
+                    if (fault == SIM_FAULT_CRC) stats.crcErrors++;
+                    if (fault == SIM_FAULT_EXCEPTION) stats.exceptions++;
+                    if (!response.empty()) stats.responses++;
+                }
+
+                std::this_thread::sleep_for(std::chrono::microseconds(wireMicros + extraDelayMicros));
+                if (!response.empty() && ::write(pty.masterFd, response.data(), response.size()) < 0) {
+                    break;
+                }
+            }
+        }
+
+        // length of the request at the start of rx, 0 while unknown
+        static size_t requestLength(const std::vector<uint8_t> &rx) {
+            if (rx.size() < 2) return 0;
+            if (rx[1] == 0x10) return rx.size() < 7 ? 0 : 9 + rx[6];
+            return 8;
+        }
+
+        uint8_t pickFault() {
+            if (nextFaultCount > 0) {
+                nextFaultCount--;
+                return nextFault;
+            }
+            float r = std::uniform_real_distribution<float>(0, 1)(rng);
+            if (r < timeoutRate) return SIM_FAULT_TIMEOUT;
+            if (r < timeoutRate + crcRate) return SIM_FAULT_CRC;
+            if (r < timeoutRate + crcRate + exceptionRate) return SIM_FAULT_EXCEPTION;
+            return SIM_FAULT_NONE;
+        }
+
+        // builds the response, returns the fault injected if any
+        uint8_t handle(const std::vector<uint8_t> &req, std::vector<uint8_t> &resp) {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            auto it = slaves.find(req[0]);
+            if (it == slaves.end()) {
+                // nobody at this address
+                return SIM_FAULT_NONE;
+            }
+            NativeModbusSlave &s = it->second;
+            stats.requests++;
+
+            uint8_t fault = pickFault();
+            if (fault == SIM_FAULT_TIMEOUT) {
+                return fault;
+            }
+
+            uint8_t function = req[1];
+            uint16_t addr = (req[2] << 8) | req[3];
+            uint16_t value = (req[4] << 8) | req[5];
+
+            resp.push_back(req[0]);
+            if (fault == SIM_FAULT_EXCEPTION || (function != 0x03 && function != 0x04 && function != 0x06 && function != 0x10) ||
+                ((function == 0x03 || function == 0x04) && (value == 0 || value > 125))) {
+                resp.push_back(function | 0x80);
+                resp.push_back(fault == SIM_FAULT_EXCEPTION ? exceptionCode : (uint8_t) ModbusMaster::ku8MBIllegalFunction);
+                if (fault != SIM_FAULT_EXCEPTION) fault = SIM_FAULT_EXCEPTION;
+            } else if (function == 0x03 || function == 0x04) {
+                resp.push_back(function);
+                resp.push_back(value * 2);
+                for (uint16_t i = 0; i < value; i++) {
+                    uint16_t reg = function == 0x03 ? s.holding(addr + i) : s.input(addr + i);
+                    resp.push_back(reg >> 8);
+                    resp.push_back(reg & 0xff);
+                }
+            } else if (function == 0x06) {
+                s.holdingRegisters[addr] = value;
+                resp.insert(resp.end(), req.begin() + 1, req.begin() + 6);
+            } else {
+                for (uint16_t i = 0; i < value; i++) {
+                    s.holdingRegisters[addr + i] = (req[7 + 2 * i] << 8) | req[8 + 2 * i];
+                }
+                resp.insert(resp.end(), req.begin() + 1, req.begin() + 6);
+            }
+
+            uint16_t crc = modbusCRC16(resp.data(), resp.size());
+            if (fault == SIM_FAULT_CRC) crc ^= 0x5555;
+            resp.push_back(crc & 0xff);
+            resp.push_back(crc >> 8);
+            return fault;
+        }
+};
+
+#endif
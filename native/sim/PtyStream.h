@@ -0,0 +1,109 @@
+/*
+  PtyStream.h - Pseudo-terminal pair for the native simulators
+  PtyPair opens a raw pty: the simulator owns the master fd and the driver under
+  test gets the slave side as a Stream (PtyStream), exactly like a serial port
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef PTY_STREAM_H
+#define PTY_STREAM_H
+
+#include <Arduino.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+class PtyPair {
+    public:
+        int masterFd;
+        int slaveFd;
+        String slaveName;
+
+        PtyPair() : masterFd(-1), slaveFd(-1) {
+            masterFd = posix_openpt(O_RDWR | O_NOCTTY);
+            if (masterFd < 0 || grantpt(masterFd) != 0 || unlockpt(masterFd) != 0) {
+                close();
+                return;
+            }
+            slaveName = ptsname(masterFd);
+            slaveFd = open(slaveName.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+            // raw 8N1 on both sides, no echo, no CR/LF translation
+            struct termios tio;
+            if (slaveFd >= 0 && tcgetattr(slaveFd, &tio) == 0) {
+                cfmakeraw(&tio);
+                tcsetattr(slaveFd, TCSANOW, &tio);
+            }
+            if (tcgetattr(masterFd, &tio) == 0) {
+                cfmakeraw(&tio);
+                tcsetattr(masterFd, TCSANOW, &tio);
+            }
+        }
+
+        ~PtyPair() {
+            close();
+        }
+
+        bool isOpen() const { return masterFd >= 0 && slaveFd >= 0; }
+
+        void close() {
+            if (slaveFd >= 0) ::close(slaveFd);
+            if (masterFd >= 0) ::close(masterFd);
+            slaveFd = masterFd = -1;
+        }
+};
+
+// non blocking Stream over a file descriptor
+class PtyStream : public Stream {
+    public:
+        PtyStream(int fd) : fd(fd), peeked(-1) {}
+
+        virtual int available() {
+            int n = 0;
+            if (ioctl(fd, FIONREAD, &n) != 0) n = 0;
+            return n + (peeked >= 0 ? 1 : 0);
+        }
+
+        virtual int read() {
+            if (peeked >= 0) {
+                int c = peeked;
+                peeked = -1;
+                return c;
+            }
+            uint8_t c;
+            return ::read(fd, &c, 1) == 1 ? c : -1;
+        }
+
+        virtual int peek() {
+            if (peeked < 0) peeked = read();
+            return peeked;
+        }
+
+        virtual size_t write(uint8_t c) { return write(&c, 1); }
+        virtual size_t write(const uint8_t *buffer, size_t size) {
+            size_t done = 0;
+            while (done < size) {
+                ssize_t n = ::write(fd, buffer + done, size - done);
+                if (n > 0) {
+                    done += n;
+                } else {
+                    struct pollfd pfd = { fd, POLLOUT, 0 };
+                    if (poll(&pfd, 1, 100) <= 0) break;
+                }
+            }
+            return done;
+        }
+        using Print::write;
+
+        virtual void flush() { tcdrain(fd); }
+
+    private:
+        int fd;
+        int peeked;
+};
+
+#endif
@@ -0,0 +1,20 @@
+/*
+  SimFaults.h - Faults and line timing shared by the native bus simulators
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef SIM_FAULTS_H
+#define SIM_FAULTS_H
+
+#define SIM_FAULT_NONE      0
+#define SIM_FAULT_TIMEOUT   1
+#define SIM_FAULT_CRC       2
+// Modbus exception response, or NAK on a Voltronic line
+#define SIM_FAULT_EXCEPTION 3
+
+// 8N1
+#define SIM_BITS_PER_BYTE 10
+
+#endif
@@ -0,0 +1,118 @@
+/*
+  SoyosourceStreamGen.h - Generates what a tap on the Soyosource display line sees
+  Display requests followed by the 15 byte 0xA6 (display) or 17 byte 0x5A (MS51)
+  responses, with configurable line noise, truncated frames, bit flips and the
+  silent gaps between polls. Deterministic for a given seed.
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef SOYOSOURCE_STREAM_GEN_H
+#define SOYOSOURCE_STREAM_GEN_H
+
+#include <Arduino.h>
+#include <random>
+
+#define SOYO_DISPLAY_FRAME_LEN 15
+#define SOYO_MS51_FRAME_LEN 17
+
+struct SoyosourceStreamEvent {
+    std::vector<uint8_t> bytes;
+    // silence on the line before the bytes, the parser drops partial frames after 50ms
+    uint32_t gapMillis;
+    // the bytes hold an uncorrupted status frame that should be decoded
+    bool intactStatus;
+};
+
+class SoyosourceStreamGen {
+    public:
+        // probabilities per event, from 0.0 to 1.0
+        float ms51Rate = 0.0;       // MS51 frames instead of display frames
+        float settingsRate = 0.1;   // settings frames instead of status frames
+        float noiseRate = 0.0;      // 1 to 8 random bytes before the request
+        float truncateRate = 0.0;   // frame cut short
+        float bitFlipRate = 0.0;    // one bit flipped in the frame
+        float gapRate = 1.0;        // poll gap before the event
+
+        uint32_t events = 0;
+        uint32_t statusFrames = 0;
+        uint32_t intactStatusFrames = 0;
+        uint64_t bytes = 0;
+
+        SoyosourceStreamGen(uint32_t seed = 1) : rng(seed) {}
+
+        SoyosourceStreamEvent next() {
+            SoyosourceStreamEvent event;
+            event.gapMillis = chance(gapRate) ? 1000 : 0;
+
+            if (chance(noiseRate)) {
+                int n = 1 + rng() % 8;
+                for (int i = 0; i < n; i++) event.bytes.push_back(rng() & 0xff);
+            }
+
+            bool settings = chance(settingsRate);
+            const uint8_t request[] = { 0x55, (uint8_t) (settings ? 0x03 : 0x01), 0x00, 0x00, 0x00, (uint8_t) (settings ? 0xFC : 0xFE) };
+            event.bytes.insert(event.bytes.end(), request, request + sizeof(request));
+
+            uint16_t power = rng() % 1200;
+            uint16_t vbat = 480 + rng() % 100;
+            uint16_t ibat = rng() % 250;
+            uint16_t vac = 220 + rng() % 30;
+            std::vector<uint8_t> frame = chance(ms51Rate)
+                ? ms51Frame(settings ? 0x03 : 0x01, power, vbat, ibat, vac, 50, 25 + rng() % 40)
+                : displayFrame(settings ? 0x03 : 0x01, power, vbat, ibat, vac, 50, 250 + rng() % 400);
+
+            bool intact = true;
+            if (chance(truncateRate)) {
+                frame.resize(1 + rng() % (frame.size() - 1));
+                intact = false;
+            } else if (chance(bitFlipRate)) {
+                frame[rng() % frame.size()] ^= 1 << (rng() % 8);
+                intact = false;
+            }
+            event.bytes.insert(event.bytes.end(), frame.begin(), frame.end());
+
+            events++;
+            bytes += event.bytes.size();
+            if (!settings) {
+                statusFrames++;
+                if (intact) intactStatusFrames++;
+            }
+            event.intactStatus = !settings && intact;
+            return event;
+        }
+
+        static uint8_t checksum(const std::vector<uint8_t> &frame) {
+            uint8_t sum = 0xFF;
+            for (size_t i = 1; i < frame.size(); i++) sum -= frame[i];
+            return sum;
+        }
+
+        // 0xA6 frame: power, mode/function, status, Vbat, Ibat, Vac, Fac*2, temperature*10+300
+        static std::vector<uint8_t> displayFrame(uint8_t function, uint16_t power, uint16_t vbat, uint16_t ibat, uint16_t vac, uint8_t fac, uint16_t temp) {
+            std::vector<uint8_t> f = { 0xA6, highByte(power), lowByte(power), (uint8_t) (0x90 | function), 0x40,
+                highByte(vbat), lowByte(vbat), highByte(ibat), lowByte(ibat), highByte(vac), lowByte(vac), (uint8_t) (fac * 2),
+                highByte(temp + 300), lowByte(temp + 300) };
+            f.push_back(checksum(f));
+            return f;
+        }
+
+        // 0x5A frame: 0x01, mode/function, status, Vbat, Ibat, Vac, Fac, power, energy, temperature
+        static std::vector<uint8_t> ms51Frame(uint8_t function, uint16_t power, uint16_t vbat, uint16_t ibat, uint16_t vac, uint8_t fac, uint8_t temp) {
+            std::vector<uint8_t> f = { 0x5A, 0x01, (uint8_t) (0x90 | function), 0x40,
+                highByte(vbat), lowByte(vbat), highByte(ibat), lowByte(ibat), highByte(vac), lowByte(vac), fac,
+                highByte(power), lowByte(power), 0x00, 0x2A, temp };
+            f.push_back(checksum(f));
+            return f;
+        }
+
+    private:
+        std::mt19937 rng;
+
+        bool chance(float p) {
+            return p > 0 && std::uniform_real_distribution<float>(0, 1)(rng) < p;
+        }
+};
+
+#endif
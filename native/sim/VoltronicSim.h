@@ -0,0 +1,241 @@
+/*
+  VoltronicSim.h - Simulated Voltronic (Axpert VM III) inverter on a serial line (host only)
+  Answers the ASCII protocol used by VoltronicInverter over a pseudo-terminal,
+  at the pace of the real 2400 baud line
+
+  - commands must end with the protocol CRC and CR, bad CRCs and unknown commands get "(NAK"
+  - QMOD, QPIRI, QPIGS, QPIWS and QPGS0 have plausible default replies, setReply() changes them
+  - replies get the CRC from voltronicCRC(), the same as VoltronicInverter::calcCRC()
+  - every reply byte is paced at the line rate, setExtraDelay() adds the inverter turnaround
+  - failNext() and setFaultRates() inject timeouts, corrupted CRCs and NAKs
+
+  Configure the replies and faults before start() or while the line is idle.
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef VOLTRONIC_SIM_H
+#define VOLTRONIC_SIM_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include "PtyStream.h"
+#include "SimFaults.h"
+#include "VoltronicFrame.h"
+
+#define VOLTRONIC_BAUD 2400
+
+// longest command accepted: QPGSn, PEx/PDx and friends are much shorter
+#define VOLTRONIC_SIM_MAX_CMD 32
+
+struct VoltronicSimStats {
+    uint32_t requests = 0;
+    uint32_t responses = 0;
+    uint32_t naks = 0;
+    uint32_t timeouts = 0;
+    uint32_t crcErrors = 0;
+    uint64_t wireBytes = 0;
+    uint64_t wireMicros = 0;
+};
+
+class VoltronicSim {
+    public:
+        VoltronicSim(uint32_t baud = VOLTRONIC_BAUD) : baud(baud), running(false), stream(NULL),
+            nextFault(SIM_FAULT_NONE), nextFaultCount(0), timeoutRate(0), crcRate(0), nakRate(0), extraDelayMicros(0) {
+            // battery mode, 5kVA 48V unit, all payloads sized like the real replies
+            replies["QMOD"] = "(B";
+            replies["QPIRI"] = "(230.0 21.7 230.0 50.0 21.7 5000 5000 48.0 46.0 42.0 56.4 54.0 2 30 060 0 2 3 9 01 0 0 52.0 0 1";
+            replies["QPIGS"] = "(000.0 00.0 230.0 49.9 0161 0119 003 460 57.50 012 100 0069 0014 103.8 57.45 00000 00110110 00 00 00856 010";
+            replies["QPIWS"] = "(000000000000000000000000000000000000";
+            replies["QPGS0"] = "(1 92932004102443 B 00 237.0 50.01 000.0 00.00 0483 0387 009 51.1 000 069 020.4 000 00942 00792 007 00000010 0 1 060 080 10 00.0 006";
+        }
+
+        ~VoltronicSim() {
+            stop();
+            delete stream;
+        }
+
+        // payload of the reply to cmd, starting with '(' and without CRC and CR, empty for an unknown command
+        void setReply(const String &cmd, const String &payload) {
+            std::lock_guard<std::mutex> lock(mutex);
+            replies[cmd] = payload;
+        }
+
+        // the next count commands get the fault instead of a normal reply
+        void failNext(uint8_t fault, uint32_t count = 1) {
+            std::lock_guard<std::mutex> lock(mutex);
+            this->nextFault = fault;
+            this->nextFaultCount = count;
+        }
+
+        // random faults, probabilities from 0.0 to 1.0 per command
+        void setFaultRates(float timeout, float crc, float nak, uint32_t seed = 1) {
+            std::lock_guard<std::mutex> lock(mutex);
+            timeoutRate = timeout;
+            crcRate = crc;
+            nakRate = nak;
+            rng.seed(seed);
+        }
+
+        // inverter turnaround between the CR of the command and the first reply byte
+        void setExtraDelay(uint32_t micros) { extraDelayMicros = micros; }
+
+        bool start() {
+            if (!pty.isOpen()) {
+                return false;
+            }
+            if (stream == NULL) {
+                stream = new PtyStream(pty.slaveFd);
+            }
+            running = true;
+            worker = std::thread(&VoltronicSim::run, this);
+            return true;
+        }
+
+        void stop() {
+            if (running) {
+                running = false;
+                worker.join();
+            }
+        }
+
+        // the driver side of the line
+        Stream &getStream() { return *stream; }
+        // the pty path, for tools outside the test program
+        const String &getPortName() const { return pty.slaveName; }
+        uint32_t getBaud() const { return baud; }
+
+        VoltronicSimStats getStats() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return stats;
+        }
+
+        void resetStats() {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats = VoltronicSimStats();
+        }
+
+    private:
+        uint32_t baud;
+        PtyPair pty;
+        std::atomic<bool> running;
+        std::thread worker;
+        std::mutex mutex;
+        PtyStream *stream;
+
+        std::map<String, String> replies;
+        uint8_t nextFault;
+        uint32_t nextFaultCount;
+        float timeoutRate;
+        float crcRate;
+        float nakRate;
+        std::mt19937 rng;
+        std::atomic<uint32_t> extraDelayMicros;
+        VoltronicSimStats stats;
+
+        void run() {
+            std::string rx;
+
+            while (running) {
+                struct pollfd pfd = { pty.masterFd, POLLIN, 0 };
+                if (poll(&pfd, 1, 20) <= 0) {
+                    continue;
+                }
+
+                char buf[64];
+                ssize_t n = ::read(pty.masterFd, buf, sizeof(buf));
+                if (n <= 0) continue;
+                rx.append(buf, n);
+
+                size_t cr = rx.find('\r');
+                if (cr == std::string::npos) {
+                    if (rx.size() > VOLTRONIC_SIM_MAX_CMD) {
+                        // line noise, the inverter never sees a command
+                        rx.clear();
+                    }
+                    continue;
+                }
+
+                std::string request = rx.substr(0, cr + 1);
+                rx.erase(0, cr + 1);
+
+                String reply;
+                uint8_t fault = handle(request, reply);
+
+                // the command already took its wire time, the reply is paced byte by byte below
+                uint64_t byteMicros = (uint64_t) SIM_BITS_PER_BYTE * 1000000 / baud;
+                uint64_t wireMicros = (request.size() + reply.length()) * byteMicros;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stats.wireBytes += request.size() + reply.length();
+                    stats.wireMicros += wireMicros;
+                    if (fault == SIM_FAULT_TIMEOUT) stats.timeouts++;
+                    if (fault == SIM_FAULT_CRC) stats.crcErrors++;
+                    if (!reply.isEmpty()) stats.responses++;
+                }
+
+                auto at = std::chrono::steady_clock::now() + std::chrono::microseconds(request.size() * byteMicros + extraDelayMicros);
+                for (size_t i = 0; i < reply.length() && running; i++) {
+                    // each byte is available once its stop bit is on the line
+                    at += std::chrono::microseconds(byteMicros);
+                    std::this_thread::sleep_until(at);
+                    if (::write(pty.masterFd, reply.c_str() + i, 1) < 0) {
+                        return;
+                    }
+                }
+            }
+        }
+
+        uint8_t pickFault() {
+            if (nextFaultCount > 0) {
+                nextFaultCount--;
+                return nextFault;
+            }
+            float r = std::uniform_real_distribution<float>(0, 1)(rng);
+            if (r < timeoutRate) return SIM_FAULT_TIMEOUT;
+            if (r < timeoutRate + crcRate) return SIM_FAULT_CRC;
+            if (r < timeoutRate + crcRate + nakRate) return SIM_FAULT_EXCEPTION;
+            return SIM_FAULT_NONE;
+        }
+
+        // builds the framed reply, returns the fault injected if any
+        uint8_t handle(const std::string &request, String &reply) {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.requests++;
+
+            uint8_t fault = pickFault();
+            if (fault == SIM_FAULT_TIMEOUT) {
+                return fault;
+            }
+
+            // command, 2 CRC bytes, CR
+            auto it = replies.end();
+            if (request.size() > 3) {
+                size_t cmdLen = request.size() - 3;
+                uint16_t crc = voltronicCRC(request.c_str(), cmdLen);
+                if ((uint8_t) request[cmdLen] == (crc >> 8) && (uint8_t) request[cmdLen + 1] == (crc & 0xff)) {
+                    it = replies.find(String(request.substr(0, cmdLen).c_str()));
+                }
+            }
+
+            if (fault == SIM_FAULT_EXCEPTION || it == replies.end() || it->second.isEmpty()) {
+                stats.naks++;
+                reply = voltronicFrame("(NAK");
+                return SIM_FAULT_EXCEPTION;
+            }
+
+            reply = voltronicFrame(it->second.c_str());
+            if (fault == SIM_FAULT_CRC) {
+                // last CRC byte, just before the CR
+                reply.setCharAt(reply.length() - 2, reply.charAt(reply.length() - 2) ^ 0x55);
+            }
+            return fault;
+        }
+};
+
+#endif
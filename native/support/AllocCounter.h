@@ -0,0 +1,58 @@
+/*
+  AllocCounter.h - Counts heap allocations done through operator new
+  Replaces the global operator new/delete, so include it in ONE translation
+  unit of a test program only (the benchmarks)
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <new>
+
+struct AllocCounter {
+    static uint64_t &allocations() { static uint64_t n = 0; return n; }
+    static uint64_t &bytes() { static uint64_t n = 0; return n; }
+    static uint64_t &frees() { static uint64_t n = 0; return n; }
+
+    uint64_t startAllocations;
+    uint64_t startBytes;
+    uint64_t startFrees;
+
+    AllocCounter() : startAllocations(allocations()), startBytes(bytes()), startFrees(frees()) {}
+
+    uint64_t allocationsSince() const { return allocations() - startAllocations; }
+    uint64_t bytesSince() const { return bytes() - startBytes; }
+    // allocations not freed yet, 0 once everything done since the start is released
+    int64_t liveSince() const { return (int64_t) allocationsSince() - (int64_t) (frees() - startFrees); }
+};
+
+inline void allocCounterFree(void *p) {
+    if (p) {
+        AllocCounter::frees()++;
+        free(p);
+    }
+}
+
+void *operator new(size_t size) {
+    AllocCounter::allocations()++;
+    AllocCounter::bytes() += size;
+    void *p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept { allocCounterFree(p); }
+void operator delete[](void *p) noexcept { allocCounterFree(p); }
+void operator delete(void *p, size_t) noexcept { allocCounterFree(p); }
+void operator delete[](void *p, size_t) noexcept { allocCounterFree(p); }
+
+#endif
@@ -0,0 +1,49 @@
+/*
+  MemoryStream.h - A Stream backed by two byte queues for the native tests
+  Bytes pushed with feed() are read by the driver, bytes written by the driver
+  are kept in tx and passed to the optional onWrite responder, which can feed
+  the reply like a device on the other end of the serial line would
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef MEMORY_STREAM_H
+#define MEMORY_STREAM_H
+
+#include <Arduino.h>
+#include <deque>
+
+class MemoryStream : public Stream {
+    public:
+        std::vector<uint8_t> tx;
+        std::function<void(MemoryStream &stream)> onWrite;
+
+        void feed(const uint8_t *data, size_t len) { rx.insert(rx.end(), data, data + len); }
+        void feed(const char *str) { feed((const uint8_t *) str, strlen(str)); }
+        void feed(const std::vector<uint8_t> &data) { feed(data.data(), data.size()); }
+
+        void clear() { rx.clear(); tx.clear(); }
+
+        virtual int available() { return rx.size(); }
+        virtual int read() {
+            if (rx.empty()) return -1;
+            uint8_t c = rx.front();
+            rx.pop_front();
+            return c;
+        }
+        virtual int peek() { return rx.empty() ? -1 : rx.front(); }
+
+        virtual size_t write(uint8_t c) { return write(&c, 1); }
+        virtual size_t write(const uint8_t *buffer, size_t size) {
+            tx.insert(tx.end(), buffer, buffer + size);
+            if (onWrite) onWrite(*this);
+            return size;
+        }
+        using Print::write;
+
+    private:
+        std::deque<uint8_t> rx;
+};
+
+#endif
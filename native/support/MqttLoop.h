@@ -0,0 +1,44 @@
+/*
+  MqttLoop.h - Runs MqttPublisher::loop() through its connection sequence
+  for the native tests, the publisher takes one connection step per call, and
+  through its publish queue, which drains a few messages per call
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef MQTT_LOOP_H
+#define MQTT_LOOP_H
+
+#include "MqttPublisher.h"
+
+// resolve, TCP, MQTT, a subscription per call and a last check
+#define MQTT_LOOP_MAX_CALLS 64
+
+// returns the loop() calls it took, 0 when it did not connect
+inline int mqttLoopUntilConnected(MqttPublisher &mqtt) {
+    for (int i = 1; i <= MQTT_LOOP_MAX_CALLS; i++) {
+        mqtt.loop();
+        if (mqtt.isConnected()) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+// the queue drains at MQTT_PUBLISH_RATE_BYTES, a step of virtual time per call
+#define MQTT_LOOP_STEP_MILLIS 10
+
+// returns the loop() calls it took to empty the publish queue, 0 when it did not
+inline int mqttLoopUntilSent(MqttPublisher &mqtt) {
+    for (int i = 1; i <= MQTT_LOOP_MAX_CALLS * 16; i++) {
+        mqtt.loop();
+        if (mqtt.getQueueDepth() == 0) {
+            return i;
+        }
+        delay(MQTT_LOOP_STEP_MILLIS);
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,119 @@
+/*
+  MqttWireClient.h - A WiFiClient for the native tests that keeps the bytes a
+  client library writes and replies with scripted bytes, like a broker would.
+  onConnect runs on every TCP connect, to queue the CONNACK of that connection.
+  packets() splits what was written into MQTT packets, publishes() decodes the
+  MQTT 5 PUBLISH packets among them. The live stream tests use it as a browser
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef MQTT_WIRE_CLIENT_H
+#define MQTT_WIRE_CLIENT_H
+
+#include <ESP8266WiFi.h>
+#include <deque>
+
+struct MqttWirePacket {
+    uint8_t header;
+    std::vector<uint8_t> body;
+    size_t size;            // on the wire, fixed header included
+};
+
+struct MqttWirePublish {
+    String topic;           // empty when the alias stands for it
+    uint16_t alias;         // 0 without one
+    String payload;
+    size_t size;
+};
+
+class MqttWireClient : public WiFiClient {
+    public:
+        std::vector<uint8_t> tx;
+        std::function<void(MqttWireClient &client)> onConnect;
+        bool open = false;
+
+        void feed(std::initializer_list<uint8_t> data) { rx.insert(rx.end(), data.begin(), data.end()); }
+        void feed(const std::vector<uint8_t> &data) { rx.insert(rx.end(), data.begin(), data.end()); }
+
+        virtual int connect(IPAddress, uint16_t) { return connectNow(); }
+        virtual int connect(const char *, uint16_t) { return connectNow(); }
+        virtual uint8_t connected() { return open; }
+        virtual void stop() { open = false; rx.clear(); }
+        virtual int available() { return rx.size(); }
+        virtual int read() {
+            if (rx.empty()) return -1;
+            uint8_t c = rx.front();
+            rx.pop_front();
+            return c;
+        }
+        virtual int read(uint8_t *buf, size_t size) {
+            size_t n = 0;
+            while (n < size && !rx.empty()) buf[n++] = read();
+            return n;
+        }
+        virtual int peek() { return rx.empty() ? -1 : rx.front(); }
+        virtual size_t write(uint8_t c) { return write(&c, 1); }
+        virtual size_t write(const uint8_t *buf, size_t size) {
+            if (!open) return 0;
+            tx.insert(tx.end(), buf, buf + size);
+            return size;
+        }
+        using Print::write;
+
+        std::vector<MqttWirePacket> packets() const {
+            std::vector<MqttWirePacket> result;
+            size_t pos = 0;
+            while (pos < tx.size()) {
+                MqttWirePacket p;
+                size_t start = pos;
+                p.header = tx[pos++];
+                uint32_t length = 0;
+                for (uint8_t shift = 0; pos < tx.size(); shift += 7) {
+                    uint8_t b = tx[pos++];
+                    length |= (uint32_t) (b & 0x7f) << shift;
+                    if ((b & 0x80) == 0) break;
+                }
+                p.body.assign(tx.begin() + pos, tx.begin() + std::min(tx.size(), (size_t) (pos + length)));
+                pos += length;
+                p.size = pos - start;
+                result.push_back(p);
+            }
+            return result;
+        }
+
+        std::vector<MqttWirePublish> publishes() const {
+            std::vector<MqttWirePublish> result;
+            for (const MqttWirePacket &p : packets()) {
+                if ((p.header & 0xf0) != 0x30) continue;
+                const std::vector<uint8_t> &b = p.body;
+                MqttWirePublish pub;
+                size_t topicLength = b[0] << 8 | b[1];
+                pub.topic = String((const char *) &b[2], topicLength);
+                size_t pos = 2 + topicLength;
+                size_t propertiesEnd = pos + 1 + b[pos];
+                pub.alias = 0;
+                for (pos++; pos < propertiesEnd; ) {
+                    if (b[pos] == 0x23) pub.alias = b[pos + 1] << 8 | b[pos + 2];
+                    pos += 3;   // the client only sends the alias
+                }
+                pub.payload = String((const char *) &b[propertiesEnd], b.size() - propertiesEnd);
+                pub.size = p.size;
+                result.push_back(pub);
+            }
+            return result;
+        }
+
+    private:
+        std::deque<uint8_t> rx;
+
+        int connectNow() {
+            Network.tcpConnects++;
+            open = true;
+            if (onConnect) onConnect(*this);
+            return 1;
+        }
+};
+
+#endif
@@ -0,0 +1,41 @@
+/*
+  VoltronicFrame.h - Builds Voltronic replies for the native tests: the payload,
+  the protocol CRC (same as VoltronicInverter::calcCRC) and the CR terminator
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef VOLTRONIC_FRAME_H
+#define VOLTRONIC_FRAME_H
+
+#include <Arduino.h>
+
+inline uint16_t voltronicCRC(const char *data, size_t len) {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t) ((uint8_t) data[i]) << 8;
+        for (int b = 0; b < 8; b++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+
+    // the protocol avoids '(', CR and LF in the CRC bytes
+    uint8_t lo = crc & 0xff;
+    uint8_t hi = crc >> 8;
+    if (lo == 0x28 || lo == 0x0d || lo == 0x0a) lo++;
+    if (hi == 0x28 || hi == 0x0d || hi == 0x0a) hi++;
+    return (hi << 8) | lo;
+}
+
+// payload + CRC + CR, e.g. voltronicFrame("(B") for a QMOD reply
+inline String voltronicFrame(const char *payload) {
+    String frame = payload;
+    uint16_t crc = voltronicCRC(frame.c_str(), frame.length());
+    frame += (char) (crc >> 8);
+    frame += (char) (crc & 0xff);
+    frame += '\r';
+    return frame;
+}
+
+#endif
@@ -0,0 +1,89 @@
+/*
+  BlockSnapshot.h - Library header for the ESP8266/ESP32 Arduino platform
+  Double buffered copy of one block of decoded values, with a generation and a time
+
+  The writer decodes into the back copy: beginWrite() starts it from the
+  current values, so an update of a few fields keeps the others, commit()
+  makes it the front copy with the next generation and abort() drops it.
+  Readers use the front copy in place. A view holds it with its generation
+  and times, and stays intact until the writer starts on it again, the write
+  after the next commit: isValid() tells, like the retry check of a seqlock.
+  The generation also tells a reader whether the block changed since last time.
+  Each commit keeps the millis() and the wall clock time (epoch milliseconds,
+  0 while the clock is not set) of the capture
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef _BLOCK_SNAPSHOT_H
+#define _BLOCK_SNAPSHOT_H
+
+#include <Arduino.h>
+
+template <typename T>
+struct BlockView {
+    const T *data;
+    uint32_t generation;        // 0 until the first commit
+    unsigned long millis;       // of the commit
+    uint64_t epochMillis;       // of the commit, 0 while the clock is not set
+};
+
+template <typename T>
+class BlockSnapshot {
+    public:
+        BlockSnapshot() : buffers(), times(), epochTimes(), generation(0), writing(false) {}
+
+        T &beginWrite() {
+            T &back = buffers[(generation + 1) & 1];
+            back = buffers[generation & 1];
+            writing = true;
+            return back;
+        }
+
+        void commit(unsigned long now, uint64_t epochMillis = 0) {
+            times[(generation + 1) & 1] = now;
+            epochTimes[(generation + 1) & 1] = epochMillis;
+            generation++;
+            writing = false;
+        }
+
+        void abort() {
+            writing = false;
+        }
+
+        // the front copy, valid until the next commit
+        const T &get() const {
+            return buffers[generation & 1];
+        }
+
+        BlockView<T> view() const {
+            uint32_t g = generation;
+            return { &buffers[g & 1], g, times[g & 1], epochTimes[g & 1] };
+        }
+
+        bool isValid(const BlockView<T> &view) const {
+            return generation == view.generation || (generation == view.generation + 1 && !writing);
+        }
+
+        uint32_t getGeneration() const {
+            return generation;
+        }
+
+        unsigned long getMillis() const {
+            return times[generation & 1];
+        }
+
+        uint64_t getEpochMillis() const {
+            return epochTimes[generation & 1];
+        }
+
+    private:
+        T buffers[2];
+        unsigned long times[2];
+        uint64_t epochTimes[2];
+        volatile uint32_t generation;
+        volatile bool writing;
+};
+
+#endif
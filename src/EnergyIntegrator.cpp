@@ -0,0 +1,228 @@
+/*
+  EnergyIntegrator.cpp - Library for the ESP8266/ESP32 Arduino platform
+  Integrates the inverter power values into energy on the device
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <coredecls.h>
+#include "EnergyIntegrator.h"
+#include "GLog.h"
+
+#define RTC_ENERGY_MAGIC 0x454e5247 // "ENRG"
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+// power field names, after any "<addr>/" prefix
+static const char *const ENERGY_FIELDS[] = {
+    "Pac", "Ppv", "Ppv1", "Ppv2", "Pload",
+    "Pbat", "Pcharge", "Pdischarge"
+};
+
+// Image of the totals as stored in RTC memory, must be a multiple of 4 bytes
+struct RtcEnergyChannel {
+    uint32_t hash;
+    uint32_t reserved;
+    double totalWh;
+};
+
+struct RtcEnergyData {
+    uint32_t crc32;
+    uint32_t magic;
+    uint32_t count;
+    uint32_t reserved;
+    RtcEnergyChannel channels[ENERGY_CHANNELS];
+};
+
+static uint32_t nameHash(const char *name) {
+    uint32_t h = FNV_OFFSET_BASIS;
+    while (*name) {
+        h = (h ^ (uint8_t) *name++) * FNV_PRIME;
+    }
+    return h;
+}
+
+EnergyIntegrator::EnergyIntegrator() {
+    channelCount = 0;
+    sampleMillis = 0;
+    sampleChanged = false;
+    samples = 0;
+    gaps = 0;
+    restored = false;
+    restoredCount = 0;
+}
+
+void EnergyIntegrator::begin() {
+    RtcEnergyData data;
+    restoredCount = 0;
+
+    if (!ESP.rtcUserMemoryRead(RTC_ENERGY_OFFSET, (uint32_t *) &data, sizeof(data))) {
+        return;
+    }
+
+    // after a power cycle the rtc memory holds garbage
+    if (data.magic != RTC_ENERGY_MAGIC || data.count > ENERGY_CHANNELS || data.crc32 != crc32(((uint8_t *) &data) + 4, sizeof(data) - 4)) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < data.count; i++) {
+        restoredHash[i] = data.channels[i].hash;
+        restoredWh[i] = data.channels[i].totalWh;
+    }
+    restoredCount = data.count;
+    restored = true;
+
+    GLOG_INFO("ENERGY: %u totals restored\n", (unsigned) restoredCount);
+}
+
+void EnergyIntegrator::beginSample(unsigned long millis) {
+    sampleMillis = millis;
+    sampleChanged = false;
+}
+
+void EnergyIntegrator::emitValue(const char *name, const char *value) {
+    float watts;
+    if (!fieldNumber(name, value, ENERGY_FIELDS, watts)) {
+        return;
+    }
+
+    EnergyChannel *c = channel(name);
+    if (c == NULL) {
+        return;
+    }
+
+    if (c->hasLast) {
+        unsigned long dt = sampleMillis - c->lastMillis;
+        if (dt > ENERGY_MAX_GAP_MILLIS) {
+            gaps++;
+        } else if (dt > 0) {
+            // trapezoid between the previous sample and this one
+            double ws = ((double) c->lastValue + watts) / 2.0 * dt / 1000.0;
+            c->intervalWs += ws;
+            c->intervalMillis += dt;
+            c->totalWh += ws / 3600.0;
+            sampleChanged = true;
+        }
+    }
+
+    if (c->samples == 0 || watts < c->min) c->min = watts;
+    if (c->samples == 0 || watts > c->max) c->max = watts;
+    c->samples++;
+
+    c->lastValue = watts;
+    c->lastMillis = sampleMillis;
+    c->hasLast = true;
+}
+
+void EnergyIntegrator::endSample() {
+    samples++;
+    if (sampleChanged) {
+        save();
+    }
+}
+
+void EnergyIntegrator::emitAggregates(InverterSink &sink) {
+    char name[INVERTER_SINK_NAME_SIZE];
+    char value[INVERTER_SINK_VALUE_SIZE];
+
+    for (uint8_t i = 0; i < channelCount; i++) {
+        EnergyChannel &c = channels[i];
+        if (c.samples == 0) {
+            continue;
+        }
+
+        // a single sample has no duration, its value is the mean
+        float mean = c.intervalMillis > 0 ? c.intervalWs * 1000.0 / c.intervalMillis : c.lastValue;
+
+        snprintf(name, sizeof(name), "%s/Min", c.name);
+        sink.emit(name, c.min);
+        snprintf(name, sizeof(name), "%s/Max", c.name);
+        sink.emit(name, c.max);
+        snprintf(name, sizeof(name), "%s/Mean", c.name);
+        sink.emit(name, mean);
+
+        // a 5s poll at 100W is 0.14Wh, more decimals than the usual "%.1f"
+        snprintf(name, sizeof(name), "%s/Energy", c.name);
+        snprintf(value, sizeof(value), "%.3f", c.intervalWs / 3600.0);
+        sink.emit(name, value);
+        snprintf(name, sizeof(name), "%s/EnergyTotal", c.name);
+        snprintf(value, sizeof(value), "%.1f", c.totalWh);
+        sink.emit(name, value);
+
+        // the next interval starts at the last sample
+        c.samples = 0;
+        c.intervalWs = 0;
+        c.intervalMillis = 0;
+    }
+}
+
+void EnergyIntegrator::emitStats(InverterSink &sink) {
+    sink.emit("Energy/Samples", samples);
+    sink.emit("Energy/Channels", channelCount);
+    sink.emit("Energy/Gaps", gaps);
+    sink.emit("Energy/Restored", restored ? "true" : "false");
+}
+
+double EnergyIntegrator::getTotalWh(const char *name) {
+    for (uint8_t i = 0; i < channelCount; i++) {
+        if (strcmp(channels[i].name, name) == 0) {
+            return channels[i].totalWh;
+        }
+    }
+    return 0;
+}
+
+EnergyChannel *EnergyIntegrator::channel(const char *name) {
+    for (uint8_t i = 0; i < channelCount; i++) {
+        if (strcmp(channels[i].name, name) == 0) {
+            return &channels[i];
+        }
+    }
+
+    if (channelCount >= ENERGY_CHANNELS || strlen(name) >= ENERGY_NAME_SIZE) {
+        return NULL;
+    }
+
+    EnergyChannel &c = channels[channelCount++];
+    memset(&c, 0, sizeof(c));
+    strcpy(c.name, name);
+    c.hash = nameHash(name);
+
+    for (uint8_t i = 0; i < restoredCount; i++) {
+        if (restoredHash[i] == c.hash) {
+            c.totalWh = restoredWh[i];
+        }
+    }
+    return &c;
+}
+
+void EnergyIntegrator::save() {
+    RtcEnergyData data;
+    memset(&data, 0, sizeof(data));
+
+    data.magic = RTC_ENERGY_MAGIC;
+
+    for (uint8_t i = 0; i < channelCount; i++) {
+        data.channels[data.count].hash = channels[i].hash;
+        data.channels[data.count++].totalWh = channels[i].totalWh;
+    }
+
+    // fields not seen since the restart keep their restored total
+    for (uint8_t i = 0; i < restoredCount && data.count < ENERGY_CHANNELS; i++) {
+        bool seen = false;
+        for (uint8_t j = 0; j < channelCount; j++) {
+            seen |= channels[j].hash == restoredHash[i];
+        }
+        if (!seen) {
+            data.channels[data.count].hash = restoredHash[i];
+            data.channels[data.count++].totalWh = restoredWh[i];
+        }
+    }
+    data.crc32 = crc32(((uint8_t *) &data) + 4, sizeof(data) - 4);
+
+    if (!ESP.rtcUserMemoryWrite(RTC_ENERGY_OFFSET, (uint32_t *) &data, sizeof(data))) {
+        GLOG_ERROR("ENERGY: save rtc totals failed\n");
+    }
+}
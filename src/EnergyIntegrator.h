@@ -0,0 +1,103 @@
+/*
+  EnergyIntegrator.h - Library header for the ESP8266/ESP32 Arduino platform
+  Integrates the inverter power values into energy on the device
+
+  The power fields are sampled far more often than the values are published
+  (Inverter::samplePower() between polls). Each sample adds the trapezoid
+  between it and the previous one to the energy of that field, and updates the
+  min/max of the interval. emitAggregates() hands out the min, max, time
+  weighted mean and energy of each field since the previous call, plus the
+  energy total, and starts a new interval
+
+  The totals are kept in RTC user memory after every sample, so they survive
+  soft resets and watchdog restarts but not power cycles
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef _ENERGY_INTEGRATOR_H
+#define _ENERGY_INTEGRATOR_H
+
+#include <Arduino.h>
+#include "GlobalDefs.h"
+#include "InverterSink.h"
+
+// time between power samples, each one is a few short Modbus reads
+#ifndef ENERGY_SAMPLE_INTERVAL_MILLIS
+#define ENERGY_SAMPLE_INTERVAL_MILLIS 1000
+#endif
+
+// time between two emitAggregates() of the main loop, they go out with the next poll after it
+#ifndef ENERGY_AGGREGATE_INTERVAL_MILLIS
+#define ENERGY_AGGREGATE_INTERVAL_MILLIS 60000
+#endif
+
+// a longer gap between two samples is not integrated, the bus or the inverter was away
+#define ENERGY_MAX_GAP_MILLIS 600000
+
+// power fields integrated, "22/Pdischarge" fits
+#define ENERGY_CHANNELS 12
+#define ENERGY_NAME_SIZE 16
+
+struct EnergyChannel {
+    char name[ENERGY_NAME_SIZE];
+    uint32_t hash;
+
+    float lastValue;
+    unsigned long lastMillis;
+    bool hasLast;
+
+    // current interval
+    float min;
+    float max;
+    double intervalWs;
+    uint32_t intervalMillis;
+    uint32_t samples;
+
+    double totalWh;
+};
+
+class EnergyIntegrator : public InverterSink {
+    public:
+        EnergyIntegrator();
+
+        // restores the totals kept in RTC memory, if any
+        void begin();
+
+        // samplePower() or emitData() goes between these two
+        void beginSample(unsigned long millis);
+        void endSample();
+
+        // <name>/Min, /Max, /Mean (W), /Energy (Wh in the interval) and /EnergyTotal (Wh), then a new interval
+        void emitAggregates(InverterSink &sink);
+
+        // sample count and channels for the tele topic
+        void emitStats(InverterSink &sink);
+
+        // the total of a field in Wh, 0 if it is unknown
+        double getTotalWh(const char *name);
+
+    protected:
+        // integrates the power fields only
+        virtual void emitValue(const char *name, const char *value);
+
+    private:
+        EnergyChannel channels[ENERGY_CHANNELS];
+        uint8_t channelCount;
+        unsigned long sampleMillis;
+        bool sampleChanged;
+        uint32_t samples;
+        uint32_t gaps;
+        bool restored;
+
+        // totals read from RTC memory, claimed by name hash when the field shows up
+        uint32_t restoredHash[ENERGY_CHANNELS];
+        double restoredWh[ENERGY_CHANNELS];
+        uint8_t restoredCount;
+
+        EnergyChannel *channel(const char *name);
+        void save();
+};
+
+#endif
@@ -9,83 +9,69 @@
 #include "GLog.h"
 #include "GlobalDefs.h"
 
-Stream *GLOG::s = NULL;
+GLogOutput GLOG::s;
 
-void GLOG::println(unsigned char v) {
-    if (GLOG::s) {
-        GLOG::s->println(v);
-    }
+GLogRing::GLogRing() {
+    written = 0;
 }
 
-void GLOG::print(unsigned char v) {
-    if (GLOG::s) {
-        GLOG::s->print(v);
-    }
+size_t GLogRing::write(uint8_t c) {
+    data[written % GLOG_RING_SIZE] = c;
+    written++;
+    return 1;
 }
 
-void GLOG::println(char v) {
-    if (GLOG::s) {
-        GLOG::s->println(v);
+size_t GLogRing::write(const uint8_t *buffer, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        data[written % GLOG_RING_SIZE] = buffer[i];
+        written++;
     }
+    return size;
 }
 
-void GLOG::print(char v) {
-    if (GLOG::s) {
-        GLOG::s->print(v);
+size_t GLogRing::read(uint32_t &cursor, uint8_t *buffer, size_t maxLen) const {
+    // the reader fell behind and lost some data
+    if (written - cursor > GLOG_RING_SIZE) {
+        cursor = tail();
     }
-}
 
-void GLOG::println(int v) {
-    if (GLOG::s) {
-        GLOG::s->println(v);
+    size_t n = 0;
+    while (n < maxLen && cursor != written) {
+        buffer[n++] = data[cursor % GLOG_RING_SIZE];
+        cursor++;
     }
+    return n;
 }
 
-void GLOG::print(int v) {
-    if (GLOG::s) {
-        GLOG::s->print(v);
-    }
+uint32_t GLogRing::tail() const {
+    return written > GLOG_RING_SIZE ? written - GLOG_RING_SIZE : 0;
 }
 
-void GLOG::println(const char * msg) {
-    if (GLOG::s) {
-        GLOG::s->println(msg);
-    }
+uint32_t GLogRing::head() const {
+    return written;
 }
 
-void GLOG::print(const char * msg) {
-    if (GLOG::s) {
-        GLOG::s->print(msg);
-    }
+GLogOutput::GLogOutput() {
+    serial = NULL;
 }
 
-void GLOG::println(const Printable &o) {
-    if (GLOG::s) {
-        GLOG::s->println(o);
+size_t GLogOutput::write(uint8_t c) {
+    if (serial) {
+        serial->write(c);
     }
+    return ring.write(c);
 }
 
-void GLOG::print(const Printable &o) {
-    if (GLOG::s) {
-        GLOG::s->print(o);
-    }
-}
-
-void GLOG:: println(const String &o) {
-    if (GLOG::s) {
-        GLOG::s->println(o);
-    }
-}
-
-void GLOG::print(const String &o) {
-    if (GLOG::s) {
-        GLOG::s->print(o);
+size_t GLogOutput::write(const uint8_t *buffer, size_t size) {
+    if (serial) {
+        serial->write(buffer, size);
     }
+    return ring.write(buffer, size);
 }
 
 size_t GLOG::printf(const char *format, ...) {
     // based on Print.cpp
-    if (GLOG::s) {
+    if (GLOG::isLogEnabled()) {
         va_list arg;
         va_start(arg, format);
         char temp[64];
@@ -101,7 +87,7 @@ size_t GLOG::printf(const char *format, ...) {
             vsnprintf(buffer, len + 1, format, arg);
             va_end(arg);
         }
-        len = GLOG::s->write((const uint8_t*) buffer, len);
+        len = GLOG::s.write((const uint8_t*) buffer, len);
         if (buffer != temp) {
             delete[] buffer;
         }
@@ -110,15 +96,49 @@ size_t GLOG::printf(const char *format, ...) {
     return 0;
 }
 
+size_t GLOG::printf_P(PGM_P format, ...) {
+    if (GLOG::isLogEnabled()) {
+        va_list arg;
+        va_start(arg, format);
+        size_t len = GLOG::vprintf_P(format, arg);
+        va_end(arg);
+        return len;
+    }
+    return 0;
+}
+
+size_t GLOG::vprintf_P(PGM_P format, va_list arg) {
+    // same as printf but with the format string in flash
+    va_list argCopy;
+    va_copy(argCopy, arg);
+    char temp[64];
+    char* buffer = temp;
+    size_t len = vsnprintf_P(temp, sizeof(temp), format, arg);
+    if (len > sizeof(temp) - 1) {
+        buffer = new char[len + 1];
+        if (!buffer) {
+            va_end(argCopy);
+            return 0;
+        }
+        vsnprintf_P(buffer, len + 1, format, argCopy);
+    }
+    va_end(argCopy);
+    len = GLOG::s.write((const uint8_t*) buffer, len);
+    if (buffer != temp) {
+        delete[] buffer;
+    }
+    return len;
+}
+
 void GLOG::logMqtt(char* topic, byte* payload, unsigned int length) {
-    if (GLOG::s) {
-        GLOG::s->print(F("MQTT: received ["));
-        GLOG::s->print(topic);
-        GLOG::s->print(F("]=["));
+    if (GLOG::isLogEnabled()) {
+        GLOG::s.print(F("MQTT: received ["));
+        GLOG::s.print(topic);
+        GLOG::s.print(F("]=["));
         for (unsigned int i = 0; i < length; i++) {
-            GLOG::s->print((char)payload[i]);
+            GLOG::s.print((char)payload[i]);
         }
-        GLOG::s->println(F("]"));
+        GLOG::s.println(F("]"));
     }
 }
     
@@ -126,13 +146,23 @@ void GLOG::setup() {
 #ifdef LARGE_ESP_BOARD
     Serial.begin(115200);
     delay(10);
-    GLOG::s = &Serial;
+    GLOG::s.serial = &Serial;
 #else
-    GLOG::s = NULL;
+    // the ring is the only output
+    GLOG::s.serial = NULL;
 #endif
 }
 
 bool GLOG::isLogEnabled() {
-    return GLOG::s != NULL;
+    // the ring is always there, unless logging is compiled out
+    return GLOG_LEVEL > GLOG_LEVEL_NONE;
+}
+
+bool GLOG::isSerialEnabled() {
+    return GLOG::s.serial != NULL;
+}
+
+GLogRing &GLOG::getRing() {
+    return GLOG::s.ring;
 }
 
@@ -2,6 +2,14 @@
   GLog.h - Library header for the ESP8266/ESP32 Arduino platform
   Global logging solution (used to prevent logging to the Serial interface)
 
+  Use the GLOG_ERROR/WARN/INFO/DEBUG macros, printf style with a literal format string
+  that is kept in flash. Messages above GLOG_LEVEL are removed at compile time and the
+  arguments are only evaluated when the level is enabled and there is a log output,
+  so building Strings inside a log call costs nothing when logging is off.
+
+  Everything logged is also kept in a fixed size RAM ring (GLOG_RING_SIZE bytes) which
+  is drained to MQTT and TCP by the log sinks, so ESP-01 boards can log without a UART.
+
   Written by JF enide.electronics (at) enide.net
   Licensed under GNU GPLv3
 */
@@ -10,29 +18,102 @@
 #define G_LOG_H
 
 #include <Arduino.h>
+#include "GlobalDefs.h"
+
+#define GLOG_LEVEL_NONE  0
+#define GLOG_LEVEL_ERROR 1
+#define GLOG_LEVEL_WARN  2
+#define GLOG_LEVEL_INFO  3
+#define GLOG_LEVEL_DEBUG 4
+
+// override with -DGLOG_LEVEL=GLOG_LEVEL_xxx in the build_flags
+#ifndef GLOG_LEVEL
+#ifdef LARGE_ESP_BOARD
+#define GLOG_LEVEL GLOG_LEVEL_DEBUG
+#else
+// ESP-01 uses its only UART to talk to the inverter, warnings and errors go to the ring only
+#define GLOG_LEVEL GLOG_LEVEL_WARN
+#endif
+#endif
+
+// RAM used by the log ring, override with -DGLOG_RING_SIZE=n (a power of two keeps the index cheap)
+#ifndef GLOG_RING_SIZE
+#if GLOG_LEVEL == GLOG_LEVEL_NONE
+// nothing is ever written to it
+#define GLOG_RING_SIZE 1
+#elif defined(LARGE_ESP_BOARD)
+#define GLOG_RING_SIZE 2048
+#else
+#define GLOG_RING_SIZE 1024
+#endif
+#endif
+
+// true if messages of this level would be written somewhere
+#define GLOG_ENABLED(level) (GLOG_LEVEL >= (level) && GLOG::isLogEnabled())
+
+#define GLOG_AT(level, fmt, ...) do { \
+        if (GLOG_ENABLED(level)) { \
+            GLOG::printf_P(PSTR(fmt), ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define GLOG_ERROR(fmt, ...) GLOG_AT(GLOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#define GLOG_WARN(fmt, ...)  GLOG_AT(GLOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define GLOG_INFO(fmt, ...)  GLOG_AT(GLOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define GLOG_DEBUG(fmt, ...) GLOG_AT(GLOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+
+// Fixed size byte ring, the oldest data is overwritten when full
+// Each reader keeps its own cursor (total bytes written when it last read) so
+// several sinks can drain it at their own pace
+class GLogRing : public Print {
+    public:
+        GLogRing();
+
+        virtual size_t write(uint8_t c);
+        virtual size_t write(const uint8_t *buffer, size_t size);
+        using Print::write;
+
+        // copies up to maxLen bytes starting at cursor and moves the cursor forward
+        // a cursor pointing to overwritten data skips to the oldest byte still available
+        size_t read(uint32_t &cursor, uint8_t *buffer, size_t maxLen) const;
+
+        // cursor for the oldest byte still in the ring
+        uint32_t tail() const;
+        // total bytes written so far, the cursor of a reader that is up to date
+        uint32_t head() const;
+
+    private:
+        uint8_t data[GLOG_RING_SIZE];
+        uint32_t written;
+};
+
+// Writes to the serial port, if any, and to the ring
+class GLogOutput : public Print {
+    public:
+        GLogOutput();
+
+        virtual size_t write(uint8_t c);
+        virtual size_t write(const uint8_t *buffer, size_t size);
+        using Print::write;
+
+        Stream *serial;
+        GLogRing ring;
+};
 
 class GLOG {
     public:
-        static void println(unsigned char v);
-        static void print(unsigned char v);
-        static void println(char v);
-        static void print(char v);
-        static void println(int v);
-        static void print(int v);
-        static void println(const char * msg);
-        static void print(const char * msg);
-        static void println(const Printable &o);
-        static void print(const Printable &o);
-        static void println(const String &o);
-        static void print(const String &o);
         static size_t printf(const char *format, ...);
+        static size_t printf_P(PGM_P format, ...) __attribute__((format(printf, 1, 2)));
         static void logMqtt(char* topic, byte* payload, unsigned int length);
         
         static void setup();
         static bool isLogEnabled();
+        static bool isSerialEnabled();
+        static GLogRing &getRing();
         
     private:
-        static Stream *s;
+        static GLogOutput s;
+        static size_t vprintf_P(PGM_P format, va_list arg);
 };
 
 #endif
@@ -12,4 +12,9 @@
 #define LARGE_ESP_BOARD
 #endif
 
+// RTC user memory layout, offsets in 4 byte blocks (128 blocks available)
+// These survive soft resets and watchdog restarts but not power cycles
+#define RTC_WIFI_CACHE_OFFSET 0     // 4 blocks of the 8 reserved, see WiCMRtcWifiCache
+#define RTC_ENERGY_OFFSET 8         // 52 blocks, see EnergyIntegrator
+
 #endif
\ No newline at end of file
@@ -0,0 +1,295 @@
+/*
+  HistoryBuffer.cpp - Library for the ESP8266/ESP32 Arduino platform
+  Keeps the energy and battery values polled while the broker is unreachable
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <FS.h>
+#include "HistoryBuffer.h"
+#include "GLog.h"
+#include "WallClock.h"
+
+// field names worth keeping, after any "<addr>/" prefix
+static const char *const HISTORY_FIELDS[] = {
+    "Etoday", "Etotal", "Epv", "Eload",
+    "Pac", "Ppv", "Ppv1", "Ppv2", "Pload",
+    "Pbat", "Pcharge", "Pdischarge",
+    "SOC", "BatteryCapacity", "Vbat"
+};
+
+HistoryBuffer::HistoryBuffer() {
+    sampleRecords = 0;
+    sampleTime = 0;
+    sampleFlags = 0;
+    firstSeq = 0;
+    lastSeq = 0;
+    lastRecords = 0;
+    readOffset = 0;
+    bootSeq = 0;
+    bootRecords = 0;
+    backlog = 0;
+    replayed = 0;
+    dropped = 0;
+    writeErrors = 0;
+}
+
+void HistoryBuffer::begin() {
+    bool found = false;
+    backlog = 0;
+
+    Dir dir = SPIFFS.openDir(HISTORY_DIR);
+    while (dir.next()) {
+        uint32_t seq = strtoul(dir.fileName().c_str() + strlen(HISTORY_DIR), NULL, 10);
+        if (!found || seq < firstSeq) firstSeq = seq;
+        if (!found || seq > lastSeq) lastSeq = seq;
+        found = true;
+        backlog += dir.fileSize() / sizeof(HistoryRecord);
+    }
+
+    lastRecords = found ? segmentRecords(lastSeq) : 0;
+    readOffset = 0;
+    bootSeq = lastSeq;
+    bootRecords = lastRecords;
+
+    // the ring may have been bigger before
+    while (lastSeq - firstSeq >= HISTORY_SEGMENTS) {
+        removeFirstSegment();
+    }
+
+    if (backlog > 0) {
+        GLOG_INFO("HISTORY: %lu records to replay\n", (unsigned long) backlog);
+    }
+}
+
+void HistoryBuffer::beginSample(time_t time) {
+    if (time >= WALLCLOCK_MIN_VALID_TIME) {
+        sampleTime = (uint32_t) time;
+        sampleFlags = 0;
+    } else {
+        // converted at the replay, once the clock is set
+        sampleTime = millis();
+        sampleFlags = HISTORY_RECORD_BOOT_MILLIS;
+    }
+    sampleRecords = 0;
+}
+
+void HistoryBuffer::emitValue(const char *name, const char *value) {
+    float number;
+    if (!fieldNumber(name, value, HISTORY_FIELDS, number)) {
+        return;
+    }
+    if (strlen(name) >= HISTORY_NAME_SIZE) {
+        GLOG_WARN("HISTORY: name %s too long, not kept\n", name);
+        dropped++;
+        return;
+    }
+
+    if (sampleRecords >= HISTORY_SAMPLE_RECORDS) {
+        dropped++;
+        return;
+    }
+
+    HistoryRecord &r = sample[sampleRecords++];
+    r.time = sampleTime;
+    r.flags = sampleFlags;
+    r.value = number;
+    memset(r.name, 0, sizeof(r.name));
+    strcpy(r.name, name);
+}
+
+void HistoryBuffer::endSample() {
+    uint8_t done = 0;
+
+    while (done < sampleRecords) {
+        if (lastRecords >= HISTORY_SEGMENT_RECORDS) {
+            startSegment();
+        }
+
+        uint32_t n = sampleRecords - done;
+        if (n > HISTORY_SEGMENT_RECORDS - lastRecords) {
+            n = HISTORY_SEGMENT_RECORDS - lastRecords;
+        }
+
+        char path[HISTORY_PATH_SIZE];
+        segmentPath(lastSeq, path);
+        File f = SPIFFS.open(path, "a");
+        size_t written = f ? f.write((const uint8_t *) &sample[done], n * sizeof(HistoryRecord)) : 0;
+        if (f) {
+            f.close();
+        }
+
+        if (written != n * sizeof(HistoryRecord)) {
+            // flash full or gone: the rest of the sample is lost and a part
+            // record may be in the file, so append to a new segment next time
+            GLOG_WARN("HISTORY: write failed, %u of %u bytes\n", (unsigned) written, (unsigned) (n * sizeof(HistoryRecord)));
+            writeErrors++;
+            backlog += written / sizeof(HistoryRecord);
+            dropped += sampleRecords - done - written / sizeof(HistoryRecord);
+            lastRecords = HISTORY_SEGMENT_RECORDS;
+            break;
+        }
+
+        lastRecords += n;
+        backlog += n;
+        done += n;
+    }
+
+    sampleRecords = 0;
+}
+
+uint32_t HistoryBuffer::getBacklog() {
+    return backlog;
+}
+
+size_t HistoryBuffer::nextBatch(char *payload, size_t size) {
+    payload[0] = '\0';
+    if (backlog == 0) {
+        return 0;
+    }
+
+    File f;
+    while (true) {
+        // segments cut short by a failed write end early, missing ones have no records
+        while (firstSeq != lastSeq && readOffset >= segmentRecords(firstSeq)) {
+            removeFirstSegment();
+        }
+
+        char path[HISTORY_PATH_SIZE];
+        segmentPath(firstSeq, path);
+        f = SPIFFS.open(path, "r");
+        if (f && f.seek(readOffset * sizeof(HistoryRecord), SeekSet) && f.size() >= (readOffset + 1) * sizeof(HistoryRecord)) {
+            break;
+        }
+        if (f) {
+            f.close();
+        }
+
+        if (firstSeq == lastSeq) {
+            // the backlog still counts records of segments that are gone
+            GLOG_WARN("HISTORY: %lu records lost\n", (unsigned long) backlog);
+            dropped += backlog;
+            backlog = 0;
+            return 0;
+        }
+        GLOG_WARN("HISTORY: cannot read %s, skipped\n", path);
+        removeFirstSegment();
+    }
+
+    size_t records = 0;
+    size_t len = 0;
+    uint32_t time = 0;
+    uint8_t flags = 0;
+    HistoryRecord r;
+    while (f.read((uint8_t *) &r, sizeof(r)) == sizeof(r)) {
+        r.name[HISTORY_NAME_SIZE - 1] = '\0';
+
+        if (records == 0) {
+            time = r.time;
+            flags = r.flags;
+            if (!(flags & HISTORY_RECORD_BOOT_MILLIS)) {
+                len = snprintf(payload, size, "{\"t\":%lu", (unsigned long) time);
+            } else if (WallClock::isSet() && isThisBoot(firstSeq, readOffset)) {
+                len = snprintf(payload, size, "{\"t\":%lu", (unsigned long) (WallClock::at(time) / 1000));
+            } else {
+                // the millis() of an earlier boot, or no clock yet
+                len = snprintf(payload, size, "{\"t_boot\":%lu", (unsigned long) (time / 1000));
+            }
+        } else if (r.time != time || r.flags != flags) {
+            break;
+        }
+
+        // room for the closing brace
+        int n = snprintf(payload + len, size - len, ",\"%s\":%.7g", r.name, r.value);
+        if (n < 0 || len + n + 2 > size) {
+            break;
+        }
+        len += n;
+        records++;
+    }
+    f.close();
+
+    if (records == 0) {
+        payload[0] = '\0';
+        return 0;
+    }
+
+    payload[len++] = '}';
+    payload[len] = '\0';
+    return records;
+}
+
+void HistoryBuffer::commitBatch(size_t records) {
+    if (records > backlog) {
+        records = backlog;
+    }
+
+    readOffset += records;
+    backlog -= records;
+    replayed += records;
+
+    if (readOffset >= segmentRecords(firstSeq)) {
+        if (firstSeq == lastSeq) {
+            // all replayed, the next sample starts a fresh segment
+            lastSeq++;
+            lastRecords = 0;
+        }
+        removeFirstSegment();
+    }
+}
+
+void HistoryBuffer::emitStats(InverterSink &sink) {
+    sink.emit("History/Records", backlog);
+    sink.emit("History/Capacity", (uint32_t) (HISTORY_SEGMENTS * HISTORY_SEGMENT_RECORDS));
+    sink.emit("History/Replayed", replayed);
+    sink.emit("History/Dropped", dropped);
+    sink.emit("History/WriteErrors", writeErrors);
+}
+
+bool HistoryBuffer::isThisBoot(uint32_t seq, uint32_t record) {
+    return seq > bootSeq || (seq == bootSeq && record >= bootRecords);
+}
+
+void HistoryBuffer::segmentPath(uint32_t seq, char *path) {
+    snprintf(path, HISTORY_PATH_SIZE, HISTORY_DIR "%lu", (unsigned long) seq);
+}
+
+uint32_t HistoryBuffer::segmentRecords(uint32_t seq) {
+    char path[HISTORY_PATH_SIZE];
+    segmentPath(seq, path);
+    File f = SPIFFS.open(path, "r");
+    if (!f) {
+        return 0;
+    }
+    uint32_t records = f.size() / sizeof(HistoryRecord);
+    f.close();
+    return records;
+}
+
+void HistoryBuffer::startSegment() {
+    lastSeq++;
+    lastRecords = 0;
+
+    // the ring is full, the oldest records go
+    while (lastSeq - firstSeq >= HISTORY_SEGMENTS) {
+        removeFirstSegment();
+    }
+}
+
+void HistoryBuffer::removeFirstSegment() {
+    uint32_t records = segmentRecords(firstSeq);
+    uint32_t pending = records > readOffset ? records - readOffset : 0;
+    if (pending > backlog) {
+        pending = backlog;
+    }
+    backlog -= pending;
+    dropped += pending;
+
+    char path[HISTORY_PATH_SIZE];
+    segmentPath(firstSeq, path);
+    SPIFFS.remove(path);
+
+    firstSeq++;
+    readOffset = 0;
+}
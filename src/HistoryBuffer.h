@@ -0,0 +1,110 @@
+/*
+  HistoryBuffer.h - Library header for the ESP8266/ESP32 Arduino platform
+  Keeps the energy and battery values polled while the broker is unreachable
+  and hands them back, oldest first, for replay once it is reachable again
+
+  Samples are fixed size records (time, value, field name) appended to a ring
+  of segment files in SPIFFS: /hist/<sequence>. A full ring drops its oldest
+  segment, so every write is an append and every erase is a whole file, which
+  spreads the wear over the flash. Replayed segments are removed; after a
+  reboot the oldest segment may be replayed again from its start
+
+  Until the clock is set a record keeps the millis() of its poll, the replay
+  turns it into the epoch time once the clock is set. A record from before a
+  reboot cannot be converted, it goes out as "t_boot", seconds from that boot
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef _HISTORY_BUFFER_H
+#define _HISTORY_BUFFER_H
+
+#include <Arduino.h>
+#include "GlobalDefs.h"
+#include "InverterSink.h"
+
+#define HISTORY_DIR "/hist/"
+#define HISTORY_PATH_SIZE 24
+
+// ring size, 2KB per segment file
+#ifdef LARGE_ESP_BOARD
+#define HISTORY_SEGMENTS 64
+#else
+#define HISTORY_SEGMENTS 4
+#endif
+#define HISTORY_SEGMENT_RECORDS 64
+
+// "247/BatteryCapacity" fits, a longer name is dropped and counted
+#define HISTORY_NAME_SIZE 23
+// history fields kept in RAM per poll, written with one append
+#define HISTORY_SAMPLE_RECORDS 16
+
+// one replay message: {"t":<time>,"<name>":<value>,...} for the records of one sample, "t_boot" instead of "t" without a wall clock time
+#define HISTORY_PAYLOAD_SIZE 512
+#define HISTORY_REPLAY_INTERVAL_MILLIS 250
+
+// time holds millis() instead of the epoch seconds
+#define HISTORY_RECORD_BOOT_MILLIS 0x01
+
+// 32 bytes
+struct HistoryRecord {
+    uint32_t time;
+    float value;
+    uint8_t flags;
+    char name[HISTORY_NAME_SIZE];
+};
+
+class HistoryBuffer : public InverterSink {
+    public:
+        HistoryBuffer();
+
+        // picks up the segments left from before a reboot, SPIFFS must be mounted
+        void begin();
+
+        // emitData() goes between these two, time is in epoch seconds or from boot until the clock is set
+        void beginSample(time_t time);
+        void endSample();
+
+        // records not replayed yet
+        uint32_t getBacklog();
+
+        // the next replay message, returns how many records it holds (0 when there is nothing to replay)
+        size_t nextBatch(char *payload, size_t size);
+        // the message from nextBatch() was published, those records are done
+        void commitBatch(size_t records);
+
+        // capacity and replay progress for the tele topic
+        void emitStats(InverterSink &sink);
+
+    protected:
+        // keeps the numeric history fields only
+        virtual void emitValue(const char *name, const char *value);
+
+    private:
+        HistoryRecord sample[HISTORY_SAMPLE_RECORDS];
+        uint8_t sampleRecords;
+        uint32_t sampleTime;
+        uint8_t sampleFlags;
+
+        uint32_t firstSeq;      // oldest segment, replay reads from here
+        uint32_t lastSeq;       // segment being appended to
+        uint32_t lastRecords;   // records in lastSeq
+        uint32_t readOffset;    // records of firstSeq already replayed
+        uint32_t bootSeq;       // the first record of this boot, older ones have a millis() of another boot
+        uint32_t bootRecords;
+
+        uint32_t backlog;
+        uint32_t replayed;
+        uint32_t dropped;
+        uint32_t writeErrors;
+
+        // written since begin(), its millis() can be converted
+        bool isThisBoot(uint32_t seq, uint32_t record);
+        void segmentPath(uint32_t seq, char *path);
+        uint32_t segmentRecords(uint32_t seq);
+        void startSegment();
+        void removeFirstSegment();
+};
+
+#endif
@@ -0,0 +1,134 @@
+/*
+  HttpPushOutput.cpp - Library for the ESP8266/ESP32 Arduino platform
+  Output stage that POSTs each poll as JSON to http://host[:port]/path
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include "HttpPushOutput.h"
+#include "GLog.h"
+
+HttpPushOutput::HttpPushOutput(WiFiClient &client) : JsonOutputStage("Http", OUTPUT_QUEUE_SIZE, ""), client(client) {
+    this->host[0] = '\0';
+    this->port = 80;
+    this->resolved = false;
+    strcpy(this->path, "/");
+    this->waitingReply = false;
+    this->sentAtMillis = 0;
+    this->statusLength = 0;
+    this->lastStatus = 0;
+    setInterval(HTTP_PUSH_INTERVAL_MILLIS);
+}
+
+bool HttpPushOutput::begin(const char *url) {
+    if (strncmp(url, "http://", 7) != 0) {
+        return false;
+    }
+
+    const char *p = url + 7;
+    size_t hostLength = strcspn(p, ":/");
+    if (hostLength == 0 || hostLength >= sizeof(host)) {
+        return false;
+    }
+    memcpy(host, p, hostLength);
+    host[hostLength] = '\0';
+    p += hostLength;
+
+    port = 80;
+    if (*p == ':') {
+        char *end;
+        long value = strtol(p + 1, &end, 10);
+        if (end == p + 1 || value <= 0 || value > 65535 || (*end != '\0' && *end != '/')) {
+            return false;
+        }
+        port = value;
+        p = end;
+    }
+
+    if (*p == '\0') {
+        strcpy(path, "/");
+    } else if (strlen(p) < sizeof(path)) {
+        strcpy(path, p);
+    } else {
+        return false;
+    }
+
+    resolved = address.fromString(host);
+    client.setTimeout(HTTP_PUSH_TIMEOUT_MILLIS);
+    return true;
+}
+
+int HttpPushOutput::getLastStatus() {
+    return lastStatus;
+}
+
+bool HttpPushOutput::isReady() {
+    return host[0] != '\0' && !waitingReply;
+}
+
+bool HttpPushOutput::send(const char *, const char *payload) {
+    // once, a lookup on every try would block the loop each time
+    if (!resolved) {
+        resolved = WiFi.hostByName(host, address, HTTP_PUSH_TIMEOUT_MILLIS) == 1;
+        if (!resolved) {
+            GLOG_WARN("HTTP: cannot resolve %s\n", host);
+            return false;
+        }
+    }
+    if (!client.connect(address, port)) {
+        return false;
+    }
+
+    char header[HTTP_PUSH_HOST_SIZE + HTTP_PUSH_PATH_SIZE + 128];
+    size_t bodyLength = strlen(payload);
+    size_t headerLength = snprintf(header, sizeof(header),
+        "POST %s HTTP/1.1\r\nHost: %s\r\nContent-Type: application/json\r\nContent-Length: %u\r\nConnection: close\r\n\r\n",
+        path, host, (unsigned) bodyLength);
+
+    // all of it goes in the send buffer or the request waits, write() would block
+    if ((size_t) client.availableForWrite() < headerLength + bodyLength
+        || client.write((const uint8_t *) header, headerLength) != headerLength
+        || client.write((const uint8_t *) payload, bodyLength) != bodyLength) {
+        client.stop();
+        return false;
+    }
+
+    waitingReply = true;
+    sentAtMillis = millis();
+    statusLength = 0;
+    return true;
+}
+
+void HttpPushOutput::loop() {
+    if (!waitingReply) {
+        return;
+    }
+
+    // "HTTP/1.1 200 OK", only the code matters
+    while (client.available() > 0 && statusLength < sizeof(statusLine) - 1) {
+        statusLine[statusLength++] = client.read();
+    }
+    statusLine[statusLength] = '\0';
+
+    if (statusLength >= 12 || (statusLength > 0 && strchr(statusLine, '\n') != NULL)) {
+        replyDone(strncmp(statusLine, "HTTP/", 5) == 0 && statusLength >= 12 ? atoi(statusLine + 9) : 0);
+    } else if (!client.connected() && client.available() == 0) {
+        replyDone(0);
+    } else if (millis() - sentAtMillis >= HTTP_PUSH_TIMEOUT_MILLIS) {
+        replyDone(0);
+    }
+}
+
+void HttpPushOutput::replyDone(int status) {
+    client.stop();
+    waitingReply = false;
+    lastStatus = status;
+
+    if (status < 200 || status >= 300) {
+        // counted as sent when the request went out
+        sent--;
+        failed++;
+        GLOG_WARN("HTTP: push to %s failed, status %d\n", host, status);
+    }
+}
@@ -0,0 +1,59 @@
+/*
+  HttpPushOutput.h - Library header for the ESP8266/ESP32 Arduino platform
+  Output stage that POSTs each poll as JSON to http://host[:port]/path
+
+  One request per connection (Connection: close) and one at a time: the body
+  is written in one go, then loop() reads the status line until the reply
+  comes or HTTP_PUSH_TIMEOUT_MILLIS passes, without blocking on it. The host
+  is resolved once and kept. A refused or timed out connection leaves the
+  message queued for the next try, after the pipeline backoff, a reply other
+  than 2xx is counted as failed (not sent) and the message is not sent again
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef _HTTP_PUSH_OUTPUT_H
+#define _HTTP_PUSH_OUTPUT_H
+
+#include <ESP8266WiFi.h>
+#include "OutputPipeline.h"
+
+#define HTTP_PUSH_HOST_SIZE 40
+#define HTTP_PUSH_PATH_SIZE 64
+// the DNS lookup and the TCP connect block up to this, and the reply is waited for as long
+#define HTTP_PUSH_TIMEOUT_MILLIS 1000
+// a poll every minute at most by default
+#define HTTP_PUSH_INTERVAL_MILLIS 60000
+
+class HttpPushOutput : public JsonOutputStage {
+    public:
+        HttpPushOutput(WiFiClient &client);
+
+        // false when the URL is not http://host[:port][/path]
+        bool begin(const char *url);
+        // status of the last reply, 0 before the first one or after a timeout
+        int getLastStatus();
+
+    protected:
+        virtual void loop();
+        virtual bool isReady();
+        virtual bool send(const char *key, const char *payload);
+
+    private:
+        WiFiClient &client;
+        char host[HTTP_PUSH_HOST_SIZE];
+        uint16_t port;
+        IPAddress address;
+        bool resolved;
+        char path[HTTP_PUSH_PATH_SIZE];
+        bool waitingReply;
+        unsigned long sentAtMillis;
+        char statusLine[16];
+        uint8_t statusLength;
+        int lastStatus;
+
+        void replyDone(int status);
+};
+
+#endif
@@ -0,0 +1,188 @@
+/*
+  InfluxUdpOutput.cpp - Library for the ESP8266/ESP32 Arduino platform
+  Output stage that sends each poll to InfluxDB as line protocol over UDP
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <cmath>
+#include "InfluxUdpOutput.h"
+#include "GLog.h"
+
+// " <seconds>000000000\n", nanoseconds
+#define TIMESTAMP_RESERVE 21
+
+// a backslash in front of each special character
+static size_t escape(char *out, size_t size, const char *in, const char *special) {
+    size_t n = 0;
+    for (const char *p = in; *p != '\0' && n + 2 < size; p++) {
+        if (strchr(special, *p) != NULL) {
+            out[n++] = '\\';
+        }
+        out[n++] = (uint8_t) *p < 0x20 ? ' ' : *p;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+InfluxUdpOutput::InfluxUdpOutput() : OutputStage("Influx", 0) {
+    this->host[0] = '\0';
+    this->port = INFLUX_DEFAULT_PORT;
+    this->resolved = false;
+    this->resolveFailedAtMillis = 0;
+    this->resolveRetryMillis = 0;
+    this->tags[0] = '\0';
+    this->length = 0;
+    this->lineAddr[0] = '\0';
+    this->lineOpen = false;
+    this->time = 0;
+}
+
+bool InfluxUdpOutput::begin(const char *server, const char *device) {
+    size_t hostLength = strcspn(server, ":");
+    if (hostLength == 0 || hostLength >= sizeof(host)) {
+        return false;
+    }
+    memcpy(host, server, hostLength);
+    host[hostLength] = '\0';
+
+    port = INFLUX_DEFAULT_PORT;
+    if (server[hostLength] == ':') {
+        char *end;
+        long value = strtol(server + hostLength + 1, &end, 10);
+        if (*end != '\0' || value <= 0 || value > 65535) {
+            return false;
+        }
+        port = value;
+    }
+    resolved = address.fromString(host);
+    resolveRetryMillis = 0;
+
+    tags[0] = '\0';
+    if (device[0] != '\0') {
+        strcpy(tags, ",device=");
+        escape(tags + 8, sizeof(tags) - 8, device, ",= ");
+    }
+    return true;
+}
+
+void InfluxUdpOutput::beginPoll(time_t time) {
+    this->time = time;
+    length = 0;
+    lineOpen = false;
+}
+
+void InfluxUdpOutput::addValue(const char *name, const char *value) {
+    // "nan" from a failed read is not a number to line protocol, and no string either
+    char *end;
+    if (!std::isfinite(strtod(value, &end)) && end != value && *end == '\0') {
+        return;
+    }
+
+    // "2/Pac" is Pac of the inverter at address 2
+    char addr[sizeof(lineAddr)] = "";
+    const char *field = name;
+    const char *p = name;
+    while (*p >= '0' && *p <= '9') p++;
+    if (p != name && *p == '/' && (size_t) (p - name) < sizeof(addr)) {
+        memcpy(addr, name, p - name);
+        addr[p - name] = '\0';
+        field = p + 1;
+    }
+
+    // key=value, strings quoted
+    char item[2 * INVERTER_SINK_NAME_SIZE + 2 * INVERTER_SINK_VALUE_SIZE + 4];
+    size_t n = escape(item, 2 * INVERTER_SINK_NAME_SIZE, field, ",= ");
+    item[n++] = '=';
+    if (isNumber(value)) {
+        n += snprintf(item + n, sizeof(item) - n, "%s", value);
+    } else {
+        item[n++] = '"';
+        n += escape(item + n, sizeof(item) - n - 1, value, "\"\\");
+        item[n++] = '"';
+    }
+
+    if (lineOpen && strcmp(lineAddr, addr) != 0) {
+        endLine();
+    }
+
+    char header[INFLUX_TAGS_SIZE + 32];
+    size_t headerLength = snprintf(header, sizeof(header), INFLUX_MEASUREMENT "%s%s%s ", tags, addr[0] != '\0' ? ",addr=" : "", addr);
+    for (;;) {
+        size_t needed = (lineOpen ? 1 : headerLength) + n + TIMESTAMP_RESERVE;
+        if (length + needed <= INFLUX_DATAGRAM_SIZE) {
+            break;
+        }
+        if (length == 0) {
+            // not even in an empty datagram
+            failed++;
+            return;
+        }
+        // whole lines only, the rest of the poll goes in the next datagram
+        if (lineOpen) {
+            endLine();
+        }
+        sendDatagram();
+    }
+
+    if (lineOpen) {
+        datagram[length++] = ',';
+    } else {
+        memcpy(datagram + length, header, headerLength);
+        length += headerLength;
+        strcpy(lineAddr, addr);
+        lineOpen = true;
+    }
+    memcpy(datagram + length, item, n);
+    length += n;
+}
+
+void InfluxUdpOutput::endLine() {
+    if (time >= WALLCLOCK_MIN_VALID_TIME) {
+        length += snprintf(datagram + length, INFLUX_DATAGRAM_SIZE - length, " %lu000000000", (unsigned long) time);
+    }
+    datagram[length++] = '\n';
+    lineOpen = false;
+}
+
+void InfluxUdpOutput::endPoll() {
+    if (lineOpen) {
+        endLine();
+    }
+    sendDatagram();
+}
+
+bool InfluxUdpOutput::resolve() {
+    if (resolved) {
+        return true;
+    }
+    // the lookup blocks, not on every poll while the name does not resolve
+    if (resolveRetryMillis > 0 && millis() - resolveFailedAtMillis < resolveRetryMillis) {
+        return false;
+    }
+
+    resolved = WiFi.hostByName(host, address, INFLUX_DNS_TIMEOUT_MILLIS) == 1;
+    if (!resolved) {
+        resolveFailedAtMillis = millis();
+        resolveRetryMillis = resolveRetryMillis == 0 ? INFLUX_DNS_RETRY_MILLIS : resolveRetryMillis * 2;
+        if (resolveRetryMillis > INFLUX_DNS_RETRY_MAX_MILLIS) {
+            resolveRetryMillis = INFLUX_DNS_RETRY_MAX_MILLIS;
+        }
+        GLOG_WARN("INFLUX: cannot resolve %s, next try in %lu s\n", host, resolveRetryMillis / 1000);
+    }
+    return resolved;
+}
+
+void InfluxUdpOutput::sendDatagram() {
+    if (length == 0) {
+        return;
+    }
+
+    if (resolve() && udp.beginPacket(address, port) == 1 && udp.write((const uint8_t *) datagram, length) == length && udp.endPacket() == 1) {
+        sent++;
+    } else {
+        failed++;
+    }
+    length = 0;
+}
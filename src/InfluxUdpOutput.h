@@ -0,0 +1,75 @@
+/*
+  InfluxUdpOutput.h - Library header for the ESP8266/ESP32 Arduino platform
+  Output stage that sends each poll to InfluxDB as line protocol over UDP
+
+  Fire and forget: a poll is one datagram of at most INFLUX_DATAGRAM_SIZE,
+  built in place in a fixed buffer, with one line per inverter,
+
+    inverter,device=garage,addr=2 Pac=1234.5,Status="Normal" 1700000000000000000
+
+  The addr tag comes from the "<addr>/" prefix of the fields on a shared
+  Growatt bus, a poll that does not fit goes out in more datagrams, each with
+  whole lines. The timestamp is the poll time, left out while the clock is
+  not set so the server stamps the lines itself. NaN and infinite values are
+  left out, line protocol has no number for them. A host that does not
+  resolve is looked up again after INFLUX_DNS_RETRY_MILLIS, twice as long
+  after each failure, the polls in between are counted as failed
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef _INFLUX_UDP_OUTPUT_H
+#define _INFLUX_UDP_OUTPUT_H
+
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include "OutputPipeline.h"
+#include "WallClock.h"
+
+// 1500 byte MTU less the IP and UDP headers, a datagram is never fragmented
+#define INFLUX_DATAGRAM_SIZE 1472
+#define INFLUX_MEASUREMENT "inverter"
+#define INFLUX_DEFAULT_PORT 8089
+#define INFLUX_HOST_SIZE 40
+// ",device=<escaped device name>"
+#define INFLUX_TAGS_SIZE 72
+#define INFLUX_DNS_TIMEOUT_MILLIS 2000
+#define INFLUX_DNS_RETRY_MILLIS 30000
+#define INFLUX_DNS_RETRY_MAX_MILLIS 600000
+
+class InfluxUdpOutput : public OutputStage {
+    public:
+        InfluxUdpOutput();
+
+        // host or host:port, false when it does not parse
+        bool begin(const char *server, const char *device);
+
+    protected:
+        virtual void beginPoll(time_t time);
+        virtual void addValue(const char *name, const char *value);
+        virtual void endPoll();
+
+    private:
+        WiFiUDP udp;
+        char host[INFLUX_HOST_SIZE];
+        uint16_t port;
+        IPAddress address;
+        bool resolved;
+        unsigned long resolveFailedAtMillis;
+        unsigned long resolveRetryMillis;   // 0 until a lookup fails
+        char tags[INFLUX_TAGS_SIZE];
+
+        char datagram[INFLUX_DATAGRAM_SIZE];
+        size_t length;
+        // the inverter of the open line, "" for a single one
+        char lineAddr[4];
+        bool lineOpen;
+        time_t time;
+
+        void endLine();
+        bool resolve();
+        void sendDatagram();
+};
+
+#endif
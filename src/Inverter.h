@@ -12,6 +12,7 @@
 #include <Arduino.h>
 #include <list>
 #include "InverterData.h"
+#include "TopicDispatcher.h"
 
 class Inverter
 {
@@ -22,9 +23,30 @@ class Inverter
         virtual bool isDataValid() = 0;
     
         virtual InverterData getData(bool fullSet = false) = 0;
+        // the same values as getData(), handed to the sink one by one without collecting them first
+        virtual void emitData(InverterSink &sink, bool fullSet = false) {
+            getData(fullSet).emitTo(sink);
+        }
+        
+        // reads only the power registers and emits those, often, for the energy integration
+        // false when the bus did not answer, drivers without it feed the integration from read()
+        virtual bool hasPowerSampling() { return false; }
+        virtual bool samplePower(InverterSink &) { return false; }
+
+        // bus counters for the tele data, drivers without them emit nothing
+        virtual void emitStats(InverterSink &) {}
+
+        // the values of each Modbus block or frame, handed over as soon as it is decoded
+        // false when the driver only has the values of a whole poll
+        virtual bool setLiveSink(InverterSink *) { return false; }
         
         virtual void setIncomingTopicData(const String &topic, const String &value) = 0;
         virtual std::list<String> getTopicsToSubscribe() = 0;
+        
+        // adds the command subtopics to the MQTT dispatch table, prefix is "<addr>/" for inverters on a shared bus
+        virtual void registerCommands(TopicDispatcher &, const char *) {}
+        // a command registered above, the value is already truncated and trimmed
+        virtual void handleCommand(uint8_t, const char *) {}
 };
 
 #endif
\ No newline at end of file
@@ -22,12 +22,12 @@ void InverterData::set(const char *name, float value) {
 }
 
 void InverterData::set(const char *name, uint32_t value) {
-    snprintf (msg, MSG_BUFFER_SIZE, "%ld", value);
+    snprintf (msg, MSG_BUFFER_SIZE, "%lu", (unsigned long) value);
     (*this)[String(name)] = String(msg);
 }
 
 void InverterData::set(const char *name, int32_t value) {
-    snprintf (msg, MSG_BUFFER_SIZE, "%ld", value);
+    snprintf (msg, MSG_BUFFER_SIZE, "%ld", (long) value);
     (*this)[String(name)] = String(msg);
 }
 
@@ -55,3 +55,13 @@ void InverterData::set(const char *name, const char * value) {
 void InverterData::set(const char *name, const String value) {
     (*this)[String(name)] = value;
 }
+
+void InverterData::emitValue(const char *name, const char *value) {
+    set(name, value);
+}
+
+void InverterData::emitTo(InverterSink &sink) const {
+    for (const auto &entry : *this) {
+        sink.emit(entry.first.c_str(), entry.second.c_str());
+    }
+}
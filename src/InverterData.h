@@ -11,12 +11,16 @@
 
 #include <Arduino.h>
 #include <map>
+#include "InverterSink.h"
 
 #define MSG_BUFFER_SIZE  (255)
 
-class InverterData : public std::map<String, String> {   
+class InverterData : public std::map<String, String>, public InverterSink {   
     private:
         char msg[MSG_BUFFER_SIZE];
+
+    protected:
+        virtual void emitValue(const char *name, const char *value);
         
     public:
         InverterData();
@@ -37,6 +41,9 @@ class InverterData : public std::map<String, String> {
         void set(const char *name, const char * value);
         
         void set(const char *name, const String value);
+
+        // replays every value into another sink, for code that still collects first
+        void emitTo(InverterSink &sink) const;
 };
 
 #endif
\ No newline at end of file
@@ -104,7 +104,7 @@ static MicInverter *createMicInverter(int modbusAddress, bool isTL) {
 
 // static method, caller is responsible for deleting the provided instance when no longer needed
 Inverter *InverterFactory::createInverter(String type, const InverterParams params) {
-    GLOG::println(String(F("FACT: inverter type ")) + type);
+    GLOG_INFO("FACT: inverter type %s\n", type.c_str());
     
     if (type == "sph") {
         // remote control and single phase
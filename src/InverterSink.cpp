@@ -0,0 +1,98 @@
+/*
+  InverterSink.cpp - Library for the ESP8266/ESP32 Arduino platform
+  Receiver for inverter values as the driver produces them
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <cmath>
+#include "InverterSink.h"
+
+void InverterSink::emit(const char *name, float value) {
+    char msg[INVERTER_SINK_VALUE_SIZE];
+    snprintf (msg, INVERTER_SINK_VALUE_SIZE, "%.1f", value);
+    emitValue(name, msg);
+}
+
+void InverterSink::emit(const char *name, uint32_t value) {
+    char msg[INVERTER_SINK_VALUE_SIZE];
+    snprintf (msg, INVERTER_SINK_VALUE_SIZE, "%lu", (unsigned long) value);
+    emitValue(name, msg);
+}
+
+void InverterSink::emit(const char *name, int32_t value) {
+    char msg[INVERTER_SINK_VALUE_SIZE];
+    snprintf (msg, INVERTER_SINK_VALUE_SIZE, "%ld", (long) value);
+    emitValue(name, msg);
+}
+
+void InverterSink::emit(const char *name, uint16_t value) {
+    char msg[INVERTER_SINK_VALUE_SIZE];
+    snprintf (msg, INVERTER_SINK_VALUE_SIZE, "%d", value);
+    emitValue(name, msg);
+}
+
+void InverterSink::emit(const char *name, int16_t value) {
+    char msg[INVERTER_SINK_VALUE_SIZE];
+    snprintf (msg, INVERTER_SINK_VALUE_SIZE, "%d", value);
+    emitValue(name, msg);
+}
+
+void InverterSink::emit(const char *name, uint8_t value) {
+    char msg[INVERTER_SINK_VALUE_SIZE];
+    snprintf (msg, INVERTER_SINK_VALUE_SIZE, "%d", value);
+    emitValue(name, msg);
+}
+
+void InverterSink::emit(const char *name, const char *value) {
+    emitValue(name, value);
+}
+
+bool isNumber(const char *value) {
+    if (value[0] == '\0' || strspn(value, "0123456789.-+eE") != strlen(value)) {
+        return false;
+    }
+    char *end;
+    double d = strtod(value, &end);
+    return *end == '\0' && std::isfinite(d);
+}
+
+bool fieldNumber(const char *name, const char *value, const char *const *fields, size_t count, float &number) {
+    const char *field = strrchr(name, '/');
+    field = field != NULL ? field + 1 : name;
+
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(field, fields[i]) == 0) {
+            if (!isNumber(value)) {
+                return false;
+            }
+            number = strtof(value, NULL);
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t formatJsonField(const char *name, const char *value, char *out, size_t size) {
+    size_t n = snprintf(out, size, "\"%s\":", name);
+    if (n + 3 > size) {
+        return 0;
+    }
+
+    if (isNumber(value)) {
+        n += snprintf(out + n, size - n, "%s", value);
+        return n < size ? n : 0;
+    }
+
+    out[n++] = '"';
+    for (const char *p = value; *p != '\0' && n + 3 < size; p++) {
+        if (*p == '"' || *p == '\\') {
+            out[n++] = '\\';
+        }
+        out[n++] = (uint8_t) *p < 0x20 ? ' ' : *p;
+    }
+    out[n++] = '"';
+    out[n] = '\0';
+    return n;
+}
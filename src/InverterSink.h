@@ -0,0 +1,79 @@
+/*
+  InverterSink.h - Library header for the ESP8266/ESP32 Arduino platform
+  Receiver for inverter values as the driver produces them
+
+  Drivers call emit(name, value) once per field, the sink decides what to do
+  with it: publish it (MqttPublisher), prefix it (MultiGrowattInverter) or keep
+  it (InverterData). Names are the literal field ids ("Ppv1", "Etoday", ...) and
+  numbers are formatted like InverterData::set() so every sink sees the same text
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef _INVERTER_SINK_H
+#define _INVERTER_SINK_H
+
+#include <Arduino.h>
+
+// longest field name after a prefix, "22/settings/priority/bat/ac/result"
+#define INVERTER_SINK_NAME_SIZE  (64)
+// longest formatted number, floats are "%.1f"
+#define INVERTER_SINK_VALUE_SIZE (48)
+
+class InverterSink {
+    protected:
+        // the only method a sink has to implement, name and value are only valid during the call
+        virtual void emitValue(const char *name, const char *value) = 0;
+
+    public:
+        virtual ~InverterSink() {}
+
+        void emit(const char *name, float value);
+
+        void emit(const char *name, uint32_t value);
+
+        void emit(const char *name, int32_t value);
+
+        void emit(const char *name, uint16_t value);
+
+        void emit(const char *name, int16_t value);
+
+        void emit(const char *name, uint8_t value);
+
+        void emit(const char *name, const char *value);
+};
+
+// a value the sinks formatted from a number, not "nan" or a text
+bool isNumber(const char *value);
+
+// the number of a value whose field, after any "<addr>/" prefix, is in the list;
+// false for another field or a value that is not a number
+bool fieldNumber(const char *name, const char *value, const char *const *fields, size_t count, float &number);
+
+template <size_t N>
+bool fieldNumber(const char *name, const char *value, const char *const (&fields)[N], float &number) {
+    return fieldNumber(name, value, fields, N, number);
+}
+
+// "name":value into out, numbers as they are and anything else as an escaped string,
+// the length written or 0 if it does not fit
+size_t formatJsonField(const char *name, const char *value, char *out, size_t size);
+
+// hands every value to two sinks, for drivers whose emitData() can only run once per read()
+class TeeSink : public InverterSink {
+    private:
+        InverterSink &first;
+        InverterSink &second;
+
+    protected:
+        virtual void emitValue(const char *name, const char *value) {
+            first.emit(name, value);
+            second.emit(name, value);
+        }
+
+    public:
+        TeeSink(InverterSink &first, InverterSink &second) : first(first), second(second) {}
+};
+
+#endif
@@ -0,0 +1,438 @@
+/*
+  LiveServer.cpp - Library for the ESP8266/ESP32 Arduino platform
+  WebSocket stream of the inverter values, ws://<ip>:81/, for dashboards
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <Hash.h>
+#include "LiveServer.h"
+#include "GLog.h"
+
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+#define WS_OPCODE_TEXT  0x1
+#define WS_OPCODE_CLOSE 0x8
+#define WS_OPCODE_PING  0x9
+#define WS_OPCODE_PONG  0xa
+#define WS_FIN          0x80
+#define WS_MASKED       0x80
+
+// room for the frame header in front of the JSON, 2 or 4 bytes
+#define FRAME_HEADER_SIZE 4
+
+static const char BASE64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+LiveServer::LiveServer(uint16_t port) : server(port) {
+    started = false;
+    fieldCount = 0;
+    changes = false;
+    frames = 0;
+    dropped = 0;
+    stalled = 0;
+    rejected = 0;
+    for (LiveClient &c : clients) {
+        c.client = NULL;
+        c.queue = NULL;
+    }
+}
+
+LiveServer::~LiveServer() {
+    for (LiveClient &c : clients) {
+        if (c.client != NULL) {
+            close(c);
+        }
+    }
+    server.stop();
+}
+
+void LiveServer::begin() {
+    server.begin();
+    server.setNoDelay(true);
+    started = true;
+}
+
+void LiveServer::acceptKey(const char *key, char accept[29]) {
+    char text[64];
+    snprintf(text, sizeof(text), "%.24s" WS_GUID, key);
+    uint8_t hash[21];
+    sha1((const uint8_t *) text, strlen(text), hash);
+    hash[20] = 0;
+
+    // 20 bytes, the last group has one padding character
+    for (int i = 0, o = 0; i < 21; i += 3, o += 4) {
+        uint32_t v = (uint32_t) hash[i] << 16 | (uint32_t) hash[i + 1] << 8 | hash[i + 2];
+        accept[o] = BASE64[(v >> 18) & 0x3f];
+        accept[o + 1] = BASE64[(v >> 12) & 0x3f];
+        accept[o + 2] = BASE64[(v >> 6) & 0x3f];
+        accept[o + 3] = BASE64[v & 0x3f];
+    }
+    accept[27] = '=';
+    accept[28] = '\0';
+}
+
+bool LiveServer::addClient(WiFiClient *client) {
+    for (LiveClient &c : clients) {
+        if (c.client != NULL) {
+            continue;
+        }
+        c.client = client;
+        c.open = false;
+        c.sinceMillis = millis();
+        c.inputLength = 0;
+        c.hasKey = false;
+        c.queue = new uint8_t[LIVE_CLIENT_QUEUE_SIZE];
+        c.head = 0;
+        c.count = 0;
+        c.resync = false;
+        c.resyncField = 0;
+        client->setNoDelay(true);
+        return true;
+    }
+
+    static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";
+    client->write((const uint8_t *) busy, sizeof(busy) - 1);
+    client->stop();
+    delete client;
+    rejected++;
+    GLOG_WARN("LIVE: all %d clients taken\n", LIVE_MAX_CLIENTS);
+    return false;
+}
+
+void LiveServer::close(LiveClient &c) {
+    c.client->stop();
+    delete c.client;
+    delete[] c.queue;
+    c.client = NULL;
+    c.queue = NULL;
+}
+
+uint8_t LiveServer::getClients() {
+    uint8_t n = 0;
+    for (LiveClient &c : clients) {
+        if (c.client != NULL && c.open) {
+            n++;
+        }
+    }
+    return n;
+}
+
+void LiveServer::emitStats(InverterSink &sink) {
+    sink.emit("Live/Clients", getClients());
+    sink.emit("Live/Frames", frames);
+    sink.emit("Live/Dropped", dropped);
+    sink.emit("Live/Stalled", stalled);
+    sink.emit("Live/Rejected", rejected);
+}
+
+void LiveServer::emitValue(const char *name, const char *value) {
+    if (strlen(name) >= LIVE_NAME_SIZE) {
+        return;
+    }
+
+    LiveField *field = NULL;
+    for (uint8_t i = 0; i < fieldCount; i++) {
+        if (strcmp(fields[i].name, name) == 0) {
+            field = &fields[i];
+            break;
+        }
+    }
+    if (field == NULL) {
+        if (fieldCount == LIVE_MAX_FIELDS) {
+            return;
+        }
+        field = &fields[fieldCount++];
+        strcpy(field->name, name);
+        field->value[0] = '\0';
+        field->changed = true;
+    }
+
+    char v[LIVE_VALUE_SIZE];
+    strncpy(v, value, sizeof(v) - 1);
+    v[sizeof(v) - 1] = '\0';
+    if (strcmp(field->value, v) != 0) {
+        strcpy(field->value, v);
+        field->changed = true;
+    }
+    changes |= field->changed;
+}
+
+size_t LiveServer::buildFrame(uint8_t *frame, uint8_t &from, bool changedOnly) {
+    char *json = (char *) frame + FRAME_HEADER_SIZE;
+    size_t n = 0;
+    json[n++] = '{';
+
+    for (; from < fieldCount; from++) {
+        if (changedOnly && !fields[from].changed) {
+            continue;
+        }
+        // escaped: every character of the value may double
+        char item[LIVE_NAME_SIZE + 2 * LIVE_VALUE_SIZE + 8];
+        size_t length = formatJsonField(fields[from].name, fields[from].value, item, sizeof(item));
+        if (length == 0) {
+            continue;
+        }
+        // a comma in front and the closing brace
+        if (n + length + 2 > LIVE_FRAME_SIZE) {
+            break;
+        }
+        if (n > 1) {
+            json[n++] = ',';
+        }
+        memcpy(json + n, item, length);
+        n += length;
+    }
+    if (n == 1) {
+        return 0;
+    }
+    json[n++] = '}';
+
+    // unmasked text frame, the length in the header byte or in 2 more
+    if (n < 126) {
+        frame[2] = WS_FIN | WS_OPCODE_TEXT;
+        frame[3] = n;
+        memmove(frame, frame + 2, n + 2);
+        return n + 2;
+    }
+    frame[0] = WS_FIN | WS_OPCODE_TEXT;
+    frame[1] = 126;
+    frame[2] = n >> 8;
+    frame[3] = n & 0xff;
+    return n + 4;
+}
+
+bool LiveServer::push(LiveClient &c, const uint8_t *data, size_t length) {
+    if (c.count + length > LIVE_CLIENT_QUEUE_SIZE) {
+        return false;
+    }
+    size_t tail = (c.head + c.count) % LIVE_CLIENT_QUEUE_SIZE;
+    size_t first = LIVE_CLIENT_QUEUE_SIZE - tail < length ? LIVE_CLIENT_QUEUE_SIZE - tail : length;
+    memcpy(c.queue + tail, data, first);
+    memcpy(c.queue, data + first, length - first);
+    c.count += length;
+    return true;
+}
+
+void LiveServer::sendChanges() {
+    if (!changes) {
+        return;
+    }
+
+    uint8_t frame[FRAME_HEADER_SIZE + LIVE_FRAME_SIZE];
+    uint8_t from = 0;
+    size_t length;
+    while ((length = buildFrame(frame, from, true)) > 0) {
+        for (LiveClient &c : clients) {
+            if (c.client == NULL || !c.open) {
+                continue;
+            }
+            // no room: the client gets everything again when there is
+            if (!push(c, frame, length)) {
+                dropped++;
+                c.resync = true;
+                c.resyncField = 0;
+            }
+        }
+        frames++;
+    }
+
+    for (uint8_t i = 0; i < fieldCount; i++) {
+        fields[i].changed = false;
+    }
+    changes = false;
+}
+
+void LiveServer::resync(LiveClient &c) {
+    uint8_t frame[FRAME_HEADER_SIZE + LIVE_FRAME_SIZE];
+    while (c.resync) {
+        uint8_t from = c.resyncField;
+        size_t length = buildFrame(frame, from, false);
+        if (length == 0) {
+            c.resync = false;
+            break;
+        }
+        if (!push(c, frame, length)) {
+            break;
+        }
+        c.resyncField = from;
+    }
+}
+
+void LiveServer::readHandshake(LiveClient &c) {
+    while (c.client->available() > 0) {
+        int b = c.client->read();
+        if (b < 0) {
+            break;
+        }
+        if (b != '\n') {
+            // long lines are cut, they are not the key
+            if (c.inputLength < LIVE_INPUT_SIZE - 1) {
+                c.input[c.inputLength++] = b;
+            }
+            continue;
+        }
+
+        if (c.inputLength > 0 && c.input[c.inputLength - 1] == '\r') {
+            c.inputLength--;
+        }
+        c.input[c.inputLength] = '\0';
+        const char *line = (const char *) c.input;
+
+        if (c.inputLength > 0) {
+            if (strncasecmp(line, "Sec-WebSocket-Key:", 18) == 0) {
+                const char *key = line + 18;
+                while (*key == ' ') key++;
+                acceptKey(key, c.accept);
+                c.hasKey = true;
+            }
+            c.inputLength = 0;
+            continue;
+        }
+
+        // end of the request
+        c.inputLength = 0;
+        if (!c.hasKey) {
+            static const char bad[] = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+            c.client->write((const uint8_t *) bad, sizeof(bad) - 1);
+            close(c);
+            return;
+        }
+
+        char reply[160];
+        size_t n = snprintf(reply, sizeof(reply), "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n", c.accept);
+        push(c, (const uint8_t *) reply, n);
+        c.open = true;
+        c.resync = true;
+        c.resyncField = 0;
+        GLOG_INFO("LIVE: client connected\n");
+        return;
+    }
+
+    if (millis() - c.sinceMillis > LIVE_HANDSHAKE_MILLIS) {
+        close(c);
+    }
+}
+
+void LiveServer::readFrames(LiveClient &c) {
+    // the client only sends control frames, masked, with up to 125 bytes
+    for (;;) {
+        size_t need = 2;
+        if (c.inputLength >= 2) {
+            uint8_t length = c.input[1] & 0x7f;
+            if (length > 125 || (c.input[1] & WS_MASKED) == 0) {
+                close(c);
+                return;
+            }
+            need = 2 + 4 + length;
+        }
+
+        if (c.inputLength < need) {
+            int available = c.client->available();
+            if (available <= 0) {
+                return;
+            }
+            size_t want = need - c.inputLength;
+            int got = c.client->read(c.input + c.inputLength, (size_t) available < want ? available : want);
+            if (got <= 0) {
+                return;
+            }
+            c.inputLength += got;
+            continue;
+        }
+
+        uint8_t opcode = c.input[0] & 0x0f;
+        uint8_t length = c.input[1] & 0x7f;
+        uint8_t *mask = c.input + 2;
+        uint8_t *payload = c.input + 6;
+        for (uint8_t i = 0; i < length; i++) {
+            payload[i] ^= mask[i % 4];
+        }
+        c.inputLength = 0;
+
+        if (opcode == WS_OPCODE_CLOSE) {
+            const uint8_t reply[] = { WS_FIN | WS_OPCODE_CLOSE, 0 };
+            c.client->write(reply, sizeof(reply));
+            close(c);
+            GLOG_INFO("LIVE: client closed\n");
+            return;
+        }
+        if (opcode == WS_OPCODE_PING) {
+            // in the queue after the frames already there, dropped like them when it is full
+            uint8_t pong[2 + 125];
+            pong[0] = WS_FIN | WS_OPCODE_PONG;
+            pong[1] = length;
+            memcpy(pong + 2, payload, length);
+            push(c, pong, 2 + length);
+        }
+        // text, binary and pong frames are ignored
+    }
+}
+
+void LiveServer::writeQueue(LiveClient &c) {
+    unsigned long now = millis();
+    if (c.count == 0) {
+        c.sinceMillis = now;
+        return;
+    }
+
+    // never block: only what fits in the socket buffer
+    size_t budget = LIVE_MAX_BYTES_PER_LOOP;
+    while (c.count > 0 && budget > 0) {
+        int space = c.client->availableForWrite();
+        if (space <= 0) {
+            break;
+        }
+        size_t n = c.count;
+        if (n > (size_t) (LIVE_CLIENT_QUEUE_SIZE - c.head)) n = LIVE_CLIENT_QUEUE_SIZE - c.head;
+        if (n > (size_t) space) n = space;
+        if (n > budget) n = budget;
+
+        size_t written = c.client->write(c.queue + c.head, n);
+        if (written == 0) {
+            break;
+        }
+        c.head = (c.head + written) % LIVE_CLIENT_QUEUE_SIZE;
+        c.count -= written;
+        budget -= written;
+        c.sinceMillis = now;
+    }
+
+    if (c.count > 0 && now - c.sinceMillis > LIVE_STALL_MILLIS) {
+        GLOG_WARN("LIVE: client stalled, closing\n");
+        stalled++;
+        close(c);
+    }
+}
+
+void LiveServer::loop() {
+    if (started && server.hasClient()) {
+        addClient(new WiFiClient(server.available()));
+    }
+
+    sendChanges();
+
+    for (LiveClient &c : clients) {
+        if (c.client == NULL) {
+            continue;
+        }
+        if (!c.client->connected()) {
+            close(c);
+            continue;
+        }
+
+        if (c.open) {
+            readFrames(c);
+        } else {
+            readHandshake(c);
+        }
+        if (c.client == NULL) {
+            continue;
+        }
+
+        if (c.open) {
+            resync(c);
+            writeQueue(c);
+        }
+    }
+}
@@ -0,0 +1,123 @@
+/*
+  LiveServer.h - Library header for the ESP8266/ESP32 Arduino platform
+  WebSocket stream of the inverter values, ws://<ip>:81/, for dashboards
+
+  The drivers hand over each Modbus block or display frame as soon as it is
+  decoded. The server keeps the last value of every field and, on the next
+  loop(), sends the ones that changed as one text frame:
+  {"Pac":1234.5,"Status":"Normal"}. A new client first gets all of them.
+
+  Each client has its own bounded send queue, written only as far as its TCP
+  send buffer allows, so a slow browser never holds up the poller. A frame
+  that does not fit is dropped and the client gets all the values again once
+  its queue is empty. A client that takes nothing for LIVE_STALL_MILLIS is
+  closed
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef _LIVE_SERVER_H
+#define _LIVE_SERVER_H
+
+#include <ESP8266WiFi.h>
+#include "GlobalDefs.h"
+#include "InverterSink.h"
+
+#define LIVE_SERVER_PORT 81
+
+#ifdef LARGE_ESP_BOARD
+#define LIVE_MAX_CLIENTS 3
+#define LIVE_MAX_FIELDS 64
+#else
+#define LIVE_MAX_CLIENTS 1
+#define LIVE_MAX_FIELDS 32
+#endif
+
+// per client, taken when it connects
+#ifndef LIVE_CLIENT_QUEUE_SIZE
+#define LIVE_CLIENT_QUEUE_SIZE 1024
+#endif
+
+// "22/EpsLoadPercent" fits, longer names are not streamed
+#define LIVE_NAME_SIZE 20
+// longer text values are cut
+#define LIVE_VALUE_SIZE 32
+// JSON of one frame
+#define LIVE_FRAME_SIZE 512
+// a header line of the handshake, or a control frame from the client
+#define LIVE_INPUT_SIZE 132
+
+#define LIVE_HANDSHAKE_MILLIS 2000
+#define LIVE_STALL_MILLIS 10000
+// max bytes sent per client and loop() call
+#define LIVE_MAX_BYTES_PER_LOOP 512
+
+struct LiveField {
+    char name[LIVE_NAME_SIZE];
+    char value[LIVE_VALUE_SIZE];
+    bool changed;
+};
+
+struct LiveClient {
+    WiFiClient *client;         // NULL for a free slot
+    bool open;                  // past the handshake
+    unsigned long sinceMillis;  // connect, then the last write that went out
+    uint8_t input[LIVE_INPUT_SIZE];
+    uint8_t inputLength;
+    bool hasKey;
+    char accept[29];            // Sec-WebSocket-Accept of the reply
+    uint8_t *queue;
+    uint16_t head;
+    uint16_t count;
+    // all the values again, from this field on, while resync is set
+    bool resync;
+    uint8_t resyncField;
+};
+
+class LiveServer : public InverterSink {
+    public:
+        LiveServer(uint16_t port = LIVE_SERVER_PORT);
+        ~LiveServer();
+
+        void begin();
+        // accepts clients, sends the changes and services the queues
+        void loop();
+
+        // a connected client, the server owns it from now on; false when all the slots are taken
+        bool addClient(WiFiClient *client);
+
+        uint8_t getClients();
+        void emitStats(InverterSink &sink);
+
+        // Sec-WebSocket-Accept for a Sec-WebSocket-Key
+        static void acceptKey(const char *key, char accept[29]);
+
+    protected:
+        // keeps the value, sent on the next loop() if it changed
+        virtual void emitValue(const char *name, const char *value);
+
+    private:
+        WiFiServer server;
+        bool started;
+        LiveField fields[LIVE_MAX_FIELDS];
+        uint8_t fieldCount;
+        bool changes;
+        LiveClient clients[LIVE_MAX_CLIENTS];
+
+        uint32_t frames;
+        uint32_t dropped;
+        uint32_t stalled;
+        uint32_t rejected;
+
+        size_t buildFrame(uint8_t *frame, uint8_t &from, bool changedOnly);
+        bool push(LiveClient &c, const uint8_t *data, size_t length);
+        void sendChanges();
+        void resync(LiveClient &c);
+        void readHandshake(LiveClient &c);
+        void readFrames(LiveClient &c);
+        void writeQueue(LiveClient &c);
+        void close(LiveClient &c);
+};
+
+#endif
@@ -0,0 +1,60 @@
+/*
+  LogServer.cpp - Library for the ESP8266/ESP32 Arduino platform
+  Raw TCP log listener, streams the GLOG ring to one client (eg: nc <ip> 23)
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include "LogServer.h"
+#include "GLog.h"
+
+LogServer::LogServer(uint16_t port) : server(port) {
+    cursor = 0;
+    started = false;
+}
+
+LogServer::~LogServer() {
+    client.stop();
+    server.stop();
+}
+
+void LogServer::begin() {
+    server.begin();
+    server.setNoDelay(true);
+    started = true;
+}
+
+void LogServer::loop() {
+    if (!started) {
+        return;
+    }
+
+    // the newest client wins
+    if (server.hasClient()) {
+        if (client.connected()) {
+            client.stop();
+        }
+        client = server.available();
+
+        // start with whatever is still in the ring
+        cursor = GLOG::getRing().tail();
+        GLOG_INFO("LOGS: tcp client connected\n");
+    }
+
+    if (!client.connected()) {
+        return;
+    }
+
+    // never block: only write what fits in the socket buffer
+    size_t room = client.availableForWrite();
+    if (room == 0) {
+        return;
+    }
+
+    uint8_t buffer[LOG_SERVER_MAX_BYTES_PER_LOOP];
+    size_t n = GLOG::getRing().read(cursor, buffer, room < sizeof(buffer) ? room : sizeof(buffer));
+    if (n > 0) {
+        client.write(buffer, n);
+    }
+}
@@ -0,0 +1,36 @@
+/*
+  LogServer.h - Library header for the ESP8266/ESP32 Arduino platform
+  Raw TCP log listener, streams the GLOG ring to one client (eg: nc <ip> 23)
+
+  Opt-in with -DLOG_SERVER_ENABLED: the port has no authentication and the
+  log shows the network and broker setup to anyone on the LAN
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef LOG_SERVER_H
+#define LOG_SERVER_H
+
+#include <ESP8266WiFi.h>
+
+#define LOG_SERVER_PORT 23
+// max bytes sent per loop() call, so the main loop is never held up
+#define LOG_SERVER_MAX_BYTES_PER_LOOP 256
+
+class LogServer {
+    public:
+        LogServer(uint16_t port = LOG_SERVER_PORT);
+        ~LogServer();
+
+        void begin();
+        void loop();
+
+    private:
+        WiFiServer server;
+        WiFiClient client;
+        uint32_t cursor;
+        bool started;
+};
+
+#endif
@@ -0,0 +1,110 @@
+/*
+  LoopProfiler.cpp - Library for the ESP8266/ESP32 Arduino platform
+  Measures how long each phase of the main loop takes, using the CPU cycle counter
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include "LoopProfiler.h"
+
+static const char *const PHASE_NAMES[PROFILE_PHASES] = {
+    "Wifi",
+    "Mqtt",
+    "InverterLoop",
+    "InverterRead",
+    "Publish",
+    "PowerSample",
+    "Outputs",
+};
+
+static const uint32_t BUCKET_LIMITS_MICROS[PROFILE_BUCKETS - 1] = {
+    100, 1000, 10000, 100000, 1000000
+};
+
+LoopProfiler::LoopProfiler() {
+    reset();
+}
+
+void LoopProfiler::start(uint8_t phase) {
+    startCycles[phase] = ESP.getCycleCount();
+}
+
+void LoopProfiler::stop(uint8_t phase) {
+    // unsigned math handles the counter wrapping, good up to ~26s at 160MHz
+    uint32_t elapsed = (ESP.getCycleCount() - startCycles[phase]) / ESP.getCpuFreqMHz();
+
+    if (elapsed > maxMicros[phase]) {
+        maxMicros[phase] = elapsed;
+    }
+    count[phase]++;
+    totalMicros[phase] += elapsed;
+
+    uint8_t bucket = 0;
+    while (bucket < PROFILE_BUCKETS - 1 && elapsed >= BUCKET_LIMITS_MICROS[bucket]) {
+        bucket++;
+    }
+    histogram[phase][bucket]++;
+}
+
+void LoopProfiler::countLoop() {
+    loops++;
+
+    uint32_t freeHeap = ESP.getFreeHeap();
+    if (freeHeap < minFreeHeap) {
+        minFreeHeap = freeHeap;
+    }
+}
+
+void LoopProfiler::reset() {
+    for (uint8_t i = 0; i < PROFILE_PHASES; i++) {
+        startCycles[i] = 0;
+        maxMicros[i] = 0;
+        count[i] = 0;
+        totalMicros[i] = 0;
+        for (uint8_t j = 0; j < PROFILE_BUCKETS; j++) {
+            histogram[i][j] = 0;
+        }
+    }
+
+    loops = 0;
+    loopsSinceMillis = millis();
+    minFreeHeap = 0xffffffff;
+}
+
+InverterData LoopProfiler::getData() {
+    InverterData data;
+    char name[40];
+
+    unsigned long now = millis();
+    float seconds = (now - loopsSinceMillis) / 1000.0f;
+    data.set("Loop/Hz", seconds > 0 ? loops / seconds : 0.0f);
+    loops = 0;
+    loopsSinceMillis = now;
+
+    data.set("Heap/Free", ESP.getFreeHeap());
+    data.set("Heap/MinFree", minFreeHeap);
+    data.set("Heap/MaxBlock", ESP.getMaxFreeBlockSize());
+    data.set("Heap/Fragmentation", ESP.getHeapFragmentation());
+
+    for (uint8_t i = 0; i < PROFILE_PHASES; i++) {
+        snprintf(name, sizeof(name), "Phase/%s/MaxUs", PHASE_NAMES[i]);
+        data.set(name, maxMicros[i]);
+
+        snprintf(name, sizeof(name), "Phase/%s/AvgUs", PHASE_NAMES[i]);
+        data.set(name, (uint32_t) (count[i] > 0 ? totalMicros[i] / count[i] : 0));
+
+        // counts per bucket, comma separated
+        String buckets;
+        for (uint8_t j = 0; j < PROFILE_BUCKETS; j++) {
+            if (j > 0) {
+                buckets += ',';
+            }
+            buckets += String(histogram[i][j]);
+        }
+        snprintf(name, sizeof(name), "Phase/%s/Histogram", PHASE_NAMES[i]);
+        data.set(name, buckets);
+    }
+
+    return data;
+}
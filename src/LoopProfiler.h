@@ -0,0 +1,54 @@
+/*
+  LoopProfiler.h - Library header for the ESP8266/ESP32 Arduino platform
+  Measures how long each phase of the main loop takes, using the CPU cycle counter
+  Keeps the max, average and a latency histogram per phase plus loop rate and heap stats
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef LOOP_PROFILER_H
+#define LOOP_PROFILER_H
+
+#include <Arduino.h>
+#include "InverterData.h"
+
+// main loop phases
+#define PROFILE_WIFI            0 // wcm.loop()
+#define PROFILE_MQTT            1 // mqtt->loop()
+#define PROFILE_INVERTER_LOOP   2 // inverter->loop()
+#define PROFILE_INVERTER_READ   3 // inverter->read()
+#define PROFILE_PUBLISH         4 // outputs of a poll
+#define PROFILE_POWER_SAMPLE    5 // inverter->samplePower()
+#define PROFILE_OUTPUTS         6 // outputs.loop()
+#define PROFILE_PHASES          7
+
+// histogram buckets: <100us, <1ms, <10ms, <100ms, <1s, >=1s
+#define PROFILE_BUCKETS         6
+
+class LoopProfiler {
+    public:
+        LoopProfiler();
+
+        void start(uint8_t phase);
+        void stop(uint8_t phase);
+        // once per loop() call, for the loop rate and the heap low water mark
+        void countLoop();
+        void reset();
+
+        // tele values, the loop rate is the average since the previous call
+        InverterData getData();
+
+    private:
+        uint32_t startCycles[PROFILE_PHASES];
+        uint32_t maxMicros[PROFILE_PHASES];
+        uint32_t count[PROFILE_PHASES];
+        uint64_t totalMicros[PROFILE_PHASES];
+        uint32_t histogram[PROFILE_PHASES][PROFILE_BUCKETS];
+
+        uint32_t loops;
+        unsigned long loopsSinceMillis;
+        uint32_t minFreeHeap;
+};
+
+#endif
@@ -0,0 +1,126 @@
+/*
+  MetricsPage.cpp - Library for the ESP8266/ESP32 Arduino platform
+  The HTTP /metrics page in the Prometheus text format
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <stdarg.h>
+#include "MetricsPage.h"
+
+// kept free for the last lines while the values are rendered
+#define TRAILER_SIZE 96
+
+MetricsPage::MetricsPage() {
+    buffer = NULL;
+    length = 0;
+    limit = 0;
+    renders = 0;
+    dropped = 0;
+    strcpy(etag, "\"0\"");
+}
+
+MetricsPage::~MetricsPage() {
+    delete[] buffer;
+}
+
+void MetricsPage::begin() {
+    if (buffer == NULL) {
+        buffer = new char[METRICS_BUFFER_SIZE];
+    }
+    buffer[0] = '\0';
+    length = 0;
+}
+
+void MetricsPage::append(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buffer + length, limit - length, format, args);
+    va_end(args);
+
+    if (n < 0 || (size_t) n >= limit - length) {
+        // whole lines only
+        buffer[length] = '\0';
+        dropped++;
+        return;
+    }
+    length += n;
+}
+
+void MetricsPage::appendValue(const char *metric, const char *label, const char *name, const char *value) {
+    // numbers as they were emitted, nothing a scraper would not parse
+    if (!isNumber(value)) {
+        return;
+    }
+    // nothing to escape in the label values
+    if (strpbrk(name, "\"\\\n") != NULL) {
+        return;
+    }
+
+    // "<addr>/<field>" from a shared bus
+    size_t digits = strspn(name, "0123456789");
+    if (digits > 0 && name[digits] == '/') {
+        append("%s{addr=\"%.*s\",%s=\"%s\"} %s\n", metric, (int) digits, name, label, name + digits + 1, value);
+    } else {
+        append("%s{%s=\"%s\"} %s\n", metric, label, name, value);
+    }
+}
+
+void MetricsPage::render(const InverterData &values, const InverterData &tele) {
+    if (buffer == NULL) {
+        return;
+    }
+
+    length = 0;
+    limit = METRICS_BUFFER_SIZE - TRAILER_SIZE;
+    dropped = 0;
+
+    append("# HELP inverter_value Inverter values of the last polls\n# TYPE inverter_value gauge\n");
+    for (auto &it : values) {
+        appendValue("inverter_value", "field", it.first.c_str(), it.second.c_str());
+    }
+    append("# HELP inverter_tele Device statistics, as in the tele topics\n# TYPE inverter_tele gauge\n");
+    for (auto &it : tele) {
+        appendValue("inverter_tele", "name", it.first.c_str(), it.second.c_str());
+    }
+
+    limit = METRICS_BUFFER_SIZE;
+    append("# TYPE inverter_metrics_dropped gauge\ninverter_metrics_dropped %u\n", (unsigned) dropped);
+    renders++;
+
+    // FNV-1a of the page
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t) buffer[i]) * 16777619u;
+    }
+    snprintf(etag, sizeof(etag), "\"%08x\"", hash);
+}
+
+const char *MetricsPage::getText() {
+    return buffer != NULL ? buffer : "";
+}
+
+size_t MetricsPage::getLength() {
+    return length;
+}
+
+const char *MetricsPage::getETag() {
+    return etag;
+}
+
+bool MetricsPage::matches(const char *ifNoneMatch) {
+    if (ifNoneMatch == NULL || ifNoneMatch[0] == '\0') {
+        return false;
+    }
+    // "*" or a list of tags
+    return strcmp(ifNoneMatch, "*") == 0 || strstr(ifNoneMatch, etag) != NULL;
+}
+
+uint32_t MetricsPage::getRenders() {
+    return renders;
+}
+
+uint16_t MetricsPage::getDropped() {
+    return dropped;
+}
@@ -0,0 +1,74 @@
+/*
+  MetricsPage.h - Library header for the ESP8266/ESP32 Arduino platform
+  The HTTP /metrics page in the Prometheus text format
+
+  The page is rendered once per poll into a buffer taken at boot, from the
+  values of the last polls and the tele data (loop profiler, Modbus, MQTT,
+  history, energy). A scrape sends the buffer as it is: it never reads the
+  inverter bus and never builds the page. Text values are left out.
+
+  The ETag is a hash of the page, a scraper that sends it back in
+  If-None-Match gets a 304 until the values change
+
+  inverter_value{field="Pac"} 1234.5
+  inverter_value{addr="1",field="Pac"} 1234.5     (Growatt on a shared bus)
+  inverter_tele{name="Modbus/Errors"} 3
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef _METRICS_PAGE_H
+#define _METRICS_PAGE_H
+
+#include <Arduino.h>
+#include "GlobalDefs.h"
+#include "InverterData.h"
+
+// the whole page, lines that do not fit are left out and counted
+#ifndef METRICS_BUFFER_SIZE
+#ifdef LARGE_ESP_BOARD
+#define METRICS_BUFFER_SIZE 8192
+#else
+#define METRICS_BUFFER_SIZE 4096
+#endif
+#endif
+
+#define METRICS_CONTENT_TYPE "text/plain; version=0.0.4"
+// "\"0123abcd\""
+#define METRICS_ETAG_SIZE 11
+
+class MetricsPage {
+    public:
+        MetricsPage();
+        ~MetricsPage();
+
+        // takes the buffer, there is an empty page until the first render
+        void begin();
+
+        // the values of the last polls and the tele data, numbers only
+        void render(const InverterData &values, const InverterData &tele);
+
+        const char *getText();
+        size_t getLength();
+        const char *getETag();
+        // true when the If-None-Match header of a request holds the current ETag
+        bool matches(const char *ifNoneMatch);
+
+        uint32_t getRenders();
+        // lines left out of the last render
+        uint16_t getDropped();
+
+    private:
+        char *buffer;
+        size_t length;
+        size_t limit;
+        char etag[METRICS_ETAG_SIZE];
+        uint32_t renders;
+        uint16_t dropped;
+
+        void append(const char *format, ...);
+        void appendValue(const char *metric, const char *label, const char *name, const char *value);
+};
+
+#endif
@@ -16,11 +16,15 @@ class ModbusUtils {
     public:
         // dumps the last response from modbus to the logs in hex format
         static void dumpRegisters(ModbusMaster * node, uint8_t length) {
-            GLOG::print(", hex[");
+            if (!GLOG_ENABLED(GLOG_LEVEL_DEBUG)) {
+                return;
+            }
+
+            GLOG_DEBUG(", hex[");
             for (uint8_t i = 0; i < length; i++) {
-                GLOG::print(String(node->getResponseBuffer(i), HEX) + ":");
+                GLOG_DEBUG("%x:", node->getResponseBuffer(i));
             }
-            GLOG::print("]");
+            GLOG_DEBUG("]");
         }
 
         static float glueFloat(uint16_t w1, uint16_t w0) {
@@ -0,0 +1,77 @@
+/*
+  Mqtt311Client.cpp - Library for the ESP8266/ESP32 Arduino platform
+  MQTT 3.1.1 through PubSubClient, the default MqttClient
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include "Mqtt311Client.h"
+
+Mqtt311Client::Mqtt311Client(WiFiClient &client) : client(client) {
+    publishBytes = 0;
+}
+
+void Mqtt311Client::setServer(const char *domain, uint16_t port) {
+    client.setServer(domain, port);
+}
+
+bool Mqtt311Client::setBufferSize(uint16_t size) {
+    return client.setBufferSize(size);
+}
+
+void Mqtt311Client::setSocketTimeout(uint16_t seconds) {
+    client.setSocketTimeout(seconds);
+}
+
+void Mqtt311Client::setCallback(void (*callback)(char *topic, uint8_t *payload, unsigned int length)) {
+    client.setCallback(callback);
+}
+
+bool Mqtt311Client::connect(const char *id, const char *username, const char *password, const char *willTopic, uint8_t willQos, bool willRetain, const char *willMessage) {
+    return client.connect(id, username, password, willTopic, willQos, willRetain, willMessage);
+}
+
+void Mqtt311Client::disconnect() {
+    client.disconnect();
+}
+
+bool Mqtt311Client::connected() {
+    return client.connected();
+}
+
+int Mqtt311Client::state() {
+    return client.state();
+}
+
+bool Mqtt311Client::publish(const char *topic, const char *payload, bool retained) {
+    if (!client.publish(topic, payload, retained)) {
+        return false;
+    }
+
+    // PubSubClient keeps no count, this is the packet it just wrote:
+    // fixed header, remaining length, topic length and topic, payload
+    uint32_t remaining = 2 + strlen(topic) + strlen(payload);
+    publishBytes += 1 + (remaining < 128 ? 1 : remaining < 16384 ? 2 : 3) + remaining;
+    return true;
+}
+
+bool Mqtt311Client::subscribe(const char *topic) {
+    return client.subscribe(topic);
+}
+
+bool Mqtt311Client::unsubscribe(const char *topic) {
+    return client.unsubscribe(topic);
+}
+
+bool Mqtt311Client::loop() {
+    return client.loop();
+}
+
+uint8_t Mqtt311Client::getProtocolLevel() {
+    return MQTT_PROTOCOL_LEVEL_311;
+}
+
+uint32_t Mqtt311Client::getPublishBytes() {
+    return publishBytes;
+}
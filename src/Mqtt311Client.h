@@ -0,0 +1,44 @@
+/*
+  Mqtt311Client.h - Library header for the ESP8266/ESP32 Arduino platform
+  MQTT 3.1.1 through PubSubClient, the default MqttClient
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef _MQTT311_CLIENT_H
+#define _MQTT311_CLIENT_H
+
+#include <ESP8266WiFi.h>
+#include <PubSubClient.h>
+#include "MqttClient.h"
+
+class Mqtt311Client : public MqttClient {
+    public:
+        Mqtt311Client(WiFiClient &client);
+
+        virtual void setServer(const char *domain, uint16_t port);
+        virtual bool setBufferSize(uint16_t size);
+        virtual void setSocketTimeout(uint16_t seconds);
+        virtual void setCallback(void (*callback)(char *topic, uint8_t *payload, unsigned int length));
+
+        virtual bool connect(const char *id, const char *username, const char *password, const char *willTopic, uint8_t willQos, bool willRetain, const char *willMessage);
+        virtual void disconnect();
+        virtual bool connected();
+        virtual int state();
+
+        using MqttClient::publish;
+        virtual bool publish(const char *topic, const char *payload, bool retained);
+        virtual bool subscribe(const char *topic);
+        virtual bool unsubscribe(const char *topic);
+        virtual bool loop();
+
+        virtual uint8_t getProtocolLevel();
+        virtual uint32_t getPublishBytes();
+
+    private:
+        PubSubClient client;
+        uint32_t publishBytes;
+};
+
+#endif
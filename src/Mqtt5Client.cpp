@@ -0,0 +1,514 @@
+/*
+  Mqtt5Client.cpp - Library for the ESP8266/ESP32 Arduino platform
+  Minimal MQTT 5 client: QoS 0 publish and subscribe, with topic aliases
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include "Mqtt5Client.h"
+
+#define MQTT5_CONNECT     0x10
+#define MQTT5_CONNACK     0x20
+#define MQTT5_PUBLISH     0x30
+#define MQTT5_SUBSCRIBE   0x82
+#define MQTT5_UNSUBSCRIBE 0xA2
+#define MQTT5_PINGREQ     0xC0
+#define MQTT5_PINGRESP    0xD0
+#define MQTT5_DISCONNECT  0xE0
+
+#define MQTT5_PROPERTY_TOPIC_ALIAS_MAXIMUM 0x22
+#define MQTT5_PROPERTY_TOPIC_ALIAS         0x23
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+static uint32_t topicHash(const char *topic) {
+    uint32_t h = FNV_OFFSET_BASIS;
+    while (*topic) {
+        h = (h ^ (uint8_t) *topic++) * FNV_PRIME;
+    }
+    return h;
+}
+
+// variable byte integer, returns its size or 0 if it is cut or too long
+static size_t getVarint(const uint8_t *p, size_t avail, uint32_t *value) {
+    *value = 0;
+    for (size_t i = 0; i < 4 && i < avail; i++) {
+        *value |= (uint32_t) (p[i] & 0x7f) << (7 * i);
+        if ((p[i] & 0x80) == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// size of a property value, 0 when unknown or cut
+static size_t propertySize(uint8_t id, const uint8_t *p, size_t avail) {
+    size_t size;
+    uint32_t value;
+
+    switch (id) {
+        case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+            size = 1;
+            break;
+        case 0x13: case 0x21: case 0x22: case 0x23:
+            size = 2;
+            break;
+        case 0x02: case 0x11: case 0x18: case 0x27:
+            size = 4;
+            break;
+        case 0x0B:
+            return getVarint(p, avail, &value);
+        case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+            size = avail >= 2 ? 2 + (p[0] << 8 | p[1]) : 0;
+            break;
+        case 0x26: {
+            // user property, a string pair
+            size_t first = avail >= 2 ? 2 + (p[0] << 8 | p[1]) : 0;
+            size = first > 0 && avail >= first + 2 ? first + 2 + (p[first] << 8 | p[first + 1]) : 0;
+            break;
+        }
+        default:
+            return 0;
+    }
+    return size <= avail ? size : 0;
+}
+
+Mqtt5Client::Mqtt5Client(WiFiClient &client) {
+    this->client = &client;
+    this->callback = NULL;
+    this->buffer = (uint8_t *) malloc(256);
+    // no heap: every packet is too big until setBufferSize() gets one
+    this->bufferSize = buffer != NULL ? 256 : 0;
+    this->domain = NULL;
+    this->port = 1883;
+    this->socketTimeoutSeconds = 15;
+    this->currentState = MQTT_DISCONNECTED;
+    this->nextPacketId = 1;
+    this->topicAliasMax = 0;
+    this->lastOutMillis = 0;
+    this->lastInMillis = 0;
+    this->pingOutstanding = false;
+    this->publishBytes = 0;
+}
+
+Mqtt5Client::~Mqtt5Client() {
+    free(buffer);
+}
+
+void Mqtt5Client::setServer(const char *domain, uint16_t port) {
+    // kept, the caller's string has to outlive the client as with PubSubClient
+    this->domain = domain;
+    this->port = port;
+}
+
+bool Mqtt5Client::setBufferSize(uint16_t size) {
+    uint8_t *newBuffer = (uint8_t *) realloc(buffer, size);
+    if (newBuffer == NULL) {
+        return false;
+    }
+    buffer = newBuffer;
+    bufferSize = size;
+    return true;
+}
+
+void Mqtt5Client::setSocketTimeout(uint16_t seconds) {
+    socketTimeoutSeconds = seconds;
+}
+
+void Mqtt5Client::setCallback(void (*callback)(char *topic, uint8_t *payload, unsigned int length)) {
+    this->callback = callback;
+}
+
+bool Mqtt5Client::connect(const char *id, const char *username, const char *password, const char *willTopic, uint8_t willQos, bool willRetain, const char *willMessage) {
+    if (buffer == NULL) {
+        currentState = MQTT_CONNECT_FAILED;
+        return false;
+    }
+    // MqttPublisher opens the connection itself, anyone else gets it opened here like PubSubClient does
+    if (!client->connected() && (domain == NULL || !client->connect(domain, port))) {
+        currentState = MQTT_CONNECT_FAILED;
+        return false;
+    }
+
+    // aliases only live as long as the connection
+    aliases.clear();
+    topicAliasMax = 0;
+    pingOutstanding = false;
+
+    uint8_t flags = 0x02;   // clean start
+    if (willTopic != NULL) {
+        flags |= 0x04 | (willQos << 3) | (willRetain ? 0x20 : 0);
+    }
+    if (username != NULL) {
+        flags |= 0x80;
+        if (password != NULL) {
+            flags |= 0x40;
+        }
+    }
+
+    size_t pos = putString(MQTT5_MAX_HEADER_SIZE, "MQTT");
+    if (pos == 0 || pos + 5 > bufferSize) {
+        currentState = MQTT_CONNECT_FAILED;
+        return false;
+    }
+    buffer[pos++] = MQTT_PROTOCOL_LEVEL_5;
+    buffer[pos++] = flags;
+    buffer[pos++] = MQTT5_KEEPALIVE_SECONDS >> 8;
+    buffer[pos++] = MQTT5_KEEPALIVE_SECONDS & 0xff;
+    buffer[pos++] = 0;      // no properties
+
+    pos = putString(pos, id);
+    if (pos > 0 && willTopic != NULL && pos < bufferSize) {
+        buffer[pos++] = 0;  // no will properties
+        pos = putString(pos, willTopic);
+        pos = pos > 0 ? putString(pos, willMessage) : 0;
+    }
+    if (pos > 0 && username != NULL) {
+        pos = putString(pos, username);
+        if (pos > 0 && password != NULL) {
+            pos = putString(pos, password);
+        }
+    }
+
+    if (pos == 0 || !sendPacket(MQTT5_CONNECT, pos) || !readConnack()) {
+        client->stop();
+        return false;
+    }
+
+    lastInMillis = millis();
+    currentState = MQTT_CONNECTED;
+    return true;
+}
+
+bool Mqtt5Client::readConnack() {
+    uint8_t header;
+    size_t length;
+    if (!readPacket(&header, &length)) {
+        currentState = client->connected() ? MQTT_CONNECTION_TIMEOUT : MQTT_CONNECT_FAILED;
+        return false;
+    }
+    if ((header & 0xf0) != MQTT5_CONNACK || length < 2) {
+        currentState = MQTT_CONNECT_FAILED;
+        return false;
+    }
+
+    uint8_t reasonCode = buffer[1];
+    if (reasonCode != 0) {
+        // a 3.1.1 broker answers in 3.1.1: two bytes and return code 1
+        if ((reasonCode == 0x01 && length == 2) || reasonCode == 0x84) {
+            currentState = MQTT_CONNECT_BAD_PROTOCOL;
+        } else if (reasonCode == 0x85) {
+            currentState = MQTT_CONNECT_BAD_CLIENT_ID;
+        } else if (reasonCode == 0x86) {
+            currentState = MQTT_CONNECT_BAD_CREDENTIALS;
+        } else if (reasonCode == 0x87) {
+            currentState = MQTT_CONNECT_UNAUTHORIZED;
+        } else if (reasonCode >= 0x88 && reasonCode <= 0x8a) {
+            currentState = MQTT_CONNECT_UNAVAILABLE;
+        } else {
+            currentState = MQTT_CONNECT_FAILED;
+        }
+        return false;
+    }
+
+    uint32_t propertiesLength;
+    size_t pos = 2;
+    size_t n = getVarint(buffer + pos, length - pos, &propertiesLength);
+    if (n == 0) {
+        return true;    // no properties
+    }
+    pos += n;
+
+    size_t end = pos + propertiesLength <= length ? pos + propertiesLength : length;
+    while (pos < end) {
+        uint8_t id = buffer[pos++];
+        size_t size = propertySize(id, buffer + pos, end - pos);
+        if (size == 0) {
+            break;
+        }
+        if (id == MQTT5_PROPERTY_TOPIC_ALIAS_MAXIMUM) {
+            uint16_t granted = buffer[pos] << 8 | buffer[pos + 1];
+            topicAliasMax = granted < MQTT5_TOPIC_ALIAS_MAX ? granted : MQTT5_TOPIC_ALIAS_MAX;
+        }
+        pos += size;
+    }
+    return true;
+}
+
+void Mqtt5Client::disconnect() {
+    if (client->connected()) {
+        buffer[0] = MQTT5_DISCONNECT;
+        buffer[1] = 0;
+        client->write(buffer, 2);
+    }
+    currentState = MQTT_DISCONNECTED;
+    client->stop();
+}
+
+bool Mqtt5Client::connected() {
+    if (currentState == MQTT_CONNECTED && !client->connected()) {
+        currentState = MQTT_CONNECTION_LOST;
+        client->stop();
+    }
+    return currentState == MQTT_CONNECTED;
+}
+
+int Mqtt5Client::state() {
+    return currentState;
+}
+
+bool Mqtt5Client::publish(const char *topic, const char *payload, bool retained) {
+    if (!connected()) {
+        return false;
+    }
+
+    uint32_t hash = topicHash(topic);
+    uint16_t alias = findAlias(topic, hash);
+    bool newAlias = alias == 0 && aliases.size() < topicAliasMax;
+    if (newAlias) {
+        alias = aliases.size() + 1;
+    }
+
+    // a known alias goes with an empty topic
+    size_t pos = putString(MQTT5_MAX_HEADER_SIZE, alias != 0 && !newAlias ? "" : topic);
+    size_t payloadLength = strlen(payload);
+    if (pos == 0 || pos + 4 + payloadLength > bufferSize) {
+        return false;
+    }
+
+    if (alias != 0) {
+        buffer[pos++] = 3;
+        buffer[pos++] = MQTT5_PROPERTY_TOPIC_ALIAS;
+        buffer[pos++] = alias >> 8;
+        buffer[pos++] = alias & 0xff;
+    } else {
+        buffer[pos++] = 0;
+    }
+    memcpy(buffer + pos, payload, payloadLength);
+    pos += payloadLength;
+
+    if (!sendPacket(MQTT5_PUBLISH | (retained ? 0x01 : 0), pos)) {
+        return false;
+    }
+
+    // only once the broker has seen the topic with it
+    if (newAlias) {
+        aliases.push_back({ hash, String(topic) });
+    }
+    return true;
+}
+
+bool Mqtt5Client::subscribe(const char *topic) {
+    if (!connected()) {
+        return false;
+    }
+
+    size_t pos = MQTT5_MAX_HEADER_SIZE;
+    buffer[pos++] = nextPacketId >> 8;
+    buffer[pos++] = nextPacketId & 0xff;
+    buffer[pos++] = 0;      // no properties
+    nextPacketId = nextPacketId == 0xffff ? 1 : nextPacketId + 1;
+
+    pos = putString(pos, topic);
+    if (pos == 0 || pos >= bufferSize) {
+        return false;
+    }
+    buffer[pos++] = 0;      // QoS 0
+    return sendPacket(MQTT5_SUBSCRIBE, pos);
+}
+
+bool Mqtt5Client::unsubscribe(const char *topic) {
+    if (!connected()) {
+        return false;
+    }
+
+    size_t pos = MQTT5_MAX_HEADER_SIZE;
+    buffer[pos++] = nextPacketId >> 8;
+    buffer[pos++] = nextPacketId & 0xff;
+    buffer[pos++] = 0;      // no properties
+    nextPacketId = nextPacketId == 0xffff ? 1 : nextPacketId + 1;
+
+    pos = putString(pos, topic);
+    return pos > 0 && sendPacket(MQTT5_UNSUBSCRIBE, pos);
+}
+
+bool Mqtt5Client::loop() {
+    if (!connected()) {
+        return false;
+    }
+
+    unsigned long now = millis();
+    if (now - lastInMillis > MQTT5_KEEPALIVE_SECONDS * 1000UL || now - lastOutMillis > MQTT5_KEEPALIVE_SECONDS * 1000UL) {
+        if (pingOutstanding) {
+            currentState = MQTT_CONNECTION_TIMEOUT;
+            client->stop();
+            return false;
+        }
+        buffer[0] = MQTT5_PINGREQ;
+        buffer[1] = 0;
+        client->write(buffer, 2);
+        lastOutMillis = now;
+        lastInMillis = now;
+        pingOutstanding = true;
+    }
+
+    while (client->available()) {
+        uint8_t header;
+        size_t length;
+        if (!readPacket(&header, &length)) {
+            continue;   // too big for the buffer, dropped
+        }
+        lastInMillis = millis();
+
+        switch (header & 0xf0) {
+            case MQTT5_PUBLISH:
+                handlePublish(header, length);
+                break;
+            case MQTT5_PINGRESP:
+                pingOutstanding = false;
+                break;
+            case MQTT5_DISCONNECT:
+                currentState = MQTT_DISCONNECTED;
+                client->stop();
+                return false;
+            default:
+                // SUBACK and UNSUBACK, nothing waits for them
+                break;
+        }
+    }
+    return true;
+}
+
+void Mqtt5Client::handlePublish(uint8_t header, size_t length) {
+    if (length < 3 || callback == NULL) {
+        return;
+    }
+
+    size_t topicLength = buffer[0] << 8 | buffer[1];
+    size_t pos = 2 + topicLength;
+    if ((header & 0x06) != 0) {
+        pos += 2;   // packet id, subscriptions are QoS 0 so it should not be there
+    }
+
+    uint32_t propertiesLength;
+    size_t n = pos < length ? getVarint(buffer + pos, length - pos, &propertiesLength) : 0;
+    if (topicLength == 0 || n == 0 || pos + n + propertiesLength > length) {
+        return;
+    }
+    pos += n + propertiesLength;
+
+    // the byte after the topic was read already, it becomes the terminator
+    buffer[2 + topicLength] = '\0';
+    callback((char *) buffer + 2, buffer + pos, length - pos);
+}
+
+uint8_t Mqtt5Client::getProtocolLevel() {
+    return MQTT_PROTOCOL_LEVEL_5;
+}
+
+uint32_t Mqtt5Client::getPublishBytes() {
+    return publishBytes;
+}
+
+uint16_t Mqtt5Client::getTopicAliasMax() {
+    return topicAliasMax;
+}
+
+uint16_t Mqtt5Client::getTopicAliases() {
+    return aliases.size();
+}
+
+size_t Mqtt5Client::putString(size_t pos, const char *s) {
+    size_t length = strlen(s);
+    if (pos + 2 + length > bufferSize) {
+        return 0;
+    }
+    buffer[pos++] = length >> 8;
+    buffer[pos++] = length & 0xff;
+    memcpy(buffer + pos, s, length);
+    return pos + length;
+}
+
+bool Mqtt5Client::sendPacket(uint8_t header, size_t end) {
+    // the remaining length goes right in front of the variable header
+    size_t remaining = end - MQTT5_MAX_HEADER_SIZE;
+    uint8_t varint[4];
+    size_t n = 0;
+    do {
+        varint[n] = remaining & 0x7f;
+        remaining >>= 7;
+        if (remaining > 0) {
+            varint[n] |= 0x80;
+        }
+        n++;
+    } while (remaining > 0 && n < sizeof(varint));
+
+    size_t start = MQTT5_MAX_HEADER_SIZE - 1 - n;
+    buffer[start] = header;
+    memcpy(buffer + start + 1, varint, n);
+
+    size_t length = end - start;
+    if (client->write(buffer + start, length) != length) {
+        return false;
+    }
+
+    lastOutMillis = millis();
+    if ((header & 0xf0) == MQTT5_PUBLISH) {
+        publishBytes += length;
+    }
+    return true;
+}
+
+bool Mqtt5Client::readByte(uint8_t *b) {
+    unsigned long start = millis();
+    while (!client->available()) {
+        if (!client->connected() || millis() - start >= socketTimeoutSeconds * 1000UL) {
+            return false;
+        }
+        delay(1);
+    }
+    *b = client->read();
+    return true;
+}
+
+bool Mqtt5Client::readPacket(uint8_t *header, size_t *length) {
+    if (!readByte(header)) {
+        return false;
+    }
+
+    uint32_t remaining = 0;
+    uint8_t b;
+    for (uint8_t shift = 0; shift < 28; shift += 7) {
+        if (!readByte(&b)) {
+            return false;
+        }
+        remaining |= (uint32_t) (b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            break;
+        }
+    }
+
+    // a packet bigger than the buffer is read and thrown away
+    for (uint32_t i = 0; i < remaining; i++) {
+        if (!readByte(&b)) {
+            return false;
+        }
+        if (i < bufferSize) {
+            buffer[i] = b;
+        }
+    }
+
+    *length = remaining;
+    return remaining <= bufferSize;
+}
+
+uint16_t Mqtt5Client::findAlias(const char *topic, uint32_t hash) {
+    for (size_t i = 0; i < aliases.size(); i++) {
+        if (aliases[i].hash == hash && aliases[i].topic == topic) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
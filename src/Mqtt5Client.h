@@ -0,0 +1,95 @@
+/*
+  Mqtt5Client.h - Library header for the ESP8266/ESP32 Arduino platform
+  Minimal MQTT 5 client: QoS 0 publish and subscribe, with topic aliases
+
+  The first publish on a topic in a connection sends the topic and assigns it
+  an alias, the following ones send an empty topic and the 2 byte alias. With
+  per field topics ("energy/growatt/22/EpsPac3") the topic is most of the
+  packet, so this roughly halves the bytes of a poll. The broker grants the
+  number of aliases in its CONNACK, topics past that go out in full
+
+  A broker without MQTT 5 refuses the CONNECT with "bad protocol", state() is
+  then MQTT_CONNECT_BAD_PROTOCOL and MqttPublisher falls back to Mqtt311Client
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef _MQTT5_CLIENT_H
+#define _MQTT5_CLIENT_H
+
+#include <ESP8266WiFi.h>
+#include <PubSubClient.h>
+#include <vector>
+#include "MqttClient.h"
+
+// same as PubSubClient
+#define MQTT5_KEEPALIVE_SECONDS 15
+// room for the fixed header in front of the packet: type and a 4 byte remaining length
+#define MQTT5_MAX_HEADER_SIZE 5
+
+// aliases kept per connection, each one holds a copy of its topic
+#define MQTT5_TOPIC_ALIAS_MAX 128
+
+struct Mqtt5TopicAlias {
+    uint32_t hash;
+    String topic;
+};
+
+class Mqtt5Client : public MqttClient {
+    public:
+        Mqtt5Client(WiFiClient &client);
+        ~Mqtt5Client();
+
+        virtual void setServer(const char *domain, uint16_t port);
+        virtual bool setBufferSize(uint16_t size);
+        virtual void setSocketTimeout(uint16_t seconds);
+        virtual void setCallback(void (*callback)(char *topic, uint8_t *payload, unsigned int length));
+
+        virtual bool connect(const char *id, const char *username, const char *password, const char *willTopic, uint8_t willQos, bool willRetain, const char *willMessage);
+        virtual void disconnect();
+        virtual bool connected();
+        virtual int state();
+
+        using MqttClient::publish;
+        virtual bool publish(const char *topic, const char *payload, bool retained);
+        virtual bool subscribe(const char *topic);
+        virtual bool unsubscribe(const char *topic);
+        virtual bool loop();
+
+        virtual uint8_t getProtocolLevel();
+        virtual uint32_t getPublishBytes();
+
+        // aliases the broker allows in this connection and the ones assigned
+        uint16_t getTopicAliasMax();
+        uint16_t getTopicAliases();
+
+    private:
+        WiFiClient *client;
+        const char *domain;
+        uint16_t port;
+        void (*callback)(char *topic, uint8_t *payload, unsigned int length);
+        uint8_t *buffer;
+        uint16_t bufferSize;
+        uint16_t socketTimeoutSeconds;
+        int currentState;
+        uint16_t nextPacketId;
+
+        std::vector<Mqtt5TopicAlias> aliases;
+        uint16_t topicAliasMax;
+
+        unsigned long lastOutMillis;
+        unsigned long lastInMillis;
+        bool pingOutstanding;
+        uint32_t publishBytes;
+
+        size_t putString(size_t pos, const char *s);
+        bool sendPacket(uint8_t header, size_t end);
+        bool readByte(uint8_t *b);
+        bool readPacket(uint8_t *header, size_t *length);
+        bool readConnack();
+        void handlePublish(uint8_t header, size_t length);
+        uint16_t findAlias(const char *topic, uint32_t hash);
+};
+
+#endif
@@ -0,0 +1,50 @@
+/*
+  MqttClient.h - Library header for the ESP8266/ESP32 Arduino platform
+  What MqttPublisher needs from an MQTT client, so the protocol can be picked
+  at run time: Mqtt311Client (PubSubClient, MQTT 3.1.1) or Mqtt5Client
+
+  The TCP (or TLS) connection is opened by MqttPublisher before connect(),
+  the client only does the MQTT handshake over it
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef _MQTT_CLIENT_H
+#define _MQTT_CLIENT_H
+
+#include <Arduino.h>
+
+// CONNECT protocol levels
+#define MQTT_PROTOCOL_LEVEL_311 4
+#define MQTT_PROTOCOL_LEVEL_5   5
+
+class MqttClient {
+    public:
+        virtual ~MqttClient() {}
+
+        virtual void setServer(const char *domain, uint16_t port) = 0;
+        virtual bool setBufferSize(uint16_t size) = 0;
+        virtual void setSocketTimeout(uint16_t seconds) = 0;
+        virtual void setCallback(void (*callback)(char *topic, uint8_t *payload, unsigned int length)) = 0;
+
+        // username and password may be NULL, the will is published retained on QoS willQos
+        virtual bool connect(const char *id, const char *username, const char *password, const char *willTopic, uint8_t willQos, bool willRetain, const char *willMessage) = 0;
+        virtual void disconnect() = 0;
+        virtual bool connected() = 0;
+        // PubSubClient's MQTT_* state codes
+        virtual int state() = 0;
+
+        // QoS 0
+        virtual bool publish(const char *topic, const char *payload, bool retained) = 0;
+        bool publish(const char *topic, const char *payload) { return publish(topic, payload, false); }
+        virtual bool subscribe(const char *topic) = 0;
+        virtual bool unsubscribe(const char *topic) = 0;
+        virtual bool loop() = 0;
+
+        virtual uint8_t getProtocolLevel() = 0;
+        // PUBLISH packets bytes (fixed header included) sent since boot
+        virtual uint32_t getPublishBytes() = 0;
+};
+
+#endif
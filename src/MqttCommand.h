@@ -0,0 +1,42 @@
+/*
+  MqttCommand.h - Library header for the ESP8266/ESP32 Arduino platform
+  Turns an incoming MQTT message into the topic and value given to the inverters
+  
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+#ifndef MQTT_COMMAND_H
+#define MQTT_COMMAND_H
+
+#include <Arduino.h>
+
+// longest value accepted by any command, e.g. "1070 49" or "00:00 23:59"
+#define MQTT_COMMAND_VALUE_MAX_LEN 15
+
+class MqttCommand {
+    public:
+        // topic without the "<base topic>/" prefix, e.g. settings/priority, points into topic
+        static const char *subtopic(const char *baseTopic, const char *topic) {
+            size_t baseLen = strlen(baseTopic);
+            if (strncmp(topic, baseTopic, baseLen) == 0 && topic[baseLen] == '/') {
+                return topic + baseLen + 1;
+            }
+            return topic;
+        }
+
+        // payload truncated to MQTT_COMMAND_VALUE_MAX_LEN chars and trimmed, points into buffer
+        static const char *value(const byte *payload, unsigned int length, char (&buffer)[MQTT_COMMAND_VALUE_MAX_LEN + 1]) {
+            unsigned int safeLength = length < MQTT_COMMAND_VALUE_MAX_LEN ? length : MQTT_COMMAND_VALUE_MAX_LEN;
+            memcpy(buffer, payload, safeLength);
+            buffer[safeLength] = '\0';
+            
+            // same as String::trim(), the payload may hold a NUL
+            char *start = buffer;
+            while (isspace((unsigned char) *start)) start++;
+            char *end = start + strlen(start);
+            while (end > start && isspace((unsigned char) end[-1])) end--;
+            *end = '\0';
+            return start;
+        }
+};
+#endif
@@ -0,0 +1,70 @@
+/*
+  MqttOutputs.cpp - Library for the ESP8266/ESP32 Arduino platform
+  The MQTT stages of the output pipeline
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include "MqttOutputs.h"
+
+MqttTopicOutput::MqttTopicOutput(HistoryBuffer *history) : OutputStage("Mqtt", 0) {
+    this->publisher = NULL;
+    this->history = history;
+    this->target = NULL;
+}
+
+void MqttTopicOutput::setPublisher(MqttPublisher *publisher) {
+    this->publisher = publisher;
+}
+
+void MqttTopicOutput::beginPoll(time_t time) {
+    if (publisher != NULL && publisher->isConnected()) {
+        publisher->beginPoll();
+        target = publisher;
+        // the capture time for the values that follow, the history records have their own
+        if (time >= WALLCLOCK_MIN_VALID_TIME) {
+            publisher->emit(MQTT_TIME_FIELD, (uint32_t) time);
+        }
+    } else if (history != NULL) {
+        // before the clock is set the history keeps millis() and converts it at the replay
+        history->beginSample(time);
+        target = history;
+    } else {
+        target = NULL;
+    }
+}
+
+void MqttTopicOutput::addValue(const char *name, const char *value) {
+    if (target == NULL) {
+        failed++;
+        return;
+    }
+    // a full live queue drops it there, counted in Mqtt/Queue/Dropped
+    target->emit(name, value);
+    sent++;
+}
+
+void MqttTopicOutput::endPoll() {
+    if (target == history && history != NULL) {
+        history->endSample();
+    }
+    target = NULL;
+}
+
+MqttJsonOutput::MqttJsonOutput() : JsonOutputStage("MqttJson", OUTPUT_QUEUE_SIZE, MQTT_JSON_SUBTOPIC) {
+    this->publisher = NULL;
+}
+
+void MqttJsonOutput::setPublisher(MqttPublisher *publisher) {
+    this->publisher = publisher;
+}
+
+bool MqttJsonOutput::isReady() {
+    // offline the messages wait in the queue, the newest dropped when it is full
+    return publisher != NULL && publisher->isConnected() && publisher->getQueueDepth() == 0;
+}
+
+bool MqttJsonOutput::send(const char *key, const char *payload) {
+    return publisher->publishNow(key, payload);
+}
@@ -0,0 +1,60 @@
+/*
+  MqttOutputs.h - Library header for the ESP8266/ESP32 Arduino platform
+  The MQTT stages of the output pipeline
+
+  MqttTopicOutput is the <topic>/<field> publishing: its queue is the live
+  queue of the publisher, and while the broker is down the poll goes to the
+  history buffer instead. Once the clock is set each poll starts with
+  <topic>/Time, the poll time in epoch seconds. MqttJsonOutput publishes each poll as one JSON
+  object on <topic>/json, from its own queue and only when the live queue of
+  the publisher is empty, so the per field values always go first
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef _MQTT_OUTPUTS_H
+#define _MQTT_OUTPUTS_H
+
+#include "OutputPipeline.h"
+#include "MqttPublisher.h"
+#include "HistoryBuffer.h"
+#include "WallClock.h"
+
+#define MQTT_JSON_SUBTOPIC "json"
+#define MQTT_TIME_FIELD "Time"
+
+class MqttTopicOutput : public OutputStage {
+    public:
+        MqttTopicOutput(HistoryBuffer *history);
+
+        // the publisher is recreated on a config change
+        void setPublisher(MqttPublisher *publisher);
+
+    protected:
+        virtual void beginPoll(time_t time);
+        virtual void addValue(const char *name, const char *value);
+        virtual void endPoll();
+
+    private:
+        MqttPublisher *publisher;
+        HistoryBuffer *history;
+        // the publisher or the history buffer, for the current poll
+        InverterSink *target;
+};
+
+class MqttJsonOutput : public JsonOutputStage {
+    public:
+        MqttJsonOutput();
+
+        void setPublisher(MqttPublisher *publisher);
+
+    protected:
+        virtual bool isReady();
+        virtual bool send(const char *key, const char *payload);
+
+    private:
+        MqttPublisher *publisher;
+};
+
+#endif
@@ -7,20 +7,50 @@
 */
 
 #include "MqttPublisher.h"
+#include "Mqtt311Client.h"
+#include "Mqtt5Client.h"
 #include "GLog.h"
 #include "uptime_formatter.h"
 
 #define LWT_TOPIC ((this->topic + "/online").c_str())
         
-MqttPublisher::MqttPublisher(WiFiClient &espClient, const char *username, const char * password, const char *baseTopic, const char *server, int port) {
+MqttPublisher::MqttPublisher(WiFiClient &espClient, const char *username, const char * password, const char *baseTopic, const char *server, int port, bool mqtt5)
+    : liveQueue(MQTT_QUEUE_LIVE_SIZE), teleQueue(MQTT_QUEUE_TELE_SIZE) {
     this->serverIp = server;
     this->portNumber = port;
     this->username = username;
     this->password = password;
-    this->client = new PubSubClient(espClient);
-    this->client->setBufferSize(768);   // 768 should be enough for the JSON payloads
-    this->client->setServer(serverIp.c_str(), portNumber);  
-    this->lastReconnectAttemptMillis = 0;
+    this->netClient = &espClient;
+    this->tls = NULL;
+    this->callback = NULL;
+    this->client = NULL;
+    if (mqtt5) {
+        setupClient(new Mqtt5Client(espClient));
+    } else {
+        setupClient(new Mqtt311Client(espClient));
+    }
+
+    // the first attempt goes straight away
+    this->connectionState = MQTT_STATE_DISCONNECTED;
+    this->subscribeIdx = 0;
+    this->lastAttemptMillis = millis();
+    this->retryDelayMillis = 0;
+    this->backoffMillis = MQTT_BACKOFF_MIN_MILLIS;
+    this->everConnected = false;
+    this->downSinceMillis = 0;
+    this->downtimeMillis = 0;
+    this->reconnects = 0;
+    this->failedConnects = 0;
+    this->pollBytes = 0;
+    this->lastPollBytes = 0;
+    this->tokens = MQTT_PUBLISH_BURST_BYTES;
+    this->lastRefillMillis = millis();
+    this->failedPublishes = 0;
+    this->congested = 0;
+    this->wifiConnectMillis = 0;
+    this->wifiFastConnected = false;
+    this->logCursor = GLOG::getRing().tail();
+    this->lastLogPublishMillis = 0;
     
     this->topic = baseTopic;
     this->clientId = "unknown";
@@ -29,88 +59,402 @@ MqttPublisher::MqttPublisher(WiFiClient &espClient, const char *username, const
 MqttPublisher::~MqttPublisher() {
     delete this->client;
 }
+
+void MqttPublisher::setupClient(MqttClient *client) {
+    delete this->client;
+    this->client = client;
+    this->client->setBufferSize(768);   // 768 should be enough for the JSON payloads
+    this->client->setServer(serverIp.c_str(), portNumber);
+    this->client->setSocketTimeout(MQTT_HANDSHAKE_TIMEOUT_SECONDS);
+    if (callback != NULL) {
+        this->client->setCallback(callback);
+    }
+}
        
 void MqttPublisher::publishData(InverterData &data) {
-    for (std::map<String, String>::iterator it = data.begin(); it != data.end(); ++it) {
-        const String & name = it->first;
-        const String & value = it->second;
-        
-        client->publish((topic + String("/") + name).c_str(), value.c_str());
+    data.emitTo(*this);
+}
+
+void MqttPublisher::beginPoll() {
+    lastPollBytes = pollBytes;
+    pollBytes = 0;
+}
+
+void MqttPublisher::emitValue(const char *name, const char *value) {
+    // a full queue drops the value, counted
+    liveQueue.push(name, value);
+}
+
+void MqttPublisher::queueTele(const char *name, const char *value) {
+    char subtopic[MQTT_TOPIC_BUFFER_SIZE];
+    if (snprintf(subtopic, sizeof(subtopic), "tele/%s", name) >= (int) sizeof(subtopic)) {
+        GLOG_WARN("MQTT: topic tele/%s too long, not published\n", name);
+        return;
     }
+    teleQueue.push(subtopic, value);
 }
 
+class MqttPublisher::TeleSink : public InverterSink {
+    private:
+        MqttPublisher &publisher;
+
+    protected:
+        virtual void emitValue(const char *name, const char *value) {
+            publisher.queueTele(name, value);
+        }
+
+    public:
+        TeleSink(MqttPublisher &publisher) : publisher(publisher) {}
+};
+
 void MqttPublisher::publishTele() {
-    client->publish((topic + "/tele/IP").c_str(), WiFi.localIP().toString().c_str());
-    client->publish((topic + "/tele/ClientID").c_str(), clientId.c_str());
-    client->publish((topic + "/tele/Uptime").c_str(), uptime_formatter::getUptime().c_str());
-    client->publish((topic + "/tele/RSSI").c_str(), String(WiFi.RSSI()).c_str());
+    queueTele("IP", WiFi.localIP().toString().c_str());
+    queueTele("ClientID", clientId.c_str());
+    queueTele("Uptime", uptime_formatter::getUptime().c_str());
+    queueTele("RSSI", String(WiFi.RSSI()).c_str());
+    queueTele("WifiConnectMs", String(wifiConnectMillis).c_str());
+    queueTele("WifiFastConnect", wifiFastConnected ? "true" : "false");
+    queueTele("Mqtt/Protocol", client->getProtocolLevel() == MQTT_PROTOCOL_LEVEL_5 ? "5" : "3.1.1");
+
+    TeleSink tele(*this);
+    emitStats(tele);
+}
+
+void MqttPublisher::emitStats(InverterSink &sink) {
+    sink.emit("Mqtt/Reconnects", reconnects);
+    sink.emit("Mqtt/FailedConnects", failedConnects);
+    sink.emit("Mqtt/DowntimeS", (uint32_t) (downtimeMillis / 1000));
+    sink.emit("Mqtt/PollBytes", lastPollBytes);
+    sink.emit("Mqtt/Queue/Depth", getQueueDepth());
+    sink.emit("Mqtt/Queue/MaxDepth", (uint16_t) (liveQueue.maxDepth() + teleQueue.maxDepth()));
+    sink.emit("Mqtt/Queue/Dropped", (uint32_t) (liveQueue.dropped() + teleQueue.dropped()));
+    sink.emit("Mqtt/Queue/Failed", failedPublishes);
+    sink.emit("Mqtt/Queue/Congested", congested);
+}
+
+void MqttPublisher::publishTele(InverterData &extra) {
+    publishTele();
+
+    for (std::map<String, String>::iterator it = extra.begin(); it != extra.end(); ++it) {
+        queueTele(it->first.c_str(), it->second.c_str());
+    }
 }
 
 void MqttPublisher::publishOnline() {
     client->publish(LWT_TOPIC, "true", true);
 }
 
+bool MqttPublisher::publishHistory(const char *payload) {
+    return publishNow(MQTT_HISTORY_SUBTOPIC, payload);
+}
+
+bool MqttPublisher::publishNow(const char *subtopic, const char *payload) {
+    if (liveQueue.depth() > 0) {
+        return false;
+    }
+
+    char fullTopic[MQTT_TOPIC_BUFFER_SIZE];
+    if (snprintf(fullTopic, sizeof(fullTopic), "%s/%s", topic.c_str(), subtopic) >= (int) sizeof(fullTopic)) {
+        GLOG_WARN("MQTT: topic %s/%s too long, not published\n", topic.c_str(), subtopic);
+        return false;
+    }
+    return client->publish(fullTopic, payload);
+}
+
 void MqttPublisher::setClientId(String &clientId) {
     this->clientId = clientId;
 }
 
 
+void MqttPublisher::setWifiConnectInfo(unsigned long connectMillis, bool fastConnected) {
+    this->wifiConnectMillis = connectMillis;
+    this->wifiFastConnected = fastConnected;
+}
+
+void MqttPublisher::setTls(MqttTls *tls) {
+    this->tls = tls;
+}
+
 void MqttPublisher::setCallback(void (*callback)(char* topic, byte* payload, unsigned int length)) {
+    // kept for a fallback client
+    this->callback = callback;
     client->setCallback(callback);
 }
 
 void MqttPublisher::addSubscription(const char *subtopic) {
     String fullTopic = this->topic + "/" + subtopic;
     
-    GLOG::println(String(F("MQTT: subscribe [")) + fullTopic + "]");
+    GLOG_INFO("MQTT: subscribe [%s]\n", fullTopic.c_str());
     subscriptions.push_back(fullTopic);
+
+    // otherwise it will be subscribed on the next connection
+    if (connectionState == MQTT_STATE_CONNECTED && client->connected()) {
+        client->subscribe(fullTopic.c_str());
+    }
+}
+
+void MqttPublisher::removeSubscriptions() {
+    if (client->connected()) {
+        for (String s : subscriptions) {
+            client->unsubscribe(s.c_str());
+        }
+    }
+
+    subscriptions.clear();
+    subscribeIdx = 0;
 }
 
 void MqttPublisher::keepConnected() {
     // Don't loop here, do it on the main loop
-    if (!client->connected() && millis() - lastReconnectAttemptMillis > 5000L) {
-        lastReconnectAttemptMillis = millis();
+    switch (connectionState) {
+        case MQTT_STATE_DISCONNECTED:
+            if (!WiFi.isConnected() || millis() - lastAttemptMillis < retryDelayMillis) {
+                break;
+            }
+            lastAttemptMillis = millis();
 
-        // Create a random client ID
-        clientId = this->topic + "-";
-        clientId += String(ESP.getChipId(), HEX);
-    
-        // Attempt to connect
-        bool success;
-        if (username.length() == 0 && password.length() == 0) {
-            GLOG::print(String(F("MQTT: attempting connection to ")) + this->serverIp + F("..."));
-            success = client->connect(clientId.c_str(), LWT_TOPIC, 1, true, "false");
-        } else {
-            GLOG::print(String(F("MQTT: attempting connection to ")) + this->serverIp + F(" with username '") + username + F("' and password with ") + password.length() + F(" chars..."));
-            success = client->connect(clientId.c_str(), username.c_str(), password.c_str(), LWT_TOPIC, 1, true, "false");
+            // Create a random client ID
+            clientId = this->topic + "-";
+            clientId += String(ESP.getChipId(), HEX);
+            connectionState = MQTT_STATE_RESOLVE;
+            break;
 
+        case MQTT_STATE_RESOLVE:
+            if (serverAddress.fromString(serverIp) || WiFi.hostByName(serverIp.c_str(), serverAddress, MQTT_DNS_TIMEOUT_MILLIS) == 1) {
+                connectionState = tls != NULL && tls->needsProbe() ? MQTT_STATE_TLS_PROBE : MQTT_STATE_TCP_CONNECT;
+            } else {
+                GLOG_INFO("MQTT: cannot resolve %s", serverIp.c_str());
+                connectFailed();
+            }
+            break;
+
+        case MQTT_STATE_TLS_PROBE:
+            // its own TCP connection and a partial handshake, a step of its own
+            if (tls->probe(serverAddress, portNumber)) {
+                connectionState = MQTT_STATE_TCP_CONNECT;
+            } else {
+                connectFailed();
+            }
+            break;
+
+        case MQTT_STATE_TCP_CONNECT: {
+            bool connected;
+            if (tls != NULL) {
+                // the handshake takes its own, longer, timeout
+                connected = tls->connect(serverAddress, portNumber);
+            } else {
+                netClient->setTimeout(MQTT_TCP_TIMEOUT_MILLIS);
+                connected = netClient->connect(serverAddress, portNumber);
+            }
+
+            if (connected) {
+                connectionState = MQTT_STATE_MQTT_CONNECT;
+            } else {
+                GLOG_INFO("MQTT: no %s connection to %s:%d", tls != NULL ? "TLS" : "TCP", serverIp.c_str(), portNumber);
+                connectFailed();
+            }
+            break;
         }
-        if (success) {
-            GLOG::println(F("connected"));
-            
-            // Once connected, publish an announcement...
-            publishTele();
-            publishOnline();
-      
-            // ... and resubscribe
-            for (String s : subscriptions) {
-                client->subscribe(s.c_str());
+
+        case MQTT_STATE_MQTT_CONNECT: {
+            // the TCP connection is already up, the MQTT client only does the handshake
+            bool success;
+            if (username.length() == 0 && password.length() == 0) {
+                GLOG_INFO("MQTT: attempting connection to %s...", this->serverIp.c_str());
+                success = client->connect(clientId.c_str(), NULL, NULL, LWT_TOPIC, 1, true, "false");
+            } else {
+                GLOG_INFO("MQTT: attempting connection to %s with username '%s' and password with %u chars...", this->serverIp.c_str(), username.c_str(), password.length());
+                success = client->connect(clientId.c_str(), username.c_str(), password.c_str(), LWT_TOPIC, 1, true, "false");
             }
-        } else {
-            GLOG::print(F("failed, rc="));
-            GLOG::print(client->state());
-            GLOG::println(F(" retry in 5 seconds"));
+
+            if (success) {
+                GLOG_INFO("connected\n");
+                connectionUp();
+
+                // Once connected, publish an announcement...
+                publishTele();
+                publishOnline();
+
+                // ... and resubscribe, one per step
+                subscribeIdx = 0;
+                connectionState = MQTT_STATE_SUBSCRIBE;
+            } else if (client->state() == MQTT_CONNECT_BAD_PROTOCOL && client->getProtocolLevel() == MQTT_PROTOCOL_LEVEL_5) {
+                // not a failure, the broker is reachable: 3.1.1 from now on, straight away
+                GLOG_INFO(" broker refused MQTT 5, falling back to 3.1.1\n");
+                netClient->stop();
+                setupClient(new Mqtt311Client(*netClient));
+                retryDelayMillis = 0;
+                connectionState = MQTT_STATE_DISCONNECTED;
+            } else {
+                netClient->stop();
+                connectFailed();
+            }
+            break;
+        }
+
+        case MQTT_STATE_SUBSCRIBE:
+            if (!client->connected()) {
+                connectionLost();
+            } else if (subscribeIdx < subscriptions.size()) {
+                client->subscribe(subscriptions[subscribeIdx++].c_str());
+            } else {
+                connectionState = MQTT_STATE_CONNECTED;
+            }
+            break;
+
+        case MQTT_STATE_CONNECTED:
+            if (!client->connected()) {
+                connectionLost();
+            }
+            break;
+    }
+}
+
+void MqttPublisher::connectFailed() {
+    failedConnects++;
+
+    retryDelayMillis = backoffMillis / 2 + random(backoffMillis / 2 + 1);
+    backoffMillis = backoffMillis * 2 > MQTT_BACKOFF_MAX_MILLIS ? MQTT_BACKOFF_MAX_MILLIS : backoffMillis * 2;
+    connectionState = MQTT_STATE_DISCONNECTED;
+
+    GLOG_INFO(" failed, rc=%d retry in %lu ms\n", client->state(), retryDelayMillis);
+}
+
+void MqttPublisher::connectionUp() {
+    if (everConnected) {
+        reconnects++;
+        downtimeMillis += millis() - downSinceMillis;
+    }
+    everConnected = true;
+    backoffMillis = MQTT_BACKOFF_MIN_MILLIS;
+}
+
+void MqttPublisher::connectionLost() {
+    GLOG_WARN("MQTT: connection lost, rc=%d\n", client->state());
+    netClient->stop();
+
+    downSinceMillis = millis();
+
+    // the first retry comes quickly, the backoff takes over if that fails
+    lastAttemptMillis = millis();
+    retryDelayMillis = backoffMillis / 2 + random(backoffMillis / 2 + 1);
+    connectionState = MQTT_STATE_DISCONNECTED;
+}
+
+void MqttPublisher::publishLog() {
+    unsigned long now = millis();
+    // after the queued messages
+    if (!client->connected() || getQueueDepth() > 0 || now - lastLogPublishMillis < MQTT_LOG_INTERVAL_MILLIS) {
+        return;
+    }
+
+    char batch[MQTT_LOG_BATCH_SIZE + 1];
+    size_t n = GLOG::getRing().read(logCursor, (uint8_t *) batch, MQTT_LOG_BATCH_SIZE);
+    if (n == 0) {
+        return;
+    }
+
+    // keep lines whole when the batch is full, the rest goes on the next batch
+    if (n == MQTT_LOG_BATCH_SIZE) {
+        size_t lineEnd = n;
+        while (lineEnd > 0 && batch[lineEnd - 1] != '\n') {
+            lineEnd--;
+        }
+        if (lineEnd > 0) {
+            logCursor -= n - lineEnd;
+            n = lineEnd;
         }
     }
+    batch[n] = '\0';
+
+    client->publish((topic + "/log").c_str(), batch);
+    lastLogPublishMillis = now;
+}
+
+void MqttPublisher::publishQueued() {
+    unsigned long now = millis();
+    uint32_t refill = (uint64_t) (now - lastRefillMillis) * MQTT_PUBLISH_RATE_BYTES / 1000;
+    if (refill > 0) {
+        tokens = tokens + refill > MQTT_PUBLISH_BURST_BYTES ? MQTT_PUBLISH_BURST_BYTES : tokens + refill;
+        lastRefillMillis = now;
+    }
+
+    // kept for the next connection otherwise
+    if (!isConnected()) {
+        return;
+    }
+
+    for (int sent = 0; sent < MQTT_PUBLISH_LOOP_MESSAGES; sent++) {
+        bool live = liveQueue.depth() > 0;
+        PublishQueue &queue = live ? liveQueue : teleQueue;
+        const char *subtopic;
+        const char *payload;
+        if (!queue.peek(&subtopic, &payload)) {
+            break;
+        }
+
+        char fullTopic[MQTT_TOPIC_BUFFER_SIZE];
+        if (snprintf(fullTopic, sizeof(fullTopic), "%s/%s", topic.c_str(), subtopic) >= (int) sizeof(fullTopic)) {
+            // a cut topic would land somewhere else, counted as failed
+            GLOG_WARN("MQTT: topic %s/%s too long, not published\n", topic.c_str(), subtopic);
+            failedPublishes++;
+            queue.pop();
+            continue;
+        }
+        uint32_t cost = strlen(fullTopic) + strlen(payload) + MQTT_PUBLISH_OVERHEAD_BYTES;
+
+        // a message bigger than the burst goes with a full bucket
+        if (tokens < cost && tokens < MQTT_PUBLISH_BURST_BYTES) {
+            break;
+        }
+        // the write would wait for the ACKs of what is in flight
+        size_t space = netClient->availableForWrite();
+        if (space < cost) {
+            congested++;
+            break;
+        }
+
+        uint32_t before = client->getPublishBytes();
+        if (!client->publish(fullTopic, payload)) {
+            failedPublishes++;
+        }
+        if (live) {
+            pollBytes += client->getPublishBytes() - before;
+        }
+        tokens = tokens > cost ? tokens - cost : 0;
+        queue.pop();
+    }
 }
 
 void MqttPublisher::loop() {
     keepConnected();
     client->loop();
+    publishQueued();
+    publishLog();
 }
 
 bool MqttPublisher::isConnected() {
-    return client->connected();
+    return connectionState == MQTT_STATE_CONNECTED && client->connected();
+}
+
+uint8_t MqttPublisher::getConnectionState() {
+    return connectionState;
+}
+
+uint16_t MqttPublisher::getQueueDepth() {
+    return liveQueue.depth() + teleQueue.depth();
+}
+
+uint32_t MqttPublisher::getPollBytes() {
+    return lastPollBytes;
+}
+
+uint8_t MqttPublisher::getProtocolLevel() {
+    return client->getProtocolLevel();
+}
+
+const char *MqttPublisher::getTopic() {
+    return topic.c_str();
 }
 
 
@@ -12,10 +12,57 @@
 #include <ESP8266WiFi.h>
 #include <PubSubClient.h>
 #include "InverterData.h"
+#include "InverterSink.h"
+#include "MqttTls.h"
+#include "MqttClient.h"
+#include "PublishQueue.h"
 
-class MqttPublisher {
+// log ring drain to <topic>/log, at most one batch per interval
+#define MQTT_LOG_BATCH_SIZE 256
+#define MQTT_LOG_INTERVAL_MILLIS 1000
+
+// connection sequence, keepConnected() takes one step per loop() call so the
+// blocking calls (DNS, TCP connect, MQTT handshake) never run back to back
+#define MQTT_STATE_DISCONNECTED  0   // waiting for the backoff delay
+#define MQTT_STATE_RESOLVE       1   // broker name to address
+#define MQTT_STATE_TLS_PROBE     2   // TLS max fragment length, once per broker
+#define MQTT_STATE_TCP_CONNECT   3   // and the TLS handshake
+#define MQTT_STATE_MQTT_CONNECT  4   // CONNECT/CONNACK, then the announcement
+#define MQTT_STATE_SUBSCRIBE     5   // one subscription per step
+#define MQTT_STATE_CONNECTED     6
+
+// each blocking step gives up after these
+#define MQTT_DNS_TIMEOUT_MILLIS 2000
+#define MQTT_TCP_TIMEOUT_MILLIS 1000
+#define MQTT_HANDSHAKE_TIMEOUT_SECONDS 2
+
+// retry delay after a failed attempt doubles up to the max, picked at random
+// between half and all of it so boards behind the same outage spread out
+#define MQTT_BACKOFF_MIN_MILLIS 1000
+#define MQTT_BACKOFF_MAX_MILLIS 60000
+
+// <base topic>/<field name> for emitted values, longer topics are cut
+#define MQTT_TOPIC_BUFFER_SIZE 128
+
+// values and tele wait in these until loop() sends them, live values first
+#define MQTT_QUEUE_LIVE_SIZE 3072
+#define MQTT_QUEUE_TELE_SIZE 1536
+
+// token bucket on the bytes sent from the queues: the sustained rate, the most
+// in one go (a TCP segment) and the messages per loop() call at most
+#define MQTT_PUBLISH_RATE_BYTES 8192
+#define MQTT_PUBLISH_BURST_BYTES 1460
+#define MQTT_PUBLISH_LOOP_MESSAGES 8
+// fixed header, remaining length and topic length of a PUBLISH, near enough
+#define MQTT_PUBLISH_OVERHEAD_BYTES 5
+
+// values kept while offline are replayed here, see HistoryBuffer
+#define MQTT_HISTORY_SUBTOPIC "history"
+
+class MqttPublisher : public InverterSink {
     private:
-        PubSubClient *client;
+        MqttClient *client;
+        void (*callback)(char* topic, byte* payload, unsigned int length);
         String serverIp;
         int portNumber;
         String username;
@@ -23,24 +70,85 @@ class MqttPublisher {
         String topic;
         String clientId;
         std::vector<String> subscriptions;
-        long lastReconnectAttemptMillis;
+        WiFiClient *netClient;
+        MqttTls *tls;
+        IPAddress serverAddress;
+
+        uint8_t connectionState;
+        size_t subscribeIdx;
+        unsigned long lastAttemptMillis;
+        unsigned long retryDelayMillis;
+        unsigned long backoffMillis;
+        bool everConnected;
+        unsigned long downSinceMillis;
+        uint32_t downtimeMillis;
+        uint32_t reconnects;
+        uint32_t failedConnects;
+        uint32_t pollBytes;
+        uint32_t lastPollBytes;
+
+        PublishQueue liveQueue;
+        PublishQueue teleQueue;
+        uint32_t tokens;
+        unsigned long lastRefillMillis;
+        uint32_t failedPublishes;
+        uint32_t congested;
+
+        unsigned long wifiConnectMillis;
+        bool wifiFastConnected;
+        uint32_t logCursor;
+        unsigned long lastLogPublishMillis;
         
+        void setupClient(MqttClient *client);
         void keepConnected();
+        void connectFailed();
+        void connectionUp();
+        void connectionLost();
+        void publishLog();
+        void queueTele(const char *name, const char *value);
+        void publishQueued();
+        // queueTele() for the values of emitStats()
+        class TeleSink;
+
+    protected:
+        // queues one inverter value for <topic>/<name>
+        virtual void emitValue(const char *name, const char *value);
         
     public:
-        MqttPublisher(WiFiClient &espClient, const char *username, const char * password, const char *baseTopic, const char *server, int port = 1883);
+        // mqtt5 tries MQTT 5 with topic aliases first and falls back to 3.1.1 if the broker refuses it
+        MqttPublisher(WiFiClient &espClient, const char *username, const char * password, const char *baseTopic, const char *server, int port = 1883, bool mqtt5 = false);
         ~MqttPublisher();
        
         void publishData(InverterData &data);
+        // the values emitted from here on are one poll, for the PollBytes tele
+        void beginPoll();
+        // bytes on the wire for the values of the previous poll
+        uint32_t getPollBytes();
         void publishTele();
+        void publishTele(InverterData &extra);
         void publishOnline();
+        // false while live values are waiting, they go first
+        bool publishHistory(const char *payload);
+        // <topic>/<subtopic> straight away, the same way as the history
+        bool publishNow(const char *subtopic, const char *payload);
+        // messages waiting in both queues
+        uint16_t getQueueDepth();
+        // the connection and queue counters of the tele data
+        void emitStats(InverterSink &sink);
         
         void setClientId(String &clientId);
+        void setWifiConnectInfo(unsigned long connectMillis, bool fastConnected);
+        // the publisher was given tls->getClient(), connections go through its handshake
+        void setTls(MqttTls *tls);
         void setCallback(void (*callback)(char* topic, byte* payload, unsigned int length));
         void addSubscription(const char *subtopic);
+        void removeSubscriptions();
 
         void loop();
         bool isConnected();
+        uint8_t getConnectionState();
+        uint8_t getProtocolLevel();
+        const char *getTopic();
 };
 
 #endif
\ No newline at end of file
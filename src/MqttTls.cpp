@@ -0,0 +1,101 @@
+/*
+  MqttTls.cpp - Library for the ESP8266/ESP32 Arduino platform
+  TLS transport for MqttPublisher, tuned for the little heap of the ESP8266
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <StackThunk.h>
+#include "MqttTls.h"
+#include "GLog.h"
+
+MqttTls::MqttTls() {
+    fingerprintValid = false;
+    probed = false;
+    rxBufferSize = MQTT_TLS_RX_BUFFER_SIZE;
+    handshakes = 0;
+    failedHandshakes = 0;
+    fullHandshakeMillis = 0;
+    lastHandshakeMillis = 0;
+    heapRetained = 0;
+}
+
+bool MqttTls::begin(const char *fingerprint) {
+    client.stop();
+    session = BearSSL::Session();
+    client.setSession(&session);
+    client.setTimeout(MQTT_TLS_TIMEOUT_MILLIS);
+    client.setBufferSizes(rxBufferSize, MQTT_TLS_TX_BUFFER_SIZE);
+
+    probed = rxBufferSize >= MQTT_TLS_FULL_RX_BUFFER_SIZE;
+    handshakes = 0;
+    failedHandshakes = 0;
+    fullHandshakeMillis = 0;
+    lastHandshakeMillis = 0;
+    heapRetained = 0;
+
+    // pinning only, there is no CA to fall back on
+    fingerprintValid = client.setFingerprint(fingerprint);
+    if (!fingerprintValid) {
+        GLOG_ERROR("TLS: bad fingerprint [%s]\n", fingerprint);
+    }
+    return fingerprintValid;
+}
+
+WiFiClient &MqttTls::getClient() {
+    return client;
+}
+
+bool MqttTls::needsProbe() {
+    return !probed;
+}
+
+bool MqttTls::probe(IPAddress address, uint16_t port) {
+    // no fallback to 16KB buffers, they would starve the heap
+    probed = BearSSL::WiFiClientSecure::probeMaxFragmentLength(address, port, MQTT_TLS_RX_BUFFER_SIZE);
+    if (!probed) {
+        failedHandshakes++;
+        GLOG_ERROR("TLS: broker refused a max fragment length of %d or is down, no TLS connection\n", MQTT_TLS_RX_BUFFER_SIZE);
+    }
+    return probed;
+}
+
+bool MqttTls::connect(IPAddress address, uint16_t port) {
+    if (!fingerprintValid || !probed) {
+        return false;
+    }
+
+    uint32_t freeBefore = ESP.getFreeHeap();
+    unsigned long start = millis();
+    bool success = client.connect(address, port);
+    unsigned long elapsed = millis() - start;
+
+    if (!success) {
+        failedHandshakes++;
+        GLOG_WARN("TLS: handshake failed after %lu ms\n", elapsed);
+        client.stop();
+        return false;
+    }
+
+    uint32_t freeAfter = ESP.getFreeHeap();
+    heapRetained = freeBefore > freeAfter ? freeBefore - freeAfter : 0;
+    handshakes++;
+    lastHandshakeMillis = elapsed;
+    if (fullHandshakeMillis == 0) {
+        fullHandshakeMillis = elapsed;
+    }
+
+    GLOG_INFO("TLS: handshake %lu ms, %lu heap bytes retained\n", elapsed, (unsigned long) heapRetained);
+    return true;
+}
+
+void MqttTls::emitStats(InverterSink &sink) {
+    sink.emit("Mqtt/Tls/Handshakes", handshakes);
+    sink.emit("Mqtt/Tls/FailedHandshakes", failedHandshakes);
+    sink.emit("Mqtt/Tls/FullHandshakeMs", fullHandshakeMillis);
+    sink.emit("Mqtt/Tls/HandshakeMs", lastHandshakeMillis);
+    sink.emit("Mqtt/Tls/HeapRetained", heapRetained);
+    sink.emit("Mqtt/Tls/StackMax", (uint32_t) stack_thunk_get_max_usage());
+    sink.emit("Mqtt/Tls/RxBuffer", rxBufferSize);
+}
@@ -0,0 +1,74 @@
+/*
+  MqttTls.h - Library header for the ESP8266/ESP32 Arduino platform
+  TLS transport for MqttPublisher, tuned for the little heap of the ESP8266
+
+  The broker certificate is pinned by its SHA1 fingerprint, so no CA chain is
+  kept or validated. The BearSSL session outlives the TCP connection and each
+  reconnect resumes it, which skips the key exchange that takes seconds of CPU.
+  The record buffers are MQTT_TLS_RX_BUFFER_SIZE instead of 16KB, which needs
+  a broker that accepts the max fragment length. This is probed before the
+  first connection, a broker that refuses it gets no TLS connection (16KB
+  buffers do not fit next to the rest on the heap) and is probed again on the
+  next attempt. The BearSSL client is only allocated when TLS is configured
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef _MQTT_TLS_H
+#define _MQTT_TLS_H
+
+#include <ESP8266WiFi.h>
+#include <WiFiClientSecure.h>
+#include "InverterSink.h"
+
+// record buffers when the broker takes the max fragment length (512, 1024, 2048 or 4096)
+// set with -DMQTT_TLS_RX_BUFFER_SIZE=n in build_flags
+#ifndef MQTT_TLS_RX_BUFFER_SIZE
+#define MQTT_TLS_RX_BUFFER_SIZE 1024
+#endif
+#ifndef MQTT_TLS_TX_BUFFER_SIZE
+#define MQTT_TLS_TX_BUFFER_SIZE 512
+#endif
+
+// what the broker may send without the max fragment length, nothing to probe when the buffer is this big
+#define MQTT_TLS_FULL_RX_BUFFER_SIZE 16384
+
+// a full handshake is mostly CPU time, it needs longer than a TCP connect
+#define MQTT_TLS_TIMEOUT_MILLIS 5000
+
+class MqttTls {
+    public:
+        MqttTls();
+
+        // the fingerprint is 20 hex bytes, with or without separators, returns false if it does not parse
+        // forgets the session, the probe and the stats, they belong to the previous broker
+        bool begin(const char *fingerprint);
+        WiFiClient &getClient();
+
+        // max fragment length, asked until the broker takes it once per begin()
+        bool needsProbe();
+        // false when the broker refuses it or cannot be reached, no connection then
+        bool probe(IPAddress address, uint16_t port);
+
+        // TCP connect and handshake, timed
+        bool connect(IPAddress address, uint16_t port);
+
+        // handshake cost for the tele topic
+        void emitStats(InverterSink &sink);
+
+    private:
+        BearSSL::WiFiClientSecure client;
+        BearSSL::Session session;
+        bool fingerprintValid;
+        bool probed;
+        uint16_t rxBufferSize;
+
+        uint32_t handshakes;
+        uint32_t failedHandshakes;
+        uint32_t fullHandshakeMillis;   // first handshake after begin(), nothing to resume
+        uint32_t lastHandshakeMillis;
+        uint32_t heapRetained;          // free heap before connect() less free heap after it, not the peak of the handshake
+};
+
+#endif
@@ -0,0 +1,278 @@
+/*
+  OutputPipeline.cpp - Library for the ESP8266/ESP32 Arduino platform
+  Fan-out of each poll to the outputs, each with its own rate, filter and queue
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include "OutputPipeline.h"
+#include "PublishQueue.h"
+
+OutputStage::OutputStage(const char *name, size_t queueSize) {
+    strncpy(this->name, name, sizeof(this->name) - 1);
+    this->name[sizeof(this->name) - 1] = '\0';
+    this->filter[0] = '\0';
+    this->messages = queueSize > 0 ? new PublishQueue(queueSize) : NULL;
+    this->intervalMillis = 0;
+    this->lastPollMillis = 0;
+    this->failedAtMillis = 0;
+    this->retryMillis = 0;
+    this->attempts = 0;
+    this->everPolled = false;
+    this->taking = false;
+    this->polls = 0;
+    this->skipped = 0;
+    this->dropped = 0;
+    this->sent = 0;
+    this->failed = 0;
+}
+
+OutputStage::~OutputStage() {
+    delete messages;
+}
+
+void OutputStage::setInterval(unsigned long millis) {
+    intervalMillis = millis;
+}
+
+void OutputStage::setFilter(const char *filter) {
+    strncpy(this->filter, filter, sizeof(this->filter) - 1);
+    this->filter[sizeof(this->filter) - 1] = '\0';
+}
+
+bool OutputStage::matches(const char *name) {
+    if (filter[0] == '\0') {
+        return true;
+    }
+
+    // "1/Pac" is Pac
+    const char *field = name;
+    while (*field >= '0' && *field <= '9') field++;
+    field = field != name && *field == '/' ? field + 1 : name;
+    size_t fieldLength = strlen(field);
+
+    for (const char *item = filter; *item != '\0'; ) {
+        const char *end = strchr(item, ',');
+        size_t length = end == NULL ? strlen(item) : end - item;
+        if (length > 0 && item[length - 1] == '*') {
+            if (fieldLength >= length - 1 && strncmp(field, item, length - 1) == 0) {
+                return true;
+            }
+        } else if (length == fieldLength && strncmp(field, item, length) == 0) {
+            return true;
+        }
+        if (end == NULL) {
+            break;
+        }
+        item = end + 1;
+    }
+    return false;
+}
+
+const char *OutputStage::getName() {
+    return name;
+}
+
+uint16_t OutputStage::getQueueDepth() {
+    return messages != NULL ? messages->depth() : 0;
+}
+
+void OutputStage::emitStats(InverterSink &sink) {
+    char stat[OUTPUT_NAME_SIZE + 24];
+
+    snprintf(stat, sizeof(stat), "Output/%s/Polls", name);
+    sink.emit(stat, polls);
+    snprintf(stat, sizeof(stat), "Output/%s/Skipped", name);
+    sink.emit(stat, skipped);
+    snprintf(stat, sizeof(stat), "Output/%s/Sent", name);
+    sink.emit(stat, sent);
+    snprintf(stat, sizeof(stat), "Output/%s/Failed", name);
+    sink.emit(stat, failed);
+    snprintf(stat, sizeof(stat), "Output/%s/Dropped", name);
+    sink.emit(stat, dropped);
+    snprintf(stat, sizeof(stat), "Output/%s/Queue", name);
+    sink.emit(stat, getQueueDepth());
+}
+
+void OutputStage::addValue(const char *name, const char *value) {
+    queue(name, value);
+}
+
+bool OutputStage::queue(const char *key, const char *payload) {
+    if (messages == NULL || !messages->push(key, payload)) {
+        dropped++;
+        return false;
+    }
+    return true;
+}
+
+JsonOutputStage::JsonOutputStage(const char *name, size_t queueSize, const char *key) : OutputStage(name, queueSize) {
+    this->key = key;
+    this->json = new char[OUTPUT_JSON_SIZE];
+    this->length = 0;
+    this->fields = 0;
+    this->time = 0;
+}
+
+JsonOutputStage::~JsonOutputStage() {
+    delete[] json;
+}
+
+void JsonOutputStage::start() {
+    length = snprintf(json, OUTPUT_JSON_SIZE, "{\"time\":%lu", (unsigned long) time);
+    fields = 0;
+}
+
+void JsonOutputStage::flush() {
+    json[length++] = '}';
+    json[length] = '\0';
+    queue(key, json);
+    start();
+}
+
+void JsonOutputStage::beginPoll(time_t time) {
+    this->time = time;
+    start();
+}
+
+void JsonOutputStage::addValue(const char *name, const char *value) {
+    // escaped: every character of the value may double
+    char item[INVERTER_SINK_NAME_SIZE + 2 * INVERTER_SINK_VALUE_SIZE + 8];
+    size_t itemLength = formatJsonField(name, value, item, sizeof(item));
+    if (itemLength == 0) {
+        failed++;
+        return;
+    }
+
+    // a comma in front and the closing brace
+    if (length + itemLength + 2 >= OUTPUT_JSON_SIZE) {
+        flush();
+    }
+    json[length++] = ',';
+    memcpy(json + length, item, itemLength);
+    length += itemLength;
+    fields++;
+}
+
+void JsonOutputStage::endPoll() {
+    // only the time, nothing to send
+    if (fields > 0) {
+        flush();
+    }
+}
+
+OutputPipeline::OutputPipeline() {
+    stageCount = 0;
+    inPoll = false;
+}
+
+OutputPipeline::~OutputPipeline() {
+    clear();
+}
+
+bool OutputPipeline::add(OutputStage *stage) {
+    if (stageCount >= OUTPUT_MAX_STAGES) {
+        delete stage;
+        return false;
+    }
+    stages[stageCount++] = stage;
+    return true;
+}
+
+void OutputPipeline::clear() {
+    for (uint8_t i = 0; i < stageCount; i++) {
+        delete stages[i];
+    }
+    stageCount = 0;
+    inPoll = false;
+}
+
+uint8_t OutputPipeline::getStageCount() {
+    return stageCount;
+}
+
+OutputStage *OutputPipeline::getStage(uint8_t index) {
+    return index < stageCount ? stages[index] : NULL;
+}
+
+void OutputPipeline::beginPoll(unsigned long now, time_t time) {
+    for (uint8_t i = 0; i < stageCount; i++) {
+        OutputStage &stage = *stages[i];
+        stage.taking = !stage.everPolled || stage.intervalMillis == 0 || now - stage.lastPollMillis >= stage.intervalMillis;
+        if (!stage.taking) {
+            stage.skipped++;
+            continue;
+        }
+        stage.everPolled = true;
+        stage.lastPollMillis = now;
+        stage.polls++;
+        stage.beginPoll(time);
+    }
+    inPoll = true;
+}
+
+void OutputPipeline::emitValue(const char *name, const char *value) {
+    if (!inPoll) {
+        return;
+    }
+    for (uint8_t i = 0; i < stageCount; i++) {
+        OutputStage &stage = *stages[i];
+        if (stage.taking && stage.matches(name)) {
+            stage.addValue(name, value);
+        }
+    }
+}
+
+void OutputPipeline::endPoll() {
+    for (uint8_t i = 0; i < stageCount; i++) {
+        OutputStage &stage = *stages[i];
+        if (stage.taking) {
+            stage.endPoll();
+            stage.taking = false;
+        }
+    }
+    inPoll = false;
+}
+
+void OutputPipeline::loop() {
+    unsigned long now = millis();
+
+    for (uint8_t i = 0; i < stageCount; i++) {
+        OutputStage &stage = *stages[i];
+        stage.loop();
+        if (stage.messages == NULL || (stage.retryMillis > 0 && now - stage.failedAtMillis < stage.retryMillis)) {
+            continue;
+        }
+
+        const char *key;
+        const char *payload;
+        for (uint8_t n = 0; n < OUTPUT_LOOP_MESSAGES && stage.isReady() && stage.messages->peek(&key, &payload); n++) {
+            if (!stage.send(key, payload)) {
+                // kept, this stage waits longer each time and the others go on
+                stage.failed++;
+                stage.failedAtMillis = now;
+                stage.retryMillis = stage.retryMillis == 0 ? OUTPUT_RETRY_MILLIS : stage.retryMillis * 2;
+                if (stage.retryMillis > OUTPUT_RETRY_MAX_MILLIS) {
+                    stage.retryMillis = OUTPUT_RETRY_MAX_MILLIS;
+                }
+                if (++stage.attempts >= OUTPUT_MAX_ATTEMPTS) {
+                    stage.messages->pop();
+                    stage.dropped++;
+                    stage.attempts = 0;
+                }
+                break;
+            }
+            stage.messages->pop();
+            stage.sent++;
+            stage.attempts = 0;
+            stage.retryMillis = 0;
+        }
+    }
+}
+
+void OutputPipeline::emitStats(InverterSink &sink) {
+    for (uint8_t i = 0; i < stageCount; i++) {
+        stages[i]->emitStats(sink);
+    }
+}
@@ -0,0 +1,152 @@
+/*
+  OutputPipeline.h - Library header for the ESP8266/ESP32 Arduino platform
+  Fan-out of each poll to the outputs, each with its own rate, filter and queue
+
+  The driver decodes a poll once and emits it into the pipeline, which hands
+  every value to the stages that take this poll: a stage skips the polls that
+  come sooner than its interval and the fields its filter does not list. What
+  a stage keeps waits in its own queue until loop() sends it, a few messages
+  per stage and call, so a stage that is slow or down only fills (and then
+  drops from) its own queue and never holds up the others or the polling.
+  After a failed send the stage waits, twice as long after each failure in a
+  row, and a message that failed OUTPUT_MAX_ATTEMPTS times is dropped
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef _OUTPUT_PIPELINE_H
+#define _OUTPUT_PIPELINE_H
+
+#include <Arduino.h>
+#include "InverterSink.h"
+
+#define OUTPUT_MAX_STAGES 6
+// "Http", "MqttJson", ...
+#define OUTPUT_NAME_SIZE 12
+// "Pac,Ppv,E*", a trailing '*' matches any field that starts with the rest
+#define OUTPUT_FILTER_SIZE 96
+// messages sent per stage and loop() call at most
+#define OUTPUT_LOOP_MESSAGES 2
+// a stage whose send failed is not tried again before this, doubled on each failure in a row
+#define OUTPUT_RETRY_MILLIS 5000
+#define OUTPUT_RETRY_MAX_MILLIS 300000
+// a message that fails this many times is dropped, the ones behind it may still go
+#define OUTPUT_MAX_ATTEMPTS 5
+
+// bytes of messages each queued stage keeps, and the longest JSON message
+#ifndef OUTPUT_QUEUE_SIZE
+#ifdef LARGE_ESP_BOARD
+#define OUTPUT_QUEUE_SIZE 2048
+#else
+#define OUTPUT_QUEUE_SIZE 1024
+#endif
+#endif
+#define OUTPUT_JSON_SIZE 640
+
+class PublishQueue;
+
+class OutputStage {
+    public:
+        // queueSize 0: the stage hands each value on in addValue() and has no queue
+        OutputStage(const char *name, size_t queueSize);
+        virtual ~OutputStage();
+
+        // the shortest time between two polls taken, 0 takes every poll
+        void setInterval(unsigned long millis);
+        // comma separated field names, "E*" for the names that start with E, empty takes them all
+        void setFilter(const char *filter);
+        // the field after any "<addr>/" prefix is in the filter
+        bool matches(const char *name);
+        const char *getName();
+        uint16_t getQueueDepth();
+        // Output/<name>/...
+        void emitStats(InverterSink &sink);
+
+    protected:
+        uint32_t sent;
+        uint32_t failed;
+
+        virtual void beginPoll(time_t) {}
+        // default: one message per value, the field name as its key
+        virtual void addValue(const char *name, const char *value);
+        virtual void endPoll() {}
+        // between the sends, e.g. to read a reply
+        virtual void loop() {}
+        // false while the stage cannot send at all, e.g. disconnected
+        virtual bool isReady() { return true; }
+        // the oldest queued message, false keeps it for a later call
+        virtual bool send(const char *, const char *) { return false; }
+        // false, and counted, when it does not fit
+        bool queue(const char *key, const char *payload);
+
+    private:
+        friend class OutputPipeline;
+
+        char name[OUTPUT_NAME_SIZE];
+        char filter[OUTPUT_FILTER_SIZE];
+        PublishQueue *messages;
+        unsigned long intervalMillis;
+        unsigned long lastPollMillis;
+        unsigned long failedAtMillis;
+        unsigned long retryMillis;      // 0 when the last send went
+        uint8_t attempts;               // of the message at the head
+        bool everPolled;
+        bool taking;
+        uint32_t polls;
+        uint32_t skipped;
+        uint32_t dropped;
+};
+
+// one JSON object per poll, {"time":<epoch>,"Pac":1234.5,...}, split in more
+// messages (each with the time) when it does not fit in OUTPUT_JSON_SIZE
+class JsonOutputStage : public OutputStage {
+    public:
+        JsonOutputStage(const char *name, size_t queueSize, const char *key);
+        virtual ~JsonOutputStage();
+
+    protected:
+        virtual void beginPoll(time_t time);
+        virtual void addValue(const char *name, const char *value);
+        virtual void endPoll();
+
+    private:
+        const char *key;
+        char *json;
+        size_t length;
+        uint16_t fields;        // in the message being built
+        time_t time;
+
+        void start();
+        void flush();
+};
+
+class OutputPipeline : public InverterSink {
+    public:
+        OutputPipeline();
+        ~OutputPipeline();
+
+        // the pipeline owns the stage, false (and deleted) when there is no room
+        bool add(OutputStage *stage);
+        // deletes all the stages
+        void clear();
+        uint8_t getStageCount();
+        OutputStage *getStage(uint8_t index);
+
+        // the values emitted in between are one poll
+        void beginPoll(unsigned long now, time_t time);
+        void endPoll();
+
+        void loop();
+        void emitStats(InverterSink &sink);
+
+    protected:
+        virtual void emitValue(const char *name, const char *value);
+
+    private:
+        OutputStage *stages[OUTPUT_MAX_STAGES];
+        uint8_t stageCount;
+        bool inPoll;
+};
+
+#endif
@@ -0,0 +1,122 @@
+/*
+  PublishQueue.cpp - Library for the ESP8266/ESP32 Arduino platform
+  MQTT messages waiting for MqttPublisher::loop()
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include "PublishQueue.h"
+
+#define RECORD_HEADER_SIZE 2
+
+PublishQueue::PublishQueue(size_t size) {
+    this->buffer = new uint8_t[size];
+    this->size = size;
+    this->highWater = 0;
+    this->drops = 0;
+    clear();
+}
+
+PublishQueue::~PublishQueue() {
+    delete[] buffer;
+}
+
+bool PublishQueue::push(const char *subtopic, const char *payload) {
+    size_t subtopicLength = strlen(subtopic) + 1;
+    size_t payloadLength = strlen(payload) + 1;
+    size_t length = RECORD_HEADER_SIZE + subtopicLength + payloadLength;
+
+    // free space is [tail, size) + [0, head) or [tail, head), none when full
+    size_t pos;
+    if (count > 0 && tail == head) {
+        pos = size;
+    } else if (tail >= head) {
+        if (size - tail >= length) {
+            pos = tail;
+        } else if (head >= length) {
+            if (size - tail >= RECORD_HEADER_SIZE) {
+                buffer[tail] = 0;
+                buffer[tail + 1] = 0;
+            }
+            pos = 0;
+        } else {
+            pos = size;
+        }
+    } else {
+        pos = head - tail >= length ? tail : size;
+    }
+
+    if (pos == size) {
+        drops++;
+        return false;
+    }
+
+    buffer[pos] = length & 0xff;
+    buffer[pos + 1] = length >> 8;
+    memcpy(buffer + pos + RECORD_HEADER_SIZE, subtopic, subtopicLength);
+    memcpy(buffer + pos + RECORD_HEADER_SIZE + subtopicLength, payload, payloadLength);
+    tail = pos + length;
+
+    count++;
+    if (count > highWater) {
+        highWater = count;
+    }
+    return true;
+}
+
+bool PublishQueue::peek(const char **subtopic, const char **payload) {
+    if (count == 0) {
+        return false;
+    }
+
+    // skip the end of ring marker
+    if (recordLength(head) == 0) {
+        head = 0;
+    }
+
+    *subtopic = (const char *) buffer + head + RECORD_HEADER_SIZE;
+    *payload = *subtopic + strlen(*subtopic) + 1;
+    return true;
+}
+
+void PublishQueue::pop() {
+    if (count == 0) {
+        return;
+    }
+    if (recordLength(head) == 0) {
+        head = 0;
+    }
+
+    head += recordLength(head);
+    count--;
+    if (count == 0) {
+        head = 0;
+        tail = 0;
+    }
+}
+
+void PublishQueue::clear() {
+    head = 0;
+    tail = 0;
+    count = 0;
+}
+
+uint16_t PublishQueue::depth() {
+    return count;
+}
+
+uint16_t PublishQueue::maxDepth() {
+    return highWater;
+}
+
+uint32_t PublishQueue::dropped() {
+    return drops;
+}
+
+size_t PublishQueue::recordLength(size_t pos) {
+    if (size - pos < RECORD_HEADER_SIZE) {
+        return 0;
+    }
+    return buffer[pos] | buffer[pos + 1] << 8;
+}
@@ -0,0 +1,47 @@
+/*
+  PublishQueue.h - Library header for the ESP8266/ESP32 Arduino platform
+  MQTT messages waiting for MqttPublisher::loop()
+
+  Messages are kept back to back in a byte ring allocated once, as a 2 byte
+  record length, the subtopic and the payload (both nul terminated), so queuing
+  does not touch the heap. A record that does not fit at the end of the ring
+  leaves a zero length marker there and goes to the start. When the ring is
+  full the new message is dropped and counted
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef _PUBLISH_QUEUE_H
+#define _PUBLISH_QUEUE_H
+
+#include <Arduino.h>
+
+class PublishQueue {
+    public:
+        PublishQueue(size_t size);
+        ~PublishQueue();
+
+        bool push(const char *subtopic, const char *payload);
+        // the oldest message, valid until pop(); false when empty
+        bool peek(const char **subtopic, const char **payload);
+        void pop();
+        void clear();
+
+        uint16_t depth();
+        uint16_t maxDepth();
+        uint32_t dropped();
+
+    private:
+        uint8_t *buffer;
+        size_t size;
+        size_t head;    // oldest record
+        size_t tail;    // where the next one goes
+        uint16_t count;
+        uint16_t highWater;
+        uint32_t drops;
+
+        size_t recordLength(size_t pos);
+};
+
+#endif
@@ -0,0 +1,277 @@
+/*
+  TimeSeries.cpp - Library for the ESP8266/ESP32 Arduino platform
+  Recent power values kept in RAM at three resolutions, for the HTTP /series page
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <cmath>
+#include "TimeSeries.h"
+#include "GLog.h"
+
+// field names kept, after any "<addr>/" prefix
+static const char *const TIMESERIES_FIELDS[] = {
+    "Pac", "Ppv", "Ppv1", "Ppv2", "Pload",
+    "Pbat", "Pcharge", "Pdischarge"
+};
+
+static const char *const TIER_NAMES[TIMESERIES_TIERS] = { "raw", "1m", "15m" };
+static const uint32_t TIER_STEPS[TIMESERIES_TIERS] = { 0, 60, 900 };
+
+// the parts of a reply
+#define PART_HEADER 0
+#define PART_POINTS 1
+#define PART_FOOTER 2
+#define PART_DONE   3
+
+// ",[4294967295,-32768]", the JSON header adds the name
+#define ROW_SIZE 32
+
+TimeSeries::TimeSeries() {
+    seriesCount = 0;
+    sampleTime = 0;
+    rejected = 0;
+}
+
+TimeSeries::~TimeSeries() {
+    for (uint8_t i = 0; i < seriesCount; i++) {
+        for (TimeSeriesRing &ring : series[i].rings) {
+            delete[] ring.values;
+            delete[] ring.times;
+        }
+    }
+}
+
+void TimeSeries::beginSample(uint32_t time) {
+    sampleTime = time;
+}
+
+void TimeSeries::emitValue(const char *name, const char *value) {
+    float number;
+    if (!fieldNumber(name, value, TIMESERIES_FIELDS, number)) {
+        return;
+    }
+
+    int8_t idx = find(name);
+    TimeSeriesData *data = idx >= 0 ? &series[idx] : create(name);
+    if (data == NULL) {
+        // every series taken, a second inverter on the bus usually
+        if (rejected++ == 0) {
+            GLOG_WARN("SERIES: no room for %s\n", name);
+        }
+        return;
+    }
+
+    // whole watts, saturated, the lowest value means no data
+    long watts = lroundf(number);
+    int16_t v = watts > INT16_MAX ? INT16_MAX : watts <= TIMESERIES_NO_DATA ? TIMESERIES_NO_DATA + 1 : watts;
+
+    if (data->rings[TIMESERIES_RAW].size > 0) {
+        push(data->rings[TIMESERIES_RAW], sampleTime, v);
+    }
+    addToBucket(data->rings[TIMESERIES_MINUTE], TIER_STEPS[TIMESERIES_MINUTE], v);
+    addToBucket(data->rings[TIMESERIES_QUARTER], TIER_STEPS[TIMESERIES_QUARTER], v);
+}
+
+int8_t TimeSeries::find(const char *name) {
+    for (uint8_t i = 0; i < seriesCount; i++) {
+        if (strcmp(series[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+TimeSeriesData *TimeSeries::create(const char *name) {
+    if (seriesCount >= TIMESERIES_MAX_SERIES || strlen(name) >= TIMESERIES_NAME_SIZE) {
+        return NULL;
+    }
+
+    // the budget share of one series: the day of quarters, half the rest for minutes, raw gets the other half
+    size_t share = TIMESERIES_RAM_BUDGET / TIMESERIES_MAX_SERIES;
+    size_t rest = share > TIMESERIES_QUARTER_POINTS * sizeof(int16_t) ? share - TIMESERIES_QUARTER_POINTS * sizeof(int16_t) : 0;
+#ifdef TIMESERIES_KEEP_RAW
+    size_t minutes = rest / 2 / sizeof(int16_t);
+#else
+    size_t minutes = rest / sizeof(int16_t);
+#endif
+    if (minutes > TIMESERIES_MINUTE_POINTS_MAX) {
+        minutes = TIMESERIES_MINUTE_POINTS_MAX;
+    }
+#ifdef TIMESERIES_KEEP_RAW
+    size_t raw = (rest - minutes * sizeof(int16_t)) / (sizeof(int16_t) + sizeof(uint32_t));
+    if (raw == 0) {
+        raw = 1;
+    }
+#else
+    size_t raw = 0;
+#endif
+
+    TimeSeriesData &data = series[seriesCount++];
+    memset(&data, 0, sizeof(data));
+    strcpy(data.name, name);
+
+    const size_t sizes[TIMESERIES_TIERS] = { raw, minutes, TIMESERIES_QUARTER_POINTS };
+    for (uint8_t t = 0; t < TIMESERIES_TIERS; t++) {
+        TimeSeriesRing &ring = data.rings[t];
+        ring.size = t == TIMESERIES_RAW || sizes[t] > 0 ? sizes[t] : 1;
+        ring.values = ring.size > 0 ? new int16_t[ring.size] : NULL;
+        ring.times = t == TIMESERIES_RAW && ring.size > 0 ? new uint32_t[ring.size] : NULL;
+    }
+
+    GLOG_DEBUG("SERIES: %s, %u raw, %u minutes\n", name, (unsigned) raw, (unsigned) minutes);
+    return &data;
+}
+
+void TimeSeries::push(TimeSeriesRing &ring, uint32_t time, int16_t value) {
+    ring.values[ring.head] = value;
+    if (ring.times != NULL) {
+        ring.times[ring.head] = time;
+    }
+    ring.head = (ring.head + 1) % ring.size;
+    if (ring.count < ring.size) {
+        ring.count++;
+    }
+    ring.lastTime = time;
+}
+
+void TimeSeries::addToBucket(TimeSeriesRing &ring, uint32_t step, int16_t value) {
+    uint32_t bucket = sampleTime - sampleTime % step;
+    uint32_t jump = bucket > ring.bucket ? bucket - ring.bucket : ring.bucket - bucket;
+
+    // a clock step past a whole ring either way, e.g. the first SNTP sync: the points are on the old clock
+    if (ring.samples > 0 && jump > (uint32_t) ring.size * step) {
+        GLOG_DEBUG("SERIES: clock step, %lu s buckets start over\n", (unsigned long) step);
+        ring.count = 0;
+        ring.head = 0;
+        ring.samples = 0;
+        ring.sum = 0;
+    }
+
+    if (ring.samples > 0 && bucket != ring.bucket) {
+        // after a clock set backwards the slot may have a point already
+        if (bucket > ring.bucket && (ring.count == 0 || ring.bucket > ring.lastTime)) {
+            // buckets nobody sampled, less than a whole ring of them
+            uint32_t empty = ring.count > 0 ? (ring.bucket - ring.lastTime) / step - 1 : 0;
+            for (uint32_t i = 0; i < empty && i < ring.size; i++) {
+                push(ring, ring.lastTime + step, TIMESERIES_NO_DATA);
+            }
+            push(ring, ring.bucket, ring.sum / ring.samples);
+        }
+        // a clock set backwards drops the bucket being filled
+        ring.samples = 0;
+        ring.sum = 0;
+    }
+
+    ring.bucket = bucket;
+    ring.sum += value;
+    ring.samples++;
+}
+
+bool TimeSeries::beginQuery(TimeSeriesQuery &query, const char *name, const char *resolution, const char *format) {
+    query.series = find(name);
+    if (query.series < 0) {
+        return false;
+    }
+
+    query.tier = TIMESERIES_TIERS;
+    for (uint8_t t = 0; t < TIMESERIES_TIERS; t++) {
+        if (strcmp(resolution, TIER_NAMES[t]) == 0) {
+            query.tier = t;
+        }
+    }
+    if (query.tier == TIMESERIES_TIERS || series[query.series].rings[query.tier].size == 0) {
+        return false;
+    }
+
+    if (strcmp(format, "json") == 0) {
+        query.json = true;
+    } else if (strcmp(format, "csv") == 0) {
+        query.json = false;
+    } else {
+        return false;
+    }
+
+    query.part = PART_HEADER;
+    query.index = 0;
+    return true;
+}
+
+size_t TimeSeries::renderPoint(TimeSeriesQuery &query, uint16_t index, char *row, size_t size) {
+    TimeSeriesRing &ring = series[query.series].rings[query.tier];
+    uint16_t pos = (ring.head + ring.size - ring.count + index) % ring.size;
+    uint32_t time = ring.times != NULL ? ring.times[pos] : ring.lastTime - (uint32_t) (ring.count - 1 - index) * TIER_STEPS[query.tier];
+    int16_t value = ring.values[pos];
+
+    const char *sep = query.json && index > 0 ? "," : "";
+    if (value == TIMESERIES_NO_DATA) {
+        return snprintf(row, size, query.json ? "%s[%lu,null]" : "%s%lu,\n", sep, (unsigned long) time);
+    }
+    return snprintf(row, size, query.json ? "%s[%lu,%d]" : "%s%lu,%d\n", sep, (unsigned long) time, value);
+}
+
+size_t TimeSeries::readQuery(TimeSeriesQuery &query, char *buffer, size_t size) {
+    TimeSeriesData &data = series[query.series];
+    TimeSeriesRing &ring = data.rings[query.tier];
+    size_t len = 0;
+    char row[ROW_SIZE + 64];
+
+    while (query.part != PART_DONE) {
+        size_t n;
+        if (query.part == PART_HEADER) {
+            n = query.json
+                ? snprintf(row, sizeof(row), "{\"field\":\"%s\",\"resolution\":\"%s\",\"points\":[", data.name, TIER_NAMES[query.tier])
+                : snprintf(row, sizeof(row), "time,%s\n", data.name);
+        } else if (query.part == PART_POINTS) {
+            if (query.index >= ring.count) {
+                query.part = PART_FOOTER;
+                continue;
+            }
+            n = renderPoint(query, query.index, row, sizeof(row));
+        } else {
+            n = query.json ? snprintf(row, sizeof(row), "]}") : 0;
+        }
+
+        // the buffer is full, the row goes in the next chunk
+        if (len + n >= size) {
+            break;
+        }
+        memcpy(buffer + len, row, n);
+        len += n;
+
+        if (query.part == PART_POINTS) {
+            query.index++;
+        } else {
+            query.part = query.part == PART_HEADER ? PART_POINTS : PART_DONE;
+        }
+    }
+
+    buffer[len] = '\0';
+    return len;
+}
+
+size_t TimeSeries::list(char *buffer, size_t size) {
+    size_t len = snprintf(buffer, size, "{\"series\":[");
+    for (uint8_t i = 0; i < seriesCount && len < size; i++) {
+        len += snprintf(buffer + len, size - len, "%s\"%s\"", i > 0 ? "," : "", series[i].name);
+    }
+    if (len < size) {
+        len += snprintf(buffer + len, size - len, "],\"budget\":%u}", (unsigned) TIMESERIES_RAM_BUDGET);
+    }
+    return len < size ? len : size - 1;
+}
+
+uint8_t TimeSeries::getSeriesCount() {
+    return seriesCount;
+}
+
+void TimeSeries::emitStats(InverterSink &sink) {
+    sink.emit("Series/Count", seriesCount);
+    sink.emit("Series/Rejected", rejected);
+}
+
+uint16_t TimeSeries::getPoints(const char *name, uint8_t tier) {
+    int8_t idx = find(name);
+    return idx >= 0 && tier < TIMESERIES_TIERS ? series[idx].rings[tier].count : 0;
+}
@@ -0,0 +1,131 @@
+/*
+  TimeSeries.h - Library header for the ESP8266/ESP32 Arduino platform
+  Recent power values kept in RAM at three resolutions, for the HTTP /series page
+
+  Each selected field gets three rings of whole watts in int16 (values past
+  +-32767W saturate): the raw samples with their time, 1 minute means and 15
+  minute means. The mean rings hold no times, their buckets follow each other
+  from the newest one back and a bucket without samples is kept as "no data".
+  The sizes come from TIMESERIES_RAM_BUDGET: the day of 15 minute means
+  first, then half the rest for up to 6 hours of 1 minute means, and the raw
+  samples get what is left: a few minutes at one sample per second. On the
+  ESP-01 that would be less than a minute of raw samples, so it only keeps
+  the means and the minutes get the whole rest, about 5 hours. A clock step
+  longer than a ring, like the first SNTP sync after counting from boot,
+  starts the mean rings over instead of filling them with "no data"
+
+  A query renders the points into the caller's buffer a few rows at a time,
+  oldest first, as CSV or JSON, so the page is sent in chunks straight from
+  the rings
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef _TIME_SERIES_H
+#define _TIME_SERIES_H
+
+#include <Arduino.h>
+#include "GlobalDefs.h"
+#include "InverterSink.h"
+
+// RAM for all the series, taken when a field is first seen
+#ifndef TIMESERIES_RAM_BUDGET
+#ifdef LARGE_ESP_BOARD
+#define TIMESERIES_RAM_BUDGET 10240
+#else
+#define TIMESERIES_RAM_BUDGET 4096
+#endif
+#endif
+
+// raw samples cost 6 bytes each, too many for the ESP-01 budget, set with -DTIMESERIES_KEEP_RAW in build_flags
+#ifdef LARGE_ESP_BOARD
+#ifndef TIMESERIES_KEEP_RAW
+#define TIMESERIES_KEEP_RAW
+#endif
+#endif
+
+// fields kept, each one gets an equal share of the budget
+#define TIMESERIES_MAX_SERIES 5
+// "22/Pdischarge" fits
+#define TIMESERIES_NAME_SIZE 16
+
+#define TIMESERIES_RAW      0
+#define TIMESERIES_MINUTE   1
+#define TIMESERIES_QUARTER  2
+#define TIMESERIES_TIERS    3
+
+#define TIMESERIES_MINUTE_POINTS_MAX 360    // 6 hours
+#define TIMESERIES_QUARTER_POINTS    96     // a day
+
+// a bucket without samples
+#define TIMESERIES_NO_DATA INT16_MIN
+
+struct TimeSeriesRing {
+    int16_t *values;        // NULL for a ring not kept
+    uint32_t *times;        // raw ring only
+    uint16_t size;
+    uint16_t count;
+    uint16_t head;          // next write
+    uint32_t lastTime;      // time of the newest point, bucket start for the means
+
+    // the bucket being filled
+    uint32_t bucket;
+    int32_t sum;
+    uint16_t samples;
+};
+
+struct TimeSeriesData {
+    char name[TIMESERIES_NAME_SIZE];
+    TimeSeriesRing rings[TIMESERIES_TIERS];
+};
+
+// state of one query between two chunks
+struct TimeSeriesQuery {
+    int8_t series;
+    uint8_t tier;
+    bool json;
+    uint8_t part;           // header, points, footer, done
+    uint16_t index;         // next point, oldest first
+};
+
+class TimeSeries : public InverterSink {
+    public:
+        TimeSeries();
+        ~TimeSeries();
+
+        // time of the values emitted next, in seconds
+        void beginSample(uint32_t time);
+
+        // resolution "raw", "1m" or "15m", format "csv" or "json"; false for an unknown series or argument, or raw when it is not kept
+        bool beginQuery(TimeSeriesQuery &query, const char *name, const char *resolution, const char *format);
+        // the next chunk of the reply, 0 when it is complete; size has to hold a row, 96 bytes
+        size_t readQuery(TimeSeriesQuery &query, char *buffer, size_t size);
+
+        // {"series":["Pac",...],"budget":<bytes>} in one go, the list is short
+        size_t list(char *buffer, size_t size);
+
+        uint8_t getSeriesCount();
+        // series kept and values left out for want of a series, for the tele topic
+        void emitStats(InverterSink &sink);
+        // points in one ring, 0 for an unknown series
+        uint16_t getPoints(const char *name, uint8_t tier);
+
+    protected:
+        // keeps the selected power fields
+        virtual void emitValue(const char *name, const char *value);
+
+    private:
+        TimeSeriesData series[TIMESERIES_MAX_SERIES];
+        uint8_t seriesCount;
+        uint32_t sampleTime;
+        uint32_t rejected;
+
+        int8_t find(const char *name);
+        TimeSeriesData *create(const char *name);
+        void push(TimeSeriesRing &ring, uint32_t time, int16_t value);
+        void addToBucket(TimeSeriesRing &ring, uint32_t step, int16_t value);
+        size_t renderPoint(TimeSeriesQuery &query, uint16_t index, char *row, size_t size);
+};
+
+#endif
@@ -0,0 +1,112 @@
+/*
+  TopicDispatcher.cpp - Library for the ESP8266/ESP32 Arduino platform
+  Routes incoming MQTT commands to the inverter that handles them
+  
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+#include "TopicDispatcher.h"
+#include "Inverter.h"
+#include "GLog.h"
+
+// FNV-1a
+#define TOPIC_HASH_BASIS 2166136261u
+#define TOPIC_HASH_PRIME 16777619u
+
+// seeds tried per table size before doubling it
+#define TOPIC_HASH_SEEDS 64
+
+TopicDispatcher::TopicDispatcher() {
+    seed = 0;
+}
+
+void TopicDispatcher::clear() {
+    routes.clear();
+    buckets.clear();
+}
+
+void TopicDispatcher::add(const char *prefix, const char *subtopic, Inverter *handler, uint8_t command) {
+    // the same topic twice can never be collision free
+    for (const TopicRoute &existing : routes) {
+        if (strncmp(existing.prefix, prefix, TOPIC_ROUTE_PREFIX_SIZE - 1) == 0 && strcmp(existing.subtopic, subtopic) == 0) {
+            GLOG_WARN("MQTT: duplicate command topic %s%s\n", prefix, subtopic);
+            return;
+        }
+    }
+    
+    TopicRoute route;
+    strncpy(route.prefix, prefix, TOPIC_ROUTE_PREFIX_SIZE);
+    route.prefix[TOPIC_ROUTE_PREFIX_SIZE - 1] = '\0';
+    route.subtopic = subtopic;
+    route.handler = handler;
+    route.command = command;
+    routes.push_back(route);
+}
+
+uint32_t TopicDispatcher::hash(uint32_t h, const char *s) {
+    while (*s) {
+        h ^= (uint8_t) *s++;
+        h *= TOPIC_HASH_PRIME;
+    }
+    return h;
+}
+
+uint32_t TopicDispatcher::hash(const TopicRoute &route) {
+    return hash(hash(TOPIC_HASH_BASIS ^ seed, route.prefix), route.subtopic);
+}
+
+void TopicDispatcher::build() {
+    size_t size = 8;
+    while (size < routes.size() * 2) {
+        size *= 2;
+    }
+    
+    while (true) {
+        for (seed = 0; seed < TOPIC_HASH_SEEDS; seed++) {
+            buckets.assign(size, 0);
+            
+            bool collision = false;
+            for (size_t i = 0; i < routes.size() && !collision; i++) {
+                uint16_t &bucket = buckets[hash(routes[i]) & (size - 1)];
+                collision = bucket != 0;
+                bucket = i + 1;
+            }
+            
+            if (!collision) {
+                GLOG_DEBUG("MQTT: %u command topics in %u buckets, seed %u\n", (unsigned) routes.size(), (unsigned) size, (unsigned) seed);
+                return;
+            }
+        }
+        size *= 2;
+    }
+}
+
+const TopicRoute *TopicDispatcher::find(const char *topic) {
+    if (buckets.empty()) {
+        return NULL;
+    }
+    
+    uint16_t bucket = buckets[hash(TOPIC_HASH_BASIS ^ seed, topic) & (buckets.size() - 1)];
+    if (bucket == 0) {
+        return NULL;
+    }
+    
+    // the hash only picks the candidate, the topic must match it exactly
+    const TopicRoute &candidate = routes[bucket - 1];
+    size_t prefixLen = strlen(candidate.prefix);
+    if (strncmp(topic, candidate.prefix, prefixLen) != 0 || strcmp(topic + prefixLen, candidate.subtopic) != 0) {
+        return NULL;
+    }
+    
+    return &candidate;
+}
+
+bool TopicDispatcher::dispatch(const char *topic, const char *value) {
+    const TopicRoute *route = find(topic);
+    if (route == NULL) {
+        return false;
+    }
+    
+    route->handler->handleCommand(route->command, value);
+    return true;
+}
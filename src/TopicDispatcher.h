@@ -0,0 +1,55 @@
+/*
+  TopicDispatcher.h - Library header for the ESP8266/ESP32 Arduino platform
+  Routes incoming MQTT commands to the inverter that handles them
+  
+  The inverters register their command subtopics (and an optional "<addr>/" prefix in
+  multi inverter mode) when the inverter is created. build() then finds a hash seed
+  with no collisions for the table size, so dispatch() is one hash over the raw topic,
+  one bucket and one compare, with no heap use.
+  
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+#ifndef TOPIC_DISPATCHER_H
+#define TOPIC_DISPATCHER_H
+
+#include <Arduino.h>
+#include <vector>
+
+// "<addr>/" with addr up to 247 and the terminator
+#define TOPIC_ROUTE_PREFIX_SIZE 5
+
+class Inverter;
+
+struct TopicRoute {
+    char prefix[TOPIC_ROUTE_PREFIX_SIZE];
+    const char *subtopic;   // not copied, must outlive the dispatcher (string literals)
+    Inverter *handler;
+    uint8_t command;
+};
+
+class TopicDispatcher {
+    public:
+        TopicDispatcher();
+        
+        void clear();
+        void add(const char *prefix, const char *subtopic, Inverter *handler, uint8_t command);
+        void build();
+        
+        // topic relative to the base topic, value already truncated and trimmed
+        // returns false when no inverter handles the topic
+        bool dispatch(const char *topic, const char *value);
+        
+        size_t size() { return routes.size(); }
+        
+    private:
+        std::vector<TopicRoute> routes;
+        std::vector<uint16_t> buckets; // route index + 1, 0 is empty
+        uint32_t seed;
+        
+        uint32_t hash(const TopicRoute &route);
+        static uint32_t hash(uint32_t h, const char *s);
+        const TopicRoute *find(const char *topic);
+};
+
+#endif
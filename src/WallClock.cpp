@@ -0,0 +1,109 @@
+/*
+  WallClock.cpp - Library for the ESP8266/ESP32 Arduino platform
+  Wall clock time from SNTP, for the poll timestamps and the poll schedule
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include "WallClock.h"
+#include "GLog.h"
+#include <sys/time.h>
+#include <coredecls.h>
+
+char WallClock::server[WALLCLOCK_SERVER_SIZE] = "";
+uint64_t WallClock::syncEpochMillis = 0;
+unsigned long WallClock::syncMillis = 0;
+uint32_t WallClock::syncs = 0;
+int32_t WallClock::lastStepMillis = 0;
+
+void WallClock::begin(const char *server) {
+    if (strcmp(WallClock::server, server) == 0) {
+        return;
+    }
+    strncpy(WallClock::server, server, sizeof(WallClock::server) - 1);
+    WallClock::server[sizeof(WallClock::server) - 1] = '\0';
+
+    settimeofday_cb(onTimeSet);
+    if (WallClock::server[0] != '\0') {
+        // UTC, the consumers do the time zones
+        configTime(0, 0, WallClock::server);
+        GLOG_INFO("CLOCK: SNTP with %s\n", WallClock::server);
+    } else {
+        configTime(0, 0, NULL);
+        GLOG_INFO("CLOCK: SNTP off\n");
+    }
+}
+
+void WallClock::onTimeSet() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    if (tv.tv_sec >= WALLCLOCK_MIN_VALID_TIME) {
+        setTime((uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000);
+    }
+}
+
+void WallClock::setTime(uint64_t epochMillis) {
+    unsigned long nowMillis = millis();
+    lastStepMillis = isSet() ? (int32_t) (int64_t) (epochMillis - at(nowMillis)) : 0;
+    syncEpochMillis = epochMillis;
+    syncMillis = nowMillis;
+    syncs++;
+    GLOG_DEBUG("CLOCK: set, step %d ms\n", (int) lastStepMillis);
+}
+
+void WallClock::reset() {
+    syncEpochMillis = 0;
+    syncMillis = 0;
+    syncs = 0;
+    lastStepMillis = 0;
+}
+
+bool WallClock::isSet() {
+    return syncEpochMillis != 0;
+}
+
+uint64_t WallClock::at(unsigned long millisValue) {
+    if (!isSet()) {
+        return 0;
+    }
+    // signed, a millis() from before the sync is earlier
+    return syncEpochMillis + (int64_t) (long) (millisValue - syncMillis);
+}
+
+uint64_t WallClock::now() {
+    return at(millis());
+}
+
+time_t WallClock::time() {
+    if (!isSet()) {
+        return millis() / 1000;
+    }
+    return now() / 1000;
+}
+
+unsigned long WallClock::nextBoundary(unsigned long periodMillis, unsigned long nowMillis) {
+    if (periodMillis == 0) {
+        return nowMillis;
+    }
+    if (!isSet()) {
+        return nowMillis + periodMillis;
+    }
+
+    uint64_t epoch = at(nowMillis);
+    uint64_t next = (epoch / periodMillis + 1) * periodMillis;
+    // a poll that started a bit early, after the clock stepped back, skips the boundary it just had
+    if (next - epoch < periodMillis / 4) {
+        next += periodMillis;
+    }
+    return nowMillis + (unsigned long) (next - epoch);
+}
+
+void WallClock::emitStats(InverterSink &sink) {
+    sink.emit("Clock/Set", isSet() ? "true" : "false");
+    sink.emit("Clock/Syncs", syncs);
+    if (isSet()) {
+        sink.emit("Clock/LastSyncS", (uint32_t) ((millis() - syncMillis) / 1000));
+        sink.emit("Clock/StepMillis", lastStepMillis);
+    }
+}
@@ -0,0 +1,64 @@
+/*
+  WallClock.h - Library header for the ESP8266/ESP32 Arduino platform
+  Wall clock time from SNTP, for the poll timestamps and the poll schedule
+
+  Each SNTP sync ties an epoch time in milliseconds to a millis() value, the
+  time in between is counted from millis(). So the clock only steps at a sync,
+  never on its own, and a millis() value can be turned into the epoch time it
+  had. Until the first sync the clock is not set: now() is 0 and time() counts
+  seconds from boot, as time() does on the core.
+
+  nextBoundary() gives the millis() of the next multiple of the poll period
+  since the epoch, so every 5s polls start at :00, :05, ... on every device
+  and the readings line up
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#ifndef _WALL_CLOCK_H
+#define _WALL_CLOCK_H
+
+#include <Arduino.h>
+#include <time.h>
+#include "InverterSink.h"
+
+#define WALLCLOCK_DEFAULT_SERVER "pool.ntp.org"
+#define WALLCLOCK_SERVER_SIZE 40
+// an earlier time (2020-01-01) means the clock is not set
+#define WALLCLOCK_MIN_VALID_TIME 1577836800
+
+class WallClock {
+    public:
+        // SNTP with this server, "" turns it off
+        static void begin(const char *server);
+
+        // a sync, from the SNTP callback
+        static void setTime(uint64_t epochMillis);
+        static void reset();
+
+        static bool isSet();
+        // epoch milliseconds, 0 until the clock is set
+        static uint64_t now();
+        // the epoch milliseconds at this millis()
+        static uint64_t at(unsigned long millisValue);
+        // epoch seconds, seconds from boot until the clock is set
+        static time_t time();
+
+        // millis() of the next poll, on a multiple of the period while the clock is set
+        static unsigned long nextBoundary(unsigned long periodMillis, unsigned long nowMillis);
+
+        static void emitStats(InverterSink &sink);
+
+    private:
+        static char server[WALLCLOCK_SERVER_SIZE];
+        static uint64_t syncEpochMillis;
+        static unsigned long syncMillis;
+        static uint32_t syncs;
+        // how far the clock moved at the last sync, the millis() drift since the one before
+        static int32_t lastStepMillis;
+
+        static void onTimeSet();
+};
+
+#endif
@@ -6,13 +6,16 @@
 */
 #include "WiCMConfig.h"
 #include "GLog.h"
+#include "GlobalDefs.h"
 #include <ArduinoJson.h>
 #include <FS.h>
+#include <coredecls.h>
 
 // global
 #define DEFAULT_TOPIC "inverter"
 #define DEFAULT_SOFTAP_PASSWORD "12345678"
 #define DEFAULT_DEVICE_NAME "inverter-to-mqtt-esp8266"
+#define DEFAULT_NTP_SERVER "pool.ntp.org"
 
 // parameter config
 #define DEVICE_NAME_K "device_name"
@@ -22,8 +25,15 @@
 #define MQTT_USERNAME_K "mqtt_username"
 #define MQTT_PASSWORD_K "mqtt_password"
 #define MQTT_TOPIC_K "mqtt_topic"
+#define MQTT_TLS_FINGERPRINT_K "mqtt_tls_fingerprint"
+#define MQTT_V5_K "mqtt_v5"
+#define MQTT_JSON_K "mqtt_json"
+#define HTTP_PUSH_URL_K "http_push_url"
+#define HTTP_PUSH_SECS_K "http_push_secs"
+#define INFLUX_SERVER_K "influx_server"
 #define MODBUS_ADDRS_K "modbus_addrs"
 #define MODBUS_POLLING_K "modbus_poll_secs"
+#define NTP_SERVER_K "ntp_server"
 #define INVERTER_MODEL_K "inverter_model"
 #define PARAMS_FILE "/config.json"
 
@@ -34,6 +44,9 @@
 #define DNS_K "dns"
 #define STA_WIFI_PARAMS_FILE "/wificonfig.json"
 
+// rtc wifi cache
+#define RTC_WIFI_CACHE_MAGIC 0x57494632 // "WIF2", the first one kept the IP lease too
+
 // helpers
 #define SHOW_JSON_FILE
 
@@ -51,8 +64,15 @@ WiCMParamConfig::WiCMParamConfig() {
     this->mqttUsername = "";
     this->mqttPassword = "";
     this->mqttBaseTopic = DEFAULT_TOPIC;
+    this->mqttTlsFingerprint = "";
+    this->mqttV5 = false;
+    this->mqttJson = false;
+    this->httpPushUrl = "";
+    this->httpPushSeconds = 60;
+    this->influxServer = "";
     this->modbusAddresses = {1};
     this->modbusPollingInSeconds = 5;
+    this->ntpServer = DEFAULT_NTP_SERVER;
     this->inverterType = "none";
 }
 WiCMParamConfig::~WiCMParamConfig(){};
@@ -60,7 +80,7 @@ WiCMParamConfig::~WiCMParamConfig(){};
 void WiCMParamConfig::save() {
     //save the custom parameters to FS
 
-    GLOG::println(F("WiCM: Saving config file"));
+    GLOG_INFO("WiCM: Saving config file\n");
 
     #if ARDUINOJSON_VERSION_MAJOR >= 6
         DynamicJsonDocument json(1024);
@@ -78,13 +98,24 @@ void WiCMParamConfig::save() {
         mqttPassword.trim();
         json[MQTT_PASSWORD_K] = mqttPassword.c_str();
         json[MQTT_TOPIC_K] = mqttBaseTopic.c_str();
+        mqttTlsFingerprint.trim();
+        json[MQTT_TLS_FINGERPRINT_K] = mqttTlsFingerprint.c_str();
+        json[MQTT_V5_K] = mqttV5;
+        json[MQTT_JSON_K] = mqttJson;
+        httpPushUrl.trim();
+        json[HTTP_PUSH_URL_K] = httpPushUrl.c_str();
+        json[HTTP_PUSH_SECS_K] = httpPushSeconds;
+        influxServer.trim();
+        json[INFLUX_SERVER_K] = influxServer.c_str();
         json[MODBUS_ADDRS_K] = modbusAddresses;
         json[MODBUS_POLLING_K] = modbusPollingInSeconds;
+        ntpServer.trim();
+        json[NTP_SERVER_K] = ntpServer.c_str();
         json[INVERTER_MODEL_K] = inverterType.c_str();
 
         File configFile = SPIFFS.open(F(PARAMS_FILE), "w");
         if (!configFile) {
-            GLOG::println(F("WiCM: Save failed"));
+            GLOG_ERROR("WiCM: Save failed\n");
         }
 
     #if ARDUINOJSON_VERSION_MAJOR >= 6
@@ -100,10 +131,10 @@ void WiCMParamConfig::save() {
 void WiCMParamConfig::load() {
     //read configuration from FS json
     if (SPIFFS.exists(F(PARAMS_FILE))) {
-        GLOG::println(F("WiCM: read config file"));
+        GLOG_INFO("WiCM: read config file\n");
         File configFile = SPIFFS.open(F(PARAMS_FILE), "r");
         if (configFile) {
-            GLOG::println(F("WiCM: open config file OK"));
+            GLOG_INFO("WiCM: open config file OK\n");
             size_t size = configFile.size();
 
             // Allocate a buffer to store contents of the file.
@@ -121,11 +152,13 @@ void WiCMParamConfig::load() {
             
             if (json.success()) {
 #endif
-                GLOG::println(F("WiCM: config json parsed"));
+                GLOG_INFO("WiCM: config json parsed\n");
 #ifdef SHOW_JSON_FILE
-                String jsonStringified;
-                serializeJson(json, jsonStringified);
-                GLOG::println(String(F("WiCM: ")) + jsonStringified);
+                if (GLOG_ENABLED(GLOG_LEVEL_DEBUG)) {
+                    String jsonStringified;
+                    serializeJson(json, jsonStringified);
+                    GLOG_DEBUG("WiCM: %s\n", jsonStringified.c_str());
+                }
 #endif
 
                 if (json.containsKey(DEVICE_NAME_K)) {
@@ -170,6 +203,42 @@ void WiCMParamConfig::load() {
                     mqttPassword = "";
                 }
 
+                if (json.containsKey(MQTT_TLS_FINGERPRINT_K)) {
+                    mqttTlsFingerprint = json[MQTT_TLS_FINGERPRINT_K].as<String>();
+                } else {
+                    mqttTlsFingerprint = "";
+                }
+
+                if (json.containsKey(MQTT_V5_K)) {
+                    mqttV5 = json[MQTT_V5_K];
+                } else {
+                    mqttV5 = false;
+                }
+
+                if (json.containsKey(MQTT_JSON_K)) {
+                    mqttJson = json[MQTT_JSON_K];
+                } else {
+                    mqttJson = false;
+                }
+
+                if (json.containsKey(HTTP_PUSH_URL_K)) {
+                    httpPushUrl = json[HTTP_PUSH_URL_K].as<String>();
+                } else {
+                    httpPushUrl = "";
+                }
+
+                if (json.containsKey(HTTP_PUSH_SECS_K)) {
+                    httpPushSeconds = json[HTTP_PUSH_SECS_K];
+                } else {
+                    httpPushSeconds = 60;
+                }
+
+                if (json.containsKey(INFLUX_SERVER_K)) {
+                    influxServer = json[INFLUX_SERVER_K].as<String>();
+                } else {
+                    influxServer = "";
+                }
+
                 if (json.containsKey(MODBUS_ADDRS_K)) {
                     modbusAddresses.clear();
                     for (int i : json[MODBUS_ADDRS_K].as<JsonArrayConst>()) {
@@ -185,6 +254,12 @@ void WiCMParamConfig::load() {
                     modbusPollingInSeconds = 5;
                 }
 
+                if (json.containsKey(NTP_SERVER_K)) {
+                    ntpServer = json[NTP_SERVER_K].as<String>();
+                } else {
+                    ntpServer = DEFAULT_NTP_SERVER;
+                }
+
                 if (json.containsKey(INVERTER_MODEL_K)) {
                     inverterType = json[INVERTER_MODEL_K].as<String>();
                     if (inverterType == "") {
@@ -194,13 +269,13 @@ void WiCMParamConfig::load() {
                     inverterType = "none";
                 }
             } else {
-                GLOG::println(F("WiCM: config file parse error"));
+                GLOG_ERROR("WiCM: config file parse error\n");
             }
             configFile.close();
-            GLOG::println(F("WiCM: read config file OK"));
+            GLOG_INFO("WiCM: read config file OK\n");
         }
     } else {
-        GLOG::println(F("WiCM: config file not found"));
+        GLOG_INFO("WiCM: config file not found\n");
     }
 
     //end read
@@ -218,10 +293,10 @@ WiCMWifiConfig::~WiCMWifiConfig() {
 
 void WiCMWifiConfig::load() {
     if (SPIFFS.exists(F(STA_WIFI_PARAMS_FILE))) {
-        GLOG::println(F("WiCM: read wifi file"));
+        GLOG_INFO("WiCM: read wifi file\n");
         File networkFile = SPIFFS.open(F(STA_WIFI_PARAMS_FILE), "r");
         if (networkFile) {
-            GLOG::println(F("WiCM: open wifi file OK"));
+            GLOG_INFO("WiCM: open wifi file OK\n");
             size_t size = networkFile.size();
 
             // Allocate a buffer to store contents of the file.
@@ -239,11 +314,13 @@ void WiCMWifiConfig::load() {
             
             if (json.success()) {
 #endif
-                GLOG::println(F("WiCM: wifi json parsed"));
+                GLOG_INFO("WiCM: wifi json parsed\n");
 #ifdef SHOW_JSON_FILE
-                String jsonStringified;
-                serializeJson(json, jsonStringified);
-                GLOG::println(String(F("WiCM: ")) + jsonStringified);
+                if (GLOG_ENABLED(GLOG_LEVEL_DEBUG)) {
+                    String jsonStringified;
+                    serializeJson(json, jsonStringified);
+                    GLOG_DEBUG("WiCM: %s\n", jsonStringified.c_str());
+                }
 #endif
 
                 if (json.containsKey(IP_K)) {
@@ -271,18 +348,18 @@ void WiCMWifiConfig::load() {
                 }
                 
             } else {
-                GLOG::println(F("WiCM: wifi json parse error"));
+                GLOG_ERROR("WiCM: wifi json parse error\n");
             }
             networkFile.close();
-            GLOG::println(F("WiCM: read wifi file OK"));
+            GLOG_INFO("WiCM: read wifi file OK\n");
         }
     } else {
-        GLOG::println(F("WiCM: wifi file not found"));
+        GLOG_INFO("WiCM: wifi file not found\n");
     }
 }
 
 void WiCMWifiConfig::save() const {
-    GLOG::println(F("WiCM: save wifi file"));
+    GLOG_INFO("WiCM: save wifi file\n");
 
     #if ARDUINOJSON_VERSION_MAJOR >= 6
         DynamicJsonDocument json(1024);
@@ -305,7 +382,7 @@ void WiCMWifiConfig::save() const {
 
         File networkFile = SPIFFS.open(F(STA_WIFI_PARAMS_FILE), "w");
         if (!networkFile) {
-            GLOG::println(F("WiCM: save wifi file failed"));
+            GLOG_ERROR("WiCM: save wifi file failed\n");
         }
 
     #if ARDUINOJSON_VERSION_MAJOR >= 6
@@ -314,7 +391,7 @@ void WiCMWifiConfig::save() const {
         json.printTo(networkFile);
     #endif
     networkFile.close();
-    GLOG::println(F("WiCM: save wifi OK"));
+    GLOG_INFO("WiCM: save wifi OK\n");
 }
 
 void WiCMWifiConfig::erase() {
@@ -325,6 +402,65 @@ bool WiCMWifiConfig::isStaticIPConfigured() const {
     return ip.isSet() && gw.isSet() && sn.isSet() && dns.isSet();
 }
 
+// Image of the wifi cache as stored in RTC memory, must be a multiple of 4 bytes
+struct RtcWifiCacheData {
+    uint32_t crc32;
+    uint32_t magic;
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t reserved;
+};
+
+WiCMRtcWifiCache::WiCMRtcWifiCache() {
+    memset(bssid, 0, sizeof(bssid));
+    channel = 0;
+}
+
+WiCMRtcWifiCache::~WiCMRtcWifiCache() {
+}
+
+void WiCMRtcWifiCache::save() const {
+    RtcWifiCacheData data;
+    memset(&data, 0, sizeof(data));
+
+    data.magic = RTC_WIFI_CACHE_MAGIC;
+    memcpy(data.bssid, bssid, sizeof(data.bssid));
+    data.channel = channel;
+    data.crc32 = crc32(((uint8_t *) &data) + 4, sizeof(data) - 4);
+
+    if (!ESP.rtcUserMemoryWrite(RTC_WIFI_CACHE_OFFSET, (uint32_t *) &data, sizeof(data))) {
+        GLOG_ERROR("WiCM: save rtc wifi cache failed\n");
+    }
+}
+
+bool WiCMRtcWifiCache::load() {
+    RtcWifiCacheData data;
+
+    if (!ESP.rtcUserMemoryRead(RTC_WIFI_CACHE_OFFSET, (uint32_t *) &data, sizeof(data))) {
+        return false;
+    }
+
+    // after a power cycle the rtc memory holds garbage
+    if (data.magic != RTC_WIFI_CACHE_MAGIC || data.crc32 != crc32(((uint8_t *) &data) + 4, sizeof(data) - 4)) {
+        return false;
+    }
+
+    if (data.channel == 0 || data.channel > 14) {
+        return false;
+    }
+
+    memcpy(bssid, data.bssid, sizeof(bssid));
+    channel = data.channel;
+
+    return true;
+}
+
+void WiCMRtcWifiCache::erase() {
+    RtcWifiCacheData data;
+    memset(&data, 0, sizeof(data));
+    ESP.rtcUserMemoryWrite(RTC_WIFI_CACHE_OFFSET, (uint32_t *) &data, sizeof(data));
+}
+
 /*
  ArduinoJSON vector converter
  Source: https://arduinojson.org/v6/how-to/create-converters-for-stl-containers/
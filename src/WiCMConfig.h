@@ -24,8 +24,15 @@ class WiCMParamConfig {
         String mqttUsername;
         String mqttPassword;
         String mqttBaseTopic;
+        String mqttTlsFingerprint;
+        bool mqttV5;
+        bool mqttJson;
+        String httpPushUrl;
+        int httpPushSeconds;
+        String influxServer;
         std::vector<int> modbusAddresses;
         int modbusPollingInSeconds;
+        String ntpServer;
         String inverterType;
         
         WiCMParamConfig();
@@ -54,4 +61,19 @@ class WiCMWifiConfig {
         bool isStaticIPConfigured() const;
 };
 
+// Last successful association (BSSID and channel) kept in RTC user memory
+// Used to reconnect without scanning after a reset or watchdog restart, the IP still comes from DHCP
+class WiCMRtcWifiCache {
+    public:
+        uint8_t bssid[6];
+        uint8_t channel;
+
+        WiCMRtcWifiCache();
+        virtual ~WiCMRtcWifiCache();
+
+        void save() const;
+        bool load();
+        void erase();
+};
+
 #endif
\ No newline at end of file
@@ -12,6 +12,8 @@
 #include <string>
 #include <sstream>
 
+// how long to wait for the cached BSSID/channel before falling back to a full scan
+#define FAST_RECONNECT_TIMEOUT_MS 3000
 
 static std::string vectorToCSV(const std::vector<int>& vec) {
     std::ostringstream oss;
@@ -71,6 +73,8 @@ WifiAndConfigManager::WifiAndConfigManager() {
     saveParamsRequired = false;
     rebootRequired = false;
     wifiConnected = false;
+    wifiConnectMillis = 0;
+    wifiFastConnected = false;
     
     // config var web params
     deviceNameParam = NULL;
@@ -80,13 +84,20 @@ WifiAndConfigManager::WifiAndConfigManager() {
     mqttUsernameParam = NULL;
     mqttPasswordParam = NULL;
     mqttBaseTopicParam = NULL;
+    mqttTlsFingerprintParam = NULL;
+    mqttV5Param = NULL;
+    mqttJsonParam = NULL;
+    httpPushUrlParam = NULL;
+    httpPushSecondsParam = NULL;
+    influxServerParam = NULL;
     modbusAddressParam = NULL;
     modbusPollingInSecondsParam = NULL;
+    ntpServerParam = NULL;
     inverterModelCustomFieldParam = NULL;
     inverterTypeCustomHidden = NULL;
 
     if (!SPIFFS.begin()) {
-        GLOG::println(("WiCM: FS mount failed"));
+        GLOG_ERROR("WiCM: FS mount failed\n");
         
         delay(1000);
         ESP.restart();
@@ -94,12 +105,12 @@ WifiAndConfigManager::WifiAndConfigManager() {
 }
 
 void WifiAndConfigManager::saveParamConfigCallback() {
-    GLOG::println(F("WiCM: Save PARAM config"));
+    GLOG_INFO("WiCM: Save PARAM config\n");
     saveParamsRequired = true;
 }
 
 void WifiAndConfigManager::saveWifiConfigCallback() {
-    GLOG::println(F("WiCM: Save WIFI config callback"));
+    GLOG_INFO("WiCM: Save WIFI config callback\n");
     
     // do not try to read these fields outside this function, it will segfault
     String ip = getParam("ip");
@@ -108,14 +119,10 @@ void WifiAndConfigManager::saveWifiConfigCallback() {
     String dns = wm.server->arg("dns");
 
     if (ip != "" && gw != "" && sn != "" && dns != "") {
-        GLOG::print(F("WiCM: STA IP: "));
-        GLOG::println(ip);
-        GLOG::print(F("WiCM: STA GW: "));
-        GLOG::println(gw);
-        GLOG::print(F("WiCM: STA SN: "));
-        GLOG::println(sn);
-        GLOG::print(F("WiCM: STADNS: "));
-        GLOG::println(dns);
+        GLOG_INFO("WiCM: STA IP: %s\n", ip.c_str());
+        GLOG_INFO("WiCM: STA GW: %s\n", gw.c_str());
+        GLOG_INFO("WiCM: STA SN: %s\n", sn.c_str());
+        GLOG_INFO("WiCM: STADNS: %s\n", dns.c_str());
         
         bool ipOK = wifiCfg.ip.fromString(ip);
         bool gwOK = wifiCfg.gw.fromString(gw);
@@ -123,11 +130,11 @@ void WifiAndConfigManager::saveWifiConfigCallback() {
         bool dnsOK = wifiCfg.dns.fromString(dns);
 
         if (!ipOK || !gwOK || !snOK || !dnsOK) {
-            GLOG::printf("WiCM: Invalid static IP configuration\nWiCM: ipOK=%d, gwOK=%d, snOK=%d, dnsOK=%d\n", ipOK, gwOK, snOK, dnsOK);
+            GLOG_WARN("WiCM: Invalid static IP configuration\nWiCM: ipOK=%d, gwOK=%d, snOK=%d, dnsOK=%d\n", ipOK, gwOK, snOK, dnsOK);
         }
 
     } else {
-        GLOG::println("WiCM: Enabling DHCP IP");
+        GLOG_INFO("WiCM: Enabling DHCP IP\n");
         wifiCfg.ip = IPAddress();
         wifiCfg.gw = IPAddress();
         wifiCfg.sn = IPAddress();;
@@ -149,16 +156,17 @@ void WifiAndConfigManager::handleEraseAll() {
 }
 
 void WifiAndConfigManager::doFactoryReset() {
-    GLOG::println(F("WiCM: DELETE CONFIG"));
+    GLOG_INFO("WiCM: DELETE CONFIG\n");
     paramsCfg.erase();
 
-    GLOG::println(F("WiCM: DELETE STATIC WIFI CONFIG"));
+    GLOG_INFO("WiCM: DELETE STATIC WIFI CONFIG\n");
     wifiCfg.erase();
 
-    GLOG::println(F("WiCM: DELETE ESP WIFI CONFIG"));
+    GLOG_INFO("WiCM: DELETE ESP WIFI CONFIG\n");
     ESP.eraseConfig();
+    rtcWifiCache.erase();
 
-    GLOG::println("WiCM: FACTORY RESET DONE");
+    GLOG_INFO("WiCM: FACTORY RESET DONE\n");
 }
 
 void WifiAndConfigManager::_updateInverterTypeSelect() {
@@ -176,8 +184,15 @@ void WifiAndConfigManager::_recycleParams() {
     if (mqttUsernameParam != NULL) delete mqttUsernameParam;
     if (mqttPasswordParam != NULL) delete mqttPasswordParam;
     if (mqttBaseTopicParam != NULL) delete mqttBaseTopicParam;
+    if (mqttTlsFingerprintParam != NULL) delete mqttTlsFingerprintParam;
+    if (mqttV5Param != NULL) delete mqttV5Param;
+    if (mqttJsonParam != NULL) delete mqttJsonParam;
+    if (httpPushUrlParam != NULL) delete httpPushUrlParam;
+    if (httpPushSecondsParam != NULL) delete httpPushSecondsParam;
+    if (influxServerParam != NULL) delete influxServerParam;
     if (modbusAddressParam != NULL) delete modbusAddressParam;
     if (modbusPollingInSecondsParam != NULL) delete modbusPollingInSecondsParam;
+    if (ntpServerParam != NULL) delete ntpServerParam;
     if (inverterModelCustomFieldParam != NULL) delete inverterModelCustomFieldParam;
     if (inverterTypeCustomHidden != NULL) delete inverterTypeCustomHidden;
 }
@@ -202,10 +217,21 @@ void WifiAndConfigManager::setupWifiAndConfig() {
     mqttUsernameParam = new WiFiManagerParameter("username", "MQTT username", String(paramsCfg.mqttUsername).c_str(), 32);
     mqttPasswordParam = new WiFiManagerParameter("password", "MQTT password", String(paramsCfg.mqttPassword).c_str(), 32);
     mqttBaseTopicParam = new WiFiManagerParameter("topic", "MQTT base topic", paramsCfg.mqttBaseTopic.c_str(), 24);
+    mqttTlsFingerprintParam = new WiFiManagerParameter("tlsfp", "MQTT TLS SHA1 fingerprint (empty: no TLS)", paramsCfg.mqttTlsFingerprint.c_str(), 59);
+    mqttV5Param = new WiFiManagerParameter("mqttv5", "MQTT 5 topic aliases (1: on, falls back to 3.1.1)", paramsCfg.mqttV5 ? "1" : "0", 1);
+    mqttJsonParam = new WiFiManagerParameter("mqttjson", "MQTT JSON of each poll on <topic>/json (1: on)", paramsCfg.mqttJson ? "1" : "0", 1);
+
+    // HTTP push params
+    httpPushUrlParam = new WiFiManagerParameter("httpurl", "HTTP push URL, http://host:port/path (empty: off)", paramsCfg.httpPushUrl.c_str(), 96);
+    httpPushSecondsParam = new WiFiManagerParameter("httpsecs", "HTTP push interval (secs)", String(paramsCfg.httpPushSeconds).c_str(), 5);
+
+    // InfluxDB params
+    influxServerParam = new WiFiManagerParameter("influx", "InfluxDB UDP server, host:port (empty: off)", paramsCfg.influxServer.c_str(), 46);
     
     // inverter params
     modbusAddressParam = new WiFiManagerParameter("modbus", "Inverter modbus address", vectorToCSV(paramsCfg.modbusAddresses).c_str(), 9); // at most 5 inverter IDs: a,b,c,d,e
     modbusPollingInSecondsParam = new WiFiManagerParameter("modbuspoll", "Inverter modbus polling (secs)", String(paramsCfg.modbusPollingInSeconds).c_str(), 3);
+    ntpServerParam = new WiFiManagerParameter("ntp", "NTP server, polls on the clock (empty: off)", paramsCfg.ntpServer.c_str(), 40);
     _updateInverterTypeSelect();
     inverterTypeCustomHidden = new WiFiManagerParameter("im_key_custom", "Will be hidden", paramsCfg.inverterType.c_str(), 10);
     
@@ -228,12 +254,23 @@ void WifiAndConfigManager::setupWifiAndConfig() {
     wm.addParameter(mqttUsernameParam);
     wm.addParameter(mqttPasswordParam);
     wm.addParameter(mqttBaseTopicParam);
+    wm.addParameter(mqttTlsFingerprintParam);
+    wm.addParameter(mqttV5Param);
+    wm.addParameter(mqttJsonParam);
+
+    // add HTTP push params
+    wm.addParameter(httpPushUrlParam);
+    wm.addParameter(httpPushSecondsParam);
+
+    // add InfluxDB params
+    wm.addParameter(influxServerParam);
     
     // add inverter params
     wm.addParameter(inverterTypeCustomHidden); // Needs to be added before the javascript that hides it
     wm.addParameter(inverterModelCustomFieldParam);
     wm.addParameter(modbusAddressParam);
     wm.addParameter(modbusPollingInSecondsParam);
+    wm.addParameter(ntpServerParam);
 
     // make static ip fields visible in Wifi menu
     wm.setShowStaticFields(true);
@@ -251,23 +288,29 @@ void WifiAndConfigManager::setupWifiAndConfig() {
         wm.setSTAStaticIPConfig(wifiCfg.ip, wifiCfg.gw, wifiCfg.sn, wifiCfg.dns);
     }
     
-    // now connect with the wifi info previously stored
-    bool res = wm.autoConnect(paramsCfg.deviceName.c_str(), paramsCfg.softApPassword.c_str());
+    // now connect with the wifi info previously stored, skipping the scan if possible
+    unsigned long connectStartMillis = millis();
+    wifiFastConnected = fastReconnect();
+
+    bool res = wifiFastConnected || wm.autoConnect(paramsCfg.deviceName.c_str(), paramsCfg.softApPassword.c_str());
+    wifiConnectMillis = millis() - connectStartMillis;
+
     if (!res) {
-        GLOG::println("WiCM: Failed to connect to wifi, restarting...");
+        GLOG_ERROR("WiCM: Failed to connect to wifi, restarting...\n");
         delay(1000);
         
         ESP.restart();
     } else {
         wifiConnected = WiFi.status() == WL_CONNECTED;
+        updateRtcWifiCache();
         wm.startWebPortal();
         wm.server->on((String(FPSTR("/eraseall")).c_str()), std::bind(&WifiAndConfigManager::handleEraseAll, this));
     }
 
-    GLOG::println("");
-    GLOG::println(F("WiCM: WiFi connected"));
-    GLOG::print(F("WiCM: IP address: "));
-    GLOG::println(WiFi.localIP());
+    GLOG_INFO("\n");
+    GLOG_INFO("WiCM: WiFi connected\n");
+    GLOG_INFO("WiCM: IP address: %s\n", WiFi.localIP().toString().c_str());
+    GLOG_INFO("WiCM: connected in %lu ms (%s)\n", wifiConnectMillis, wifiFastConnected ? "cached BSSID" : "full scan");
 
     randomSeed(micros());
 
@@ -285,6 +328,50 @@ void WifiAndConfigManager::setupWifiAndConfig() {
     }
 }
 
+bool WifiAndConfigManager::fastReconnect() {
+    if (!rtcWifiCache.load()) {
+        GLOG_INFO("WiCM: no cached BSSID, doing full scan\n");
+        return false;
+    }
+
+    // credentials saved by the SDK on the last successful connection
+    String ssid = WiFi.SSID();
+    String psk = WiFi.psk();
+    if (ssid.length() == 0) {
+        return false;
+    }
+
+    // only the scan is skipped, the lease comes from DHCP as usual so it is renewed and never outlives its time
+    if (wifiCfg.isStaticIPConfigured()) {
+        WiFi.config(wifiCfg.ip, wifiCfg.gw, wifiCfg.sn, wifiCfg.dns);
+    } else {
+        WiFi.config(0U, 0U, 0U);
+    }
+
+    GLOG_INFO("WiCM: fast reconnect to %s on channel %d\n", ssid.c_str(), rtcWifiCache.channel);
+    WiFi.begin(ssid.c_str(), psk.c_str(), rtcWifiCache.channel, rtcWifiCache.bssid);
+
+    if (WiFi.waitForConnectResult(FAST_RECONNECT_TIMEOUT_MS) == WL_CONNECTED) {
+        return true;
+    }
+
+    GLOG_WARN("WiCM: fast reconnect failed, doing full scan\n");
+    rtcWifiCache.erase();
+    WiFi.disconnect();
+
+    return false;
+}
+
+void WifiAndConfigManager::updateRtcWifiCache() {
+    if (WiFi.status() != WL_CONNECTED) {
+        return;
+    }
+
+    memcpy(rtcWifiCache.bssid, WiFi.BSSID(), sizeof(rtcWifiCache.bssid));
+    rtcWifiCache.channel = WiFi.channel();
+    rtcWifiCache.save();
+}
+
 void WifiAndConfigManager::copyFromParamsToVars() {
     // copy values back to our variables
     paramsCfg.deviceName = String(deviceNameParam->getValue());
@@ -297,9 +384,20 @@ void WifiAndConfigManager::copyFromParamsToVars() {
     paramsCfg.mqttPassword = String(mqttPasswordParam->getValue());
     paramsCfg.mqttPassword.trim();
     paramsCfg.mqttBaseTopic = String(mqttBaseTopicParam->getValue());
+    paramsCfg.mqttTlsFingerprint = String(mqttTlsFingerprintParam->getValue());
+    paramsCfg.mqttTlsFingerprint.trim();
+    paramsCfg.mqttV5 = String(mqttV5Param->getValue()).toInt() == 1;
+    paramsCfg.mqttJson = String(mqttJsonParam->getValue()).toInt() == 1;
+    paramsCfg.httpPushUrl = String(httpPushUrlParam->getValue());
+    paramsCfg.httpPushUrl.trim();
+    paramsCfg.httpPushSeconds = String(httpPushSecondsParam->getValue()).toInt();
+    paramsCfg.influxServer = String(influxServerParam->getValue());
+    paramsCfg.influxServer.trim();
     
     paramsCfg.modbusAddresses = csvToVector(modbusAddressParam->getValue());
     paramsCfg.modbusPollingInSeconds = String(modbusPollingInSecondsParam->getValue()).toInt();
+    paramsCfg.ntpServer = String(ntpServerParam->getValue());
+    paramsCfg.ntpServer.trim();
     paramsCfg.inverterType = String(inverterTypeCustomHidden->getValue());
 
     _updateInverterTypeSelect();
@@ -315,63 +413,36 @@ String WifiAndConfigManager::getParam(String name){
 }
 
 void WifiAndConfigManager::show() {
-    GLOG::println(F("---------------------------"));
-    GLOG::print(F("-> IP            : "));
-    if (wifiCfg.ip.isSet()) {
-        GLOG::println(wifiCfg.ip.toString());    
-    } else {
-        GLOG::println(F("<not set>"));    
+    if (!GLOG_ENABLED(GLOG_LEVEL_INFO)) {
+        return;
     }
-    GLOG::print(F("-> GW            : "));
-    if (wifiCfg.gw.isSet()) {
-        GLOG::println(wifiCfg.gw.toString());    
-    } else {
-        GLOG::println(F("<not set>"));    
-    }
-    GLOG::print(F("-> SN            : "));
-    if (wifiCfg.sn.isSet()) {
-        GLOG::println(wifiCfg.sn.toString());    
-    } else {
-        GLOG::println(F("<not set>"));    
-    }
-    GLOG::print(F("-> DNS           : "));
-    if (wifiCfg.dns.isSet()) {
-        GLOG::println(wifiCfg.dns.toString());    
-    } else {
-        GLOG::println(F("<not set>"));    
-    }
-
-    GLOG::println(F("---------------------------"));
-    GLOG::print(F("-> Device name   : "));
-    GLOG::println(paramsCfg.deviceName);
-    
-    GLOG::print(F("-> SoftAP pass   : "));
-    GLOG::println(paramsCfg.softApPassword);
-    
-    GLOG::print(F("-> Mqtt server   : "));
-    GLOG::println(paramsCfg.mqttServer);
- 
-    GLOG::print(F("-> Mqtt port     : "));
-    GLOG::println(paramsCfg.mqttPort);
-    
-    GLOG::print(F("-> Mqtt Username : "));
-    GLOG::println(paramsCfg.mqttUsername);
-    
-    GLOG::print(F("-> Mqtt Password : "));
-    GLOG::println(paramsCfg.mqttPassword);
-    
-    GLOG::print(F("-> Mqtt Topic    : "));
-    GLOG::println(paramsCfg.mqttBaseTopic);
-    
-    GLOG::print(F("-> Modbus Addrs  : "));
-    GLOG::println(vectorToCSV(paramsCfg.modbusAddresses).c_str());
-    
-    GLOG::print(F("-> Modbus Poll(s): "));
-    GLOG::println(paramsCfg.modbusPollingInSeconds);
 
-    GLOG::print(F("-> Inverter type: "));
-    GLOG::println(paramsCfg.inverterType);
-    GLOG::println(F("---------------------------"));
+    GLOG_INFO("---------------------------\n");
+    GLOG_INFO("-> IP            : %s\n", wifiCfg.ip.isSet() ? wifiCfg.ip.toString().c_str() : "<not set>");
+    GLOG_INFO("-> GW            : %s\n", wifiCfg.gw.isSet() ? wifiCfg.gw.toString().c_str() : "<not set>");
+    GLOG_INFO("-> SN            : %s\n", wifiCfg.sn.isSet() ? wifiCfg.sn.toString().c_str() : "<not set>");
+    GLOG_INFO("-> DNS           : %s\n", wifiCfg.dns.isSet() ? wifiCfg.dns.toString().c_str() : "<not set>");
+
+    GLOG_INFO("---------------------------\n");
+    GLOG_INFO("-> Device name   : %s\n", paramsCfg.deviceName.c_str());
+    // the log goes out on MQTT, never the passwords
+    GLOG_INFO("-> SoftAP pass   : %s\n", paramsCfg.softApPassword.length() > 0 ? "********" : "<not set>");
+    GLOG_INFO("-> Mqtt server   : %s\n", paramsCfg.mqttServer.c_str());
+    GLOG_INFO("-> Mqtt port     : %d\n", paramsCfg.mqttPort);
+    GLOG_INFO("-> Mqtt Username : %s\n", paramsCfg.mqttUsername.c_str());
+    GLOG_INFO("-> Mqtt Password : %s\n", paramsCfg.mqttPassword.length() > 0 ? "********" : "<not set>");
+    GLOG_INFO("-> Mqtt Topic    : %s\n", paramsCfg.mqttBaseTopic.c_str());
+    GLOG_INFO("-> Mqtt TLS FP   : %s\n", paramsCfg.mqttTlsFingerprint.length() > 0 ? paramsCfg.mqttTlsFingerprint.c_str() : "<no TLS>");
+    GLOG_INFO("-> Mqtt 5        : %s\n", paramsCfg.mqttV5 ? "yes" : "no");
+    GLOG_INFO("-> Mqtt JSON     : %s\n", paramsCfg.mqttJson ? "yes" : "no");
+    GLOG_INFO("-> HTTP push     : %s\n", paramsCfg.httpPushUrl.length() > 0 ? paramsCfg.httpPushUrl.c_str() : "<off>");
+    GLOG_INFO("-> HTTP push(s)  : %d\n", paramsCfg.httpPushSeconds);
+    GLOG_INFO("-> InfluxDB UDP  : %s\n", paramsCfg.influxServer.length() > 0 ? paramsCfg.influxServer.c_str() : "<off>");
+    GLOG_INFO("-> Modbus Addrs  : %s\n", vectorToCSV(paramsCfg.modbusAddresses).c_str());
+    GLOG_INFO("-> Modbus Poll(s): %d\n", paramsCfg.modbusPollingInSeconds);
+    GLOG_INFO("-> NTP server    : %s\n", paramsCfg.ntpServer.length() > 0 ? paramsCfg.ntpServer.c_str() : "<off>");
+    GLOG_INFO("-> Inverter type: %s\n", paramsCfg.inverterType.c_str());
+    GLOG_INFO("---------------------------\n");
 }
 
 String WifiAndConfigManager::getDeviceName() {
@@ -398,6 +469,30 @@ String WifiAndConfigManager::getMqttTopic() {
     return paramsCfg.mqttBaseTopic;
 }
 
+String WifiAndConfigManager::getMqttTlsFingerprint() {
+    return paramsCfg.mqttTlsFingerprint;
+}
+
+bool WifiAndConfigManager::isMqttV5() {
+    return paramsCfg.mqttV5;
+}
+
+bool WifiAndConfigManager::isMqttJson() {
+    return paramsCfg.mqttJson;
+}
+
+String WifiAndConfigManager::getHttpPushUrl() {
+    return paramsCfg.httpPushUrl;
+}
+
+int WifiAndConfigManager::getHttpPushSeconds() {
+    return paramsCfg.httpPushSeconds;
+}
+
+String WifiAndConfigManager::getInfluxServer() {
+    return paramsCfg.influxServer;
+}
+
 std::vector<int> WifiAndConfigManager::getModbusAddresses() {
     return paramsCfg.modbusAddresses;
 }
@@ -406,6 +501,10 @@ int WifiAndConfigManager::getModbusPollingInSeconds() {
     return paramsCfg.modbusPollingInSeconds;
 }
 
+String WifiAndConfigManager::getNtpServer() {
+    return paramsCfg.ntpServer;
+}
+
 String WifiAndConfigManager::getInverterType() {
     return paramsCfg.inverterType;
 }
@@ -423,43 +522,83 @@ void WifiAndConfigManager::loop() {
         bool connected = wm.autoConnect(paramsCfg.deviceName.c_str(), paramsCfg.softApPassword.c_str());
 
         if (!connected && ++connectRetries > 5) {
-            GLOG::println("WiCM: Failed to connect to wifi, restarting...");
+            GLOG_ERROR("WiCM: Failed to connect to wifi, restarting...\n");
             delay(1000);
             
             ESP.restart();
         }
         
         if (!isWifiConnected()) {
-            GLOG::printf("WiCM: Failed to connect to wifi, retry %d", connectRetries);
+            GLOG_WARN("WiCM: Failed to connect to wifi, retry %d\n", connectRetries);
+        } else {
+            // may have roamed to another AP
+            updateRtcWifiCache();
         }
 
         delay(1000);
     }
 }
 
-bool WifiAndConfigManager::checkforConfigChanges() {
+uint8_t WifiAndConfigManager::checkforConfigChanges() {
     if (saveWifiStaticIPRequired) {
         wifiCfg.save();
         saveWifiStaticIPRequired = false;
     }
 
     if (saveParamsRequired) {
-        String newDeviceName = String(deviceNameParam->getValue());
-        if (newDeviceName != paramsCfg.deviceName) {
-            GLOG::println(String(F("WiCM: New device name : ")) + newDeviceName);
+        WiCMParamConfig oldCfg = paramsCfg;
+        copyFromParamsToVars();
+
+        uint8_t changes = CONFIG_CHANGED_NONE;
+
+        if (paramsCfg.deviceName != oldCfg.deviceName) {
+            GLOG_INFO("WiCM: New device name : %s\n", paramsCfg.deviceName.c_str());
+            changes |= CONFIG_CHANGED_DEVICE;
             rebootRequired = true;
         }
-        
-        copyFromParamsToVars();
-        
+
+        if (paramsCfg.softApPassword != oldCfg.softApPassword) {
+            changes |= CONFIG_CHANGED_SOFTAP;
+        }
+
+        if (paramsCfg.mqttServer != oldCfg.mqttServer
+            || paramsCfg.mqttPort != oldCfg.mqttPort
+            || paramsCfg.mqttUsername != oldCfg.mqttUsername
+            || paramsCfg.mqttPassword != oldCfg.mqttPassword
+            || paramsCfg.mqttBaseTopic != oldCfg.mqttBaseTopic
+            || paramsCfg.mqttTlsFingerprint != oldCfg.mqttTlsFingerprint
+            || paramsCfg.mqttV5 != oldCfg.mqttV5) {
+            changes |= CONFIG_CHANGED_MQTT;
+        }
+
+        if (paramsCfg.inverterType != oldCfg.inverterType || paramsCfg.modbusAddresses != oldCfg.modbusAddresses) {
+            changes |= CONFIG_CHANGED_INVERTER;
+        }
+
+        if (paramsCfg.modbusPollingInSeconds != oldCfg.modbusPollingInSeconds) {
+            changes |= CONFIG_CHANGED_POLLING;
+        }
+
+        if (paramsCfg.mqttJson != oldCfg.mqttJson
+            || paramsCfg.httpPushUrl != oldCfg.httpPushUrl
+            || paramsCfg.httpPushSeconds != oldCfg.httpPushSeconds
+            || paramsCfg.influxServer != oldCfg.influxServer) {
+            changes |= CONFIG_CHANGED_OUTPUTS;
+        }
+
+        if (paramsCfg.ntpServer != oldCfg.ntpServer) {
+            changes |= CONFIG_CHANGED_CLOCK;
+        }
+
         paramsCfg.save();
         saveParamsRequired = false;
-        
+
+        GLOG_INFO("WiCM: config changes=0x%02x\n", changes);
         show();
-        
-        return true;
+
+        return changes;
     } else {
-        return false;
+        return CONFIG_CHANGED_NONE;
     }
 }
 
@@ -471,9 +610,17 @@ bool WifiAndConfigManager::isWifiConnected() {
     bool wifiConnectedNow = WiFi.status() == WL_CONNECTED;
     
     if (wifiConnected != wifiConnectedNow) {
-        GLOG::println(String(F("WiCM: WiFi ")) + String(wifiConnectedNow ? F("") : F("dis")) + String("connected"));
+        GLOG_INFO("WiCM: WiFi %sconnected\n", wifiConnectedNow ? "" : "dis");
         wifiConnected = wifiConnectedNow;
     }
     
     return wifiConnected;
 }
+
+unsigned long WifiAndConfigManager::getWifiConnectMillis() {
+    return wifiConnectMillis;
+}
+
+bool WifiAndConfigManager::isWifiFastConnected() {
+    return wifiFastConnected;
+}
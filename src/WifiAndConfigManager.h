@@ -17,6 +17,16 @@
 
 #define _IMCFBS_SIZE 890
 
+// Change set returned by checkforConfigChanges(), one bit per group of fields
+#define CONFIG_CHANGED_NONE     0x00
+#define CONFIG_CHANGED_DEVICE   0x01 // device name, requires a restart
+#define CONFIG_CHANGED_SOFTAP   0x02 // softAP password, only used by the portal
+#define CONFIG_CHANGED_MQTT     0x04 // server, port, username, password or base topic
+#define CONFIG_CHANGED_INVERTER 0x08 // inverter type or modbus addresses
+#define CONFIG_CHANGED_POLLING  0x10 // polling interval, read on every loop
+#define CONFIG_CHANGED_OUTPUTS  0x20 // MQTT JSON, HTTP push or InfluxDB
+#define CONFIG_CHANGED_CLOCK    0x40 // SNTP server
+
 
 class WifiAndConfigManager {
     private:
@@ -30,8 +40,15 @@ class WifiAndConfigManager {
         WiFiManagerParameter *mqttUsernameParam;
         WiFiManagerParameter *mqttPasswordParam;
         WiFiManagerParameter *mqttBaseTopicParam;
+        WiFiManagerParameter *mqttTlsFingerprintParam;
+        WiFiManagerParameter *mqttV5Param;
+        WiFiManagerParameter *mqttJsonParam;
+        WiFiManagerParameter *httpPushUrlParam;
+        WiFiManagerParameter *httpPushSecondsParam;
+        WiFiManagerParameter *influxServerParam;
         WiFiManagerParameter *modbusAddressParam;
         WiFiManagerParameter *modbusPollingInSecondsParam;
+        WiFiManagerParameter *ntpServerParam;
         
         char inverterModelCustomFieldBufferStr[_IMCFBS_SIZE];
         WiFiManagerParameter *inverterModelCustomFieldParam;
@@ -42,6 +59,11 @@ class WifiAndConfigManager {
 
         // wifi params (Static IP & friends)
         WiCMWifiConfig wifiCfg;
+
+        // last association, to skip the scan on the next reset
+        WiCMRtcWifiCache rtcWifiCache;
+        unsigned long wifiConnectMillis;
+        bool wifiFastConnected;
         
         // Flags
         bool saveWifiStaticIPRequired;
@@ -57,6 +79,8 @@ class WifiAndConfigManager {
         String getParam(String name);
         void _updateInverterTypeSelect();
         void _recycleParams();
+        bool fastReconnect();
+        void updateRtcWifiCache();
 
     public:
         WifiAndConfigManager();
@@ -69,8 +93,15 @@ class WifiAndConfigManager {
         String getMqttUsername();
         String getMqttPassword();
         String getMqttTopic();
+        String getMqttTlsFingerprint();
+        bool isMqttV5();
+        bool isMqttJson();
+        String getHttpPushUrl();
+        int getHttpPushSeconds();
+        String getInfluxServer();
         std::vector<int> getModbusAddresses();
         int getModbusPollingInSeconds();
+        String getNtpServer();
         String getInverterType();
 
         WiFiManager & getWM();
@@ -78,9 +109,11 @@ class WifiAndConfigManager {
         
         
         void doFactoryReset();
-        bool checkforConfigChanges();
+        uint8_t checkforConfigChanges();
         bool isRestartRequired();
         bool isWifiConnected();
+        unsigned long getWifiConnectMillis();
+        bool isWifiFastConnected();
 };
 
 #endif
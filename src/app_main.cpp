@@ -31,8 +31,23 @@
 #include "Inverter.h"
 #include "InverterFactory.h"
 #include "MqttPublisher.h"
+#include "MqttTls.h"
+#include "MqttCommand.h"
+#include "TopicDispatcher.h"
 #include "InverterData.h"
 #include "GLog.h"
+#include "LogServer.h"
+#include "LoopProfiler.h"
+#include "HistoryBuffer.h"
+#include "EnergyIntegrator.h"
+#include "TimeSeries.h"
+#include "MetricsPage.h"
+#include "LiveServer.h"
+#include "OutputPipeline.h"
+#include "MqttOutputs.h"
+#include "HttpPushOutput.h"
+#include "InfluxUdpOutput.h"
+#include "WallClock.h"
 
 /*
  * You can set the ESP8266 LED working mode by publishing a value to this topic
@@ -41,7 +56,24 @@
  * 2: LED blinks when reading data from the inverter and publishing it to MQTT (default)
  */
 #define SETTINGS_LED_SUBTOPIC "settings/led"
-#define MIN(a,b) (((a) < (b)) ? (a) : (b))
+
+/*
+ * Publishing "reset" to this topic clears the main loop profiler stats (max, histograms, heap low water mark)
+ */
+#define SETTINGS_PROFILER_SUBTOPIC "settings/profiler"
+
+/*
+ * Recent power values: /series lists the fields, /series?field=Pac&res=1m&format=json returns one
+ * res is raw (default), 1m or 15m and format is csv (default) or json
+ */
+#define SERIES_URI "/series"
+// the reply goes out in chunks of this size
+#define SERIES_CHUNK_SIZE 256
+
+/*
+ * Prometheus text format, rendered after each poll, with an ETag
+ */
+#define METRICS_URI "/metrics"
 
 #ifdef LARGE_ESP_BOARD
 #define BUTTON D2
@@ -49,30 +81,57 @@
 #endif
 
 WiFiClient espClient;
+WiFiClient httpClient;
+// used instead of espClient when a broker fingerprint is configured, NULL without one
+MqttTls *mqttTls = NULL;
 Leds leds;
 
+// the next poll, on a wall clock boundary once the clock is set
+unsigned long nextPollAtMillis = 0;
 // tasks last run at millis
-unsigned long lastReportSentAtMillis = 0;
 unsigned long lastTeleSentAtMillis = 0;
 unsigned long lastWifiCheckAtMillis = 0;
+unsigned long lastHistoryReplayAtMillis = 0;
+unsigned long lastPowerSampleAtMillis = 0;
+unsigned long lastAggregatesAtMillis = 0;
 bool areRemoteCommandsSupported = false;
 
 // led status (0 = off, 1 = on, 2 = blink when publishing data)
 uint8_t ledStatus = 2;
-char mqttValueBuffer16[16];
 uint8_t tasksRedLedCounter = 0;
 
 Inverter *inverter = NULL;
 MqttPublisher *mqtt = NULL;
+TopicDispatcher commands;
 WifiAndConfigManager wcm;
+#ifdef LOG_SERVER_ENABLED
+LogServer logServer;
+#endif
+LoopProfiler profiler;
+HistoryBuffer history;
+EnergyIntegrator energy;
+TimeSeries series;
+// the power samples go to both
+TeeSink powerSamples(energy, series);
+MetricsPage metrics;
+// the last value of each field, for the metrics page
+InverterData latestValues;
+LiveServer live;
+// the driver streams each block as it is decoded, otherwise the poll values go out
+bool liveFromDriver = false;
+// each poll fans out from here to the MQTT topics and the configured outputs
+OutputPipeline outputs;
+MqttTopicOutput *mqttOutput = NULL;
+MqttJsonOutput *mqttJsonOutput = NULL;
 
 void mqttCallback(char* topic, byte* payload, unsigned int length) {
-    GLOG::logMqtt(topic, payload, length);
+    if (GLOG_ENABLED(GLOG_LEVEL_DEBUG)) {
+        GLOG::logMqtt(topic, payload, length);
+    }
 
-    String subTopic(topic);
-    subTopic.replace(wcm.getMqttTopic() + "/", "");
+    const char *subTopic = MqttCommand::subtopic(mqtt->getTopic(), topic);
 
-    if (subTopic == SETTINGS_LED_SUBTOPIC) {
+    if (strcmp(subTopic, SETTINGS_LED_SUBTOPIC) == 0) {
         // Switch on the LED if an 1 was received as first character
         char cLedStatus = (char)payload[0];
         if (cLedStatus == '1') {
@@ -85,17 +144,19 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
             leds.dimDefault();  // Dim the LED 
             ledStatus = 2;
         }
+    } else if (strcmp(subTopic, SETTINGS_PROFILER_SUBTOPIC) == 0) {
+        if (length >= 5 && memcmp(payload, "reset", 5) == 0) {
+            profiler.reset();
+            GLOG_INFO("LOOP: profiler reset\n");
+        }
     } else {
         leds.lightUpRed(); // RED lights up
         tasksRedLedCounter++;
         
-        int safeLength = MIN(length, 15);
-        memcpy(mqttValueBuffer16, payload, safeLength);
-        mqttValueBuffer16[safeLength] = '\0';
-        
-        String sPayload = String(mqttValueBuffer16);
-        sPayload.trim();
-        inverter->setIncomingTopicData(subTopic, sPayload);
+        char value[MQTT_COMMAND_VALUE_MAX_LEN + 1];
+        if (!commands.dispatch(subTopic, MqttCommand::value(payload, length, value))) {
+            GLOG_WARN("MQTT: no command at [%s]\n", subTopic);
+        }
     }
 }
 
@@ -103,43 +164,220 @@ void setupInverter() {
     InverterParams p;
     p.modbusAddresses = wcm.getModbusAddresses();
     inverter = InverterFactory::createInverter(wcm.getInverterType(), p);
+    liveFromDriver = inverter->setLiveSink(&live);
+
+    // the MQTT callback goes straight from the topic to the inverter
+    commands.clear();
+    inverter->registerCommands(commands, "");
+    commands.build();
 }
 
-void setupMqtt(std::list<String> inverterSettingsTopics) {
-    mqtt = new MqttPublisher(espClient, wcm.getMqttUsername().c_str(), wcm.getMqttPassword().c_str(), wcm.getMqttTopic().c_str(), wcm.getMqttServer().c_str(), wcm.getMqttPort());
-    mqtt->setCallback(mqttCallback);
+void subscribeTopics(std::list<String> inverterSettingsTopics) {
     mqtt->addSubscription(SETTINGS_LED_SUBTOPIC);
+    mqtt->addSubscription(SETTINGS_PROFILER_SUBTOPIC);
     
     for (std::list<String>::iterator it = inverterSettingsTopics.begin(); it != inverterSettingsTopics.end(); ++it) {
         mqtt->addSubscription((*it).c_str());
     }
-    
+}
+
+void setupMqtt(std::list<String> inverterSettingsTopics) {
+    // a fingerprint turns TLS on
+    bool useTls = wcm.getMqttTlsFingerprint().length() > 0;
+    if (useTls) {
+        if (mqttTls == NULL) {
+            mqttTls = new MqttTls();
+        }
+        mqttTls->begin(wcm.getMqttTlsFingerprint().c_str());
+    } else if (mqttTls != NULL) {
+        // the BearSSL client is big, gone with the fingerprint
+        delete mqttTls;
+        mqttTls = NULL;
+    }
+
+    mqtt = new MqttPublisher(useTls ? mqttTls->getClient() : espClient, wcm.getMqttUsername().c_str(), wcm.getMqttPassword().c_str(), wcm.getMqttTopic().c_str(), wcm.getMqttServer().c_str(), wcm.getMqttPort(), wcm.isMqttV5());
+    if (useTls) {
+        mqtt->setTls(mqttTls);
+    }
+    mqtt->setCallback(mqttCallback);
+    mqtt->setWifiConnectInfo(wcm.getWifiConnectMillis(), wcm.isWifiFastConnected());
+    subscribeTopics(inverterSettingsTopics);
+
+    if (mqttOutput != NULL) mqttOutput->setPublisher(mqtt);
+    if (mqttJsonOutput != NULL) mqttJsonOutput->setPublisher(mqtt);
+}
+
+// the MQTT topics always, the other outputs as configured, each with its own queue
+void setupOutputs() {
+    outputs.clear();
+    httpClient.stop();
+
+    mqttOutput = new MqttTopicOutput(&history);
+    mqttOutput->setPublisher(mqtt);
+    outputs.add(mqttOutput);
+
+    mqttJsonOutput = NULL;
+    if (wcm.isMqttJson()) {
+        mqttJsonOutput = new MqttJsonOutput();
+        mqttJsonOutput->setPublisher(mqtt);
+        outputs.add(mqttJsonOutput);
+    }
+
+    String url = wcm.getHttpPushUrl();
+    if (url.length() > 0) {
+        HttpPushOutput *http = new HttpPushOutput(httpClient);
+        if (http->begin(url.c_str())) {
+            http->setInterval(wcm.getHttpPushSeconds() * 1000UL);
+            outputs.add(http);
+        } else {
+            GLOG_WARN("LOOP: bad HTTP push URL [%s]\n", url.c_str());
+            delete http;
+        }
+    }
+
+    String influxServer = wcm.getInfluxServer();
+    if (influxServer.length() > 0) {
+        InfluxUdpOutput *influx = new InfluxUdpOutput();
+        if (influx->begin(influxServer.c_str(), wcm.getDeviceName().c_str())) {
+            outputs.add(influx);
+        } else {
+            GLOG_WARN("LOOP: bad InfluxDB server [%s]\n", influxServer.c_str());
+            delete influx;
+        }
+    }
 }
 
 void setupLogger() {
     GLOG::setup();
-    wcm.getWM().setDebugOutput(GLOG::isLogEnabled());
+    // WiFiManager writes straight to Serial
+    wcm.getWM().setDebugOutput(GLOG::isSerialEnabled());
 }
 
-void applyNewConfiguration() {
-    delay(1000);
-    
-    GLOG::println(F("LOOP: New config, deleting objects"));
+// only rebuild what the change set affects, a polling interval change needs nothing at all
+void applyNewConfiguration(uint8_t changes) {
+    if (changes & CONFIG_CHANGED_INVERTER) {
+        GLOG_INFO("LOOP: New config, recreating inverter\n");
+        
+        delete inverter;
+        setupInverter();
+    }
+
+    auto topics = inverter->getTopicsToSubscribe();
     
-    // delete old objects
-    delete mqtt;
-    delete inverter;
-    espClient.stop();
+    if (changes & CONFIG_CHANGED_MQTT) {
+        // let the portal reply before the connection goes down
+        delay(1000);
+        
+        GLOG_INFO("LOOP: New config, recreating mqtt\n");
+        
+        delete mqtt;
+        espClient.stop();
+        if (mqttTls != NULL) {
+            mqttTls->getClient().stop();
+        }
+        setupMqtt(topics);
+    } else if (changes & CONFIG_CHANGED_INVERTER) {
+        // same broker session, just swap the command topics
+        mqtt->removeSubscriptions();
+        subscribeTopics(topics);
+    }
     
-    GLOG::println(F("LOOP: New config, creating objects"));
+    if (changes & CONFIG_CHANGED_OUTPUTS) {
+        GLOG_INFO("LOOP: New config, recreating outputs\n");
+        setupOutputs();
+    }
+
+    if (changes & CONFIG_CHANGED_CLOCK) {
+        WallClock::begin(wcm.getNtpServer().c_str());
+    }
+
+    if (changes & (CONFIG_CHANGED_POLLING | CONFIG_CHANGED_CLOCK)) {
+        // the next poll on the new schedule
+        nextPollAtMillis = millis();
+    }
     
-    // set them up again
-    setupInverter();
-    auto topics = inverter->getTopicsToSubscribe();
-    setupMqtt(topics);
     areRemoteCommandsSupported = topics.size() > 0;
 }
 
+// the poll values go to the sink, the metrics and the live stream (unless the driver streams its blocks)
+// and, without a power sampler, they are the energy samples too
+void emitPoll(InverterSink &sink, unsigned long now, time_t pollTime) {
+    TeeSink latestAndLive(latestValues, live);
+    TeeSink withLatest(sink, liveFromDriver ? (InverterSink &) latestValues : latestAndLive);
+    if (inverter->hasPowerSampling()) {
+        inverter->emitData(withLatest);
+        return;
+    }
+
+    TeeSink withSamples(withLatest, powerSamples);
+    energy.beginSample(now);
+    series.beginSample(pollTime);
+    inverter->emitData(withSamples);
+    energy.endSample();
+}
+
+void handleSeries() {
+    ESP8266WebServer &server = *wcm.getWM().server;
+    char chunk[SERIES_CHUNK_SIZE];
+
+    if (!server.hasArg("field")) {
+        series.list(chunk, sizeof(chunk));
+        server.send(200, "application/json", chunk);
+        return;
+    }
+
+    String resolution = server.hasArg("res") ? server.arg("res") : "raw";
+    String format = server.hasArg("format") ? server.arg("format") : "csv";
+    TimeSeriesQuery query;
+    if (!series.beginQuery(query, server.arg("field").c_str(), resolution.c_str(), format.c_str())) {
+        server.send(404, "text/plain", "unknown field, res or format");
+        return;
+    }
+
+    // chunked, straight from the rings
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(200, format == "json" ? "application/json" : "text/csv", "");
+    size_t n;
+    while ((n = series.readQuery(query, chunk, sizeof(chunk))) > 0) {
+        server.sendContent(chunk, n);
+    }
+    server.sendContent("");
+}
+
+// the tele data besides what the MQTT publisher adds itself
+InverterData getTeleData() {
+    InverterData tele = profiler.getData();
+    inverter->emitStats(tele);
+    history.emitStats(tele);
+    energy.emitStats(tele);
+    series.emitStats(tele);
+    live.emitStats(tele);
+    outputs.emitStats(tele);
+    WallClock::emitStats(tele);
+    if (mqttTls != NULL) {
+        mqttTls->emitStats(tele);
+    }
+    return tele;
+}
+
+void renderMetrics() {
+    InverterData tele = getTeleData();
+    mqtt->emitStats(tele);
+    metrics.render(latestValues, tele);
+}
+
+// the page is ready, a scrape only sends it
+void handleMetrics() {
+    ESP8266WebServer &server = *wcm.getWM().server;
+
+    server.sendHeader("ETag", metrics.getETag());
+    if (metrics.matches(server.header("If-None-Match").c_str())) {
+        server.send(304, METRICS_CONTENT_TYPE, "");
+        return;
+    }
+    server.send_P(200, METRICS_CONTENT_TYPE, metrics.getText(), metrics.getLength());
+}
+
 bool isFactoryResetRequested() {
 #ifdef LARGE_ESP_BOARD
     static unsigned long pressStart = 0;
@@ -164,54 +402,115 @@ void setup() {
 #endif
     setupLogger();
     wcm.setupWifiAndConfig();
+    wcm.getWM().server->on(SERIES_URI, handleSeries);
+    wcm.getWM().server->on(METRICS_URI, handleMetrics);
+    const char *metricsHeaders[] = { "If-None-Match" };
+    wcm.getWM().server->collectHeaders(metricsHeaders, 1);
+    metrics.begin();
+    history.begin();
+    energy.begin();
+#ifdef LOG_SERVER_ENABLED
+    logServer.begin();
+#endif
+    live.begin();
     setupInverter();
     auto topics = inverter->getTopicsToSubscribe();
     setupMqtt(topics);
+    setupOutputs();
+    WallClock::begin(wcm.getNtpServer().c_str());
+    nextPollAtMillis = millis();
     areRemoteCommandsSupported = topics.size() > 0;
 }
 
 void loop() {
+    profiler.countLoop();
+
+    profiler.start(PROFILE_WIFI);
     wcm.loop();
+    profiler.stop(PROFILE_WIFI);
 
     if (isFactoryResetRequested()) {
-        GLOG::println(F("LOOP: Factory reset!"));
+        GLOG_WARN("LOOP: Factory reset!\n");
         wcm.doFactoryReset();
         delay(1000);
         ESP.restart();
     }
 
     // handle config changes
-    if (wcm.checkforConfigChanges()) {
+    uint8_t configChanges = wcm.checkforConfigChanges();
+    if (configChanges != CONFIG_CHANGED_NONE) {
         if (wcm.isRestartRequired()) {
-            GLOG::println(F("LOOP: New config, RESTARTING!"));
+            GLOG_WARN("LOOP: New config, RESTARTING!\n");
             delay(1000);
             ESP.restart();
         } else {
-            applyNewConfiguration();
+            applyNewConfiguration(configChanges);
         }
     }
     
+    profiler.start(PROFILE_MQTT);
     mqtt->loop();
+    profiler.stop(PROFILE_MQTT);
+
+    profiler.start(PROFILE_INVERTER_LOOP);
     inverter->loop();
+    profiler.stop(PROFILE_INVERTER_LOOP);
+
+#ifdef LOG_SERVER_ENABLED
+    logServer.loop();
+#endif
+    live.loop();
+
+    profiler.start(PROFILE_OUTPUTS);
+    outputs.loop();
+    profiler.stop(PROFILE_OUTPUTS);
 
     unsigned long now = millis();
 
-    // inverter report
-    if (mqtt->isConnected() && now - lastReportSentAtMillis > wcm.getModbusPollingInSeconds() * (unsigned)1000) {
+    // power sampling for the energy integration, between the polls
+    if (inverter->hasPowerSampling() && now - lastPowerSampleAtMillis >= ENERGY_SAMPLE_INTERVAL_MILLIS) {
+        profiler.start(PROFILE_POWER_SAMPLE);
+        energy.beginSample(now);
+        series.beginSample(WallClock::time());
+        inverter->samplePower(powerSamples);
+        energy.endSample();
+        profiler.stop(PROFILE_POWER_SAMPLE);
+
+        lastPowerSampleAtMillis = now;
+    }
+
+    // inverter report, polling goes on without the broker and the history buffer keeps the values
+    bool polled = false;
+    if ((long) (now - nextPollAtMillis) >= 0) {
         if (ledStatus == 2) leds.lightUpDefault(); // Turn the LED on
-        GLOG::print(F("LOOP: Polling inverter"));
+        GLOG_DEBUG("LOOP: Polling inverter");
+        // the values are stamped with the start of the poll, the boundary it was scheduled on
+        time_t pollTime = WallClock::time();
+        profiler.start(PROFILE_INVERTER_READ);
         inverter->read();
+        profiler.stop(PROFILE_INVERTER_READ);
 
         if (inverter->isDataValid()) {
-            GLOG::print(F(", publishing"));
-            InverterData data = inverter->getData();
-            mqtt->publishData(data);
-            GLOG::println(F(", done!"));
+            // offline the MQTT output keeps the poll in the history buffer
+            GLOG_DEBUG(", %s", mqtt->isConnected() ? "publishing" : "offline, keeping history");
+            profiler.start(PROFILE_PUBLISH);
+            outputs.beginPoll(now, pollTime);
+            emitPoll(outputs, now, pollTime);
+            // the aggregates ride along with a poll, through the filters and intervals of each output
+            if (now - lastAggregatesAtMillis >= ENERGY_AGGREGATE_INTERVAL_MILLIS) {
+                energy.emitAggregates(outputs);
+                lastAggregatesAtMillis = now;
+            }
+            outputs.endPoll();
+            profiler.stop(PROFILE_PUBLISH);
+            GLOG_DEBUG(", done!\n");
         } else {
-            GLOG::println(F(", failed!"));
+            GLOG_DEBUG(", failed!\n");
         }
 
-        lastReportSentAtMillis = now;
+        renderMetrics();
+        nextPollAtMillis = WallClock::nextBoundary(wcm.getModbusPollingInSeconds() * 1000UL, now);
+        polled = true;
         
         if (ledStatus == 2) leds.dimDefault(); // Turn the LED off
         if (tasksRedLedCounter > 0) tasksRedLedCounter--;
@@ -224,10 +523,22 @@ void loop() {
         }
     }
 
+    // offline history replay, one message at a time and never in the same pass as a live poll
+    if (!polled && mqtt->isConnected() && history.getBacklog() > 0 && now - lastHistoryReplayAtMillis > HISTORY_REPLAY_INTERVAL_MILLIS) {
+        char payload[HISTORY_PAYLOAD_SIZE];
+        size_t records = history.nextBatch(payload, sizeof(payload));
+        if (records > 0 && mqtt->publishHistory(payload)) {
+            history.commitBatch(records);
+        }
+
+        lastHistoryReplayAtMillis = now;
+    }
+
     // inverter tele report
     if (mqtt->isConnected() && now - lastTeleSentAtMillis > 60000) {
-        GLOG::println(F("LOOP: Publishing telemetry"));
-        mqtt->publishTele();
+        GLOG_DEBUG("LOOP: Publishing telemetry\n");
+        InverterData profile = getTeleData();
+        mqtt->publishTele(profile);
 
         lastTeleSentAtMillis = now;
     }
@@ -12,6 +12,7 @@
 #include "GrowattTaskFactory.h"
 #include "../Task.h"
 #include "../ModbusUtils.h"
+#include "../WallClock.h"
 
 
 static uint8_t stateSequence[] = {0, 1, 3, 0, 1, 4, 0, 1, 3, 0, 1, 4, 2};
@@ -30,34 +31,35 @@ void GrowattInverter::read() {
         runningTask = incomingTasks.front();
         incomingTasks.pop_front();
         
-        GLOG::print(", TASK starting");
+        GLOG_DEBUG(", TASK starting");
         
         runningTask->run();
         this->valid = true; // it's always true even if the task fails be cause we will always return a Ok/Fail message on the "task_topic"/result
         
-        GLOG::print(", completed");
+        GLOG_DEBUG(", completed");
             
         return;
     }
     
     // read data
-    GLOG::print(String(", step=") + stateSequence[currentStateIdx]);
+    GLOG_DEBUG(", step=%d", stateSequence[currentStateIdx]);
 
     if (stateSequence[currentStateIdx] == 0) {
-        uint8_t result1 = this->node->readInputRegisters(0, 12);
+        uint8_t result1 = this->readInputRegisters(0, 12);
         if (result1 == this->node->ku8MBSuccess) {
-
-            this->status = this->node->getResponseBuffer(0);
+            GrowattPvBlock &b = pv.beginWrite();
+            b.status = this->node->getResponseBuffer(0);
 
             // 2 PV inputs
-            this->Vpv1 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(3));
-            this->Ipv1 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(4)) / 10.0;
-            this->Ppv1 = ModbusUtils::glueFloat(this->node->getResponseBuffer(5), this->node->getResponseBuffer(6));
+            b.Vpv1 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(3));
+            b.Ipv1 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(4)) / 10.0;
+            b.Ppv1 = ModbusUtils::glueFloat(this->node->getResponseBuffer(5), this->node->getResponseBuffer(6));
 
-            this->Vpv2 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(7));
-            this->Ipv2 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(8)) / 10.0;
-            this->Ppv2 = ModbusUtils::glueFloat(this->node->getResponseBuffer(9), this->node->getResponseBuffer(10));
+            b.Vpv2 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(7));
+            b.Ipv2 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(8)) / 10.0;
+            b.Ppv2 = ModbusUtils::glueFloat(this->node->getResponseBuffer(9), this->node->getResponseBuffer(10));
 
+            pv.commit(millis(), WallClock::now());
             this->valid = true;
         } else {
             this->valid = false;
@@ -66,27 +68,29 @@ void GrowattInverter::read() {
     } else if (stateSequence[currentStateIdx] == 1) {
         // AC stuff, including the other phases for TL SPH inverters and energy produced
         // start reading at 35 and read up to 24 registers
-        uint8_t result2 = this->node->readInputRegisters(35, 24);
+        uint8_t result2 = this->readInputRegisters(35, 24);
         if (result2 == this->node->ku8MBSuccess) {
-            this->Pac = ModbusUtils::glueFloat(this->node->getResponseBuffer(0), this->node->getResponseBuffer(1)); // 35, 36
-            this->Fac = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(2))/10; // 37
+            GrowattAcBlock &b = ac.beginWrite();
+            b.Pac = ModbusUtils::glueFloat(this->node->getResponseBuffer(0), this->node->getResponseBuffer(1)); // 35, 36
+            b.Fac = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(2))/10; // 37
 
-            this->Vac1 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(3)); // 38
-            this->Iac1 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(4)); // 39
-            this->Pac1 = ModbusUtils::glueFloat(this->node->getResponseBuffer(5), this->node->getResponseBuffer(6)); // 40, 41
+            b.Vac1 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(3)); // 38
+            b.Iac1 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(4)); // 39
+            b.Pac1 = ModbusUtils::glueFloat(this->node->getResponseBuffer(5), this->node->getResponseBuffer(6)); // 40, 41
             if (this->enableTL) {
-                this->Vac2 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(7)); //42
-                this->Iac2 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(8)); //43
-                this->Pac2 = ModbusUtils::glueFloat(this->node->getResponseBuffer(9), this->node->getResponseBuffer(10)); //44, 45
+                b.Vac2 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(7)); //42
+                b.Iac2 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(8)); //43
+                b.Pac2 = ModbusUtils::glueFloat(this->node->getResponseBuffer(9), this->node->getResponseBuffer(10)); //44, 45
 
-                this->Vac3 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(11)); //46
-                this->Iac3 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(12)); //47
-                this->Pac3 = ModbusUtils::glueFloat(this->node->getResponseBuffer(13), this->node->getResponseBuffer(14)); //48, 49
+                b.Vac3 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(11)); //46
+                b.Iac3 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(12)); //47
+                b.Pac3 = ModbusUtils::glueFloat(this->node->getResponseBuffer(13), this->node->getResponseBuffer(14)); //48, 49
             }
-            this->Etoday = ModbusUtils::glueFloat(this->node->getResponseBuffer(18), this->node->getResponseBuffer(19)); //53, 54
-            this->Etotal = ModbusUtils::glueFloat(this->node->getResponseBuffer(20), this->node->getResponseBuffer(21)); //55, 56
-            this->Ttotal = ModbusUtils::glueFloat(this->node->getResponseBuffer(22), this->node->getResponseBuffer(23)); //57, 58
+            b.Etoday = ModbusUtils::glueFloat(this->node->getResponseBuffer(18), this->node->getResponseBuffer(19)); //53, 54
+            b.Etotal = ModbusUtils::glueFloat(this->node->getResponseBuffer(20), this->node->getResponseBuffer(21)); //55, 56
+            b.Ttotal = ModbusUtils::glueFloat(this->node->getResponseBuffer(22), this->node->getResponseBuffer(23)); //57, 58
             
+            ac.commit(millis(), WallClock::now());
             this->valid = true;
         } else {
             this->valid = false;
@@ -95,18 +99,19 @@ void GrowattInverter::read() {
     } else  if (stateSequence[currentStateIdx] == 2) {
         // Temperatures, Battery and Priority (LoadFirst, BatFirst, GridFirst)
         // start reading at register 93 and read up to 30 registers
-        uint8_t result3 = this->node->readInputRegisters(93, 30);
+        uint8_t result3 = this->readInputRegisters(93, 30);
         if (result3 == this->node->ku8MBSuccess) {
-
-            this->temp1 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(0)); //93
-            this->temp2 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(1)); //94
-            this->temp3 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(2)); //95
+            GrowattTempBlock &b = temps.beginWrite();
+            b.temp1 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(0)); //93
+            b.temp2 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(1)); //94
+            b.temp3 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(2)); //95
             
-            this->deratingMode = this->node->getResponseBuffer(11); //104
+            b.deratingMode = this->node->getResponseBuffer(11); //104
 
-            this->Priority = this->node->getResponseBuffer(25); //118
-            this->BatteryType = this->node->getResponseBuffer(26); //119
+            b.Priority = this->node->getResponseBuffer(25); //118
+            b.BatteryType = this->node->getResponseBuffer(26); //119
             
+            temps.commit(millis(), WallClock::now());
             this->valid = true;
         } else {
             this->valid = false;
@@ -115,44 +120,50 @@ void GrowattInverter::read() {
     } else if (stateSequence[currentStateIdx] == 3) {
         // Battery status
         // start reading at register 1009 and read up to 6 registers
-        uint8_t result4 = this->node->readInputRegisters(1009, 6);
+        uint8_t result4 = this->readInputRegisters(1009, 6);
         if (result4 == this->node->ku8MBSuccess) {
+            GrowattBatteryBlock &b = battery.beginWrite();
             // ModbusUtils::dumpRegisters(this->node, 6);
-            this->Pdischarge = ModbusUtils::glueFloat(this->node->getResponseBuffer(0), this->node->getResponseBuffer(1)); //1009, 1010
-            this->Pcharge = ModbusUtils::glueFloat(this->node->getResponseBuffer(2), this->node->getResponseBuffer(3)); //1011, 1012
-            this->Vbat = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(4)); //1013
-            this->SOC = this->node->getResponseBuffer(5); // 1014
+            b.Pdischarge = ModbusUtils::glueFloat(this->node->getResponseBuffer(0), this->node->getResponseBuffer(1)); //1009, 1010
+            b.Pcharge = ModbusUtils::glueFloat(this->node->getResponseBuffer(2), this->node->getResponseBuffer(3)); //1011, 1012
+            b.Vbat = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(4)); //1013
+            b.SOC = this->node->getResponseBuffer(5); // 1014
             
+            battery.commit(millis(), WallClock::now());
             this->valid = true;
         } else {
+            if (result4 == this->node->ku8MBIllegalDataAddress) {
+                this->hasBatteryRegisters = false;
+            }
             this->valid = false;
         }
         
     } else {
         // EPS
         // EPS starts at register 1067 and is 15 registers long (see page 44)
-        uint8_t result5 = this->node->readInputRegisters(1067, 15);
+        uint8_t result5 = this->readInputRegisters(1067, 15);
         if (result5 == this->node->ku8MBSuccess) {
+            GrowattEpsBlock &b = eps.beginWrite();
+            b.EpsFac = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(0)) / 10.0; //1067
 
-            this->EpsFac = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(0)) / 10.0; //1067
-
-            this->EpsVac1 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(1)); //1068
-            this->EpsIac1 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(2)); //1069
-            this->EpsPac1 = ModbusUtils::glueFloat(this->node->getResponseBuffer(3), this->node->getResponseBuffer(4)); //1070, 1071
+            b.EpsVac1 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(1)); //1068
+            b.EpsIac1 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(2)); //1069
+            b.EpsPac1 = ModbusUtils::glueFloat(this->node->getResponseBuffer(3), this->node->getResponseBuffer(4)); //1070, 1071
 
             if (this->enableTL) {
-                this->EpsVac2 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(5)); //1072
-                this->EpsIac2 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(6)); //1073
-                this->EpsPac2 = ModbusUtils::glueFloat(this->node->getResponseBuffer(7), this->node->getResponseBuffer(8)); //1074, 1075
+                b.EpsVac2 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(5)); //1072
+                b.EpsIac2 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(6)); //1073
+                b.EpsPac2 = ModbusUtils::glueFloat(this->node->getResponseBuffer(7), this->node->getResponseBuffer(8)); //1074, 1075
 
-                this->EpsVac3 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(9)); //1076
-                this->EpsIac3 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(10)); //1077
-                this->EpsPac3 = ModbusUtils::glueFloat(this->node->getResponseBuffer(11), this->node->getResponseBuffer(12)); //1078, 1079
+                b.EpsVac3 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(9)); //1076
+                b.EpsIac3 = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(10)); //1077
+                b.EpsPac3 = ModbusUtils::glueFloat(this->node->getResponseBuffer(11), this->node->getResponseBuffer(12)); //1078, 1079
             }
 
-            this->EpsLoadPercent = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(13)); //1080
-            this->EpsPF = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(14)) / 100.0; //1081
+            b.EpsLoadPercent = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(13)); //1080
+            b.EpsPF = ModbusUtils::glueFloat(0, this->node->getResponseBuffer(14)) / 100.0; //1081
             
+            eps.commit(millis(), WallClock::now());
             this->valid = true;
         } else {
             this->valid = false;
@@ -160,8 +171,18 @@ void GrowattInverter::read() {
         
     }
     
+    // the inverter answers again, at sunrise usually
+    if (this->valid) {
+        this->sampleRetryMillis = 0;
+    }
+
     lastUpdatedState = stateSequence[currentStateIdx];
     incrementStateIdx();
+
+    // the block just decoded, a task result waits for the poll
+    if (this->valid && this->liveSink != NULL && this->runningTask == NULL) {
+        emitData(*this->liveSink);
+    }
 }
 
 
@@ -175,68 +196,27 @@ GrowattInverter::GrowattInverter(Stream *serial, bool shouldDeleteSerial, uint8_
     this->node->begin(slaveAddress, *serial);
     this->currentStateIdx = 0;
     this->lastUpdatedState = 0;
+    this->runningTask = NULL;
+    this->liveSink = NULL;
+    this->modbusRequests = 0;
+    this->modbusErrors = 0;
+    this->modbusTimeouts = 0;
+    this->modbusLastError = 0;
+    this->hasBatteryRegisters = true;
+    this->sampleFailedAtMillis = 0;
+    this->sampleRetryMillis = 0;
 
     this->valid = false;
-    this->status = 0;
-    this->Ppv1 = 0.0;
-    this->Vpv1 = 0.0;
-    this->Ipv1 = 0.0;
-
-    this->Ppv2 = 0.0;
-    this->Vpv2 = 0.0;
-    this->Ipv2 = 0.0;
-
-    this->Pac1 = 0.0;
-    this->Vac1 = 0.0;
-    this->Iac1 = 0.0;
-
-    this->Pac2 = 0.0;
-    this->Vac2 = 0.0;
-    this->Iac2 = 0.0;
-
-    this->Pac3 = 0.0;
-    this->Vac3 = 0.0;
-    this->Iac3 = 0.0;
-
-    this->Fac = 0.0;
-    this->Pac = 0.0;
-
-    this->Etoday = 0.0;
-    this->Etotal = 0.0;
-    this->Ttotal = 0.0;
-
-    this->temp1 = 0.0;
-    this->temp2 = 0.0;
-    this->temp3 = 0.0;
-
-    this->deratingMode = 0;
-    this->Priority = 0;
-    this->BatteryType = 0;
-
-    this->Pdischarge = 0.0;
-    this->Pcharge = 0.0;
-    this->Vbat = 0.0;
-    this->SOC = 0;
-
-    this->EpsFac = 0;
-
-    this->EpsPac1 = 0.0;
-    this->EpsVac1 = 0.0;
-    this->EpsIac1 = 0.0;
-
-    this->EpsPac2 = 0.0;
-    this->EpsVac2 = 0.0;
-    this->EpsIac2 = 0.0;
-
-    this->EpsPac3 = 0.0;
-    this->EpsVac3 = 0.0;
-    this->EpsIac3 = 0.0;
-
-    this->EpsLoadPercent = 0.0;
-    this->EpsPF = 0.0;
 }
 
 GrowattInverter::~GrowattInverter() {
+    // tasks not run yet, or run but not reported
+    for (Task *task : incomingTasks) {
+        delete task;
+    }
+    incomingTasks.clear();
+    delete runningTask;
+
     delete this->node;
 
     if (this->shouldDeleteSerial) {
@@ -250,180 +230,291 @@ bool GrowattInverter::isDataValid() {
 
 InverterData GrowattInverter::getData(bool fullSet) {
     InverterData data;
-    
+    emitData(data, fullSet);
+    return data;
+}
+
+void GrowattInverter::emitData(InverterSink &sink, bool fullSet) {
     // handle task data
     if (runningTask != NULL) {
         // return task data
         if (runningTask->isSuccessful()) {
-            InverterData respData = runningTask->response();
-            data.insert(respData.begin(), respData.end());
+            runningTask->response().emitTo(sink);
         }
         // append task result
-        data.set((runningTask->subtopic()+"/result").c_str(), runningTask->isSuccessful() ? "Ok" : "Fail");
+        char resultName[INVERTER_SINK_NAME_SIZE];
+        snprintf(resultName, sizeof(resultName), "%s/result", runningTask->subtopic().c_str());
+        sink.emit(resultName, runningTask->isSuccessful() ? "Ok" : "Fail");
         
         delete runningTask;
         runningTask = NULL;
         
         this->valid = false;
         
-        return data;
+        return;
     }
     
-    // handle read data
+    // handle read data, from the front copy of each block
+    const GrowattPvBlock &pvBlock = pv.get();
+    const GrowattAcBlock &acBlock = ac.get();
+    const GrowattTempBlock &tempBlock = temps.get();
+    const GrowattBatteryBlock &batteryBlock = battery.get();
+    const GrowattEpsBlock &epsBlock = eps.get();
+
     if (lastUpdatedState == 0 || fullSet) {
-        data.set("status", this->status);
+        sink.emit("status", pvBlock.status);
       
-        data.set("Ppv1", this->Ppv1);    
-        data.set("Vpv1", this->Vpv1);
-        data.set("Ipv1", this->Ipv1);
+        sink.emit("Ppv1", pvBlock.Ppv1);    
+        sink.emit("Vpv1", pvBlock.Vpv1);
+        sink.emit("Ipv1", pvBlock.Ipv1);
       
-        data.set("Ppv2", this->Ppv2);   
-        data.set("Vpv2", this->Vpv2);
-        data.set("Ipv2", this->Ipv2);
+        sink.emit("Ppv2", pvBlock.Ppv2);   
+        sink.emit("Vpv2", pvBlock.Vpv2);
+        sink.emit("Ipv2", pvBlock.Ipv2);
     }
 
     if (lastUpdatedState == 1 || fullSet) {
-        data.set("Vac1", this->Vac1);
-        data.set("Iac1", this->Iac1);
-        data.set("Pac1", this->Pac1);
+        sink.emit("Vac1", acBlock.Vac1);
+        sink.emit("Iac1", acBlock.Iac1);
+        sink.emit("Pac1", acBlock.Pac1);
         
-        data.set("Pac", this->Pac);
-        data.set("Fac", this->Fac);
+        sink.emit("Pac", acBlock.Pac);
+        sink.emit("Fac", acBlock.Fac);
         
         if (this->enableTL) {
-            data.set("Vac2", this->Vac2);
-            data.set("Iac2", this->Iac2);
-            data.set("Pac2", this->Pac2);
+            sink.emit("Vac2", acBlock.Vac2);
+            sink.emit("Iac2", acBlock.Iac2);
+            sink.emit("Pac2", acBlock.Pac2);
             
-            data.set("Vac3", this->Vac3);
-            data.set("Iac3", this->Iac3);
-            data.set("Pac3", this->Pac3);
+            sink.emit("Vac3", acBlock.Vac3);
+            sink.emit("Iac3", acBlock.Iac3);
+            sink.emit("Pac3", acBlock.Pac3);
         }
 
-        data.set("Etoday", this->Etoday);
-        data.set("Etotal", this->Etotal);
-        data.set("Ttotal", this->Ttotal);
+        sink.emit("Etoday", acBlock.Etoday);
+        sink.emit("Etotal", acBlock.Etotal);
+        sink.emit("Ttotal", acBlock.Ttotal);
     } 
 
     if (lastUpdatedState == 2 || fullSet) {
-        data.set("Temp1", this->temp1);
-        data.set("Temp2", this->temp2);
-        data.set("Temp3", this->temp3);
+        sink.emit("Temp1", tempBlock.temp1);
+        sink.emit("Temp2", tempBlock.temp2);
+        sink.emit("Temp3", tempBlock.temp3);
         
-        data.set("DeratingMode", this->deratingMode);
+        sink.emit("DeratingMode", tempBlock.deratingMode);
         
-        switch(this->deratingMode) {
+        switch(tempBlock.deratingMode) {
             case 0:
-                data.set("Derating", "None");
+                sink.emit("Derating", "None");
             break;
             case 1:
-                data.set("Derating", "PV");
+                sink.emit("Derating", "PV");
             break;
             case 2:
-                data.set("Derating", "*");
+                sink.emit("Derating", "*");
             break;
             case 3:
-                data.set("Derating", "Vac");
+                sink.emit("Derating", "Vac");
             break;
             case 4:
-                data.set("Derating", "Fac");
+                sink.emit("Derating", "Fac");
             break;
             case 5:
-                data.set("Derating", "Tboost");
+                sink.emit("Derating", "Tboost");
             break;
             case 6:
-                data.set("Derating", "Tinv");
+                sink.emit("Derating", "Tinv");
             break;
             case 7:
-                data.set("Derating", "Control");
+                sink.emit("Derating", "Control");
             break;
             case 8:
-                data.set("Derating", "*");
+                sink.emit("Derating", "*");
             break;
             case 9:
-                data.set("Derating", "OverBackByTime");
+                sink.emit("Derating", "OverBackByTime");
             break;
             default:
-                data.set("Derating", "Unknown");
+                sink.emit("Derating", "Unknown");
         }
       
-        switch (this->Priority) {
+        switch (tempBlock.Priority) {
             case 0:
-                data.set("Priority", "Load");
+                sink.emit("Priority", "Load");
             break;
             case 1:
-                data.set("Priority", "Bat");
+                sink.emit("Priority", "Bat");
             break;
             case 2:
-                data.set("Priority", "Grid");
+                sink.emit("Priority", "Grid");
             break;
             default:
-                data.set("Priority", (String("Unknown ") + this->Priority).c_str());
+                sink.emit("Priority", (String("Unknown ") + tempBlock.Priority).c_str());
         }
 
         // Battery
-        switch (this->BatteryType) {
+        switch (tempBlock.BatteryType) {
             case 0:
-                data.set("Battery", "LeadAcid");
+                sink.emit("Battery", "LeadAcid");
             break;
             
             case 1:
-                data.set("Battery", "Lithium");
+                sink.emit("Battery", "Lithium");
             break;
             default:
-                data.set("Battery", (String("Unknown type ") + this->BatteryType).c_str());
+                sink.emit("Battery", (String("Unknown type ") + tempBlock.BatteryType).c_str());
         }
     }
 
     if (lastUpdatedState == 3 || fullSet) {
-        data.set("Pdischarge", this->Pdischarge);
-        data.set("Pcharge", this->Pcharge);
-        data.set("Vbat", this->Vbat);
-        data.set("SOC", this->SOC);
+        sink.emit("Pdischarge", batteryBlock.Pdischarge);
+        sink.emit("Pcharge", batteryBlock.Pcharge);
+        sink.emit("Vbat", batteryBlock.Vbat);
+        sink.emit("SOC", batteryBlock.SOC);
     }
 
     if (lastUpdatedState == 4 || fullSet) {
         // EPS
-        data.set("EpsFac", this->EpsFac);
+        sink.emit("EpsFac", epsBlock.EpsFac);
 
-        data.set("EpsPac1", this->EpsPac1);
-        data.set("EpsVac1", this->EpsVac1);
-        data.set("EpsIac1", this->EpsIac1);
+        sink.emit("EpsPac1", epsBlock.EpsPac1);
+        sink.emit("EpsVac1", epsBlock.EpsVac1);
+        sink.emit("EpsIac1", epsBlock.EpsIac1);
 
         if (this->enableTL) {
-            data.set("EpsPac2", this->EpsPac2);
-            data.set("EpsVac2", this->EpsVac2);
-            data.set("EpsIac2", this->EpsIac2);
+            sink.emit("EpsPac2", epsBlock.EpsPac2);
+            sink.emit("EpsVac2", epsBlock.EpsVac2);
+            sink.emit("EpsIac2", epsBlock.EpsIac2);
             
-            data.set("EpsPac3", this->EpsPac3);
-            data.set("EpsVac3", this->EpsVac3);
-            data.set("EpsIac3", this->EpsIac3);
+            sink.emit("EpsPac3", epsBlock.EpsPac3);
+            sink.emit("EpsVac3", epsBlock.EpsVac3);
+            sink.emit("EpsIac3", epsBlock.EpsIac3);
         }
 
-        data.set("EpsLoadPercent", this->EpsLoadPercent);
-        data.set("EpsPF", this->EpsPF);
+        sink.emit("EpsLoadPercent", epsBlock.EpsLoadPercent);
+        sink.emit("EpsPF", epsBlock.EpsPF);
     }
-    
-    return data;
 }
 
 
 
+bool GrowattInverter::samplePower(InverterSink &sink) {
+    // the bus belongs to the task until its result is out
+    if (runningTask != NULL || incomingTasks.size() > 0) {
+        return false;
+    }
+    // an inverter asleep at night times out each read, the loop is not held up every second
+    if (this->sampleRetryMillis > 0 && millis() - this->sampleFailedAtMillis < this->sampleRetryMillis) {
+        return false;
+    }
+
+    // three short reads into the power block, the register blocks keep the time of their full read
+    if (this->readInputRegisters(5, 6) != this->node->ku8MBSuccess) {
+        this->sampleFailed();
+        return false;
+    }
+    GrowattPowerBlock &p = power.beginWrite();
+    p.Ppv1 = ModbusUtils::glueFloat(this->node->getResponseBuffer(0), this->node->getResponseBuffer(1)); // 5, 6
+    p.Ppv2 = ModbusUtils::glueFloat(this->node->getResponseBuffer(4), this->node->getResponseBuffer(5)); // 9, 10
+
+    if (this->readInputRegisters(35, 2) != this->node->ku8MBSuccess) {
+        power.abort();
+        this->sampleFailed();
+        return false;
+    }
+    p.Pac = ModbusUtils::glueFloat(this->node->getResponseBuffer(0), this->node->getResponseBuffer(1)); // 35, 36
+    this->sampleRetryMillis = 0;
+
+    // a model without a battery answers its registers with an illegal address, they are not read again
+    bool hasBattery = false;
+    if (this->hasBatteryRegisters) {
+        uint8_t result = this->readInputRegisters(1009, 4);
+        if (result == this->node->ku8MBSuccess) {
+            p.Pdischarge = ModbusUtils::glueFloat(this->node->getResponseBuffer(0), this->node->getResponseBuffer(1)); // 1009, 1010
+            p.Pcharge = ModbusUtils::glueFloat(this->node->getResponseBuffer(2), this->node->getResponseBuffer(3)); // 1011, 1012
+            hasBattery = true;
+        } else if (result == this->node->ku8MBIllegalDataAddress) {
+            this->hasBatteryRegisters = false;
+        }
+        // PV and AC are sampled anyway
+    }
+    power.commit(millis(), WallClock::now());
+
+    sink.emit("Ppv1", power.get().Ppv1);
+    sink.emit("Ppv2", power.get().Ppv2);
+    sink.emit("Pac", power.get().Pac);
+    if (hasBattery) {
+        sink.emit("Pdischarge", power.get().Pdischarge);
+        sink.emit("Pcharge", power.get().Pcharge);
+    }
+    return true;
+}
+
+void GrowattInverter::sampleFailed() {
+    this->sampleRetryMillis = this->sampleRetryMillis == 0 ? GROWATT_SAMPLE_RETRY_MILLIS : this->sampleRetryMillis * 2;
+    if (this->sampleRetryMillis > GROWATT_SAMPLE_RETRY_MAX_MILLIS) {
+        this->sampleRetryMillis = GROWATT_SAMPLE_RETRY_MAX_MILLIS;
+    }
+    this->sampleFailedAtMillis = millis();
+}
+
+uint8_t GrowattInverter::readInputRegisters(uint16_t addr, uint16_t count) {
+    uint8_t result = this->node->readInputRegisters(addr, count);
+    this->modbusRequests++;
+    if (result != this->node->ku8MBSuccess) {
+        this->modbusErrors++;
+        this->modbusLastError = result;
+        if (result == this->node->ku8MBResponseTimedOut) {
+            this->modbusTimeouts++;
+        }
+    }
+    return result;
+}
+
+bool GrowattInverter::setLiveSink(InverterSink *sink) {
+    this->liveSink = sink;
+    return true;
+}
+
+void GrowattInverter::emitStats(InverterSink &sink) {
+    sink.emit("Modbus/Requests", this->modbusRequests);
+    sink.emit("Modbus/Errors", this->modbusErrors);
+    sink.emit("Modbus/Timeouts", this->modbusTimeouts);
+    sink.emit("Modbus/LastError", this->modbusLastError);
+}
+
 void GrowattInverter::setIncomingTopicData(const String &topic, const String &value)
+{
+    uint8_t command = GrowattTaskFactory::commandFromTopic(topic.c_str());
+    if (command == GROWATT_COMMAND_UNKNOWN) {
+        GLOG_WARN("INVERTER: unknown task topic=[%s], value=[%s]\n", topic.c_str(), value.c_str());
+        return;
+    }
+    
+    handleCommand(command, value.c_str());
+}
+
+void GrowattInverter::handleCommand(uint8_t command, const char *value)
 {
     if (incomingTasks.size() > 3) {
-        GLOG::println(F("INVERTER: tasks queue full: task rejected"));
+        GLOG_WARN("INVERTER: tasks queue full: task rejected\n");
         return;
     }
     
-    Task* task = GrowattTaskFactory::create(this->node, topic, value);
+    Task* task = GrowattTaskFactory::create(this->node, command, value);
     if (task != NULL) {
         incomingTasks.push_back(task);
-        GLOG::println(String(F("INVERTER: accepted task topic=[")) + topic + F("], value=[") + value + F("]"));
+        GLOG_INFO("INVERTER: accepted task %s, value=[%s]\n", task->subtopic().c_str(), value);
     } else {
-        GLOG::println(String(F("INVERTER: unknown task topic=[")) + topic + F("], value=[") + value + F("]"));
+        GLOG_WARN("INVERTER: bad value for task %u, value=[%s]\n", command, value);
+    }
+}
+
+void GrowattInverter::registerCommands(TopicDispatcher &dispatcher, const char *prefix)
+{
+    if (this->enableRemoteCommands) {
+        GrowattTaskFactory::registerCommands(dispatcher, prefix, this);
     }
-    
 }
 
 std::list<String> GrowattInverter::getTopicsToSubscribe()
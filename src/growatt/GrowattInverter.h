@@ -17,9 +17,101 @@
 #include <functional>
 #include <ModbusMaster.h>
 #include "../Task.h"
+#include "../BlockSnapshot.h"
 
 #include "../Inverter.h"
 
+// a failed power sample waits before the bus is asked again, doubling up to the max, a valid poll starts over
+#ifndef GROWATT_SAMPLE_RETRY_MILLIS
+#define GROWATT_SAMPLE_RETRY_MILLIS 5000
+#endif
+#ifndef GROWATT_SAMPLE_RETRY_MAX_MILLIS
+#define GROWATT_SAMPLE_RETRY_MAX_MILLIS 300000
+#endif
+
+// input registers 0..11
+struct GrowattPvBlock {
+    uint8_t status;
+
+    float Ppv1;
+    float Vpv1;
+    float Ipv1;
+
+    float Ppv2;
+    float Vpv2;
+    float Ipv2;
+};
+
+// input registers 35..58
+struct GrowattAcBlock {
+    float Pac1; // VA
+    float Vac1;
+    float Iac1;
+
+    float Pac2; // VA
+    float Vac2;
+    float Iac2;
+
+    float Pac3; // VA
+    float Vac3;
+    float Iac3;
+
+    float Fac; // Hz
+    float Pac; // W
+
+    float Etoday;
+    float Etotal;
+    float Ttotal;
+};
+
+// input registers 93..122
+struct GrowattTempBlock {
+    float temp1;
+    float temp2;
+    float temp3;
+
+    uint8_t deratingMode;
+    uint8_t Priority;
+    uint8_t BatteryType;
+};
+
+// input registers 1009..1014
+struct GrowattBatteryBlock {
+    float Pdischarge;
+    float Pcharge;
+    float Vbat;
+    uint16_t SOC;
+};
+
+// input registers 1067..1081, EPS output
+struct GrowattEpsBlock {
+    float EpsFac; // Hz
+
+    float EpsPac1; // VA
+    float EpsVac1;
+    float EpsIac1;
+
+    float EpsPac2; // VA
+    float EpsVac2;
+    float EpsIac2;
+
+    float EpsPac3; // VA
+    float EpsVac3;
+    float EpsIac3;
+
+    float EpsLoadPercent; // 0 .. 100
+    float EpsPF; // -1.0 .. 1.0
+};
+
+// input registers 5..10, 35..36 and 1009..1012, the power fields of samplePower() between the polls
+struct GrowattPowerBlock {
+    float Ppv1;
+    float Ppv2;
+    float Pac;
+    float Pdischarge;
+    float Pcharge;
+};
+
 class GrowattInverter : public Inverter
 {
     public:
@@ -29,11 +121,31 @@ class GrowattInverter : public Inverter
         virtual bool isDataValid();
     
         virtual InverterData getData(bool fullSet = false);
+    
+        virtual void emitData(InverterSink &sink, bool fullSet = false);
+        virtual bool hasPowerSampling() { return true; }
+        virtual bool samplePower(InverterSink &sink);
+        virtual void emitStats(InverterSink &sink);
+        virtual bool setLiveSink(InverterSink *sink);
         virtual void setIncomingTopicData(const String &topic, const String &value);
         virtual std::list<String> getTopicsToSubscribe();
+        virtual void registerCommands(TopicDispatcher &dispatcher, const char *prefix);
+        virtual void handleCommand(uint8_t command, const char *value);
+
+        // the last decoded blocks, for readers outside the poll: view() and isValid()
+        const BlockSnapshot<GrowattPvBlock> &getPvBlock() { return pv; }
+        const BlockSnapshot<GrowattAcBlock> &getAcBlock() { return ac; }
+        const BlockSnapshot<GrowattTempBlock> &getTempBlock() { return temps; }
+        const BlockSnapshot<GrowattBatteryBlock> &getBatteryBlock() { return battery; }
+        const BlockSnapshot<GrowattEpsBlock> &getEpsBlock() { return eps; }
+        const BlockSnapshot<GrowattPowerBlock> &getPowerBlock() { return power; }
 
     private:
         void incrementStateIdx();
+        // readInputRegisters() of the node, counted for emitStats()
+        uint8_t readInputRegisters(uint16_t addr, uint16_t count);
+        // next power sample after the backoff
+        void sampleFailed();
         
         Stream *serial;
         bool shouldDeleteSerial;
@@ -41,71 +153,30 @@ class GrowattInverter : public Inverter
         bool enableTL;
 
         ModbusMaster *node;
+        InverterSink *liveSink;
+        uint32_t modbusRequests;
+        uint32_t modbusErrors;
+        uint32_t modbusTimeouts;
+        uint8_t modbusLastError;
         uint8_t currentStateIdx;
         uint8_t lastUpdatedState;
-
-        float Ppv1;
-        float Vpv1;
-        float Ipv1;
-
-        float Ppv2;
-        float Vpv2;
-        float Ipv2;
-
-        float Pac1; // VA
-        float Vac1;
-        float Iac1;
-
-        float Pac2; // VA
-        float Vac2;
-        float Iac2;
-
-        float Pac3; // VA
-        float Vac3;
-        float Iac3;
-        
-        float Fac; // Hz
-        float Pac; // W
-
-        float Etoday;
-        float Etotal;
-        float Ttotal;
-        
-        float temp1;
-        float temp2;
-        float temp3;
-        
-        uint8_t deratingMode;
-        uint8_t Priority;
-        uint8_t BatteryType;
-        
-        float Pdischarge;
-        float Pcharge;
-        float Vbat;
-        uint16_t SOC;
-        
-        // EPS output
-        float EpsFac; // Hz
-        
-        float EpsPac1; // VA
-        float EpsVac1;
-        float EpsIac1;
-        
-        float EpsPac2; // VA
-        float EpsVac2;
-        float EpsIac2;
-        
-        float EpsPac3; // VA
-        float EpsVac3;
-        float EpsIac3;
-        
-        float EpsLoadPercent; // 0 .. 100
-        float EpsPF; // -1.0 .. 1.0
+        // false once the battery registers answered with an illegal data address
+        bool hasBatteryRegisters;
+        // power sampling backoff, 0 while the samples are answered
+        unsigned long sampleFailedAtMillis;
+        unsigned long sampleRetryMillis;
+
+        // one copy per input register block, readers never see a block half decoded
+        BlockSnapshot<GrowattPvBlock> pv;
+        BlockSnapshot<GrowattAcBlock> ac;
+        BlockSnapshot<GrowattTempBlock> temps;
+        BlockSnapshot<GrowattBatteryBlock> battery;
+        BlockSnapshot<GrowattEpsBlock> eps;
+        // the power samples, the blocks above only change with a full read
+        BlockSnapshot<GrowattPowerBlock> power;
 
         bool valid;
 
-        uint8_t status;
-        
         // the active task, if any or NULL
         Task *runningTask;
         // list of incoming tasks (usually from mqtt) to be executed by the inverter... like changing the priority, etc.
@@ -29,9 +29,7 @@ String GrowattPriorityBatteryFirstACChargerConfigTask::subtopic()
 
 bool GrowattPriorityBatteryFirstACChargerConfigTask::run()
 {
-    GLOG::print("GrowattPriorityBatteryFirstACChargerConfigTask::run ");
-    GLOG::print((subtopic() + " payload=").c_str());
-    GLOG::println(mqttPayload.c_str());
+    GLOG_INFO("GrowattPriorityBatteryFirstACChargerConfigTask::run %s payload=%s\n", subtopic().c_str(), mqttPayload.c_str());
     
     setSuccessful(false);
     
@@ -32,9 +32,7 @@ String GrowattPriorityConfigSetOneRegisterTask::subtopic()
 
 bool GrowattPriorityConfigSetOneRegisterTask::run()
 {
-    GLOG::print("GrowattPriorityConfigSetOneRegisterTask::run ");
-    GLOG::print((subtopic() + " payload=").c_str());
-    GLOG::println(mqttPayload.c_str());
+    GLOG_INFO("GrowattPriorityConfigSetOneRegisterTask::run %s payload=%s\n", subtopic().c_str(), mqttPayload.c_str());
     
     setSuccessful(false);
     
@@ -38,36 +38,36 @@ String GrowattPriorityTask::subtopic() {
 #define TIME_REG_LEN 3
 bool GrowattPriorityTask::run() {
     String &priority = this->mqttValue;
-    GLOG::print(String(F(LOG_MSG)) + priority);
+    GLOG_INFO(LOG_MSG "%s", priority.c_str());
     setSuccessful(false);
 
     if (priority == F(TOPIC_VALUE_PRIORITY_LOAD)) {
         if (!checkAndSetEnableBit(BAT_REG_START, 0)) {
-            GLOG::println(String(F(LOG_MSG)) + priority + F(" failed, cannot read/write 1100...1102"));
+            GLOG_ERROR(LOG_MSG "%s failed, cannot read/write 1100...1102\n", priority.c_str());
             return false;
         }
         if (!checkAndSetEnableBit(GRID_REG_START, 0)) {
-            GLOG::println(String(F(LOG_MSG)) + priority + F(" failed, cannot read/write 1080...1082"));
+            GLOG_ERROR(LOG_MSG "%s failed, cannot read/write 1080...1082\n", priority.c_str());
             return false;
         }
         setSuccessful(true);
     } else if (priority == F(TOPIC_VALUE_PRIORITY_BAT)) {
         if (!checkAndSetEnableBit(GRID_REG_START, 0)) {
-            GLOG::println(String(F(LOG_MSG)) + priority + F(" failed, cannot read/write 1080...1082"));
+            GLOG_ERROR(LOG_MSG "%s failed, cannot read/write 1080...1082\n", priority.c_str());
             return false;
         }
         if (!checkAndSetEnableBit(BAT_REG_START, 1)) {
-            GLOG::println(String(F(LOG_MSG)) + priority + F(" failed, cannot read/write 1100...1102"));
+            GLOG_ERROR(LOG_MSG "%s failed, cannot read/write 1100...1102\n", priority.c_str());
             return false;
         }
         setSuccessful(true);
     } else if (priority == F(TOPIC_VALUE_PRIORITY_GRID)) {
         if (!checkAndSetEnableBit(BAT_REG_START, 0)) {
-            GLOG::println(String(F(LOG_MSG)) + priority + F(" failed, cannot read/write 1100...1102"));
+            GLOG_ERROR(LOG_MSG "%s failed, cannot read/write 1100...1102\n", priority.c_str());
             return false;
         }
         if (!checkAndSetEnableBit(GRID_REG_START, 1)) {
-            GLOG::println(String(F(LOG_MSG)) + priority + F(" failed, cannot read/write 1080...1082"));
+            GLOG_ERROR(LOG_MSG "%s failed, cannot read/write 1080...1082\n", priority.c_str());
             return false;
         }
         setSuccessful(true);
@@ -77,7 +77,7 @@ bool GrowattPriorityTask::run() {
         }
         setSuccessful(true);
     } else {
-        GLOG::println(String(F(LOG_MSG)) + priority + F(" failed, invalid value"));
+        GLOG_ERROR(LOG_MSG "%s failed, invalid value\n", priority.c_str());
         setSuccessful(false);
     }
     
@@ -231,11 +231,11 @@ bool GrowattPriorityTask::readPriorityStatus() {
 #else
         json.printTo(jsonResponse);
 #endif
-        GLOG::println(String(" ok, json=") + jsonResponse);
+        GLOG_INFO(" ok, json=%s\n", jsonResponse.c_str());
         response().set((String(F(TOPIC_SETTINGS_PRIORITY)) + F("/data")).c_str(), jsonResponse); // setting as string
         return true;
     } else {
-        GLOG::println(String(" failed with code ") + String(result, DEC) + F(", cannot read 1070...1118"));
+        GLOG_ERROR(" failed with code %d, cannot read 1070...1118\n", result);
         return false;
     }
 }
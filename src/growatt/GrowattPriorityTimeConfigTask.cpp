@@ -32,9 +32,7 @@ String GrowattPriorityTimeConfigTask::subtopic()
 
 bool GrowattPriorityTimeConfigTask::run()
 {
-    GLOG::print("GrowattPriorityTimeConfigTask::run ");
-    GLOG::print((subtopic() + " payload=").c_str());
-    GLOG::println(mqttPayload.c_str());
+    GLOG_INFO("GrowattPriorityTimeConfigTask::run %s payload=%s\n", subtopic().c_str(), mqttPayload.c_str());
     
     setSuccessful(false);
     
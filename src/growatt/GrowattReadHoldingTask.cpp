@@ -38,8 +38,7 @@ String GrowattReadHoldingTask::subtopic() {
 
 bool GrowattReadHoldingTask::run() {
     
-    GLOG::print(F("GrowattReadHoldingTask::run "));
-    GLOG::println((subtopic() + " addr=" + this->addr + " len=" + this->length).c_str());
+    GLOG_INFO("GrowattReadHoldingTask::run %s addr=%u len=%u\n", subtopic().c_str(), this->addr, this->length);
     
     setSuccessful(false);
     
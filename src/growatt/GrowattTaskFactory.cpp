@@ -5,8 +5,6 @@
   Written by JF enide.electronics (at) enide.net
   Licensed under GNU GPLv3
 */
-#include<StringSplitter.h>
-
 #include "GrowattTaskFactory.h"
 #include "GrowattPriorityTask.h"
 #include "GrowattReadHoldingTask.h"
@@ -14,76 +12,112 @@
 #include "GrowattPriorityBatteryFirstACChargerConfigTask.h"
 #include "GrowattPriorityPowerRatingConfigTask.h"
 #include "GrowattPriorityStopStateOfChargeConfigTask.h"
+#include "GrowattPriorityTaskCommon.h"
+
+struct GrowattCommand {
+    const char *subtopic;
+    uint8_t command;
+    bool subscribe;
+};
+
+// t2 and t3 are accepted but not subscribed to
+static const GrowattCommand commands[] = {
+    { TOPIC_SETTINGS_PRIORITY,                              GROWATT_COMMAND_PRIORITY,       true },
+    { TOPIC_SETTINGS_READ_HOLDING_TASK,                     GROWATT_COMMAND_READ_HOLDING,   true },
+    { "settings/priority/bat/t1",                           GROWATT_COMMAND_BAT_T1,         true },
+    { "settings/priority/bat/t2",                           GROWATT_COMMAND_BAT_T2,         false },
+    { "settings/priority/bat/t3",                           GROWATT_COMMAND_BAT_T3,         false },
+    { TOPIC_SETTINGS_PRIORITY_BAT_FIRST_AC_CHARGER_TASK,    GROWATT_COMMAND_BAT_AC,         true },
+    { "settings/priority/bat/pr",                           GROWATT_COMMAND_BAT_PR,         true },
+    { "settings/priority/bat/ssoc",                         GROWATT_COMMAND_BAT_SSOC,       true },
+    { "settings/priority/grid/t1",                          GROWATT_COMMAND_GRID_T1,        true },
+    { "settings/priority/grid/t2",                          GROWATT_COMMAND_GRID_T2,        false },
+    { "settings/priority/grid/t3",                          GROWATT_COMMAND_GRID_T3,        false },
+    { "settings/priority/grid/pr",                          GROWATT_COMMAND_GRID_PR,        true },
+    { "settings/priority/grid/ssoc",                        GROWATT_COMMAND_GRID_SSOC,      true },
+};
+
+#define GROWATT_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+static const char *timeNames[] = { "t1", "t2", "t3" };
 
 Task* GrowattTaskFactory::create(ModbusMaster *node, const String &topic, const String &value) {
+    return create(node, commandFromTopic(topic.c_str()), value.c_str());
+}
+
+Task* GrowattTaskFactory::create(ModbusMaster *node, uint8_t command, const char *value) {
     Task *task = NULL;
     
-    // set priority: "/settings/priority"
-    if (topic == String(F(TOPIC_SETTINGS_PRIORITY))) {
-        task = new GrowattPriorityTask(node, value);
-    } else if (topic.startsWith(F(TOPIC_SETTINGS_PRIORITY))) {
-        // per priority configs like ac, pr, ssoc
-        auto ss = StringSplitter(topic, '/', 4); 
-        
-        if (ss.getItemCount() == 4) {
-            String whichPriority = ss.getItemAtIndex(2);
-            String whichConfig = ss.getItemAtIndex(3);
-            
-            if ((whichPriority == "bat" || whichPriority == "grid") && (whichConfig == "t1" || whichConfig == "t2" || whichConfig == "t3")) {
-                task = new GrowattPriorityTimeConfigTask(node, ss.getItemAtIndex(2), ss.getItemAtIndex(3), value);
-            } else if (whichPriority == "bat" && whichConfig == "ac") {
-                task = new GrowattPriorityBatteryFirstACChargerConfigTask(node, value);
-            } else if ((whichPriority == "bat" || whichPriority == "grid") && whichConfig == "pr") {
-                task = new GrowattPriorityPowerRatingConfigTask(node, whichPriority, value);
-            } else if ((whichPriority == "bat" || whichPriority == "grid") && whichConfig == "ssoc") {
-                task = new GrowattPriorityStopStateOfChargeConfigTask(node, whichPriority, value);
-            }
-        }
-    } else if (topic == String(F(TOPIC_SETTINGS_READ_HOLDING_TASK))) {
-        String payload = value;
-        String fields[2];
-        uint8_t fieldsIndex = 0;
-        
-        while (payload.length() > 0) {
-            int index = payload.indexOf(' ');
-            if (index == -1) {
-                // no space, keep whole/remaining string
-                fields[fieldsIndex++] = payload;
-                break;
-            } else {
-                fields[fieldsIndex++] = payload.substring(0, index);
-                payload = payload.substring(index + 1);
+    switch (command) {
+        case GROWATT_COMMAND_PRIORITY:
+            task = new GrowattPriorityTask(node, value);
+            break;
+        case GROWATT_COMMAND_BAT_T1:
+        case GROWATT_COMMAND_BAT_T2:
+        case GROWATT_COMMAND_BAT_T3:
+            task = new GrowattPriorityTimeConfigTask(node, TOPIC_VALUE_PRIORITY_BAT, timeNames[command - GROWATT_COMMAND_BAT_T1], value);
+            break;
+        case GROWATT_COMMAND_GRID_T1:
+        case GROWATT_COMMAND_GRID_T2:
+        case GROWATT_COMMAND_GRID_T3:
+            task = new GrowattPriorityTimeConfigTask(node, TOPIC_VALUE_PRIORITY_GRID, timeNames[command - GROWATT_COMMAND_GRID_T1], value);
+            break;
+        case GROWATT_COMMAND_BAT_AC:
+            task = new GrowattPriorityBatteryFirstACChargerConfigTask(node, value);
+            break;
+        case GROWATT_COMMAND_BAT_PR:
+            task = new GrowattPriorityPowerRatingConfigTask(node, TOPIC_VALUE_PRIORITY_BAT, value);
+            break;
+        case GROWATT_COMMAND_GRID_PR:
+            task = new GrowattPriorityPowerRatingConfigTask(node, TOPIC_VALUE_PRIORITY_GRID, value);
+            break;
+        case GROWATT_COMMAND_BAT_SSOC:
+            task = new GrowattPriorityStopStateOfChargeConfigTask(node, TOPIC_VALUE_PRIORITY_BAT, value);
+            break;
+        case GROWATT_COMMAND_GRID_SSOC:
+            task = new GrowattPriorityStopStateOfChargeConfigTask(node, TOPIC_VALUE_PRIORITY_GRID, value);
+            break;
+        case GROWATT_COMMAND_READ_HOLDING: {
+            // "<addr> <length>", nothing else
+            const char *space = strchr(value, ' ');
+            if (space != NULL && space != value && space[1] != '\0' && strchr(space + 1, ' ') == NULL) {
+                uint16_t addr = atoi(value);
+                uint8_t length = atoi(space + 1);
+                task = new GrowattReadHoldingTask(node, addr, length);
             }
-        }
-        
-        if (fieldsIndex == 2) {
-            uint16_t addr = fields[0].toInt();
-            uint8_t length = fields[1].toInt();
-            task = new GrowattReadHoldingTask(node, addr, length);
+            break;
         }
     }
     
     return task;
 }
 
+uint8_t GrowattTaskFactory::commandFromTopic(const char *topic) {
+    for (size_t i = 0; i < GROWATT_COMMANDS; i++) {
+        if (strcmp(topic, commands[i].subtopic) == 0) {
+            return commands[i].command;
+        }
+    }
+    
+    return GROWATT_COMMAND_UNKNOWN;
+}
+
 std::list<String> GrowattTaskFactory::registeredSubtopics() {
     std::list<String> topics;
     
-    topics.push_back(F(TOPIC_SETTINGS_PRIORITY));
-    topics.push_back(F(TOPIC_SETTINGS_READ_HOLDING_TASK));
-    
-    topics.push_back(F("settings/priority/bat/t1"));
-    //topics.push_back(F("settings/priority/bat/t2"));
-    //topics.push_back(F("settings/priority/bat/t3"));
-    topics.push_back(F("settings/priority/bat/ac"));
-    topics.push_back(F("settings/priority/bat/pr"));
-    topics.push_back(F("settings/priority/bat/ssoc"));
-    
-    topics.push_back(F("settings/priority/grid/t1"));
-    //topics.push_back(F("settings/priority/grid/t2"));
-    //topics.push_back(F("settings/priority/grid/t3"));
-    topics.push_back(F("settings/priority/grid/pr"));
-    topics.push_back(F("settings/priority/grid/ssoc"));
+    for (size_t i = 0; i < GROWATT_COMMANDS; i++) {
+        if (commands[i].subscribe) {
+            topics.push_back(commands[i].subtopic);
+        }
+    }
     
     return topics;
 }
+
+void GrowattTaskFactory::registerCommands(TopicDispatcher &dispatcher, const char *prefix, Inverter *handler) {
+    for (size_t i = 0; i < GROWATT_COMMANDS; i++) {
+        if (commands[i].subscribe) {
+            dispatcher.add(prefix, commands[i].subtopic, handler, commands[i].command);
+        }
+    }
+}
@@ -11,10 +11,32 @@
 #include "Task.h"
 #include <list>
 #include <ModbusMaster.h>
+#include "../TopicDispatcher.h"
+
+// command ids, one per subtopic
+#define GROWATT_COMMAND_PRIORITY        0
+#define GROWATT_COMMAND_READ_HOLDING    1
+#define GROWATT_COMMAND_BAT_T1          2
+#define GROWATT_COMMAND_BAT_T2          3
+#define GROWATT_COMMAND_BAT_T3          4
+#define GROWATT_COMMAND_GRID_T1         5
+#define GROWATT_COMMAND_GRID_T2         6
+#define GROWATT_COMMAND_GRID_T3         7
+#define GROWATT_COMMAND_BAT_AC          8
+#define GROWATT_COMMAND_BAT_PR          9
+#define GROWATT_COMMAND_GRID_PR         10
+#define GROWATT_COMMAND_BAT_SSOC        11
+#define GROWATT_COMMAND_GRID_SSOC       12
+#define GROWATT_COMMAND_UNKNOWN         0xff
+
+class Inverter;
 
 class GrowattTaskFactory {
     public:
         static Task* create(ModbusMaster *node, const String &topic, const String &value);
+        static Task* create(ModbusMaster *node, uint8_t command, const char *value);
+        static uint8_t commandFromTopic(const char *topic);
         static std::list<String> registeredSubtopics();
+        static void registerCommands(TopicDispatcher &dispatcher, const char *prefix, Inverter *handler);
 };
-#endif
\ No newline at end of file
+#endif
@@ -116,50 +116,52 @@ bool MicInverter::isDataValid() {
 }
 
 
-InverterData MicInverter::getData(bool ignored) {
+InverterData MicInverter::getData(bool fullSet) {
     InverterData data;
-    
-    data.set("status", this->status);
+    emitData(data, fullSet);
+    return data;
+}
 
-    data.set("Ppv", this->Ppv);    
+void MicInverter::emitData(InverterSink &sink, bool) {
+    sink.emit("status", this->status);
 
-    data.set("Ppv1", this->Ppv1);    
-    data.set("Vpv1", this->Vpv1);
-    data.set("Ipv1", this->Ipv1);
+    sink.emit("Ppv", this->Ppv);    
+
+    sink.emit("Ppv1", this->Ppv1);    
+    sink.emit("Vpv1", this->Vpv1);
+    sink.emit("Ipv1", this->Ipv1);
     
-    data.set("Ppv2", this->Ppv2);   
-    data.set("Vpv2", this->Vpv2);
-    data.set("Ipv2", this->Ipv2);
+    sink.emit("Ppv2", this->Ppv2);   
+    sink.emit("Vpv2", this->Vpv2);
+    sink.emit("Ipv2", this->Ipv2);
     
-    data.set("Pac", this->Pac);
-    data.set("Fac", this->Fac);
+    sink.emit("Pac", this->Pac);
+    sink.emit("Fac", this->Fac);
     
-    data.set("Vac1", this->Vac1);
-    data.set("Iac1", this->Iac1);
-    data.set("Pac1", this->Pac1);
+    sink.emit("Vac1", this->Vac1);
+    sink.emit("Iac1", this->Iac1);
+    sink.emit("Pac1", this->Pac1);
     
     if (this->enableTL) {
-        data.set("Vac2", this->Vac2);
-        data.set("Iac2", this->Iac2);
-        data.set("Pac2", this->Pac2);
+        sink.emit("Vac2", this->Vac2);
+        sink.emit("Iac2", this->Iac2);
+        sink.emit("Pac2", this->Pac2);
         
-        data.set("Vac3", this->Vac3);
-        data.set("Iac3", this->Iac3);
-        data.set("Pac3", this->Pac3);
+        sink.emit("Vac3", this->Vac3);
+        sink.emit("Iac3", this->Iac3);
+        sink.emit("Pac3", this->Pac3);
     }
 
-    data.set("Etoday", this->Etoday);
-    data.set("Etotal", this->Etotal);
-    data.set("Ttotal", this->Ttotal);
+    sink.emit("Etoday", this->Etoday);
+    sink.emit("Etotal", this->Etotal);
+    sink.emit("Ttotal", this->Ttotal);
 
-    data.set("Temp1", this->tempInverter);
-    data.set("Temp2", this->tempIPM);
-    
-    return data;
+    sink.emit("Temp1", this->tempInverter);
+    sink.emit("Temp2", this->tempIPM);
 }
 
 void MicInverter::setIncomingTopicData(const String &topic, const String &value) {
-    GLOG::println(F("INVERTER: no remote control: task rejected"));
+    GLOG_WARN("INVERTER: no remote control: task rejected\n");
 }
 
 std::list<String> MicInverter::getTopicsToSubscribe() {
@@ -29,6 +29,8 @@ class MicInverter : public Inverter
         virtual bool isDataValid();
     
         virtual InverterData getData(bool fullSet = false);
+    
+        virtual void emitData(InverterSink &sink, bool fullSet = false);
         virtual void setIncomingTopicData(const String &topic, const String &value);
         virtual std::list<String> getTopicsToSubscribe();
 
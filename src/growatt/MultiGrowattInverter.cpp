@@ -15,6 +15,9 @@ MultiGrowattInverter::MultiGrowattInverter(Stream *serial, bool shouldDeleteSeri
     this->serial = serial;
     this->shouldDeleteSerial = shouldDeleteSerial;
     this->modbusAddrs.insert(this->modbusAddrs.end(), slaveAddresses.begin(), slaveAddresses.end());
+    this->currentModbusIdx = 0;
+    this->currentSampleIdx = 0;
+    this->lastModbusIdx = 0;
 
     for (int modbusAddr : slaveAddresses) {
         Inverter *inverter = factory->createInverter(serial, modbusAddr, enableRemoteCommands, enableThreePhases);
@@ -33,6 +36,10 @@ MultiGrowattInverter::~MultiGrowattInverter() {
     inverters.clear();
     modbusAddrs.clear();
 
+    for (InverterSink *sink : liveSinks) {
+        delete sink;
+    }
+
     if (this->shouldDeleteSerial) {
         delete this->serial;
     }
@@ -42,7 +49,7 @@ MultiGrowattInverter::~MultiGrowattInverter() {
 void MultiGrowattInverter::read() {
     int modbusAddr = this->modbusAddrs[this->currentModbusIdx];
 
-    GLOG::printf(" @ %d", modbusAddr);
+    GLOG_DEBUG(" @ %d", modbusAddr);
     Inverter *inverter = this->inverters[modbusAddr];
     inverter->read();
 
@@ -56,18 +63,85 @@ bool MultiGrowattInverter::isDataValid() {
     return inverter->isDataValid();
 }
 
+// hands the values on with the inverter address in front: 22/Ppv1
+class AddrPrefixSink : public InverterSink {
+    private:
+        InverterSink &target;
+        char name[INVERTER_SINK_NAME_SIZE];
+        size_t prefixLen;
+
+    protected:
+        virtual void emitValue(const char *subName, const char *value) {
+            strncpy(name + prefixLen, subName, sizeof(name) - prefixLen);
+            name[sizeof(name) - 1] = '\0';
+            target.emit(name, value);
+        }
+
+    public:
+        AddrPrefixSink(InverterSink &target, int modbusAddr) : target(target) {
+            prefixLen = snprintf(name, sizeof(name), "%d/", modbusAddr);
+        }
+};
+
 InverterData MultiGrowattInverter::getData(bool fullSet) {
+    InverterData data;
+    emitData(data, fullSet);
+    return data;
+}
+
+void MultiGrowattInverter::emitData(InverterSink &sink, bool fullSet) {
     int modbusAddr = this->modbusAddrs[this->lastModbusIdx];
     Inverter *inverter = this->inverters[modbusAddr];
     
-    InverterData data = inverter->getData(fullSet);
+    AddrPrefixSink dataWithAddrPrefix(sink, modbusAddr);
+    inverter->emitData(dataWithAddrPrefix, fullSet);
+}
+
+bool MultiGrowattInverter::hasPowerSampling() {
+    // MIC inverters are wrapped too, and they have no power sampling
+    for (const auto & inverterEntry : inverters) {
+        if (!inverterEntry.second->hasPowerSampling()) {
+            return false;
+        }
+    }
+    return !inverters.empty();
+}
 
-    InverterData dataWithAddrPrefix;
-    for (const auto & entry : data) {
-        dataWithAddrPrefix[String(modbusAddr) + "/" + entry.first] = entry.second;
+bool MultiGrowattInverter::samplePower(InverterSink &sink) {
+    // one inverter per call, a silent one holds up the loop for a single timeout
+    if (this->modbusAddrs.empty()) {
+        return false;
     }
+    int modbusAddr = this->modbusAddrs[this->currentSampleIdx];
+    this->currentSampleIdx = (this->currentSampleIdx + 1) % this->modbusAddrs.size();
 
-    return dataWithAddrPrefix;
+    AddrPrefixSink dataWithAddrPrefix(sink, modbusAddr);
+    return this->inverters[modbusAddr]->samplePower(dataWithAddrPrefix);
+}
+
+bool MultiGrowattInverter::setLiveSink(InverterSink *sink) {
+    for (InverterSink *liveSink : liveSinks) {
+        delete liveSink;
+    }
+    liveSinks.clear();
+
+    bool live = true;
+    for (int modbusAddr : this->modbusAddrs) {
+        InverterSink *liveSink = NULL;
+        if (sink != NULL) {
+            liveSink = new AddrPrefixSink(*sink, modbusAddr);
+            liveSinks.push_back(liveSink);
+        }
+        live &= this->inverters[modbusAddr]->setLiveSink(liveSink);
+    }
+    return live;
+}
+
+void MultiGrowattInverter::emitStats(InverterSink &sink) {
+    for (int modbusAddr : this->modbusAddrs) {
+        AddrPrefixSink dataWithAddrPrefix(sink, modbusAddr);
+        this->inverters[modbusAddr]->emitStats(dataWithAddrPrefix);
+    }
 }
 
 void MultiGrowattInverter::setIncomingTopicData(const String &topic, const String &value) {
@@ -111,6 +185,18 @@ std::list<String> MultiGrowattInverter::getTopicsToSubscribe() {
     return allTopics;
 }
 
+void MultiGrowattInverter::registerCommands(TopicDispatcher &dispatcher, const char *prefix) {
+    // straight to the inverter at addr: growatt/22/settings/priority/bat/ac
+    for (auto inverterEntry : this->inverters) {
+        char addrPrefix[TOPIC_ROUTE_PREFIX_SIZE];
+        if (snprintf(addrPrefix, sizeof(addrPrefix), "%s%d/", prefix, inverterEntry.first) >= (int) sizeof(addrPrefix)) {
+            GLOG_WARN("INVERTER: prefix %s%d/ too long, no commands\n", prefix, inverterEntry.first);
+            continue;
+        }
+        inverterEntry.second->registerCommands(dispatcher, addrPrefix);
+    }
+}
+
 void MultiGrowattInverter::incrementModbusAddress() {
     currentModbusIdx += 1;
     if (currentModbusIdx >= this->modbusAddrs.size()) {
@@ -34,8 +34,15 @@ class MultiGrowattInverter : public Inverter
         virtual bool isDataValid();
     
         virtual InverterData getData(bool fullSet = false);
+    
+        virtual void emitData(InverterSink &sink, bool fullSet = false);
+        virtual bool hasPowerSampling();
+        virtual bool samplePower(InverterSink &sink);
+        virtual void emitStats(InverterSink &sink);
+        virtual bool setLiveSink(InverterSink *sink);
         virtual void setIncomingTopicData(const String &topic, const String &value);
         virtual std::list<String> getTopicsToSubscribe();
+        virtual void registerCommands(TopicDispatcher &dispatcher, const char *prefix);
 
     private:
         void incrementModbusAddress();
@@ -46,9 +53,13 @@ class MultiGrowattInverter : public Inverter
         bool shouldDeleteSerial;
         std::vector<int> modbusAddrs;
         std::map<int,Inverter*> inverters;
+        // "<addr>/" in front of the live values of each inverter
+        std::vector<InverterSink*> liveSinks;
 
         int currentModbusIdx;
         int lastModbusIdx;
+        // the next inverter of samplePower()
+        int currentSampleIdx;
 
 };
 
@@ -49,6 +49,8 @@ SoyosourceGTNInverter::SoyosourceGTNInverter(Stream *serial, bool shouldDeleteSe
     this->shouldDeleteSerial = shouldDeleteSerial;
     this->lastReadMillis = millis();
     this->unknownFrameCounter = 0;
+    this->isValid = false;
+    this->liveSink = NULL;
 }
 
 SoyosourceGTNInverter::~SoyosourceGTNInverter() {
@@ -109,7 +111,7 @@ bool SoyosourceGTNInverter::parseSoyosourceDisplayByte(uint8_t byte) {
     
     if (at == 0) {
         if (raw[0] != SOF_SOYO_RESPONSE && raw[0] != SOF_MS51_RESPONSE) {
-            GLOG::printf("INVERTER: Invalid header: 0x%02X\n", raw[0]);
+            GLOG_DEBUG("INVERTER: Invalid header: 0x%02X\n", raw[0]);
 
             // return false to reset buffer
             return false;
@@ -142,12 +144,15 @@ bool SoyosourceGTNInverter::parseSoyosourceDisplayByte(uint8_t byte) {
     uint8_t remote_crc = raw[frame_len - 1];
     
     if (computed_crc != remote_crc) {
-        GLOG::printf("INVERTER: CRC error: 0x%02X != 0x%02X\n", computed_crc, remote_crc);
+        GLOG_WARN("INVERTER: CRC error: 0x%02X != 0x%02X\n", computed_crc, remote_crc);
         return false;
     }
 
     std::vector<uint8_t> data(this->rxBuffer.begin(), this->rxBuffer.begin() + frame_len);
     this->decodeFrameData(function, data);
+    if (this->isValid && this->liveSink != NULL) {
+        this->inverterData.emitTo(*this->liveSink);
+    }
 
     // return false to reset buffer
     return false;
@@ -155,7 +160,7 @@ bool SoyosourceGTNInverter::parseSoyosourceDisplayByte(uint8_t byte) {
 
 void SoyosourceGTNInverter::decodeFrameData(const uint8_t &function, const std::vector<uint8_t> &data) {
     if (data.size() != SOF_SOYO_RESPONSE_LEN && data.size() != SOF_MS51_RESPONSE_LEN) {
-        GLOG::println("INVERTER: Invalid frame size");
+        GLOG_WARN("INVERTER: Invalid frame size\n");
         isValid = buildErrorData(data);
         return;
     }
@@ -169,10 +174,10 @@ void SoyosourceGTNInverter::decodeFrameData(const uint8_t &function, const std::
                 isValid = this->extractMS51StatusData(data);
                 break;
             case SETTINGS_COMMAND:
-                GLOG::println("INVERTER: Ignoring settings frame");
+                GLOG_DEBUG("INVERTER: Ignoring settings frame\n");
                 break;
             default:
-                GLOG::printf("INVERTER: Ignoring MS51 frame, src=0x%02x, func=0x%02x\n", response_source, function);
+                GLOG_DEBUG("INVERTER: Ignoring MS51 frame, src=0x%02x, func=0x%02x\n", response_source, function);
         }
     } else if (response_source == SOF_SOYO_RESPONSE) {
         switch (function) {
@@ -180,13 +185,13 @@ void SoyosourceGTNInverter::decodeFrameData(const uint8_t &function, const std::
                 isValid = this->extractDisplayStatusData(data);
                 break;
             case SETTINGS_COMMAND:
-                GLOG::println("INVERTER: Ignoring settings frame");
+                GLOG_DEBUG("INVERTER: Ignoring settings frame\n");
                 break;
             default:
-                GLOG::printf("INVERTER: Ignoring frame, src=0x%02x, func=0x%02x\n", response_source, function);
+                GLOG_DEBUG("INVERTER: Ignoring frame, src=0x%02x, func=0x%02x\n", response_source, function);
         }
     } else {
-        GLOG::printf("INVERTER: Ignoring unknwon frame, src=0x%02x, func=0x%02x\n", response_source, function);
+        GLOG_DEBUG("INVERTER: Ignoring unknwon frame, src=0x%02x, func=0x%02x\n", response_source, function);
         isValid = buildErrorData(data, response_source, function);
     }
 }
@@ -208,25 +213,49 @@ InverterData SoyosourceGTNInverter::getData(bool fullSet) {
     return InverterData();
 }
 
+void SoyosourceGTNInverter::emitData(InverterSink &sink, bool) {
+    if (isValid) {
+        isValid = false;
+        inverterData.emitTo(sink);
+    }
+}
+
+bool SoyosourceGTNInverter::setLiveSink(InverterSink *sink) {
+    this->liveSink = sink;
+    return true;
+}
+
 void SoyosourceGTNInverter::setIncomingTopicData(const String &topic, const String &value) {
+    if (topic == SOYOSOURCE_POWER_SUBTOPIC) {
+        handleCommand(SOYOSOURCE_COMMAND_POWER, value.c_str());
+    }
+}
+
+void SoyosourceGTNInverter::handleCommand(uint8_t command, const char *value) {
 #ifdef LARGE_ESP_BOARD
-    if (topic == "settings/power") {
-        int power = value.toInt();
+    if (command == SOYOSOURCE_COMMAND_POWER) {
+        int power = atoi(value);
         
         if (power < 0) power = 0;
         if (power > 1200) power = 1200;
         
         meter.updateDemand(power);
 
-        GLOG::printf("INVERTER: output power = %dW\n", power);
+        GLOG_INFO("INVERTER: output power = %dW\n", power);
     }
 #endif
 }
 
+void SoyosourceGTNInverter::registerCommands(TopicDispatcher &dispatcher, const char *prefix) {
+#ifdef LARGE_ESP_BOARD
+    dispatcher.add(prefix, SOYOSOURCE_POWER_SUBTOPIC, this, SOYOSOURCE_COMMAND_POWER);
+#endif
+}
+
 std::list<String> SoyosourceGTNInverter::getTopicsToSubscribe() {
     std::list<String> topics;
 #ifdef LARGE_ESP_BOARD
-    topics.push_back("settings/power");
+    topics.push_back(SOYOSOURCE_POWER_SUBTOPIC);
 #endif
     return topics;
 }
@@ -288,10 +317,10 @@ bool SoyosourceGTNInverter::extractMS51StatusData(const std::vector<uint8_t> &da
         return (uint16_t(data[i + 0]) << 8) | (uint16_t(data[i + 1]) << 0);
     };
 
-    GLOG::printf("INVERTER: Status frame (MS51, %d bytes) received\n", data.size());
+    GLOG_DEBUG("INVERTER: Status frame (MS51, %u bytes) received\n", (unsigned) data.size());
 
     if (soyosource_get_16bit(8) == 0x0000 && data[15] == 0x00) {
-        GLOG::println("INVERTER: Ignoring empty MS51 status");
+        GLOG_DEBUG("INVERTER: Ignoring empty MS51 status\n");
         return false;
     }
 
@@ -19,6 +19,10 @@
 #include "../Inverter.h"
 #include "VirtualLimiter.h"
 
+// output power demand in W for the virtual limiter (D1 mini only)
+#define SOYOSOURCE_POWER_SUBTOPIC "settings/power"
+#define SOYOSOURCE_COMMAND_POWER 0
+
 class SoyosourceGTNInverter : public Inverter {
     public:
         SoyosourceGTNInverter(Stream *serial, bool shouldDeleteSerial);
@@ -28,8 +32,13 @@ class SoyosourceGTNInverter : public Inverter {
         virtual bool isDataValid();
     
         virtual InverterData getData(bool fullSet = false);
+    
+        virtual void emitData(InverterSink &sink, bool fullSet = false);
+        virtual bool setLiveSink(InverterSink *sink);
         virtual void setIncomingTopicData(const String &topic, const String &value);
         virtual std::list<String> getTopicsToSubscribe();
+        virtual void registerCommands(TopicDispatcher &dispatcher, const char *prefix);
+        virtual void handleCommand(uint8_t command, const char *value);
     private:
         Stream *serial;
         bool shouldDeleteSerial;
@@ -42,6 +51,7 @@ class SoyosourceGTNInverter : public Inverter {
         
         bool isValid;
         InverterData inverterData;
+        InverterSink *liveSink;
 
         bool parseSoyosourceDisplayByte(uint8_t byte);
         void decodeFrameData(const uint8_t &function, const std::vector<uint8_t> &data);
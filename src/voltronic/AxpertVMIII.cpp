@@ -59,6 +59,10 @@ InverterData VoltronicAxpertVMIIIInverter::getData(bool fullSet) {
     return inverterData;
 }
 
+void VoltronicAxpertVMIIIInverter::emitData(InverterSink &sink, bool) {
+    inverterData.emitTo(sink);
+}
+
 
 void VoltronicAxpertVMIIIInverter::setIncomingTopicData(const String &topic, const String &value) {
     // nothing for now
@@ -150,7 +154,7 @@ void VoltronicAxpertVMIIIInverter::readGeneralStatus() {
             char device_status[9];
             memset(device_status, '\0', 9);
 
-            sscanf(response.c_str(), "%f %f %f %f %d %d %d %d %f %d %d %d %f %f %f %d %s", 
+            sscanf(response.c_str(), "%f %f %f %f %d %d %d %d %f %d %d %d %f %f %f %d %8s", 
             &voltage_grid, &freq_grid, &voltage_out, &freq_out, &load_va, &load_watt, &load_percent, 
             &voltage_bus, &voltage_batt, &batt_charge_current, &batt_capacity, &temp_heatsink, 
             &pv_input_current, &pv_input_voltage, &scc_voltage, &batt_discharge_current, device_status);
@@ -174,9 +178,9 @@ void VoltronicAxpertVMIIIInverter::readGeneralStatus() {
             inverterData.set("Vbat", voltage_batt);
             inverterData.set("IbatCharge", batt_charge_current);
             inverterData.set("IbatDischarge", batt_discharge_current);
-            inverterData.set("LoadStatusON", device_status[3]);
-            inverterData.set("SCCchargeON", device_status[6]);
-            inverterData.set("ACchargeON", device_status[7]);
+            inverterData.set("LoadStatusON", (uint8_t) (device_status[3] == '1'));
+            inverterData.set("SCCchargeON", (uint8_t) (device_status[6] == '1'));
+            inverterData.set("ACchargeON", (uint8_t) (device_status[7] == '1'));
 
             isValid = true;
         }
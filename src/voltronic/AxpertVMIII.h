@@ -21,6 +21,8 @@ class VoltronicAxpertVMIIIInverter : public VoltronicInverter {
 
         virtual InverterData getData(bool fullSet = false);
 
+        virtual void emitData(InverterSink &sink, bool fullSet = false);
+
         virtual void setIncomingTopicData(const String &topic, const String &value);
         virtual std::list<String> getTopicsToSubscribe();
 
@@ -15,6 +15,7 @@
 VoltronicInverter::VoltronicInverter(Stream *serial, bool shouldDeleteSerial) {
     this->serial = serial;
     this->shouldDeleteSerial = shouldDeleteSerial;
+    this->isValid = false;
 }
 
 VoltronicInverter::~VoltronicInverter() {
@@ -42,9 +43,10 @@ bool VoltronicInverter::sendCommand(String cmd) {
     memset(sendStr, 0, 30);
     sprintf((char *)sendStr, "%s%c%c\r", cmd.c_str(), (uint8_t)(cmdCrc >> 8), (uint8_t)(cmdCrc & 0xFF));
 
-    GLOG::printf("\nINVERTER: sendCommand %2u bytes, cmd=\"%s\", CRC=0x%04x\n", strlen((char *)sendStr), cmd.c_str(), cmdCrc);
+    GLOG_DEBUG("\nINVERTER: sendCommand %2u bytes, cmd=\"%s\", CRC=0x%04x\n", (unsigned) strlen((char *)sendStr), cmd.c_str(), cmdCrc);
     
-    return this->serial->write(sendStr, cmdLen + 2) > 0;
+    // command, CRC and CR
+    return this->serial->write(sendStr, cmdLen + 3) > 0;
 }
 
 uint16_t VoltronicInverter::calcCRC(uint8_t *pin, uint8_t len) {
@@ -92,7 +94,7 @@ uint16_t VoltronicInverter::calcCRC(uint8_t *pin, uint8_t len) {
 
 String VoltronicInverter::recvResponse(uint16_t replysize) {
     uint16_t n = 0; // number of bytes received
-    int b; // byte received
+    int b = 0; // byte received
     char recvBuffer[RECV_BUF_SIZE];
 
     uint32_t startTimeMillis = millis();
@@ -108,22 +110,31 @@ String VoltronicInverter::recvResponse(uint16_t replysize) {
         }
     } while (n < replysize && n < RECV_BUF_SIZE && ((char) b) != '\r' && ((char) b) != '\n' && millis() - startTimeMillis < 5000);
 
-    if (millis() - startTimeMillis >= 5000 || n != replysize) {
+    // replysize is the longest reply expected, some models send shorter ones (e.g. 36 warning bits in QPIWS)
+    if (millis() - startTimeMillis >= 5000 || n < 4) {
         return "";
     }
 
     recvBuffer[n] = '\0';
 
     // check first byte == (
-    if (recvBuffer[0] != '(' || recvBuffer[replysize-1] != 0x0d) {
-        GLOG::println("\nINVERTER: incorrect start/stop bytes.");
-        GLOG::printf("INVERTER: Buffer: %s\n", recvBuffer);
+    if (recvBuffer[0] != '(' || recvBuffer[n-1] != 0x0d) {
+        GLOG_WARN("\nINVERTER: incorrect start/stop bytes.\n");
+        GLOG_WARN("INVERTER: Buffer: %s\n", recvBuffer);
         return "";
     }
 
     // check CRC
-    uint16_t crc = calcCRC((uint8_t*)recvBuffer, replysize-3);
-    if (recvBuffer[replysize-3]!=(crc>>8) || recvBuffer[replysize-2]!=(crc&0xff)) {
+    uint16_t crc = calcCRC((uint8_t*)recvBuffer, n-3);
+    if ((uint8_t) recvBuffer[n-3]!=(crc>>8) || (uint8_t) recvBuffer[n-2]!=(crc&0xff)) {
+        return "";
+    }
+
+    recvBuffer[n-3] = '\0';
+
+    // unknown command or wrong CRC in the command
+    if (strcmp(recvBuffer, "(NAK") == 0) {
+        GLOG_WARN("\nINVERTER: command not acknowledged.\n");
         return "";
     }
 
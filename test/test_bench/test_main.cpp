@@ -0,0 +1,217 @@
+/*
+  test_main.cpp - Host benchmarks of one poll per driver: CPU time and heap
+  allocations for read() + getData() + publishData() and for read() + emitData()
+  straight into the publisher, queue drain included, pio test -e native -f test_bench
+
+  The native env builds with GLOG_LEVEL_NONE, so these are the costs with logging off.
+  Numbers are host numbers: use them to compare changes, not as ESP8266 timings.
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <unity.h>
+#include <chrono>
+#include <AllocCounter.h>
+#include <MemoryStream.h>
+#include <VoltronicFrame.h>
+#include <MqttLoop.h>
+
+#include "growatt/GrowattInverter.h"
+#include "growatt/MicInverter.h"
+#include "growatt/MultiGrowattInverter.h"
+#include "soyosource/SoyosourceGTNInverter.h"
+#include "voltronic/AxpertVMIII.h"
+#include "MqttPublisher.h"
+
+#ifndef BENCH_POLLS
+#define BENCH_POLLS 20000
+#endif
+
+static MemoryStream serial;
+
+void setUp() {
+    ModbusBus.reset();
+    MqttBroker.reset();
+    serial.clear();
+    serial.onWrite = nullptr;
+}
+
+void tearDown() {
+}
+
+// runs poll() BENCH_POLLS times and prints the average cost of one poll
+static void bench(const char *name, std::function<void()> poll) {
+    poll(); // warm up, lazy allocations
+
+    AllocCounter allocs;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_POLLS; i++) {
+        poll();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    double nsPerPoll = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / (double) BENCH_POLLS;
+    char msg[160];
+    snprintf(msg, sizeof(msg), "%-28s %10.0f ns/poll %8.1f allocs/poll %10.1f bytes/poll",
+        name, nsPerPoll, allocs.allocationsSince() / (double) BENCH_POLLS, allocs.bytesSince() / (double) BENCH_POLLS);
+    TEST_MESSAGE(msg);
+}
+
+static MqttPublisher *connectedPublisher(WiFiClient &client) {
+    MqttPublisher *mqtt = new MqttPublisher(client, "", "", "energy/bench", "127.0.0.1");
+    mqttLoopUntilConnected(*mqtt);
+    return mqtt;
+}
+
+void test_bench_glog_disabled() {
+    AllocCounter allocs;
+    for (int i = 0; i < BENCH_POLLS; i++) {
+        GLOG_DEBUG("INVERTER: %s step=%d\n", String(i).c_str(), i);
+        GLOG_INFO("MQTT: %s\n", (String("energy/bench/") + i).c_str());
+    }
+
+    // disabled levels must not even evaluate their arguments
+    TEST_ASSERT_EQUAL(0, allocs.allocationsSince());
+    bench("GLOG disabled call", []() { GLOG_INFO("INVERTER: %s\n", String(42).c_str()); });
+}
+
+void test_bench_growatt_poll() {
+    NativeModbusSlave &inv = ModbusBus.slave(1);
+    for (uint16_t r = 0; r < 125; r++) inv.inputRegisters[r] = r * 10;
+    for (uint16_t r = 1000; r < 1125; r++) inv.inputRegisters[r] = r;
+
+    GrowattInverter inverter(&serial, false, 1, true, true);
+    WiFiClient client;
+    MqttPublisher *mqtt = connectedPublisher(client);
+
+    bench("GrowattInverter read+get", [&]() {
+        inverter.read();
+        InverterData data = inverter.getData();
+    });
+
+    bench("GrowattInverter +publish", [&]() {
+        inverter.read();
+        InverterData data = inverter.getData();
+        mqtt->publishData(data);
+        mqttLoopUntilSent(*mqtt);
+        MqttBroker.published.clear();
+    });
+
+    bench("GrowattInverter +emit", [&]() {
+        inverter.read();
+        inverter.emitData(*mqtt);
+        mqttLoopUntilSent(*mqtt);
+        MqttBroker.published.clear();
+    });
+
+    delete mqtt;
+}
+
+class BenchGrowattFactory : public MultiGrowattInverterInnerFactory {
+    public:
+        virtual Inverter *createInverter(Stream *serial, int modbusAddress, bool enableRemoteCommands, bool isTL) {
+            return new GrowattInverter(serial, false, modbusAddress, enableRemoteCommands, isTL);
+        }
+};
+
+void test_bench_multi_growatt_poll() {
+    for (uint8_t addr = 1; addr <= 2; addr++) {
+        NativeModbusSlave &inv = ModbusBus.slave(addr);
+        for (uint16_t r = 0; r < 125; r++) inv.inputRegisters[r] = r * 10;
+        for (uint16_t r = 1000; r < 1125; r++) inv.inputRegisters[r] = r;
+    }
+
+    MultiGrowattInverter inverter(&serial, false, { 1, 2 }, true, true, new BenchGrowattFactory());
+    WiFiClient client;
+    MqttPublisher *mqtt = connectedPublisher(client);
+
+    bench("MultiGrowatt +publish", [&]() {
+        inverter.read();
+        InverterData data = inverter.getData();
+        mqtt->publishData(data);
+        mqttLoopUntilSent(*mqtt);
+        MqttBroker.published.clear();
+    });
+
+    bench("MultiGrowatt +emit", [&]() {
+        inverter.read();
+        inverter.emitData(*mqtt);
+        mqttLoopUntilSent(*mqtt);
+        MqttBroker.published.clear();
+    });
+
+    delete mqtt;
+}
+
+void test_bench_mic_poll() {
+    NativeModbusSlave &inv = ModbusBus.slave(1);
+    for (uint16_t r = 0; r < 42; r++) inv.inputRegisters[r] = r * 10;
+
+    MicInverter inverter(&serial, false, 1, true);
+    WiFiClient client;
+    MqttPublisher *mqtt = connectedPublisher(client);
+
+    bench("MicInverter +publish", [&]() {
+        inverter.read();
+        InverterData data = inverter.getData();
+        mqtt->publishData(data);
+        mqttLoopUntilSent(*mqtt);
+        MqttBroker.published.clear();
+    });
+
+    delete mqtt;
+}
+
+void test_bench_soyosource_poll() {
+    static const uint8_t frame[] = { 0xA6, 0x00, 0x00, 0xD1, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFB, 0x64, 0x02, 0x0D, 0xBE };
+    SoyosourceGTNInverter inverter(&serial, false);
+    WiFiClient client;
+    MqttPublisher *mqtt = connectedPublisher(client);
+
+    bench("SoyosourceGTN +publish", [&]() {
+        inverter.read();
+        serial.tx.clear();
+        serial.feed(frame, sizeof(frame));
+        inverter.loop();
+        InverterData data = inverter.getData();
+        mqtt->publishData(data);
+        mqttLoopUntilSent(*mqtt);
+        MqttBroker.published.clear();
+    });
+
+    delete mqtt;
+}
+
+void test_bench_voltronic_poll() {
+    VoltronicAxpertVMIIIInverter inverter(&serial, false);
+    serial.onWrite = [](MemoryStream &stream) {
+        static const String mode = voltronicFrame("(B");
+        static const String nak = voltronicFrame("(NAK");
+        bool isMode = stream.tx.size() >= 4 && memcmp(stream.tx.data(), "QMOD", 4) == 0;
+        const String &reply = isMode ? mode : nak;
+        stream.tx.clear();
+        stream.feed((const uint8_t *) reply.c_str(), reply.length());
+    };
+
+    // QMOD is answered, the other three commands get a NAK
+    bench("VoltronicAxpertVMIII cycle", [&]() {
+        for (int i = 0; i < 4; i++) {
+            inverter.read();
+            InverterData data = inverter.getData();
+        }
+    });
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_bench_glog_disabled);
+    RUN_TEST(test_bench_growatt_poll);
+    RUN_TEST(test_bench_multi_growatt_poll);
+    RUN_TEST(test_bench_mic_poll);
+    RUN_TEST(test_bench_soyosource_poll);
+    RUN_TEST(test_bench_voltronic_poll);
+
+    return UNITY_END();
+}
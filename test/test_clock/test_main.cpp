@@ -0,0 +1,163 @@
+/*
+  test_main.cpp - Wall clock: time counted from the last sync, polls scheduled
+  on multiples of the period, a boundary skipped after the clock steps back,
+  the capture time of the Growatt blocks and the poll time on <topic>/Time
+  pio test -e native -f test_clock
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <unity.h>
+#include <MemoryStream.h>
+#include <MqttWireClient.h>
+#include <MqttLoop.h>
+
+#include "WallClock.h"
+#include "InverterData.h"
+#include "OutputPipeline.h"
+#include "MqttOutputs.h"
+#include "growatt/GrowattInverter.h"
+
+static MemoryStream serial;
+
+void setUp() {
+    WallClock::reset();
+    ModbusBus.reset();
+    MqttBroker.reset();
+    serial.clear();
+}
+
+void tearDown() {
+}
+
+void test_clock_not_set_counts_from_boot() {
+    TEST_ASSERT_FALSE(WallClock::isSet());
+    TEST_ASSERT_EQUAL(0, WallClock::now());
+    TEST_ASSERT_EQUAL(millis() / 1000, WallClock::time());
+
+    // no boundaries yet, one period from now
+    unsigned long now = millis();
+    TEST_ASSERT_EQUAL(now + 5000, WallClock::nextBoundary(5000, now));
+
+    InverterData stats;
+    WallClock::emitStats(stats);
+    TEST_ASSERT_EQUAL_STRING("false", stats["Clock/Set"].c_str());
+    TEST_ASSERT_EQUAL_STRING("0", stats["Clock/Syncs"].c_str());
+}
+
+void test_clock_runs_on_millis_between_syncs() {
+    WallClock::setTime(1700000002300ULL);
+    unsigned long synced = millis();
+    TEST_ASSERT_TRUE(WallClock::isSet());
+
+    delay(1500);
+    TEST_ASSERT_EQUAL(1700000002300ULL + (millis() - synced), WallClock::now());
+    TEST_ASSERT_EQUAL(1700000003, WallClock::time());
+    // a millis() from before the sync is earlier
+    TEST_ASSERT_EQUAL(1700000002300ULL - 1000, WallClock::at(synced - 1000));
+}
+
+void test_clock_polls_on_boundaries() {
+    unsigned long start = millis();
+    WallClock::setTime(1700000002300ULL);
+
+    // :02.3, the next one is :05
+    unsigned long next = WallClock::nextBoundary(5000, start);
+    TEST_ASSERT_EQUAL(start + 2700, next);
+    TEST_ASSERT_EQUAL(1700000005000ULL, WallClock::at(next));
+
+    // a poll that started 40ms late keeps the schedule
+    next = WallClock::nextBoundary(5000, next + 40);
+    TEST_ASSERT_EQUAL(1700000010000ULL, WallClock::at(next));
+
+    // whole minutes
+    next = WallClock::nextBoundary(60000, start);
+    TEST_ASSERT_EQUAL(1700000040000ULL, WallClock::at(next));
+}
+
+void test_clock_step_back_skips_the_boundary() {
+    WallClock::setTime(1700000005000ULL);
+    unsigned long boundary = millis();
+
+    // the poll of :05 runs, then a sync sets the clock 30ms back
+    WallClock::setTime(WallClock::now() - 30);
+    unsigned long next = WallClock::nextBoundary(5000, boundary);
+    // not :05 again 30ms later, :10
+    TEST_ASSERT_EQUAL(1700000010000ULL, WallClock::at(next));
+    TEST_ASSERT_UINT32_WITHIN(2, boundary + 5030, next);
+
+    InverterData stats;
+    WallClock::emitStats(stats);
+    TEST_ASSERT_EQUAL_STRING("true", stats["Clock/Set"].c_str());
+    TEST_ASSERT_EQUAL_STRING("2", stats["Clock/Syncs"].c_str());
+    TEST_ASSERT_INT_WITHIN(1, -30, stats["Clock/StepMillis"].toInt());
+}
+
+void test_clock_growatt_blocks_keep_the_capture_time() {
+    NativeModbusSlave &inv = ModbusBus.slave(1);
+    for (uint16_t r = 0; r < 125; r++) inv.inputRegisters[r] = r;
+    for (uint16_t r = 1000; r < 1125; r++) inv.inputRegisters[r] = r - 1000;
+    GrowattInverter inverter(&serial, false, 1, false, false);
+
+    // before the clock is set
+    inverter.read();
+    TEST_ASSERT_EQUAL(1, inverter.getPvBlock().getGeneration());
+    TEST_ASSERT_EQUAL(0, inverter.getPvBlock().getEpochMillis());
+
+    WallClock::setTime(1700000000000ULL);
+    delay(100);
+    inverter.read();
+    BlockView<GrowattAcBlock> ac = inverter.getAcBlock().view();
+    TEST_ASSERT_EQUAL(1, ac.generation);
+    TEST_ASSERT_EQUAL(WallClock::at(ac.millis), ac.epochMillis);
+    TEST_ASSERT_TRUE(ac.epochMillis >= 1700000000100ULL);
+    // the PV block still has the time of its own read
+    TEST_ASSERT_EQUAL(0, inverter.getPvBlock().getEpochMillis());
+}
+
+void test_clock_poll_time_on_mqtt() {
+    WiFiClient client;
+    MqttPublisher mqtt(client, "", "", "inverter", "127.0.0.1");
+    TEST_ASSERT_TRUE(mqttLoopUntilConnected(mqtt) > 0);
+
+    OutputPipeline outputs;
+    MqttTopicOutput *topics = new MqttTopicOutput(NULL);
+    topics->setPublisher(&mqtt);
+    outputs.add(topics);
+
+    // from boot, no time
+    outputs.beginPoll(millis(), 100);
+    outputs.emit("Pac", 1234.5f);
+    outputs.endPoll();
+    for (int i = 0; i < 10; i++) {
+        mqtt.loop();
+        delay(MQTT_LOOP_STEP_MILLIS);
+    }
+    TEST_ASSERT_NOT_NULL(MqttBroker.lastPayload("inverter/Pac"));
+    TEST_ASSERT_NULL(MqttBroker.lastPayload("inverter/" MQTT_TIME_FIELD));
+
+    outputs.beginPoll(millis(), 1700000005);
+    outputs.emit("Pac", 1000.5f);
+    outputs.endPoll();
+    for (int i = 0; i < 10; i++) {
+        mqtt.loop();
+        delay(MQTT_LOOP_STEP_MILLIS);
+    }
+    TEST_ASSERT_NOT_NULL(MqttBroker.lastPayload("inverter/" MQTT_TIME_FIELD));
+    TEST_ASSERT_EQUAL_STRING("1700000005", MqttBroker.lastPayload("inverter/" MQTT_TIME_FIELD)->c_str());
+    TEST_ASSERT_EQUAL_STRING("1000.5", MqttBroker.lastPayload("inverter/Pac")->c_str());
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_clock_not_set_counts_from_boot);
+    RUN_TEST(test_clock_runs_on_millis_between_syncs);
+    RUN_TEST(test_clock_polls_on_boundaries);
+    RUN_TEST(test_clock_step_back_skips_the_boundary);
+    RUN_TEST(test_clock_growatt_blocks_keep_the_capture_time);
+    RUN_TEST(test_clock_poll_time_on_mqtt);
+
+    return UNITY_END();
+}
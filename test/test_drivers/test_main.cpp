@@ -0,0 +1,699 @@
+/*
+  test_main.cpp - Unit tests for the inverter drivers and the MQTT publisher
+  Runs on the host with the native shims: pio test -e native -f test_drivers
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <unity.h>
+#include <MemoryStream.h>
+#include <VoltronicFrame.h>
+#include <MqttLoop.h>
+
+#include "growatt/GrowattInverter.h"
+#include "growatt/MicInverter.h"
+#include "growatt/MultiGrowattInverter.h"
+#include "soyosource/SoyosourceGTNInverter.h"
+#include "voltronic/AxpertVMIII.h"
+#include "MqttPublisher.h"
+#include "MqttTls.h"
+
+// TlsServer's certificate
+#define TLS_FINGERPRINT "a0:a1:a2:a3:a4:a5:a6:a7:a8:a9:aa:ab:ac:ad:ae:af:b0:b1:b2:b3"
+
+// steps in one full GrowattInverter state sequence
+#define GROWATT_SEQUENCE_LEN 13
+
+static MemoryStream serial;
+
+void setUp() {
+    ModbusBus.reset();
+    MqttBroker.reset();
+    serial.clear();
+    serial.onWrite = nullptr;
+    Network.tcpConnects = 0;
+    Network.sendBuffer = 2 * 1460;
+    TlsServer.reset();
+}
+
+void tearDown() {
+}
+
+static void assertValue(const char *expected, InverterData &data, const char *name) {
+    TEST_ASSERT_TRUE_MESSAGE(data.count(name) == 1, name);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(expected, data[name].c_str(), name);
+}
+
+static void seedGrowatt(uint8_t addr) {
+    NativeModbusSlave &inv = ModbusBus.slave(addr);
+    inv.inputRegisters[0] = 1;          // status
+    inv.inputRegisters[3] = 3512;       // Vpv1
+    inv.inputRegisters[4] = 42;         // Ipv1 (x100)
+    inv.setInput32(5, 14755);           // Ppv1
+    inv.setInput32(35, 123456);         // Pac
+    inv.inputRegisters[37] = 5001;      // Fac (x100)
+    inv.inputRegisters[38] = 2301;      // Vac1
+    inv.setInput32(53, 187);            // Etoday
+    inv.inputRegisters[93] = 412;       // Temp1
+    inv.inputRegisters[118] = 1;        // priority bat
+    inv.inputRegisters[119] = 1;        // lithium
+    inv.setInput32(1009, 2500);         // Pdischarge
+    inv.inputRegisters[1013] = 524;     // Vbat
+    inv.inputRegisters[1014] = 87;      // SOC
+    inv.inputRegisters[1067] = 5000;    // EpsFac (x100)
+}
+
+void test_growatt_full_sequence() {
+    seedGrowatt(1);
+    GrowattInverter inverter(&serial, false, 1, true, false);
+
+    for (int i = 0; i < GROWATT_SEQUENCE_LEN; i++) {
+        inverter.read();
+        TEST_ASSERT_TRUE(inverter.isDataValid());
+    }
+
+    InverterData data = inverter.getData(true);
+    assertValue("1", data, "status");
+    assertValue("351.2", data, "Vpv1");
+    assertValue("0.4", data, "Ipv1");
+    assertValue("1475.5", data, "Ppv1");
+    assertValue("12345.6", data, "Pac");
+    assertValue("50.0", data, "Fac");
+    assertValue("230.1", data, "Vac1");
+    assertValue("18.7", data, "Etoday");
+    assertValue("41.2", data, "Temp1");
+    assertValue("Bat", data, "Priority");
+    assertValue("Lithium", data, "Battery");
+    assertValue("250.0", data, "Pdischarge");
+    assertValue("52.4", data, "Vbat");
+    assertValue("87", data, "SOC");
+    assertValue("50.0", data, "EpsFac");
+    TEST_ASSERT_EQUAL(0, data.count("Vac2"));
+}
+
+void test_growatt_partial_data_follows_last_block() {
+    seedGrowatt(1);
+    GrowattInverter inverter(&serial, false, 1, true, false);
+
+    inverter.read();    // block 0, PV
+    InverterData data = inverter.getData();
+    assertValue("351.2", data, "Vpv1");
+    TEST_ASSERT_EQUAL(0, data.count("Pac"));
+
+    inverter.read();    // block 1, AC
+    data = inverter.getData();
+    assertValue("12345.6", data, "Pac");
+    TEST_ASSERT_EQUAL(0, data.count("Vpv1"));
+}
+
+void test_growatt_timeout_invalidates_data() {
+    GrowattInverter inverter(&serial, false, 7, true, false);
+
+    inverter.read();
+    TEST_ASSERT_FALSE(inverter.isDataValid());
+
+    seedGrowatt(7);
+    ModbusBus.failNext(ModbusMaster::ku8MBInvalidCRC);
+    inverter.read();
+    TEST_ASSERT_FALSE(inverter.isDataValid());
+
+    inverter.read();
+    TEST_ASSERT_TRUE(inverter.isDataValid());
+}
+
+void test_growatt_remote_command_writes_register() {
+    seedGrowatt(1);
+    GrowattInverter inverter(&serial, false, 1, true, false);
+
+    inverter.setIncomingTopicData("settings/priority/bat/ac", "on");
+    inverter.read();
+    TEST_ASSERT_TRUE(inverter.isDataValid());
+    TEST_ASSERT_EQUAL(1, ModbusBus.slave(1).holding(1092));
+
+    InverterData data = inverter.getData();
+    assertValue("Ok", data, "settings/priority/bat/ac/result");
+    assertValue("addr=1092 ac=1", data, "settings/priority/bat/ac/data");
+}
+
+void test_growatt_read_holding_task() {
+    seedGrowatt(1);
+    ModbusBus.slave(1).holdingRegisters[1070] = 0x0064;
+    ModbusBus.slave(1).holdingRegisters[1071] = 0x000a;
+    GrowattInverter inverter(&serial, false, 1, true, false);
+
+    inverter.setIncomingTopicData("settings/read_holding", "1070 2");
+    inverter.read();
+
+    InverterData data = inverter.getData();
+    assertValue("Ok", data, "settings/read_holding/result");
+    assertValue("64:0a", data, "settings/read_holding/data");
+}
+
+void test_growatt_unknown_command_is_ignored() {
+    GrowattInverter inverter(&serial, false, 1, true, false);
+
+    inverter.setIncomingTopicData("settings/unknown", "1");
+    TEST_ASSERT_EQUAL(0, ModbusBus.requests);
+
+    inverter.read();
+    TEST_ASSERT_EQUAL(1, ModbusBus.requests);
+}
+
+void test_mic_read() {
+    NativeModbusSlave &inv = ModbusBus.slave(3);
+    inv.inputRegisters[0] = 1;
+    inv.setInput32(1, 6001);            // Ppv
+    inv.inputRegisters[3] = 3300;       // Vpv1
+    inv.setInput32(11, 5800);           // Pac
+    inv.inputRegisters[13] = 4998;      // Fac (x100)
+    inv.inputRegisters[32] = 385;       // inverter temperature
+    MicInverter inverter(&serial, false, 3, false);
+
+    inverter.read();
+    TEST_ASSERT_TRUE(inverter.isDataValid());
+
+    InverterData data = inverter.getData();
+    assertValue("600.1", data, "Ppv");
+    assertValue("330.0", data, "Vpv1");
+    assertValue("580.0", data, "Pac");
+    assertValue("50.0", data, "Fac");
+    TEST_ASSERT_EQUAL(0, data.count("Vac2"));
+}
+
+class TestGrowattFactory : public MultiGrowattInverterInnerFactory {
+    public:
+        virtual Inverter *createInverter(Stream *serial, int modbusAddress, bool enableRemoteCommands, bool isTL) {
+            return new GrowattInverter(serial, false, modbusAddress, enableRemoteCommands, isTL);
+        }
+};
+
+void test_multi_growatt_prefixes_addresses() {
+    seedGrowatt(1);
+    seedGrowatt(2);
+    ModbusBus.slave(2).inputRegisters[3] = 3000;
+    MultiGrowattInverter inverter(&serial, false, { 1, 2 }, true, false, new TestGrowattFactory());
+
+    inverter.read();
+    InverterData data = inverter.getData();
+    assertValue("351.2", data, "1/Vpv1");
+
+    inverter.read();
+    data = inverter.getData();
+    assertValue("300.0", data, "2/Vpv1");
+    TEST_ASSERT_EQUAL(0, data.count("1/Vpv1"));
+}
+
+void test_multi_growatt_routes_commands() {
+    seedGrowatt(1);
+    seedGrowatt(2);
+    MultiGrowattInverter inverter(&serial, false, { 1, 2 }, true, false, new TestGrowattFactory());
+
+    inverter.setIncomingTopicData("2/settings/priority/bat/ac", "on");
+    inverter.read();
+    inverter.read();
+
+    TEST_ASSERT_EQUAL(0, ModbusBus.slave(1).holding(1092));
+    TEST_ASSERT_EQUAL(1, ModbusBus.slave(2).holding(1092));
+    InverterData data = inverter.getData();
+    assertValue("Ok", data, "2/settings/priority/bat/ac/result");
+}
+
+void test_multi_growatt_emits_prefixed_values() {
+    seedGrowatt(1);
+    seedGrowatt(2);
+    MultiGrowattInverter inverter(&serial, false, { 1, 2 }, true, false, new TestGrowattFactory());
+    MultiGrowattInverter collected(&serial, false, { 1, 2 }, true, false, new TestGrowattFactory());
+
+    // the streamed values are exactly what getData() collects
+    for (int i = 0; i < 4; i++) {
+        inverter.read();
+        collected.read();
+
+        InverterData streamed;
+        inverter.emitData(streamed, true);
+        InverterData data = collected.getData(true);
+        TEST_ASSERT_TRUE(streamed == data);
+        TEST_ASSERT_TRUE(streamed.size() > 0);
+    }
+}
+
+static const uint8_t SOYO_STATUS[] = { 0xA6, 0x00, 0x00, 0xD1, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFB, 0x64, 0x02, 0x0D, 0xBE };
+
+void test_soyosource_status_frame() {
+    SoyosourceGTNInverter inverter(&serial, false);
+
+    serial.feed(SOYO_STATUS, sizeof(SOYO_STATUS));
+    inverter.loop();
+
+    TEST_ASSERT_TRUE(inverter.isDataValid());
+    InverterData data = inverter.getData();
+    assertValue("251", data, "Vac");
+    assertValue("50.0", data, "Fac");
+    assertValue("DC voltage too low", data, "ErrorString");
+
+    // data is consumed by getData
+    TEST_ASSERT_FALSE(inverter.isDataValid());
+}
+
+void test_soyosource_bad_checksum_is_dropped() {
+    SoyosourceGTNInverter inverter(&serial, false);
+    uint8_t frame[sizeof(SOYO_STATUS)];
+    memcpy(frame, SOYO_STATUS, sizeof(frame));
+    frame[sizeof(frame) - 1] ^= 0xff;
+
+    serial.feed(frame, sizeof(frame));
+    inverter.loop();
+    TEST_ASSERT_FALSE(inverter.isDataValid());
+
+    // resynchronizes on the next good frame
+    serial.feed(SOYO_STATUS, sizeof(SOYO_STATUS));
+    inverter.loop();
+    TEST_ASSERT_TRUE(inverter.isDataValid());
+}
+
+void test_soyosource_sends_status_request() {
+    SoyosourceGTNInverter inverter(&serial, false);
+
+    inverter.read();
+
+    TEST_ASSERT_EQUAL(6, serial.tx.size());
+    TEST_ASSERT_EQUAL_HEX8(0x55, serial.tx[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x01, serial.tx[1]);
+    TEST_ASSERT_EQUAL_HEX8(0xFE, serial.tx[5]);
+}
+
+void test_voltronic_mode() {
+    VoltronicAxpertVMIIIInverter inverter(&serial, false);
+    serial.onWrite = [](MemoryStream &stream) {
+        if (stream.tx.size() >= 4 && memcmp(stream.tx.data(), "QMOD", 4) == 0) {
+            String reply = voltronicFrame("(B");
+            stream.feed((const uint8_t *) reply.c_str(), reply.length());
+        }
+    };
+
+    inverter.read();
+
+    TEST_ASSERT_TRUE(inverter.isDataValid());
+    InverterData data = inverter.getData();
+    assertValue("4", data, "InverterMode");
+}
+
+void test_voltronic_bad_crc() {
+    VoltronicAxpertVMIIIInverter inverter(&serial, false);
+    serial.onWrite = [](MemoryStream &stream) {
+        stream.feed("(Bxx\r");
+    };
+
+    inverter.read();
+
+    TEST_ASSERT_FALSE(inverter.isDataValid());
+}
+
+void test_mqtt_publisher_connects_and_publishes() {
+    WiFiClient client;
+    MqttPublisher mqtt(client, "", "", "energy/test", "127.0.0.1");
+    mqtt.addSubscription("settings/led");
+
+    TEST_ASSERT_TRUE(mqttLoopUntilConnected(mqtt) > 0);
+    TEST_ASSERT_EQUAL(1, MqttBroker.connections);
+    TEST_ASSERT_NOT_NULL(MqttBroker.lastPayload("energy/test/online"));
+    TEST_ASSERT_EQUAL(1, MqttBroker.subscriptions.size());
+    TEST_ASSERT_EQUAL_STRING("energy/test/settings/led", MqttBroker.subscriptions[0].c_str());
+
+    InverterData data;
+    data.set("Pac", 1234.5f);
+    data.set("status", (uint8_t) 1);
+    mqtt.publishData(data);
+    TEST_ASSERT_TRUE(mqttLoopUntilSent(mqtt) > 0);
+    TEST_ASSERT_EQUAL_STRING("1234.5", MqttBroker.lastPayload("energy/test/Pac")->c_str());
+    TEST_ASSERT_EQUAL_STRING("1", MqttBroker.lastPayload("energy/test/status")->c_str());
+}
+
+void test_mqtt_publisher_reconnects() {
+    WiFiClient client;
+    MqttPublisher mqtt(client, "user", "pass", "energy/test", "127.0.0.1");
+    mqtt.addSubscription("settings/led");
+
+    MqttBroker.available = false;
+    TEST_ASSERT_EQUAL(0, mqttLoopUntilConnected(mqtt));
+    TEST_ASSERT_FALSE(mqtt.isConnected());
+
+    MqttBroker.available = true;
+    delay(MQTT_BACKOFF_MAX_MILLIS);
+    TEST_ASSERT_TRUE(mqttLoopUntilConnected(mqtt) > 0);
+    TEST_ASSERT_EQUAL(1, MqttBroker.subscriptions.size());
+}
+
+void test_mqtt_publisher_connects_one_step_per_loop() {
+    WiFiClient client;
+    MqttPublisher mqtt(client, "", "", "energy/test", "broker.local");
+    mqtt.addSubscription("settings/led");
+    mqtt.addSubscription("settings/profiler");
+
+    const uint8_t expected[] = { MQTT_STATE_RESOLVE, MQTT_STATE_TCP_CONNECT, MQTT_STATE_MQTT_CONNECT,
+        MQTT_STATE_SUBSCRIBE, MQTT_STATE_SUBSCRIBE, MQTT_STATE_SUBSCRIBE, MQTT_STATE_CONNECTED };
+    for (uint8_t state : expected) {
+        mqtt.loop();
+        TEST_ASSERT_EQUAL(state, mqtt.getConnectionState());
+    }
+
+    // one subscription per step, after the announcement
+    TEST_ASSERT_TRUE(mqtt.isConnected());
+    TEST_ASSERT_EQUAL(2, MqttBroker.subscriptions.size());
+    TEST_ASSERT_EQUAL(1, Network.tcpConnects);
+}
+
+void test_mqtt_publisher_backoff_is_jittered_and_capped() {
+    WiFiClient client;
+    MqttPublisher mqtt(client, "", "", "energy/test", "127.0.0.1");
+    MqttBroker.available = false;
+
+    // 20 minutes of a 10ms main loop with the broker down
+    std::vector<unsigned long> attempts;
+    unsigned long longestLoop = 0;
+    for (int i = 0; i < 120000; i++) {
+        uint32_t before = Network.tcpConnects;
+        unsigned long start = millis();
+        mqtt.loop();
+        longestLoop = std::max(longestLoop, millis() - start);
+        if (Network.tcpConnects != before) {
+            attempts.push_back(start);
+        }
+        delay(10);
+    }
+
+    // a dead broker costs one TCP timeout per attempt, never more
+    TEST_ASSERT_TRUE(longestLoop <= MQTT_TCP_TIMEOUT_MILLIS);
+    TEST_ASSERT_TRUE(attempts.size() > 20);
+    TEST_ASSERT_TRUE(attempts.size() < 60);
+
+    bool jittered = false;
+    for (size_t i = 2; i < attempts.size(); i++) {
+        unsigned long gap = attempts[i] - attempts[i - 1];
+        TEST_ASSERT_TRUE(gap <= MQTT_BACKOFF_MAX_MILLIS + MQTT_TCP_TIMEOUT_MILLIS + 100);
+        TEST_ASSERT_TRUE(gap >= MQTT_BACKOFF_MIN_MILLIS / 2);
+        jittered |= i > 8 && gap < MQTT_BACKOFF_MAX_MILLIS - 1000;
+    }
+    TEST_ASSERT_TRUE(jittered);
+}
+
+void test_mqtt_publisher_reports_reconnects_and_downtime() {
+    WiFiClient client;
+    MqttPublisher mqtt(client, "", "", "energy/test", "127.0.0.1");
+    TEST_ASSERT_TRUE(mqttLoopUntilConnected(mqtt) > 0);
+    mqttLoopUntilSent(mqtt);
+    TEST_ASSERT_EQUAL_STRING("0", MqttBroker.lastPayload("energy/test/tele/Mqtt/Reconnects")->c_str());
+
+    // 30s outage
+    MqttBroker.available = false;
+    mqtt.loop();
+    TEST_ASSERT_FALSE(mqtt.isConnected());
+    for (int i = 0; i < 300; i++) {
+        delay(100);
+        mqtt.loop();
+    }
+    MqttBroker.available = true;
+    delay(MQTT_BACKOFF_MAX_MILLIS);
+    TEST_ASSERT_TRUE(mqttLoopUntilConnected(mqtt) > 0);
+    mqttLoopUntilSent(mqtt);
+
+    TEST_ASSERT_EQUAL_STRING("1", MqttBroker.lastPayload("energy/test/tele/Mqtt/Reconnects")->c_str());
+    int downtime = MqttBroker.lastPayload("energy/test/tele/Mqtt/DowntimeS")->toInt();
+    TEST_ASSERT_TRUE(downtime >= 30 + MQTT_BACKOFF_MAX_MILLIS / 1000);
+    TEST_ASSERT_TRUE(downtime < 100 + MQTT_BACKOFF_MAX_MILLIS / 1000);
+    TEST_ASSERT_TRUE(MqttBroker.lastPayload("energy/test/tele/Mqtt/FailedConnects")->toInt() > 0);
+}
+
+void test_mqtt_publisher_is_a_sink() {
+    seedGrowatt(1);
+    GrowattInverter inverter(&serial, false, 1, true, false);
+    WiFiClient client;
+    MqttPublisher mqtt(client, "", "", "energy/test", "127.0.0.1");
+    mqttLoopUntilConnected(mqtt);
+    mqttLoopUntilSent(mqtt);
+
+    inverter.read();
+    MqttBroker.published.clear();
+    inverter.emitData(mqtt);
+    TEST_ASSERT_EQUAL(0, MqttBroker.published.size());
+    TEST_ASSERT_TRUE(mqttLoopUntilSent(mqtt) > 0);
+    TEST_ASSERT_EQUAL(7, MqttBroker.published.size());
+    TEST_ASSERT_EQUAL_STRING("351.2", MqttBroker.lastPayload("energy/test/Vpv1")->c_str());
+    TEST_ASSERT_EQUAL_STRING("1", MqttBroker.lastPayload("energy/test/status")->c_str());
+}
+
+void test_mqtt_publisher_skips_a_topic_too_long() {
+    // 100 characters of base topic, with the name past MQTT_TOPIC_BUFFER_SIZE
+    std::string base(100, 'b');
+    WiFiClient client;
+    MqttPublisher mqtt(client, "", "", base.c_str(), "127.0.0.1");
+    mqttLoopUntilConnected(mqtt);
+    mqttLoopUntilSent(mqtt);
+    MqttBroker.published.clear();
+
+    mqtt.emit("Pac", 1234.5f);
+    mqtt.emit("1/settings/priority/bat/ac/result", "Ok");
+    mqtt.emit("Ppv1", 100.5f);
+    mqttLoopUntilSent(mqtt);
+
+    // the cut topic is not published anywhere, the ones after it are
+    TEST_ASSERT_EQUAL(2, MqttBroker.published.size());
+    TEST_ASSERT_NOT_NULL(MqttBroker.lastPayload((base + "/Ppv1").c_str()));
+    InverterData stats;
+    mqtt.emitStats(stats);
+    assertValue("1", stats, "Mqtt/Queue/Failed");
+    assertValue("0", stats, "Mqtt/Queue/Depth");
+}
+
+void test_mqtt_publisher_queue_spreads_a_burst() {
+    WiFiClient client;
+    MqttPublisher mqtt(client, "", "", "energy/test", "127.0.0.1");
+    mqttLoopUntilConnected(mqtt);
+    mqttLoopUntilSent(mqtt);
+    MqttBroker.published.clear();
+
+    // a full set worth of values in one go
+    for (int i = 0; i < 60; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "Field%d", i);
+        mqtt.emit(name, 1000.5f + i);
+    }
+    TEST_ASSERT_EQUAL(60, mqtt.getQueueDepth());
+
+    mqtt.loop();
+    TEST_ASSERT_EQUAL(MQTT_PUBLISH_LOOP_MESSAGES, MqttBroker.published.size());
+
+    // past the burst the bucket sets the pace
+    int calls = mqttLoopUntilSent(mqtt);
+    TEST_ASSERT_TRUE(calls > 60 / MQTT_PUBLISH_LOOP_MESSAGES);
+    TEST_ASSERT_EQUAL(60, MqttBroker.published.size());
+    TEST_ASSERT_EQUAL_STRING("energy/test/Field0", MqttBroker.published[0].topic.c_str());
+    TEST_ASSERT_EQUAL_STRING("1059.5", MqttBroker.lastPayload("energy/test/Field59")->c_str());
+}
+
+void test_mqtt_publisher_live_values_before_tele() {
+    WiFiClient client;
+    MqttPublisher mqtt(client, "", "", "energy/test", "127.0.0.1");
+    mqttLoopUntilConnected(mqtt);
+    mqttLoopUntilSent(mqtt);
+    MqttBroker.published.clear();
+
+    mqtt.publishTele();
+    mqtt.emit("Pac", 1234.5f);
+    mqttLoopUntilSent(mqtt);
+
+    TEST_ASSERT_EQUAL_STRING("energy/test/Pac", MqttBroker.published[0].topic.c_str());
+    TEST_ASSERT_EQUAL_STRING("energy/test/tele/IP", MqttBroker.published[1].topic.c_str());
+}
+
+void test_mqtt_publisher_queue_full_drops() {
+    WiFiClient client;
+    MqttPublisher mqtt(client, "", "", "energy/test", "127.0.0.1");
+    mqttLoopUntilConnected(mqtt);
+    mqttLoopUntilSent(mqtt);
+    MqttBroker.published.clear();
+
+    for (int i = 0; i < 500; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "Field%d", i);
+        mqtt.emit(name, 1000.5f + i);
+    }
+    TEST_ASSERT_TRUE(mqtt.getQueueDepth() < 500);
+
+    mqttLoopUntilSent(mqtt);
+    mqtt.publishTele();
+    mqttLoopUntilSent(mqtt);
+    int sent = 0;
+    for (NativeMqttMessage &m : MqttBroker.published) {
+        sent += m.topic.startsWith("energy/test/Field") ? 1 : 0;
+    }
+    TEST_ASSERT_TRUE(sent > 0);
+    TEST_ASSERT_EQUAL(500 - sent, MqttBroker.lastPayload("energy/test/tele/Mqtt/Queue/Dropped")->toInt());
+    TEST_ASSERT_EQUAL_STRING("0", MqttBroker.lastPayload("energy/test/tele/Mqtt/Queue/Failed")->c_str());
+}
+
+void test_mqtt_publisher_waits_for_the_send_buffer() {
+    WiFiClient client;
+    MqttPublisher mqtt(client, "", "", "energy/test", "127.0.0.1");
+    mqttLoopUntilConnected(mqtt);
+    mqttLoopUntilSent(mqtt);
+    MqttBroker.published.clear();
+
+    // unacknowledged segments fill the send buffer, the loop does not wait for them
+    Network.sendBuffer = 10;
+    mqtt.emit("Pac", 1234.5f);
+    for (int i = 0; i < 10; i++) {
+        mqtt.loop();
+        delay(100);
+    }
+    TEST_ASSERT_EQUAL(0, MqttBroker.published.size());
+    TEST_ASSERT_EQUAL(1, mqtt.getQueueDepth());
+
+    Network.sendBuffer = 2 * 1460;
+    mqttLoopUntilSent(mqtt);
+    mqtt.publishTele();
+    mqttLoopUntilSent(mqtt);
+    TEST_ASSERT_EQUAL_STRING("1234.5", MqttBroker.lastPayload("energy/test/Pac")->c_str());
+    TEST_ASSERT_EQUAL_STRING("10", MqttBroker.lastPayload("energy/test/tele/Mqtt/Queue/Congested")->c_str());
+}
+
+static String receivedTopic;
+
+void test_mqtt_publisher_callback() {
+    WiFiClient client;
+    MqttPublisher mqtt(client, "", "", "energy/test", "127.0.0.1");
+    mqtt.setCallback([](char *topic, byte *payload, unsigned int length) {
+        receivedTopic = topic;
+    });
+    mqtt.addSubscription("settings/led");
+    mqttLoopUntilConnected(mqtt);
+
+    TEST_ASSERT_TRUE(MqttBroker.deliver("energy/test/settings/led", "on"));
+    TEST_ASSERT_EQUAL_STRING("energy/test/settings/led", receivedTopic.c_str());
+    TEST_ASSERT_FALSE(MqttBroker.deliver("energy/test/other", "on"));
+}
+
+void test_mqtt_tls_resumes_session_after_reconnect() {
+    MqttTls tls;
+    TEST_ASSERT_TRUE(tls.begin(TLS_FINGERPRINT));
+    MqttPublisher mqtt(tls.getClient(), "", "", "energy/test", "127.0.0.1", 8883);
+    mqtt.setTls(&tls);
+
+    const uint8_t expected[] = { MQTT_STATE_RESOLVE, MQTT_STATE_TLS_PROBE, MQTT_STATE_TCP_CONNECT, MQTT_STATE_MQTT_CONNECT };
+    for (uint8_t state : expected) {
+        mqtt.loop();
+        TEST_ASSERT_EQUAL(state, mqtt.getConnectionState());
+    }
+    TEST_ASSERT_TRUE(mqttLoopUntilConnected(mqtt) > 0);
+    TEST_ASSERT_EQUAL(1, TlsServer.handshakes);
+    TEST_ASSERT_EQUAL(0, TlsServer.resumed);
+    TEST_ASSERT_EQUAL(MQTT_TLS_RX_BUFFER_SIZE, TlsServer.rxBufferSize);
+
+    // the session outlives the connection, the probe is not repeated
+    MqttBroker.available = false;
+    mqtt.loop();
+    MqttBroker.available = true;
+    delay(MQTT_BACKOFF_MAX_MILLIS);
+    TEST_ASSERT_TRUE(mqttLoopUntilConnected(mqtt) > 0);
+    TEST_ASSERT_EQUAL(2, TlsServer.handshakes);
+    TEST_ASSERT_EQUAL(1, TlsServer.resumed);
+    TEST_ASSERT_EQUAL(1, TlsServer.probes);
+
+    InverterData stats;
+    tls.emitStats(stats);
+    assertValue("2", stats, "Mqtt/Tls/Handshakes");
+    TEST_ASSERT_TRUE(stats["Mqtt/Tls/FullHandshakeMs"].toInt() >= TlsServer.fullHandshakeMillis);
+    TEST_ASSERT_TRUE(stats["Mqtt/Tls/HandshakeMs"].toInt() < TlsServer.fullHandshakeMillis);
+
+    // a broker restart loses the sessions, the next handshake is a full one
+    TlsServer.forgetSessions();
+    MqttBroker.available = false;
+    mqtt.loop();
+    MqttBroker.available = true;
+    delay(MQTT_BACKOFF_MAX_MILLIS);
+    TEST_ASSERT_TRUE(mqttLoopUntilConnected(mqtt) > 0);
+    TEST_ASSERT_EQUAL(1, TlsServer.resumed);
+}
+
+void test_mqtt_tls_pins_the_fingerprint() {
+    MqttTls tls;
+    TEST_ASSERT_FALSE(tls.begin("a0:a1:zz"));
+    TEST_ASSERT_TRUE(tls.begin("00:a1:a2:a3:a4:a5:a6:a7:a8:a9:aa:ab:ac:ad:ae:af:b0:b1:b2:b3"));
+    MqttPublisher mqtt(tls.getClient(), "", "", "energy/test", "127.0.0.1", 8883);
+    mqtt.setTls(&tls);
+
+    TEST_ASSERT_EQUAL(0, mqttLoopUntilConnected(mqtt));
+    TEST_ASSERT_EQUAL(0, TlsServer.handshakes);
+    TEST_ASSERT_EQUAL(0, MqttBroker.connections);
+
+    InverterData stats;
+    tls.emitStats(stats);
+    TEST_ASSERT_TRUE(stats["Mqtt/Tls/FailedHandshakes"].toInt() > 0);
+
+    // a new broker starts from zero
+    TEST_ASSERT_TRUE(tls.begin(TLS_FINGERPRINT));
+    stats.clear();
+    tls.emitStats(stats);
+    assertValue("0", stats, "Mqtt/Tls/FailedHandshakes");
+    assertValue("0", stats, "Mqtt/Tls/Handshakes");
+}
+
+void test_mqtt_tls_without_max_fragment_length() {
+    TlsServer.maxFragmentLength = false;
+    MqttTls tls;
+    tls.begin(TLS_FINGERPRINT);
+    MqttPublisher mqtt(tls.getClient(), "", "", "energy/test", "127.0.0.1", 8883);
+    mqtt.setTls(&tls);
+
+    // no 16KB buffers, no connection at all
+    TEST_ASSERT_EQUAL(0, mqttLoopUntilConnected(mqtt));
+    TEST_ASSERT_EQUAL(0, TlsServer.handshakes);
+    TEST_ASSERT_TRUE(TlsServer.probes > 0);
+
+    // probed again on the next attempt, a broker that takes it now gets the connection
+    TlsServer.maxFragmentLength = true;
+    delay(MQTT_BACKOFF_MAX_MILLIS);
+    TEST_ASSERT_TRUE(mqttLoopUntilConnected(mqtt) > 0);
+    TEST_ASSERT_EQUAL(MQTT_TLS_RX_BUFFER_SIZE, TlsServer.rxBufferSize);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_growatt_full_sequence);
+    RUN_TEST(test_growatt_partial_data_follows_last_block);
+    RUN_TEST(test_growatt_timeout_invalidates_data);
+    RUN_TEST(test_growatt_remote_command_writes_register);
+    RUN_TEST(test_growatt_read_holding_task);
+    RUN_TEST(test_growatt_unknown_command_is_ignored);
+    RUN_TEST(test_mic_read);
+    RUN_TEST(test_multi_growatt_prefixes_addresses);
+    RUN_TEST(test_multi_growatt_routes_commands);
+    RUN_TEST(test_multi_growatt_emits_prefixed_values);
+
+    RUN_TEST(test_soyosource_status_frame);
+    RUN_TEST(test_soyosource_bad_checksum_is_dropped);
+    RUN_TEST(test_soyosource_sends_status_request);
+
+    RUN_TEST(test_voltronic_mode);
+    RUN_TEST(test_voltronic_bad_crc);
+
+    RUN_TEST(test_mqtt_publisher_connects_and_publishes);
+    RUN_TEST(test_mqtt_publisher_reconnects);
+    RUN_TEST(test_mqtt_publisher_connects_one_step_per_loop);
+    RUN_TEST(test_mqtt_publisher_backoff_is_jittered_and_capped);
+    RUN_TEST(test_mqtt_publisher_reports_reconnects_and_downtime);
+    RUN_TEST(test_mqtt_publisher_is_a_sink);
+    RUN_TEST(test_mqtt_publisher_skips_a_topic_too_long);
+    RUN_TEST(test_mqtt_publisher_queue_spreads_a_burst);
+    RUN_TEST(test_mqtt_publisher_live_values_before_tele);
+    RUN_TEST(test_mqtt_publisher_queue_full_drops);
+    RUN_TEST(test_mqtt_publisher_waits_for_the_send_buffer);
+    RUN_TEST(test_mqtt_publisher_callback);
+    RUN_TEST(test_mqtt_tls_resumes_session_after_reconnect);
+    RUN_TEST(test_mqtt_tls_pins_the_fingerprint);
+    RUN_TEST(test_mqtt_tls_without_max_fragment_length);
+
+    return UNITY_END();
+}
@@ -0,0 +1,262 @@
+/*
+  test_main.cpp - On-device energy integration: the trapezoid sums, the interval
+  aggregates, totals across a soft reset and the Growatt power sampling, with
+  and without battery registers and never on MIC buses
+  pio test -e native -f test_energy
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <unity.h>
+#include <MemoryStream.h>
+
+#include "EnergyIntegrator.h"
+#include "InverterData.h"
+#include "growatt/GrowattInverter.h"
+#include "growatt/MultiGrowattInverter.h"
+#include "growatt/MicInverter.h"
+
+static MemoryStream serial;
+
+void setUp() {
+    ModbusBus.reset();
+    serial.clear();
+    memset(ESP.rtcMemory, 0, sizeof(ESP.rtcMemory));
+}
+
+void tearDown() {
+}
+
+static void addSample(EnergyIntegrator &energy, unsigned long millis, float pac) {
+    energy.beginSample(millis);
+    energy.emit("Pac", pac);
+    energy.emit("Vac1", 230.0f);
+    energy.endSample();
+}
+
+class EnergyGrowattFactory : public MultiGrowattInverterInnerFactory {
+    public:
+        virtual Inverter *createInverter(Stream *serial, int modbusAddress, bool enableRemoteCommands, bool isTL) {
+            return new GrowattInverter(serial, false, modbusAddress, enableRemoteCommands, isTL);
+        }
+};
+
+class EnergyMicFactory : public MultiGrowattInverterInnerFactory {
+    public:
+        virtual Inverter *createInverter(Stream *serial, int modbusAddress, bool enableRemoteCommands, bool isTL) {
+            return new MicInverter(serial, false, modbusAddress, isTL);
+        }
+};
+
+void test_energy_trapezoid_of_a_ramp() {
+    EnergyIntegrator energy;
+    energy.begin();
+
+    // 0 to 1000W over 10s, sampled every second: the trapezoids are exact
+    for (int i = 0; i <= 10; i++) {
+        addSample(energy, i * 1000, i * 100.0f);
+    }
+
+    InverterData data;
+    energy.emitAggregates(data);
+    TEST_ASSERT_EQUAL_STRING("0.0", data["Pac/Min"].c_str());
+    TEST_ASSERT_EQUAL_STRING("1000.0", data["Pac/Max"].c_str());
+    TEST_ASSERT_EQUAL_STRING("500.0", data["Pac/Mean"].c_str());
+    TEST_ASSERT_EQUAL_STRING("1.389", data["Pac/Energy"].c_str());
+    TEST_ASSERT_EQUAL_STRING("1.4", data["Pac/EnergyTotal"].c_str());
+    // not a power field
+    TEST_ASSERT_TRUE(data.find("Vac1/Min") == data.end());
+}
+
+void test_energy_mean_is_time_weighted() {
+    EnergyIntegrator energy;
+    energy.begin();
+
+    // 100W for 9s, a spike to 1000W sampled once
+    addSample(energy, 0, 100.0f);
+    addSample(energy, 9000, 100.0f);
+    addSample(energy, 10000, 1000.0f);
+
+    InverterData data;
+    energy.emitAggregates(data);
+    TEST_ASSERT_EQUAL_STRING("145.0", data["Pac/Mean"].c_str());
+
+    // the next interval starts at the last sample, the total goes on
+    addSample(energy, 20000, 1000.0f);
+    InverterData next;
+    energy.emitAggregates(next);
+    TEST_ASSERT_EQUAL_STRING("1000.0", next["Pac/Min"].c_str());
+    TEST_ASSERT_EQUAL_STRING("2.778", next["Pac/Energy"].c_str());
+    TEST_ASSERT_FLOAT_WITHIN(0.001, (900.0 + 550.0 + 10000.0) / 3600.0, energy.getTotalWh("Pac"));
+
+    // nothing sampled, nothing emitted
+    InverterData empty;
+    energy.emitAggregates(empty);
+    TEST_ASSERT_EQUAL(0, empty.size());
+}
+
+void test_energy_gap_is_not_integrated() {
+    EnergyIntegrator energy;
+    energy.begin();
+
+    addSample(energy, 0, 500.0f);
+    addSample(energy, ENERGY_MAX_GAP_MILLIS + 1000, 500.0f);
+    addSample(energy, ENERGY_MAX_GAP_MILLIS + 2000, 500.0f);
+
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, 500.0 / 3600.0, energy.getTotalWh("Pac"));
+    InverterData stats;
+    energy.emitStats(stats);
+    TEST_ASSERT_EQUAL_STRING("1", stats["Energy/Gaps"].c_str());
+    TEST_ASSERT_EQUAL_STRING("3", stats["Energy/Samples"].c_str());
+}
+
+void test_energy_totals_survive_a_soft_reset() {
+    {
+        EnergyIntegrator energy;
+        energy.begin();
+        for (int i = 0; i <= 36; i++) {
+            addSample(energy, i * 100000, 1000.0f);
+        }
+        TEST_ASSERT_FLOAT_WITHIN(0.001, 1000.0, energy.getTotalWh("Pac"));
+    }
+
+    // the RTC memory is still there after the restart
+    EnergyIntegrator energy;
+    energy.begin();
+    addSample(energy, 0, 1000.0f);
+    addSample(energy, 3600, 1000.0f);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 1001.0, energy.getTotalWh("Pac"));
+
+    InverterData stats;
+    energy.emitStats(stats);
+    TEST_ASSERT_EQUAL_STRING("true", stats["Energy/Restored"].c_str());
+
+    // a power cycle leaves garbage, the totals start over
+    ESP.rtcMemory[RTC_ENERGY_OFFSET + 5] ^= 0x100;
+    EnergyIntegrator afterPowerCycle;
+    afterPowerCycle.begin();
+    addSample(afterPowerCycle, 0, 1000.0f);
+    addSample(afterPowerCycle, 3600, 1000.0f);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 1.0, afterPowerCycle.getTotalWh("Pac"));
+}
+
+void test_energy_growatt_power_sampling() {
+    NativeModbusSlave &inv = ModbusBus.slave(1);
+    inv.setInput32(5, 14755);           // Ppv1
+    inv.setInput32(9, 2000);            // Ppv2
+    inv.setInput32(35, 12345);          // Pac
+    inv.setInput32(1009, 500);          // Pdischarge
+    inv.setInput32(1011, 0);            // Pcharge
+
+    GrowattInverter inverter(&serial, false, 1, true, false);
+    TEST_ASSERT_TRUE(inverter.hasPowerSampling());
+
+    InverterData data;
+    TEST_ASSERT_TRUE(inverter.samplePower(data));
+    TEST_ASSERT_EQUAL(5, data.size());
+    TEST_ASSERT_EQUAL_STRING("1475.5", data["Ppv1"].c_str());
+    TEST_ASSERT_EQUAL_STRING("200.0", data["Ppv2"].c_str());
+    TEST_ASSERT_EQUAL_STRING("1234.5", data["Pac"].c_str());
+    TEST_ASSERT_EQUAL_STRING("50.0", data["Pdischarge"].c_str());
+
+    // three short reads
+    TEST_ASSERT_EQUAL(3, ModbusBus.requests);
+
+    // a bus without the inverter
+    ModbusBus.reset();
+    InverterData none;
+    TEST_ASSERT_FALSE(inverter.samplePower(none));
+    TEST_ASSERT_EQUAL(1, ModbusBus.requests);
+
+    // the bus is left alone during the backoff, then asked again with twice the wait
+    TEST_ASSERT_FALSE(inverter.samplePower(none));
+    TEST_ASSERT_EQUAL(1, ModbusBus.requests);
+    delay(GROWATT_SAMPLE_RETRY_MILLIS);
+    TEST_ASSERT_FALSE(inverter.samplePower(none));
+    TEST_ASSERT_EQUAL(2, ModbusBus.requests);
+    delay(GROWATT_SAMPLE_RETRY_MILLIS);
+    TEST_ASSERT_FALSE(inverter.samplePower(none));
+    TEST_ASSERT_EQUAL(2, ModbusBus.requests);
+}
+
+void test_energy_growatt_without_battery_registers() {
+    NativeModbusSlave &inv = ModbusBus.slave(1);
+    inv.setInput32(35, 12345);          // Pac
+    inv.lastInputRegister = 124;
+
+    GrowattInverter inverter(&serial, false, 1, false, false);
+    InverterData data;
+    TEST_ASSERT_TRUE(inverter.samplePower(data));
+    TEST_ASSERT_EQUAL(3, data.size());
+    TEST_ASSERT_EQUAL_STRING("1234.5", data["Pac"].c_str());
+    TEST_ASSERT_EQUAL(3, ModbusBus.requests);
+
+    // the battery registers are not asked for again
+    TEST_ASSERT_TRUE(inverter.samplePower(data));
+    TEST_ASSERT_EQUAL(5, ModbusBus.requests);
+    TEST_ASSERT_EQUAL(0, inverter.getBatteryBlock().getGeneration());
+}
+
+void test_energy_multi_mic_has_no_power_sampling() {
+    MultiGrowattInverter mic(&serial, false, { 1, 2 }, true, false, new EnergyMicFactory());
+    TEST_ASSERT_FALSE(mic.hasPowerSampling());
+
+    MultiGrowattInverter sph(&serial, false, { 1, 2 }, true, false, new EnergyGrowattFactory());
+    TEST_ASSERT_TRUE(sph.hasPowerSampling());
+}
+
+void test_energy_multi_growatt_prefixes_the_channels() {
+    for (uint8_t addr = 1; addr <= 2; addr++) {
+        ModbusBus.slave(addr).setInput32(35, addr * 10000);
+    }
+    MultiGrowattInverter inverter(&serial, false, { 1, 2 }, true, false, new EnergyGrowattFactory());
+
+    EnergyIntegrator energy;
+    energy.begin();
+    // 10 minutes apart, the longest gap still integrated, one inverter per sample
+    for (unsigned long t = 0; t <= ENERGY_MAX_GAP_MILLIS; t += ENERGY_MAX_GAP_MILLIS) {
+        for (uint8_t addr = 1; addr <= 2; addr++) {
+            ModbusBus.requests = 0;
+            energy.beginSample(t);
+            TEST_ASSERT_TRUE(inverter.samplePower(energy));
+            energy.endSample();
+            TEST_ASSERT_EQUAL(3, ModbusBus.requests);
+        }
+    }
+
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 1000.0 / 6, energy.getTotalWh("1/Pac"));
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 2000.0 / 6, energy.getTotalWh("2/Pac"));
+}
+
+void test_energy_tee_feeds_both_sinks() {
+    InverterData published;
+    EnergyIntegrator energy;
+    energy.begin();
+
+    TeeSink both(published, energy);
+    energy.beginSample(0);
+    both.emit("Pac", 100.0f);
+    energy.endSample();
+
+    TEST_ASSERT_EQUAL_STRING("100.0", published["Pac"].c_str());
+    InverterData data;
+    energy.emitAggregates(data);
+    TEST_ASSERT_EQUAL_STRING("100.0", data["Pac/Mean"].c_str());
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_energy_trapezoid_of_a_ramp);
+    RUN_TEST(test_energy_mean_is_time_weighted);
+    RUN_TEST(test_energy_gap_is_not_integrated);
+    RUN_TEST(test_energy_totals_survive_a_soft_reset);
+    RUN_TEST(test_energy_growatt_power_sampling);
+    RUN_TEST(test_energy_growatt_without_battery_registers);
+    RUN_TEST(test_energy_multi_mic_has_no_power_sampling);
+    RUN_TEST(test_energy_multi_growatt_prefixes_the_channels);
+    RUN_TEST(test_energy_tee_feeds_both_sinks);
+
+    return UNITY_END();
+}
@@ -0,0 +1,206 @@
+/*
+  test_main.cpp - End-to-end tests and throughput benchmark of the Growatt drivers
+  talking Modbus RTU to simulated inverters over a pseudo-terminal
+  pio test -e native -f test_growatt_rtu -v
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <unity.h>
+#include <GrowattSlaveSim.h>
+
+#include "growatt/GrowattInverter.h"
+#include "growatt/MultiGrowattInverter.h"
+
+// relative to the project directory, where pio runs the tests
+#define HOLDING_DUMP "docs/read-hold-01-a1070-l49-bat-first.txt"
+#define HOLDING_DUMP_HEX "64:05:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:28:2b:01:00:00:00:00:00:00:00:00:173b:01:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00"
+
+// steps in one full GrowattInverter state sequence
+#define GROWATT_SEQUENCE_LEN 13
+
+// fast bus for the functional tests, the benchmark uses the real 9600 baud
+#define TEST_BAUD 115200
+#define GROWATT_BAUD 9600
+
+static GrowattSlaveSim *sim;
+
+void setUp() {
+    ModbusBus.reset();
+    ModbusBus.rtu = true;
+    ModbusBus.responseTimeoutMs = 100;
+    sim = new GrowattSlaveSim(TEST_BAUD);
+}
+
+void tearDown() {
+    delete sim;
+}
+
+static void assertValue(const char *expected, InverterData &data, const char *name) {
+    TEST_ASSERT_TRUE_MESSAGE(data.count(name) == 1, name);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(expected, data[name].c_str(), name);
+}
+
+void test_rtu_crc() {
+    // read 2 input registers at 0 from slave 1
+    const uint8_t frame[] = { 0x01, 0x04, 0x00, 0x00, 0x00, 0x02 };
+    TEST_ASSERT_EQUAL_HEX16(0xCB71, modbusCRC16(frame, sizeof(frame)));
+}
+
+void test_rtu_full_sequence() {
+    sim->slave(1);
+    TEST_ASSERT_TRUE(sim->start());
+    GrowattInverter inverter(&sim->getStream(), false, 1, true, false);
+
+    for (int i = 0; i < GROWATT_SEQUENCE_LEN; i++) {
+        inverter.read();
+        TEST_ASSERT_TRUE(inverter.isDataValid());
+    }
+
+    InverterData data = inverter.getData(true);
+    assertValue("351.2", data, "Vpv1");
+    assertValue("2512.0", data, "Pac");
+    assertValue("18.7", data, "Etoday");
+    assertValue("Bat", data, "Priority");
+    assertValue("87", data, "SOC");
+    TEST_ASSERT_EQUAL(GROWATT_SEQUENCE_LEN, sim->getStats().responses);
+}
+
+void test_rtu_read_holding_matches_dump() {
+    TEST_ASSERT_TRUE_MESSAGE(sim->loadHoldingDump(1, HOLDING_DUMP), HOLDING_DUMP);
+    TEST_ASSERT_TRUE(sim->start());
+    GrowattInverter inverter(&sim->getStream(), false, 1, true, false);
+
+    inverter.setIncomingTopicData("settings/read_holding", "1070 49");
+    inverter.read();
+
+    InverterData data = inverter.getData();
+    assertValue("Ok", data, "settings/read_holding/result");
+    assertValue(HOLDING_DUMP_HEX, data, "settings/read_holding/data");
+}
+
+void test_rtu_write_register() {
+    TEST_ASSERT_TRUE(sim->loadHoldingDump(1, HOLDING_DUMP));
+    TEST_ASSERT_EQUAL(1, sim->slave(1).holding(1092));
+    TEST_ASSERT_TRUE(sim->start());
+    GrowattInverter inverter(&sim->getStream(), false, 1, true, false);
+
+    inverter.setIncomingTopicData("settings/priority/bat/ac", "off");
+    inverter.read();
+
+    InverterData data = inverter.getData();
+    assertValue("Ok", data, "settings/priority/bat/ac/result");
+    TEST_ASSERT_EQUAL(0, sim->slave(1).holding(1092));
+}
+
+void test_rtu_injected_faults() {
+    sim->slave(1);
+    TEST_ASSERT_TRUE(sim->start());
+    GrowattInverter inverter(&sim->getStream(), false, 1, true, false);
+
+    sim->failNext(SIM_FAULT_TIMEOUT);
+    inverter.read();
+    TEST_ASSERT_FALSE(inverter.isDataValid());
+
+    sim->failNext(SIM_FAULT_CRC);
+    inverter.read();
+    TEST_ASSERT_FALSE(inverter.isDataValid());
+
+    sim->failNext(SIM_FAULT_EXCEPTION, 1, ModbusMaster::ku8MBIllegalDataAddress);
+    inverter.read();
+    TEST_ASSERT_FALSE(inverter.isDataValid());
+
+    inverter.read();
+    TEST_ASSERT_TRUE(inverter.isDataValid());
+
+    GrowattSlaveSimStats stats = sim->getStats();
+    TEST_ASSERT_EQUAL(4, stats.requests);
+    TEST_ASSERT_EQUAL(1, stats.timeouts);
+    TEST_ASSERT_EQUAL(1, stats.crcErrors);
+    TEST_ASSERT_EQUAL(1, stats.exceptions);
+}
+
+class RtuGrowattFactory : public MultiGrowattInverterInnerFactory {
+    public:
+        virtual Inverter *createInverter(Stream *serial, int modbusAddress, bool enableRemoteCommands, bool isTL) {
+            return new GrowattInverter(serial, false, modbusAddress, enableRemoteCommands, isTL);
+        }
+};
+
+void test_rtu_multiple_addresses() {
+    sim->slave(1);
+    sim->slave(2).inputRegisters[3] = 3000;
+    TEST_ASSERT_TRUE(sim->start());
+    // nobody answers at 3
+    MultiGrowattInverter inverter(&sim->getStream(), false, { 1, 2, 3 }, true, false, new RtuGrowattFactory());
+
+    inverter.read();
+    TEST_ASSERT_TRUE(inverter.isDataValid());
+    InverterData data = inverter.getData();
+    assertValue("351.2", data, "1/Vpv1");
+
+    inverter.read();
+    TEST_ASSERT_TRUE(inverter.isDataValid());
+    data = inverter.getData();
+    assertValue("300.0", data, "2/Vpv1");
+
+    inverter.read();
+    TEST_ASSERT_FALSE(inverter.isDataValid());
+}
+
+// polls back to back for a number of full sequences, like the main loop with no
+// polling interval, and reports what the bus and the loop get
+static void benchThroughput(const char *name, int sequences) {
+    sim->resetStats();
+    GrowattInverter inverter(&sim->getStream(), false, 1, true, true);
+
+    int polls = sequences * GROWATT_SEQUENCE_LEN;
+    int valid = 0;
+    unsigned long maxLatency = 0;
+    unsigned long start = micros();
+    for (int i = 0; i < polls; i++) {
+        unsigned long pollStart = micros();
+        inverter.read();
+        InverterData data = inverter.getData();
+        maxLatency = std::max(maxLatency, micros() - pollStart);
+        if (inverter.isDataValid()) valid++;
+    }
+    unsigned long elapsed = micros() - start;
+
+    GrowattSlaveSimStats stats = sim->getStats();
+    char msg[200];
+    snprintf(msg, sizeof(msg), "%-18s %6.1f polls/s %5.1f%% valid, bus %5.1f%% busy %6llu bytes, loop latency avg %6.1f ms max %6.1f ms",
+        name, polls * 1e6 / elapsed, 100.0 * valid / polls, 100.0 * stats.wireMicros / elapsed, (unsigned long long) stats.wireBytes,
+        elapsed / 1000.0 / polls, maxLatency / 1000.0);
+    TEST_MESSAGE(msg);
+}
+
+void test_bench_rtu_throughput() {
+    delete sim;
+    sim = new GrowattSlaveSim(GROWATT_BAUD);
+    sim->slave(1);
+    TEST_ASSERT_TRUE(sim->start());
+
+    // a real Growatt answers within ~300ms, keep the library default of 2s out of the benchmark
+    ModbusBus.responseTimeoutMs = 300;
+
+    benchThroughput("clean bus", 2);
+
+    sim->setFaultRates(0.05, 0.05, 0.0, 42);
+    benchThroughput("5% timeout 5% crc", 2);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_rtu_crc);
+    RUN_TEST(test_rtu_full_sequence);
+    RUN_TEST(test_rtu_read_holding_matches_dump);
+    RUN_TEST(test_rtu_write_register);
+    RUN_TEST(test_rtu_injected_faults);
+    RUN_TEST(test_rtu_multiple_addresses);
+    RUN_TEST(test_bench_rtu_throughput);
+
+    return UNITY_END();
+}
@@ -0,0 +1,320 @@
+/*
+  test_main.cpp - Offline history buffer: what is kept, the segment ring in SPIFFS,
+  recovery after a reboot or a lost segment and the replay to MQTT, pio test -e native -f test_history
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <unity.h>
+#include <FS.h>
+#include <MemoryStream.h>
+#include <MqttLoop.h>
+
+#include "HistoryBuffer.h"
+#include "growatt/GrowattInverter.h"
+#include "growatt/MultiGrowattInverter.h"
+#include "MqttPublisher.h"
+#include "WallClock.h"
+
+static MemoryStream serial;
+// poll times once the clock is set
+static const uint32_t T0 = 1700000000;
+
+void setUp() {
+    SPIFFS.reset();
+    ModbusBus.reset();
+    MqttBroker.reset();
+    serial.clear();
+    WallClock::reset();
+}
+
+void tearDown() {
+}
+
+// one poll of a battery inverter: two history fields and a text one
+static void addSample(HistoryBuffer &history, uint32_t time) {
+    history.beginSample(T0 + time);
+    history.emit("Etoday", 12.5f);
+    history.emit("SOC", (uint16_t) 80);
+    history.emit("Priority", "Bat");
+    history.endSample();
+}
+
+static void seedGrowatt(uint8_t addr) {
+    NativeModbusSlave &inv = ModbusBus.slave(addr);
+    inv.inputRegisters[3] = 3512;       // Vpv1
+    inv.setInput32(5, 14755);           // Ppv1
+    inv.setInput32(35, 123456);         // Pac
+    inv.setInput32(53, 187);            // Etoday
+    inv.inputRegisters[1014] = 87;      // SOC
+}
+
+class HistoryGrowattFactory : public MultiGrowattInverterInnerFactory {
+    public:
+        virtual Inverter *createInverter(Stream *serial, int modbusAddress, bool enableRemoteCommands, bool isTL) {
+            return new GrowattInverter(serial, false, modbusAddress, enableRemoteCommands, isTL);
+        }
+};
+
+void test_history_keeps_numeric_history_fields() {
+    HistoryBuffer history;
+    history.begin();
+
+    addSample(history, 100);
+    TEST_ASSERT_EQUAL(2, history.getBacklog());
+
+    char payload[HISTORY_PAYLOAD_SIZE];
+    TEST_ASSERT_EQUAL(2, history.nextBatch(payload, sizeof(payload)));
+    TEST_ASSERT_EQUAL_STRING("{\"t\":1700000100,\"Etoday\":12.5,\"SOC\":80}", payload);
+
+    history.commitBatch(2);
+    TEST_ASSERT_EQUAL(0, history.getBacklog());
+    TEST_ASSERT_EQUAL(0, history.nextBatch(payload, sizeof(payload)));
+    TEST_ASSERT_EQUAL(0, SPIFFS.files.size());
+
+    // an address prefix fits, a name too long for a record is counted
+    history.beginSample(T0 + 200);
+    history.emit("247/BatteryCapacity", (uint16_t) 95);
+    history.emit("12345678901234567890/SOC", (uint16_t) 80);
+    history.endSample();
+    TEST_ASSERT_EQUAL(1, history.nextBatch(payload, sizeof(payload)));
+    TEST_ASSERT_EQUAL_STRING("{\"t\":1700000200,\"247/BatteryCapacity\":95}", payload);
+    InverterData stats;
+    history.emitStats(stats);
+    TEST_ASSERT_EQUAL_STRING("1", stats["History/Dropped"].c_str());
+}
+
+void test_history_one_message_per_sample() {
+    HistoryBuffer history;
+    history.begin();
+    for (uint32_t t = 1; t <= 3; t++) {
+        addSample(history, t * 30);
+    }
+
+    char payload[HISTORY_PAYLOAD_SIZE];
+    for (uint32_t t = 1; t <= 3; t++) {
+        size_t records = history.nextBatch(payload, sizeof(payload));
+        TEST_ASSERT_EQUAL(2, records);
+        TEST_ASSERT_EQUAL(T0 + t * 30, strtoul(payload + 5, NULL, 10));
+        history.commitBatch(records);
+    }
+    TEST_ASSERT_EQUAL(0, history.getBacklog());
+
+    // a small payload buffer splits a sample, nothing is lost
+    addSample(history, 200);
+    TEST_ASSERT_EQUAL(1, history.nextBatch(payload, 32));
+    TEST_ASSERT_EQUAL_STRING("{\"t\":1700000200,\"Etoday\":12.5}", payload);
+    history.commitBatch(1);
+    TEST_ASSERT_EQUAL(1, history.nextBatch(payload, 32));
+    TEST_ASSERT_EQUAL_STRING("{\"t\":1700000200,\"SOC\":80}", payload);
+}
+
+void test_history_ring_drops_oldest_segment() {
+    HistoryBuffer history;
+    history.begin();
+
+    const uint32_t capacity = HISTORY_SEGMENTS * HISTORY_SEGMENT_RECORDS;
+    const uint32_t samples = capacity;  // twice the ring, two records each
+    for (uint32_t t = 0; t < samples; t++) {
+        addSample(history, t);
+    }
+
+    TEST_ASSERT_TRUE(history.getBacklog() <= capacity);
+    TEST_ASSERT_TRUE(history.getBacklog() > capacity - HISTORY_SEGMENT_RECORDS);
+    TEST_ASSERT_TRUE(SPIFFS.files.size() <= HISTORY_SEGMENTS);
+
+    // the oldest samples are gone, the newest are kept
+    char payload[HISTORY_PAYLOAD_SIZE];
+    history.nextBatch(payload, sizeof(payload));
+    TEST_ASSERT_TRUE(strtoul(payload + 5, NULL, 10) >= T0 + samples - capacity / 2);
+
+    InverterData stats;
+    history.emitStats(stats);
+    TEST_ASSERT_EQUAL(samples * 2, history.getBacklog() + stats["History/Dropped"].toInt());
+    TEST_ASSERT_EQUAL(capacity, stats["History/Capacity"].toInt());
+
+    // appends only, every record is written once
+    TEST_ASSERT_TRUE(SPIFFS.bytesWritten == samples * 2 * sizeof(HistoryRecord));
+}
+
+void test_history_survives_reboot() {
+    {
+        HistoryBuffer history;
+        history.begin();
+        for (uint32_t t = 0; t < HISTORY_SEGMENT_RECORDS; t++) {
+            addSample(history, t);
+        }
+        char payload[HISTORY_PAYLOAD_SIZE];
+        history.commitBatch(history.nextBatch(payload, sizeof(payload)));
+    }
+
+    HistoryBuffer history;
+    history.begin();
+    // the replayed part of the oldest segment comes back, nothing else does
+    TEST_ASSERT_EQUAL(HISTORY_SEGMENT_RECORDS * 2, history.getBacklog());
+
+    addSample(history, 1000);
+    TEST_ASSERT_EQUAL(HISTORY_SEGMENT_RECORDS * 2 + 2, history.getBacklog());
+
+    char payload[HISTORY_PAYLOAD_SIZE];
+    size_t records;
+    String last;
+    while ((records = history.nextBatch(payload, sizeof(payload))) > 0) {
+        history.commitBatch(records);
+        last = payload;
+    }
+    TEST_ASSERT_EQUAL(0, history.getBacklog());
+    TEST_ASSERT_EQUAL_STRING("{\"t\":1700001000,\"Etoday\":12.5,\"SOC\":80}", last.c_str());
+    TEST_ASSERT_EQUAL(0, SPIFFS.files.size());
+}
+
+void test_history_full_flash_is_counted() {
+    SPIFFS.totalBytes = 3 * sizeof(HistoryRecord);
+    HistoryBuffer history;
+    history.begin();
+
+    addSample(history, 1);
+    addSample(history, 2);
+    TEST_ASSERT_EQUAL(3, history.getBacklog());
+
+    InverterData stats;
+    history.emitStats(stats);
+    TEST_ASSERT_EQUAL_STRING("1", stats["History/WriteErrors"].c_str());
+    TEST_ASSERT_EQUAL_STRING("1", stats["History/Dropped"].c_str());
+
+    // the records that made it are replayed
+    char payload[HISTORY_PAYLOAD_SIZE];
+    size_t records;
+    uint32_t total = 0;
+    while ((records = history.nextBatch(payload, sizeof(payload))) > 0) {
+        history.commitBatch(records);
+        total += records;
+    }
+    TEST_ASSERT_EQUAL(3, total);
+}
+
+void test_history_missing_segment_is_skipped() {
+    HistoryBuffer history;
+    history.begin();
+    // two full segments and one more sample
+    for (uint32_t t = 0; t <= HISTORY_SEGMENT_RECORDS; t++) {
+        addSample(history, t);
+    }
+    TEST_ASSERT_EQUAL(3, SPIFFS.files.size());
+    SPIFFS.remove(HISTORY_DIR "1");
+    SPIFFS.remove(HISTORY_DIR "2");
+
+    char payload[HISTORY_PAYLOAD_SIZE];
+    size_t records;
+    uint32_t total = 0;
+    for (int i = 0; i < 1000 && (records = history.nextBatch(payload, sizeof(payload))) > 0; i++) {
+        history.commitBatch(records);
+        total += records;
+    }
+    TEST_ASSERT_EQUAL(HISTORY_SEGMENT_RECORDS, total);
+    TEST_ASSERT_EQUAL(0, history.getBacklog());
+
+    InverterData stats;
+    history.emitStats(stats);
+    TEST_ASSERT_EQUAL(HISTORY_SEGMENT_RECORDS + 2, stats["History/Dropped"].toInt());
+
+    // and the next sample goes out
+    addSample(history, 1000);
+    TEST_ASSERT_EQUAL(2, history.nextBatch(payload, sizeof(payload)));
+}
+
+void test_history_gets_the_wall_clock_time_at_the_replay() {
+    // left from a boot without a clock
+    {
+        HistoryBuffer history;
+        history.begin();
+        delay(5000);
+        history.beginSample(5);
+        history.emit("Etoday", 1.5f);
+        history.endSample();
+    }
+
+    HistoryBuffer history;
+    history.begin();
+    delay(1000);
+    unsigned long polledAt = millis();
+    history.beginSample(polledAt / 1000);
+    history.emit("Etoday", 2.5f);
+    history.endSample();
+    delay(2000);
+    history.beginSample(millis() / 1000);
+    history.emit("Etoday", 3.5f);
+    history.endSample();
+
+    char payload[HISTORY_PAYLOAD_SIZE];
+    // no clock yet, seconds from boot
+    TEST_ASSERT_EQUAL(1, history.nextBatch(payload, sizeof(payload)));
+    TEST_ASSERT_TRUE(strncmp(payload, "{\"t_boot\":", 10) == 0);
+
+    // the earlier boot stays from boot, this one is converted
+    WallClock::setTime((uint64_t) T0 * 1000);
+    unsigned long syncedAt = millis();
+    history.commitBatch(history.nextBatch(payload, sizeof(payload)));
+    TEST_ASSERT_TRUE(strncmp(payload, "{\"t_boot\":", 10) == 0);
+    TEST_ASSERT_TRUE(strstr(payload, "\"Etoday\":1.5") != NULL);
+
+    char expected[64];
+    snprintf(expected, sizeof(expected), "{\"t\":%lu,\"Etoday\":2.5}", (unsigned long) (T0 - (syncedAt - polledAt) / 1000));
+    history.commitBatch(history.nextBatch(payload, sizeof(payload)));
+    TEST_ASSERT_EQUAL_STRING(expected, payload);
+    snprintf(expected, sizeof(expected), "{\"t\":%lu,\"Etoday\":3.5}", (unsigned long) (T0 - (syncedAt - polledAt - 2000) / 1000));
+    history.commitBatch(history.nextBatch(payload, sizeof(payload)));
+    TEST_ASSERT_EQUAL_STRING(expected, payload);
+    TEST_ASSERT_EQUAL(0, history.getBacklog());
+}
+
+void test_history_from_multi_inverter_to_mqtt() {
+    seedGrowatt(1);
+    seedGrowatt(2);
+    MultiGrowattInverter inverter(&serial, false, { 1, 2 }, true, false, new HistoryGrowattFactory());
+    HistoryBuffer history;
+    history.begin();
+
+    // broker down: two polls go to the history
+    for (uint32_t t = 0; t < 2; t++) {
+        inverter.read();
+        history.beginSample(T0 + t);
+        inverter.emitData(history, true);
+        history.endSample();
+    }
+
+    WiFiClient client;
+    MqttPublisher mqtt(client, "", "", "energy/test", "127.0.0.1");
+    mqttLoopUntilConnected(mqtt);
+    MqttBroker.published.clear();
+
+    char payload[HISTORY_PAYLOAD_SIZE];
+    size_t records;
+    while ((records = history.nextBatch(payload, sizeof(payload))) > 0) {
+        TEST_ASSERT_TRUE(mqtt.publishHistory(payload));
+        history.commitBatch(records);
+    }
+
+    TEST_ASSERT_EQUAL(2, MqttBroker.published.size());
+    TEST_ASSERT_EQUAL_STRING("energy/test/history", MqttBroker.published[0].topic.c_str());
+    // the first poll of each inverter only read the PV block, no Vpv1: it is not a history field
+    TEST_ASSERT_TRUE(MqttBroker.published[0].payload.startsWith("{\"t\":1700000000,\"1/Ppv1\":1475.5,\"1/Ppv2\":0,\"1/Pac\":0"));
+    TEST_ASSERT_EQUAL(-1, MqttBroker.published[0].payload.indexOf("Vpv1"));
+    TEST_ASSERT_TRUE(MqttBroker.published[1].payload.startsWith("{\"t\":1700000001,\"2/Ppv1\":1475.5"));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_history_keeps_numeric_history_fields);
+    RUN_TEST(test_history_one_message_per_sample);
+    RUN_TEST(test_history_ring_drops_oldest_segment);
+    RUN_TEST(test_history_survives_reboot);
+    RUN_TEST(test_history_full_flash_is_counted);
+    RUN_TEST(test_history_missing_segment_is_skipped);
+    RUN_TEST(test_history_gets_the_wall_clock_time_at_the_replay);
+    RUN_TEST(test_history_from_multi_inverter_to_mqtt);
+
+    return UNITY_END();
+}
@@ -0,0 +1,280 @@
+/*
+  test_main.cpp - WebSocket live stream: the handshake, the first full frame and
+  the deltas, values straight from the Growatt and Soyosource decoders, a slow
+  client that drops frames and resyncs or stalls, control frames and a client
+  too many
+  pio test -e native -f test_live
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <unity.h>
+#include <string>
+#include <MemoryStream.h>
+#include <MqttWireClient.h>
+
+#include "LiveServer.h"
+#include "InverterData.h"
+#include "growatt/GrowattInverter.h"
+#include "soyosource/SoyosourceGTNInverter.h"
+
+static MemoryStream serial;
+
+// a browser with its own TCP send buffer
+class LiveWireClient : public MqttWireClient {
+    public:
+        int space = 2 * 1460;
+        virtual int availableForWrite() { return space; }
+};
+
+void setUp() {
+    ModbusBus.reset();
+    serial.clear();
+}
+
+void tearDown() {
+}
+
+static const char REQUEST[] =
+    "GET / HTTP/1.1\r\nHost: 192.168.4.2:81\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+
+static LiveWireClient *connectClient(LiveServer &live) {
+    LiveWireClient *client = new LiveWireClient();
+    client->open = true;
+    TEST_ASSERT_TRUE(live.addClient(client));
+    std::string request(REQUEST);
+    client->feed(std::vector<uint8_t>(request.begin(), request.end()));
+    live.loop();
+    return client;
+}
+
+// the payloads of the text frames written to the client, after the handshake reply
+static std::vector<std::string> textFrames(const std::vector<uint8_t> &tx) {
+    std::vector<std::string> frames;
+    std::string all(tx.begin(), tx.end());
+    size_t pos = all.find("\r\n\r\n");
+    pos = pos == std::string::npos ? 0 : pos + 4;
+    while (pos + 2 <= all.size()) {
+        uint8_t opcode = all[pos] & 0x0f;
+        size_t length = (uint8_t) all[pos + 1];
+        pos += 2;
+        if (length == 126) {
+            length = (uint8_t) all[pos] << 8 | (uint8_t) all[pos + 1];
+            pos += 2;
+        }
+        if (opcode == 0x1) {
+            frames.push_back(all.substr(pos, length));
+        }
+        pos += length;
+    }
+    return frames;
+}
+
+static std::vector<uint8_t> maskedFrame(uint8_t opcode, const char *payload) {
+    const uint8_t mask[] = { 0x11, 0x22, 0x33, 0x44 };
+    size_t length = strlen(payload);
+    std::vector<uint8_t> frame = { (uint8_t) (0x80 | opcode), (uint8_t) (0x80 | length), mask[0], mask[1], mask[2], mask[3] };
+    for (size_t i = 0; i < length; i++) {
+        frame.push_back(payload[i] ^ mask[i % 4]);
+    }
+    return frame;
+}
+
+void test_live_accept_key() {
+    // the example of RFC 6455
+    char accept[29];
+    LiveServer::acceptKey("dGhlIHNhbXBsZSBub25jZQ==", accept);
+    TEST_ASSERT_EQUAL_STRING("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=", accept);
+}
+
+void test_live_handshake_then_all_values_then_deltas() {
+    LiveServer live;
+    live.emit("Pac", 1234.5f);
+    live.emit("Status", "Normal");
+    live.loop();
+
+    LiveWireClient *client = connectClient(live);
+    std::string reply(client->tx.begin(), client->tx.end());
+    TEST_ASSERT_EQUAL(0, reply.find("HTTP/1.1 101 Switching Protocols\r\n"));
+    TEST_ASSERT_TRUE(reply.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != std::string::npos);
+    TEST_ASSERT_EQUAL(1, live.getClients());
+
+    std::vector<std::string> frames = textFrames(client->tx);
+    TEST_ASSERT_EQUAL(1, frames.size());
+    TEST_ASSERT_EQUAL_STRING("{\"Pac\":1234.5,\"Status\":\"Normal\"}", frames[0].c_str());
+
+    // only what changed
+    live.emit("Pac", 1234.5f);
+    live.emit("Status", "Fault \"E1\"");
+    live.emit("Vac1", 230.0f);
+    live.loop();
+    live.emit("Pac", 1000.0f);
+    live.loop();
+    // nothing at all
+    live.emit("Pac", 1000.0f);
+    live.loop();
+
+    frames = textFrames(client->tx);
+    TEST_ASSERT_EQUAL(3, frames.size());
+    TEST_ASSERT_EQUAL_STRING("{\"Status\":\"Fault \\\"E1\\\"\",\"Vac1\":230.0}", frames[1].c_str());
+    TEST_ASSERT_EQUAL_STRING("{\"Pac\":1000.0}", frames[2].c_str());
+}
+
+void test_live_growatt_blocks_as_they_are_decoded() {
+    NativeModbusSlave &inv = ModbusBus.slave(1);
+    for (uint16_t r = 0; r < 125; r++) inv.inputRegisters[r] = r * 10;
+    GrowattInverter inverter(&serial, false, 1, false, false);
+
+    LiveServer live;
+    TEST_ASSERT_TRUE(inverter.setLiveSink(&live));
+    LiveWireClient *client = connectClient(live);
+
+    // first block: status and PV, without a poll
+    inverter.read();
+    live.loop();
+    std::vector<std::string> frames = textFrames(client->tx);
+    TEST_ASSERT_EQUAL(1, frames.size());
+    TEST_ASSERT_TRUE(frames[0].find("\"Ppv1\":") != std::string::npos);
+    TEST_ASSERT_TRUE(frames[0].find("\"Pac\":") == std::string::npos);
+
+    // second block: AC
+    inverter.read();
+    live.loop();
+    frames = textFrames(client->tx);
+    TEST_ASSERT_EQUAL(2, frames.size());
+    TEST_ASSERT_TRUE(frames[1].find("\"Pac\":") != std::string::npos);
+
+    // a failed read sends nothing
+    ModbusBus.failNext(ModbusMaster::ku8MBResponseTimedOut);
+    inverter.read();
+    live.loop();
+    TEST_ASSERT_EQUAL(2, textFrames(client->tx).size());
+}
+
+void test_live_soyosource_frames_as_they_are_parsed() {
+    static const uint8_t status[] = { 0xA6, 0x00, 0x00, 0xD1, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFB, 0x64, 0x02, 0x0D, 0xBE };
+    SoyosourceGTNInverter inverter(&serial, false);
+
+    LiveServer live;
+    TEST_ASSERT_TRUE(inverter.setLiveSink(&live));
+    LiveWireClient *client = connectClient(live);
+
+    serial.feed(status, sizeof(status));
+    inverter.loop();
+    live.loop();
+
+    std::vector<std::string> frames = textFrames(client->tx);
+    TEST_ASSERT_EQUAL(1, frames.size());
+    TEST_ASSERT_TRUE(frames[0].find("\"Vac\":251") != std::string::npos);
+    // the poll still gets the frame
+    TEST_ASSERT_TRUE(inverter.isDataValid());
+}
+
+void test_live_slow_client_drops_and_resyncs() {
+    LiveServer live;
+    LiveWireClient *client = connectClient(live);
+    size_t sent = client->tx.size();
+
+    // the browser stops reading
+    client->space = 0;
+    char name[8];
+    for (int i = 0; i < 200; i++) {
+        snprintf(name, sizeof(name), "F%d", i % 20);
+        live.emit(name, (uint32_t) i);
+        live.loop();
+        delay(10);
+    }
+    TEST_ASSERT_EQUAL(sent, client->tx.size());
+
+    InverterData stats;
+    live.emitStats(stats);
+    TEST_ASSERT_TRUE(atoi(stats["Live/Dropped"].c_str()) > 0);
+    TEST_ASSERT_EQUAL_STRING("1", stats["Live/Clients"].c_str());
+
+    // it reads again: the queue, then every value as it is now
+    client->space = 2 * 1460;
+    for (int i = 0; i < 10; i++) {
+        live.loop();
+    }
+    std::vector<std::string> frames = textFrames(client->tx);
+    std::string last = frames.back();
+    TEST_ASSERT_TRUE(last.find("\"F0\":180") != std::string::npos);
+    TEST_ASSERT_TRUE(last.find("\"F19\":199") != std::string::npos);
+}
+
+void test_live_stalled_client_is_closed() {
+    LiveServer live;
+    LiveWireClient *client = connectClient(live);
+    client->space = 0;
+
+    live.emit("Pac", 1.0f);
+    live.loop();
+    delay(LIVE_STALL_MILLIS + 10);
+    live.loop();
+
+    InverterData stats;
+    live.emitStats(stats);
+    TEST_ASSERT_EQUAL_STRING("1", stats["Live/Stalled"].c_str());
+    TEST_ASSERT_EQUAL(0, live.getClients());
+
+    // the slot is free again
+    connectClient(live);
+    TEST_ASSERT_EQUAL(1, live.getClients());
+}
+
+void test_live_ping_and_close() {
+    LiveServer live;
+    LiveWireClient *client = connectClient(live);
+    client->tx.clear();
+
+    client->feed(maskedFrame(0x9, "hi"));
+    live.loop();
+    const uint8_t pong[] = { 0x8a, 0x02, 'h', 'i' };
+    TEST_ASSERT_EQUAL(sizeof(pong), client->tx.size());
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(pong, client->tx.data(), sizeof(pong));
+
+    client->feed(maskedFrame(0x8, ""));
+    live.loop();
+    TEST_ASSERT_EQUAL(0, live.getClients());
+}
+
+void test_live_bad_request_and_a_client_too_many() {
+    LiveServer live;
+
+    // no key
+    LiveWireClient *bad = new LiveWireClient();
+    bad->open = true;
+    TEST_ASSERT_TRUE(live.addClient(bad));
+    bad->feed({ 'G', 'E', 'T', ' ', '/', '\r', '\n', '\r', '\n' });
+    live.loop();
+    TEST_ASSERT_EQUAL(0, live.getClients());
+
+    for (int i = 0; i < LIVE_MAX_CLIENTS; i++) {
+        connectClient(live);
+    }
+    LiveWireClient *extra = new LiveWireClient();
+    extra->open = true;
+    TEST_ASSERT_FALSE(live.addClient(extra));
+
+    InverterData stats;
+    live.emitStats(stats);
+    TEST_ASSERT_EQUAL_STRING("1", stats["Live/Rejected"].c_str());
+    TEST_ASSERT_EQUAL(LIVE_MAX_CLIENTS, live.getClients());
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_live_accept_key);
+    RUN_TEST(test_live_handshake_then_all_values_then_deltas);
+    RUN_TEST(test_live_growatt_blocks_as_they_are_decoded);
+    RUN_TEST(test_live_soyosource_frames_as_they_are_parsed);
+    RUN_TEST(test_live_slow_client_drops_and_resyncs);
+    RUN_TEST(test_live_stalled_client_is_closed);
+    RUN_TEST(test_live_ping_and_close);
+    RUN_TEST(test_live_bad_request_and_a_client_too_many);
+
+    return UNITY_END();
+}
@@ -0,0 +1,170 @@
+/*
+  test_main.cpp - Prometheus /metrics page: the rendered text, the shared bus
+  label, the ETag, a full buffer and the Modbus counters of the Growatt driver
+  pio test -e native -f test_metrics
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <unity.h>
+#include <MemoryStream.h>
+
+#include "MetricsPage.h"
+#include "growatt/GrowattInverter.h"
+#include "growatt/MultiGrowattInverter.h"
+
+static MemoryStream serial;
+
+void setUp() {
+    ModbusBus.reset();
+    serial.clear();
+}
+
+void tearDown() {
+}
+
+class MetricsGrowattFactory : public MultiGrowattInverterInnerFactory {
+    public:
+        virtual Inverter *createInverter(Stream *serial, int modbusAddress, bool enableRemoteCommands, bool isTL) {
+            return new GrowattInverter(serial, false, modbusAddress, enableRemoteCommands, isTL);
+        }
+};
+
+void test_metrics_page_text() {
+    MetricsPage metrics;
+    metrics.begin();
+    TEST_ASSERT_EQUAL(0, metrics.getLength());
+
+    InverterData values;
+    values.set("Pac", 1234.5f);
+    values.set("Status", "Normal");
+    values.set("Etotal", (uint32_t) 100);
+    InverterData tele;
+    tele.set("Modbus/Errors", (uint32_t) 3);
+    tele.set("Uptime", "1 day");
+    metrics.render(values, tele);
+
+    TEST_ASSERT_EQUAL_STRING(
+        "# HELP inverter_value Inverter values of the last polls\n# TYPE inverter_value gauge\n"
+        "inverter_value{field=\"Etotal\"} 100\n"
+        "inverter_value{field=\"Pac\"} 1234.5\n"
+        "# HELP inverter_tele Device statistics, as in the tele topics\n# TYPE inverter_tele gauge\n"
+        "inverter_tele{name=\"Modbus/Errors\"} 3\n"
+        "# TYPE inverter_metrics_dropped gauge\ninverter_metrics_dropped 0\n",
+        metrics.getText());
+    TEST_ASSERT_EQUAL(strlen(metrics.getText()), metrics.getLength());
+    TEST_ASSERT_EQUAL(1, metrics.getRenders());
+}
+
+void test_metrics_shared_bus_address_label() {
+    MetricsPage metrics;
+    metrics.begin();
+
+    InverterData values;
+    values.set("1/Pac", 10.0f);
+    values.set("22/Pac", 20.0f);
+    InverterData tele;
+    metrics.render(values, tele);
+
+    TEST_ASSERT_NOT_NULL(strstr(metrics.getText(), "inverter_value{addr=\"1\",field=\"Pac\"} 10.0\n"));
+    TEST_ASSERT_NOT_NULL(strstr(metrics.getText(), "inverter_value{addr=\"22\",field=\"Pac\"} 20.0\n"));
+}
+
+void test_metrics_etag() {
+    MetricsPage metrics;
+    metrics.begin();
+    InverterData values;
+    InverterData tele;
+    values.set("Pac", 1.0f);
+    metrics.render(values, tele);
+    String first = metrics.getETag();
+    TEST_ASSERT_EQUAL(10, first.length());
+
+    // same page, same tag
+    metrics.render(values, tele);
+    TEST_ASSERT_EQUAL_STRING(first.c_str(), metrics.getETag());
+    TEST_ASSERT_TRUE(metrics.matches(first.c_str()));
+    TEST_ASSERT_TRUE(metrics.matches(("\"x\", " + first).c_str()));
+    TEST_ASSERT_TRUE(metrics.matches("*"));
+    TEST_ASSERT_FALSE(metrics.matches(""));
+    TEST_ASSERT_FALSE(metrics.matches(NULL));
+
+    values.set("Pac", 2.0f);
+    metrics.render(values, tele);
+    TEST_ASSERT_FALSE(metrics.matches(first.c_str()));
+}
+
+void test_metrics_full_buffer_keeps_whole_lines() {
+    MetricsPage metrics;
+    metrics.begin();
+
+    InverterData values;
+    char name[16];
+    for (int i = 0; i < 500; i++) {
+        snprintf(name, sizeof(name), "Field%03d", i);
+        values.set(name, (uint32_t) i);
+    }
+    InverterData tele;
+    metrics.render(values, tele);
+
+    TEST_ASSERT_TRUE(metrics.getDropped() > 0);
+    TEST_ASSERT_TRUE(metrics.getLength() < METRICS_BUFFER_SIZE);
+    TEST_ASSERT_EQUAL('\n', metrics.getText()[metrics.getLength() - 1]);
+    char last[64];
+    snprintf(last, sizeof(last), "inverter_metrics_dropped %u\n", (unsigned) metrics.getDropped());
+    TEST_ASSERT_NOT_NULL(strstr(metrics.getText(), last));
+}
+
+void test_metrics_growatt_modbus_counters() {
+    NativeModbusSlave &inv = ModbusBus.slave(1);
+    for (uint16_t r = 0; r < 125; r++) inv.inputRegisters[r] = r;
+    GrowattInverter inverter(&serial, false, 1, false, false);
+
+    inverter.read();
+    ModbusBus.failNext(ModbusMaster::ku8MBResponseTimedOut);
+    inverter.read();
+    ModbusBus.failNext(ModbusMaster::ku8MBInvalidCRC);
+    inverter.read();
+
+    InverterData tele;
+    inverter.emitStats(tele);
+    TEST_ASSERT_EQUAL_STRING("3", tele["Modbus/Requests"].c_str());
+    TEST_ASSERT_EQUAL_STRING("2", tele["Modbus/Errors"].c_str());
+    TEST_ASSERT_EQUAL_STRING("1", tele["Modbus/Timeouts"].c_str());
+    TEST_ASSERT_EQUAL_STRING("227", tele["Modbus/LastError"].c_str());
+
+    MetricsPage metrics;
+    metrics.begin();
+    InverterData values;
+    inverter.emitData(values);
+    metrics.render(values, tele);
+    TEST_ASSERT_NOT_NULL(strstr(metrics.getText(), "inverter_tele{name=\"Modbus/Requests\"} 3\n"));
+}
+
+void test_metrics_multi_growatt_counters_per_address() {
+    ModbusBus.slave(1);
+    ModbusBus.slave(2);
+    MultiGrowattInverter inverter(&serial, false, { 1, 2 }, false, false, new MetricsGrowattFactory());
+
+    inverter.read();
+    inverter.read();
+
+    InverterData tele;
+    inverter.emitStats(tele);
+    TEST_ASSERT_EQUAL_STRING("1", tele["1/Modbus/Requests"].c_str());
+    TEST_ASSERT_EQUAL_STRING("1", tele["2/Modbus/Requests"].c_str());
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_metrics_page_text);
+    RUN_TEST(test_metrics_shared_bus_address_label);
+    RUN_TEST(test_metrics_etag);
+    RUN_TEST(test_metrics_full_buffer_keeps_whole_lines);
+    RUN_TEST(test_metrics_growatt_modbus_counters);
+    RUN_TEST(test_metrics_multi_growatt_counters_per_address);
+
+    return UNITY_END();
+}
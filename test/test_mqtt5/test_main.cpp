@@ -0,0 +1,232 @@
+/*
+  test_main.cpp - MQTT 5 client: CONNECT and CONNACK, topic aliases, incoming
+  messages, the fallback to 3.1.1 and the bytes of a poll in both protocols
+  pio test -e native -f test_mqtt5 -v
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <unity.h>
+#include <MemoryStream.h>
+#include <MqttWireClient.h>
+#include <MqttLoop.h>
+
+#include "Mqtt5Client.h"
+#include "MqttPublisher.h"
+#include "growatt/GrowattInverter.h"
+
+static MemoryStream serial;
+
+void setUp() {
+    ModbusBus.reset();
+    MqttBroker.reset();
+    serial.clear();
+    Network.tcpConnects = 0;
+}
+
+void tearDown() {
+}
+
+// CONNACK, success, with a Topic Alias Maximum property
+static void feedConnack(MqttWireClient &wire, uint16_t aliasMax) {
+    wire.feed({ 0x20, 0x06, 0x00, 0x00, 0x03, 0x22, (uint8_t) (aliasMax >> 8), (uint8_t) (aliasMax & 0xff) });
+}
+
+static String lastTopic;
+static String lastPayload;
+
+static void callback(char *topic, uint8_t *payload, unsigned int length) {
+    lastTopic = topic;
+    lastPayload = String((const char *) payload, length);
+}
+
+void test_mqtt5_connect_packet() {
+    MqttWireClient wire;
+    wire.connect("broker", 1883);
+    feedConnack(wire, 10);
+
+    Mqtt5Client client(wire);
+    TEST_ASSERT_TRUE(client.connect("id", "user", "pass", "t/online", 1, true, "false"));
+    TEST_ASSERT_EQUAL(MQTT_CONNECTED, client.state());
+    TEST_ASSERT_EQUAL(10, client.getTopicAliasMax());
+
+    std::vector<MqttWirePacket> packets = wire.packets();
+    TEST_ASSERT_EQUAL(1, packets.size());
+    TEST_ASSERT_EQUAL_HEX8(0x10, packets[0].header);
+    const uint8_t head[] = { 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x05, 0xee, 0x00, MQTT5_KEEPALIVE_SECONDS, 0x00, 0x00, 0x02, 'i', 'd', 0x00 };
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(head, packets[0].body.data(), sizeof(head));
+    TEST_ASSERT_EQUAL(packets[0].size, wire.tx.size());
+}
+
+void test_mqtt5_topic_alias_after_first_publish() {
+    MqttWireClient wire;
+    wire.connect("broker", 1883);
+    feedConnack(wire, 2);
+    Mqtt5Client client(wire);
+    TEST_ASSERT_TRUE(client.connect("id", NULL, NULL, NULL, 0, false, NULL));
+    wire.tx.clear();
+
+    TEST_ASSERT_TRUE(client.publish("energy/growatt/22/EpsPac3", "1234.5"));
+    TEST_ASSERT_TRUE(client.publish("energy/growatt/22/EpsPac3", "1234.6"));
+    TEST_ASSERT_TRUE(client.publish("energy/growatt/22/Etoday", "7.1"));
+    // the broker granted two aliases
+    TEST_ASSERT_TRUE(client.publish("energy/growatt/22/Etotal", "100.2"));
+    TEST_ASSERT_TRUE(client.publish("energy/growatt/22/Etoday", "7.2"));
+
+    std::vector<MqttWirePublish> pubs = wire.publishes();
+    TEST_ASSERT_EQUAL(5, pubs.size());
+    TEST_ASSERT_EQUAL_STRING("energy/growatt/22/EpsPac3", pubs[0].topic.c_str());
+    TEST_ASSERT_EQUAL(1, pubs[0].alias);
+    TEST_ASSERT_EQUAL_STRING("", pubs[1].topic.c_str());
+    TEST_ASSERT_EQUAL(1, pubs[1].alias);
+    TEST_ASSERT_EQUAL_STRING("1234.6", pubs[1].payload.c_str());
+    TEST_ASSERT_EQUAL(2, pubs[2].alias);
+    TEST_ASSERT_EQUAL_STRING("energy/growatt/22/Etotal", pubs[3].topic.c_str());
+    TEST_ASSERT_EQUAL(0, pubs[3].alias);
+    TEST_ASSERT_EQUAL_STRING("", pubs[4].topic.c_str());
+    TEST_ASSERT_EQUAL(2, pubs[4].alias);
+
+    // header, length, empty topic, alias property and payload
+    TEST_ASSERT_EQUAL(2 + 2 + 4 + 6, pubs[1].size);
+    TEST_ASSERT_EQUAL(wire.tx.size(), client.getPublishBytes());
+
+    // aliases are per connection
+    wire.stop();
+    wire.connect("broker", 1883);
+    feedConnack(wire, 2);
+    TEST_ASSERT_TRUE(client.connect("id", NULL, NULL, NULL, 0, false, NULL));
+    wire.tx.clear();
+    TEST_ASSERT_TRUE(client.publish("energy/growatt/22/EpsPac3", "1"));
+    TEST_ASSERT_EQUAL_STRING("energy/growatt/22/EpsPac3", wire.publishes()[0].topic.c_str());
+}
+
+void test_mqtt5_no_aliases_without_the_property() {
+    MqttWireClient wire;
+    wire.connect("broker", 1883);
+    wire.feed({ 0x20, 0x03, 0x00, 0x00, 0x00 });
+    Mqtt5Client client(wire);
+    TEST_ASSERT_TRUE(client.connect("id", NULL, NULL, NULL, 0, false, NULL));
+    wire.tx.clear();
+
+    client.publish("energy/growatt/Pac", "1");
+    client.publish("energy/growatt/Pac", "2");
+    std::vector<MqttWirePublish> pubs = wire.publishes();
+    TEST_ASSERT_EQUAL_STRING("energy/growatt/Pac", pubs[1].topic.c_str());
+    TEST_ASSERT_EQUAL(0, pubs[1].alias);
+}
+
+void test_mqtt5_incoming_publish() {
+    MqttWireClient wire;
+    wire.connect("broker", 1883);
+    feedConnack(wire, 0);
+    Mqtt5Client client(wire);
+    client.setCallback(callback);
+    TEST_ASSERT_TRUE(client.connect("id", NULL, NULL, NULL, 0, false, NULL));
+    TEST_ASSERT_TRUE(client.subscribe("e/settings/led"));
+    TEST_ASSERT_EQUAL_HEX8(0x82, wire.packets().back().header);
+
+    // with a user property the client skips
+    wire.feed({ 0x30, 0x18, 0x00, 0x0e, 'e', '/', 's', 'e', 't', 't', 'i', 'n', 'g', 's', '/', 'l', 'e', 'd',
+        0x06, 0x26, 0x00, 0x01, 'k', 0x00, 0x00, '1' });
+    TEST_ASSERT_TRUE(client.loop());
+    TEST_ASSERT_EQUAL_STRING("e/settings/led", lastTopic.c_str());
+    TEST_ASSERT_EQUAL_STRING("1", lastPayload.c_str());
+
+    // the broker goes away
+    wire.feed({ 0xe0, 0x00 });
+    TEST_ASSERT_FALSE(client.loop());
+    TEST_ASSERT_FALSE(client.connected());
+}
+
+void test_mqtt5_bad_credentials() {
+    MqttWireClient wire;
+    wire.connect("broker", 1883);
+    wire.feed({ 0x20, 0x03, 0x00, 0x86, 0x00 });
+    Mqtt5Client client(wire);
+    TEST_ASSERT_FALSE(client.connect("id", "user", "wrong", NULL, 0, false, NULL));
+    TEST_ASSERT_EQUAL(MQTT_CONNECT_BAD_CREDENTIALS, client.state());
+    TEST_ASSERT_FALSE(wire.open);
+}
+
+void test_mqtt5_opens_the_connection_when_not_open() {
+    MqttWireClient wire;
+    Mqtt5Client client(wire);
+    // nowhere to connect to
+    TEST_ASSERT_FALSE(client.connect("id", NULL, NULL, NULL, 0, false, NULL));
+    TEST_ASSERT_FALSE(wire.open);
+
+    client.setServer("broker", 1883);
+    feedConnack(wire, 10);
+    TEST_ASSERT_TRUE(client.connect("id", NULL, NULL, NULL, 0, false, NULL));
+    TEST_ASSERT_TRUE(wire.open);
+}
+
+void test_mqtt5_falls_back_to_311() {
+    MqttWireClient wire;
+    // a 3.1.1 broker: return code 1, unacceptable protocol version
+    wire.onConnect = [](MqttWireClient &w) { w.feed({ 0x20, 0x02, 0x00, 0x01 }); };
+
+    MqttPublisher mqtt(wire, "", "", "energy/test", "127.0.0.1", 1883, true);
+    mqtt.addSubscription("settings/led");
+    TEST_ASSERT_EQUAL(MQTT_PROTOCOL_LEVEL_5, mqtt.getProtocolLevel());
+
+    TEST_ASSERT_TRUE(mqttLoopUntilConnected(mqtt) > 0);
+    TEST_ASSERT_EQUAL(MQTT_PROTOCOL_LEVEL_311, mqtt.getProtocolLevel());
+    TEST_ASSERT_EQUAL(2, Network.tcpConnects);
+    mqttLoopUntilSent(mqtt);
+
+    // the fallback is not a failure and the 3.1.1 client has everything set up
+    TEST_ASSERT_EQUAL_STRING("0", MqttBroker.lastPayload("energy/test/tele/Mqtt/FailedConnects")->c_str());
+    TEST_ASSERT_EQUAL_STRING("3.1.1", MqttBroker.lastPayload("energy/test/tele/Mqtt/Protocol")->c_str());
+    TEST_ASSERT_EQUAL(1, MqttBroker.subscriptions.size());
+}
+
+// both protocols, two polls of a Growatt SPH TL with the full set, bytes of the second one
+static uint32_t growattPollBytes(bool mqtt5) {
+    NativeModbusSlave &inv = ModbusBus.slave(1);
+    for (uint16_t r = 0; r < 125; r++) inv.inputRegisters[r] = r * 10;
+    for (uint16_t r = 1000; r < 1125; r++) inv.inputRegisters[r] = r;
+    GrowattInverter inverter(&serial, false, 1, true, true);
+
+    MqttWireClient wire;
+    wire.onConnect = [](MqttWireClient &w) { feedConnack(w, MQTT5_TOPIC_ALIAS_MAX); };
+    MqttPublisher mqtt(wire, "", "", "energy/growatt", "127.0.0.1", 1883, mqtt5);
+    TEST_ASSERT_TRUE(mqttLoopUntilConnected(mqtt) > 0);
+
+    for (int i = 0; i < 2; i++) {
+        inverter.read();
+        mqtt.beginPoll();
+        inverter.emitData(mqtt, true);
+        mqttLoopUntilSent(mqtt);
+    }
+    mqtt.beginPoll();
+    return mqtt.getPollBytes();
+}
+
+void test_mqtt5_poll_bytes_both_protocols() {
+    uint32_t bytes311 = growattPollBytes(false);
+    uint32_t bytes5 = growattPollBytes(true);
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "Growatt TL full set: MQTT 3.1.1 %u bytes/poll, MQTT 5 %u bytes/poll", (unsigned) bytes311, (unsigned) bytes5);
+    TEST_MESSAGE(msg);
+
+    TEST_ASSERT_TRUE(bytes311 > 0);
+    TEST_ASSERT_TRUE(bytes5 * 2 < bytes311);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_mqtt5_connect_packet);
+    RUN_TEST(test_mqtt5_topic_alias_after_first_publish);
+    RUN_TEST(test_mqtt5_no_aliases_without_the_property);
+    RUN_TEST(test_mqtt5_incoming_publish);
+    RUN_TEST(test_mqtt5_bad_credentials);
+    RUN_TEST(test_mqtt5_opens_the_connection_when_not_open);
+    RUN_TEST(test_mqtt5_falls_back_to_311);
+    RUN_TEST(test_mqtt5_poll_bytes_both_protocols);
+
+    return UNITY_END();
+}
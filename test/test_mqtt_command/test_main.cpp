@@ -0,0 +1,265 @@
+/*
+  test_main.cpp - MQTT command path: topic and value handling, task creation,
+  fuzz input replay with leak and allocation checks, and dispatch benchmark
+  pio test -e native -f test_mqtt_command -v
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <unity.h>
+#include <chrono>
+#include <random>
+#include <MqttCommandFuzz.h>
+
+#define FUZZ_REPLAYS 5000
+#define BENCH_MESSAGES 200000
+
+static MemoryStream serial;
+
+void setUp() {
+    ModbusBus.reset();
+    mqttCommandFuzzSetupBus();
+    serial.clear();
+}
+
+void tearDown() {
+}
+
+static const byte *bytes(const char *s) {
+    return (const byte *) s;
+}
+
+static String value(const char *payload, unsigned int length) {
+    char buffer[MQTT_COMMAND_VALUE_MAX_LEN + 1];
+    return MqttCommand::value(bytes(payload), length, buffer);
+}
+
+void test_subtopic_strips_base_topic() {
+    TEST_ASSERT_EQUAL_STRING("settings/priority", MqttCommand::subtopic("energy/growatt", "energy/growatt/settings/priority"));
+    TEST_ASSERT_EQUAL_STRING("2/settings/priority", MqttCommand::subtopic("energy/growatt", "energy/growatt/2/settings/priority"));
+    TEST_ASSERT_EQUAL_STRING("other/settings/led", MqttCommand::subtopic("energy/growatt", "other/settings/led"));
+    TEST_ASSERT_EQUAL_STRING("energy/growattx/settings/led", MqttCommand::subtopic("energy/growatt", "energy/growattx/settings/led"));
+}
+
+void test_value_truncated_and_trimmed() {
+    TEST_ASSERT_EQUAL_STRING("bat", value(" bat \r\n", 7).c_str());
+    TEST_ASSERT_EQUAL_STRING("00:00 23:59", value("00:00 23:59", 11).c_str());
+    TEST_ASSERT_EQUAL_STRING("123456789012345", value("1234567890123456789", 19).c_str());
+    // the length counts, not a terminator
+    TEST_ASSERT_EQUAL_STRING("on", value("onoff", 2).c_str());
+    TEST_ASSERT_EQUAL_STRING("", value("", 0).c_str());
+    TEST_ASSERT_EQUAL_STRING("", value("   ", 3).c_str());
+}
+
+static String dispatchAndRun(Inverter &inverter, const char *topic, const char *payload) {
+    TopicDispatcher commands;
+    mqttCommandRegister(commands, &inverter);
+    mqttCommandDispatch(commands, MQTT_FUZZ_BASE_TOPIC, topic, bytes(payload), strlen(payload));
+    inverter.read();
+    InverterData data = inverter.getData();
+    for (const auto &entry : data) {
+        if (entry.first.endsWith("/result")) {
+            return entry.first + "=" + entry.second;
+        }
+    }
+    return "";
+}
+
+void test_commands_become_tasks() {
+    GrowattInverter inverter(&serial, false, 1, true, false);
+
+    TEST_ASSERT_EQUAL_STRING("settings/priority/result=Ok",
+        dispatchAndRun(inverter, "energy/growatt/settings/priority", "bat").c_str());
+    TEST_ASSERT_EQUAL_STRING("settings/priority/bat/t1/result=Ok",
+        dispatchAndRun(inverter, "energy/growatt/settings/priority/bat/t1", "01:00 05:30").c_str());
+    TEST_ASSERT_EQUAL_STRING("settings/read_holding/result=Ok",
+        dispatchAndRun(inverter, "energy/growatt/settings/read_holding", "1070 2").c_str());
+    TEST_ASSERT_EQUAL_STRING("", dispatchAndRun(inverter, "energy/growatt/settings/nothing", "1").c_str());
+}
+
+void test_read_holding_rejects_extra_fields() {
+    GrowattInverter inverter(&serial, false, 1, true, false);
+
+    // used to write a third field past the end of the fields array
+    TEST_ASSERT_EQUAL_STRING("", dispatchAndRun(inverter, "energy/growatt/settings/read_holding", "1 2 3 4 5 6 7").c_str());
+    TEST_ASSERT_EQUAL_STRING("", dispatchAndRun(inverter, "energy/growatt/settings/read_holding", "1070").c_str());
+}
+
+void test_dispatch_table() {
+    GrowattInverter inverter(&serial, false, 1, true, false);
+    TopicDispatcher commands;
+    mqttCommandRegister(commands, &inverter);
+
+    // every subscribed topic has a route, and nothing else
+    std::list<String> topics = inverter.getTopicsToSubscribe();
+    TEST_ASSERT_EQUAL(topics.size(), commands.size());
+    for (const String &topic : topics) {
+        TEST_ASSERT_TRUE_MESSAGE(commands.dispatch(topic.c_str(), ""), topic.c_str());
+    }
+    TEST_ASSERT_FALSE(commands.dispatch("settings/priorit", "bat"));
+    TEST_ASSERT_FALSE(commands.dispatch("settings/priority/", "bat"));
+    TEST_ASSERT_FALSE(commands.dispatch("", "bat"));
+
+    // no remote commands, no routes
+    GrowattInverter readOnly(&serial, false, 1, false, false);
+    mqttCommandRegister(commands, &readOnly);
+    TEST_ASSERT_EQUAL(0, commands.size());
+    TEST_ASSERT_FALSE(commands.dispatch("settings/priority", "bat"));
+}
+
+void test_multi_routes_by_prefix() {
+    MultiGrowattInverter inverter(&serial, false, { 1, 2 }, true, false, new MqttFuzzGrowattFactory());
+    TopicDispatcher commands;
+    mqttCommandRegister(commands, &inverter);
+    TEST_ASSERT_EQUAL(inverter.getTopicsToSubscribe().size(), commands.size());
+
+    // the task for 2 runs when 2 is polled, after 1
+    TEST_ASSERT_TRUE(mqttCommandDispatch(commands, MQTT_FUZZ_BASE_TOPIC, "energy/growatt/2/settings/priority/bat/ac", bytes("on"), 2));
+    inverter.read();
+    TEST_ASSERT_EQUAL(0, inverter.getData().count("2/settings/priority/bat/ac/result"));
+    inverter.read();
+    TEST_ASSERT_EQUAL_STRING("Ok", inverter.getData()["2/settings/priority/bat/ac/result"].c_str());
+    TEST_ASSERT_EQUAL(1, ModbusBus.slave(2).holding(1092));
+
+    // no such inverter, no prefix, or no number
+    TEST_ASSERT_FALSE(mqttCommandDispatch(commands, MQTT_FUZZ_BASE_TOPIC, "energy/growatt/3/settings/priority", bytes("bat"), 3));
+    TEST_ASSERT_FALSE(mqttCommandDispatch(commands, MQTT_FUZZ_BASE_TOPIC, "energy/growatt/settings/priority", bytes("bat"), 3));
+    TEST_ASSERT_FALSE(mqttCommandDispatch(commands, MQTT_FUZZ_BASE_TOPIC, "energy/growatt/x/settings/priority", bytes("bat"), 3));
+    TEST_ASSERT_FALSE(mqttCommandDispatch(commands, MQTT_FUZZ_BASE_TOPIC, "energy/growatt/02/settings/priority", bytes("bat"), 3));
+
+    // a prefix from the caller goes in front of the address
+    TopicDispatcher nested;
+    inverter.registerCommands(nested, "9/");
+    nested.build();
+    TEST_ASSERT_EQUAL(commands.size(), nested.size());
+    TEST_ASSERT_TRUE(nested.dispatch("9/2/settings/priority", "bat"));
+    TEST_ASSERT_FALSE(nested.dispatch("2/settings/priority", "bat"));
+}
+
+void test_dispatch_without_heap() {
+    GrowattInverter inverter(&serial, false, 1, true, false);
+    TopicDispatcher commands;
+    mqttCommandRegister(commands, &inverter);
+
+    // matching, routing and value parsing, only a task allocates
+    AllocCounter allocs;
+    TEST_ASSERT_FALSE(mqttCommandDispatch(commands, MQTT_FUZZ_BASE_TOPIC, "energy/growatt/settings/unknown", bytes("1"), 1));
+    TEST_ASSERT_TRUE(mqttCommandDispatch(commands, MQTT_FUZZ_BASE_TOPIC, "energy/growatt/settings/read_holding", bytes("1 2 3"), 5));
+    TEST_ASSERT_EQUAL(0, allocs.allocationsSince());
+}
+
+void test_queued_tasks_freed_with_inverter() {
+    AllocCounter allocs;
+    {
+        GrowattInverter inverter(&serial, false, 1, true, false);
+        for (int i = 0; i < 4; i++) {
+            inverter.setIncomingTopicData("settings/priority", "grid");
+        }
+    }
+    TEST_ASSERT_EQUAL(0, allocs.liveSince());
+}
+
+void test_fuzz_replay() {
+    // valid commands, then random bytes and mutations of the valid ones
+    const char *seeds[] = {
+        "\x02settings/priority\nbat",
+        "\x02settings/priority/bat/t1\n00:00 23:59",
+        "\x02settings/priority/grid/pr\n100",
+        "\x02settings/priority/bat/ssoc\n10",
+        "\x02settings/priority/bat/ac\non",
+        "\x02settings/read_holding\n1070 49",
+        "\x03" "2/settings/priority\nload",
+        "\x03" "1/settings/read_holding\n0 64",
+    };
+    uint32_t accepted = 0;
+    for (const char *seed : seeds) {
+        accepted += mqttCommandFuzzOne(bytes(seed), strlen(seed));
+    }
+    TEST_ASSERT_EQUAL(sizeof(seeds) / sizeof(seeds[0]), accepted);
+
+    std::mt19937 rng(7);
+    for (int i = 0; i < FUZZ_REPLAYS; i++) {
+        std::vector<uint8_t> input;
+        if (i % 2 == 0) {
+            input.resize(rng() % 200);
+            for (uint8_t &b : input) b = rng();
+        } else {
+            const char *seed = seeds[rng() % (sizeof(seeds) / sizeof(seeds[0]))];
+            input.assign(seed, seed + strlen(seed));
+            for (int m = rng() % 4; m >= 0; m--) {
+                size_t at = rng() % (input.size() + 1);
+                switch (rng() % 3) {
+                    case 0: input.insert(input.begin() + at, (uint8_t) rng()); break;
+                    case 1: if (at < input.size()) input.erase(input.begin() + at); break;
+                    default: if (at < input.size()) input[at] ^= 1 << (rng() % 8); break;
+                }
+            }
+        }
+        mqttCommandFuzzOne(input.data(), input.size());
+    }
+}
+
+// dispatch only: MqttCommand + TopicDispatcher up to the queued task, in batches
+// of as many messages as the task queue takes, the tasks run outside the timed part
+#define BENCH_BATCH 4
+#define BENCH_DRAIN_READS 8
+
+static void benchDispatch(const char *name, Inverter &inverter, const char *topic, const char *payload) {
+    TopicDispatcher commands;
+    mqttCommandRegister(commands, &inverter);
+    unsigned int length = strlen(payload);
+    std::chrono::nanoseconds elapsed(0);
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+
+    for (int i = 0; i < BENCH_MESSAGES / BENCH_BATCH; i++) {
+        AllocCounter allocs;
+        auto start = std::chrono::steady_clock::now();
+        for (int m = 0; m < BENCH_BATCH; m++) {
+            mqttCommandDispatch(commands, MQTT_FUZZ_BASE_TOPIC, topic, bytes(payload), length);
+        }
+        elapsed += std::chrono::steady_clock::now() - start;
+        allocations += allocs.allocationsSince();
+        allocatedBytes += allocs.bytesSince();
+
+        for (int r = 0; r < BENCH_DRAIN_READS; r++) {
+            inverter.read();
+            inverter.getData();
+        }
+    }
+
+    int messages = BENCH_MESSAGES / BENCH_BATCH * BENCH_BATCH;
+    char msg[160];
+    snprintf(msg, sizeof(msg), "%-24s %8.0f ns/msg %6.1f allocs/msg %8.1f bytes/msg",
+        name, elapsed.count() / (double) messages, allocations / (double) messages, allocatedBytes / (double) messages);
+    TEST_MESSAGE(msg);
+}
+
+void test_bench_dispatch() {
+    GrowattInverter single(&serial, false, 1, true, false);
+    benchDispatch("priority", single, "energy/growatt/settings/priority", "bat");
+    benchDispatch("priority/bat/t1", single, "energy/growatt/settings/priority/bat/t1", "00:00 23:59");
+    benchDispatch("read_holding", single, "energy/growatt/settings/read_holding", "1070 49");
+    benchDispatch("unknown topic", single, "energy/growatt/settings/unknown", "1");
+
+    MultiGrowattInverter multi(&serial, false, { 1, 2 }, true, false, new MqttFuzzGrowattFactory());
+    benchDispatch("multi 2/priority/bat/ac", multi, "energy/growatt/2/settings/priority/bat/ac", "on");
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_subtopic_strips_base_topic);
+    RUN_TEST(test_value_truncated_and_trimmed);
+    RUN_TEST(test_commands_become_tasks);
+    RUN_TEST(test_read_holding_rejects_extra_fields);
+    RUN_TEST(test_dispatch_table);
+    RUN_TEST(test_multi_routes_by_prefix);
+    RUN_TEST(test_dispatch_without_heap);
+    RUN_TEST(test_queued_tasks_freed_with_inverter);
+    RUN_TEST(test_fuzz_replay);
+    RUN_TEST(test_bench_dispatch);
+
+    return UNITY_END();
+}
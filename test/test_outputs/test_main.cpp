@@ -0,0 +1,523 @@
+/*
+  test_main.cpp - Output pipeline: one poll fanned out to stages with their own
+  interval, filter and queue, a stage that is down without holding up the
+  others, JSON messages split to fit, the MQTT topics and JSON, the history
+  while the broker is down, the HTTP push with its replies and the InfluxDB
+  line protocol datagrams, read back from a UDP socket on 127.0.0.1
+  pio test -e native -f test_outputs
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <unity.h>
+#include <string>
+#include <FS.h>
+#include <MqttWireClient.h>
+#include <MqttLoop.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "OutputPipeline.h"
+#include "MqttOutputs.h"
+#include "HttpPushOutput.h"
+#include "InfluxUdpOutput.h"
+#include "InverterData.h"
+
+// keeps what it sends, or refuses it while down
+class RecordingStage : public OutputStage {
+    public:
+        std::vector<std::string> messages;
+        bool down = false;
+
+        RecordingStage(const char *name, size_t queueSize = 512) : OutputStage(name, queueSize) {}
+
+    protected:
+        virtual bool send(const char *key, const char *payload) {
+            if (down) return false;
+            messages.push_back(std::string(key) + "=" + payload);
+            return true;
+        }
+};
+
+class JsonRecordingStage : public JsonOutputStage {
+    public:
+        std::vector<std::string> messages;
+
+        JsonRecordingStage() : JsonOutputStage("Json", 4096, "json") {}
+
+    protected:
+        virtual bool send(const char *key, const char *payload) {
+            messages.push_back(payload);
+            return true;
+        }
+};
+
+// a server that is not there
+class RefusedWireClient : public MqttWireClient {
+    public:
+        virtual int connect(IPAddress, uint16_t) { return 0; }
+        virtual int connect(const char *, uint16_t) { return 0; }
+};
+
+// an InfluxDB UDP listener on a free local port
+class UdpListener {
+    public:
+        uint16_t port;
+
+        UdpListener() {
+            fd = socket(AF_INET, SOCK_DGRAM, 0);
+            struct sockaddr_in local = {};
+            local.sin_family = AF_INET;
+            local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            bind(fd, (struct sockaddr *) &local, sizeof(local));
+            socklen_t size = sizeof(local);
+            getsockname(fd, (struct sockaddr *) &local, &size);
+            port = ntohs(local.sin_port);
+            struct timeval timeout = { 0, 200000 };
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        }
+        ~UdpListener() { close(fd); }
+
+        // the datagrams that came, in order
+        std::vector<std::string> receive() {
+            std::vector<std::string> datagrams;
+            char buffer[65536];
+            ssize_t n;
+            while ((n = recv(fd, buffer, sizeof(buffer), 0)) >= 0) {
+                datagrams.push_back(std::string(buffer, n));
+            }
+            return datagrams;
+        }
+
+    private:
+        int fd;
+};
+
+void setUp() {
+    SPIFFS.reset();
+    MqttBroker.reset();
+}
+
+void tearDown() {
+}
+
+static void poll(OutputPipeline &outputs, time_t time) {
+    outputs.beginPoll(millis(), time);
+    outputs.emit("Pac", 1234.5f);
+    outputs.emit("Etoday", 12.5f);
+    outputs.emit("Vpv1", 351.2f);
+    outputs.emit("2/Eac", 3.0f);
+    outputs.emit("Status", "Normal");
+    outputs.endPoll();
+}
+
+static void loopFor(OutputPipeline &outputs, int calls) {
+    for (int i = 0; i < calls; i++) {
+        outputs.loop();
+        delay(10);
+    }
+}
+
+void test_outputs_interval_and_filter_per_stage() {
+    OutputPipeline outputs;
+    RecordingStage *all = new RecordingStage("All");
+    RecordingStage *energy = new RecordingStage("Energy");
+    energy->setFilter("Pac,E*");
+    energy->setInterval(10000);
+    TEST_ASSERT_TRUE(outputs.add(all));
+    TEST_ASSERT_TRUE(outputs.add(energy));
+
+    poll(outputs, 100);
+    loopFor(outputs, 5);
+    TEST_ASSERT_EQUAL(5, all->messages.size());
+    TEST_ASSERT_EQUAL(3, energy->messages.size());
+    TEST_ASSERT_EQUAL_STRING("Pac=1234.5", energy->messages[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("Etoday=12.5", energy->messages[1].c_str());
+    // the field after the address
+    TEST_ASSERT_EQUAL_STRING("2/Eac=3.0", energy->messages[2].c_str());
+
+    // too soon for the energy stage
+    delay(5000);
+    poll(outputs, 105);
+    loopFor(outputs, 5);
+    TEST_ASSERT_EQUAL(10, all->messages.size());
+    TEST_ASSERT_EQUAL(3, energy->messages.size());
+
+    delay(5000);
+    poll(outputs, 110);
+    loopFor(outputs, 5);
+    TEST_ASSERT_EQUAL(6, energy->messages.size());
+
+    InverterData stats;
+    outputs.emitStats(stats);
+    TEST_ASSERT_EQUAL_STRING("3", stats["Output/All/Polls"].c_str());
+    TEST_ASSERT_EQUAL_STRING("15", stats["Output/All/Sent"].c_str());
+    TEST_ASSERT_EQUAL_STRING("2", stats["Output/Energy/Polls"].c_str());
+    TEST_ASSERT_EQUAL_STRING("1", stats["Output/Energy/Skipped"].c_str());
+    TEST_ASSERT_EQUAL_STRING("0", stats["Output/Energy/Queue"].c_str());
+}
+
+void test_outputs_stage_down_does_not_hold_up_the_others() {
+    OutputPipeline outputs;
+    RecordingStage *down = new RecordingStage("Down", 128);
+    RecordingStage *up = new RecordingStage("Up");
+    down->down = true;
+    outputs.add(down);
+    outputs.add(up);
+
+    for (int i = 0; i < 4; i++) {
+        poll(outputs, i);
+        loopFor(outputs, 3);
+    }
+    TEST_ASSERT_EQUAL(20, up->messages.size());
+    TEST_ASSERT_EQUAL(0, down->messages.size());
+
+    InverterData stats;
+    outputs.emitStats(stats);
+    // one try, then it waits for OUTPUT_RETRY_MILLIS
+    TEST_ASSERT_EQUAL_STRING("1", stats["Output/Down/Failed"].c_str());
+    TEST_ASSERT_TRUE(atoi(stats["Output/Down/Dropped"].c_str()) > 0);
+    TEST_ASSERT_EQUAL_STRING("0", stats["Output/Up/Dropped"].c_str());
+
+    // back up: what it kept goes out, oldest first
+    down->down = false;
+    delay(OUTPUT_RETRY_MILLIS);
+    loopFor(outputs, 10);
+    TEST_ASSERT_EQUAL(0, down->getQueueDepth());
+    TEST_ASSERT_TRUE(down->messages.size() > 0);
+    TEST_ASSERT_EQUAL_STRING("Pac=1234.5", down->messages[0].c_str());
+}
+
+void test_outputs_failing_message_backs_off_then_dropped() {
+    OutputPipeline outputs;
+    RecordingStage *down = new RecordingStage("Down");
+    down->down = true;
+    outputs.add(down);
+
+    poll(outputs, 1);
+    size_t queued = down->getQueueDepth();
+    outputs.loop();
+
+    // 5s, 10s, 20s, 40s between the tries
+    unsigned long wait = OUTPUT_RETRY_MILLIS;
+    for (int attempt = 2; attempt <= OUTPUT_MAX_ATTEMPTS; attempt++) {
+        delay(wait - 1);
+        outputs.loop();
+        InverterData stats;
+        outputs.emitStats(stats);
+        TEST_ASSERT_EQUAL(attempt - 1, stats["Output/Down/Failed"].toInt());
+        delay(1);
+        outputs.loop();
+        wait *= 2;
+    }
+
+    // the head is gone, the next one has its own tries
+    TEST_ASSERT_EQUAL(queued - 1, down->getQueueDepth());
+    InverterData stats;
+    outputs.emitStats(stats);
+    TEST_ASSERT_EQUAL(OUTPUT_MAX_ATTEMPTS, stats["Output/Down/Failed"].toInt());
+    TEST_ASSERT_EQUAL_STRING("1", stats["Output/Down/Dropped"].c_str());
+
+    // back up: the wait is still on, then the rest goes
+    down->down = false;
+    delay(wait);
+    loopFor(outputs, 10);
+    TEST_ASSERT_EQUAL(0, down->getQueueDepth());
+    TEST_ASSERT_EQUAL(queued - 1, down->messages.size());
+}
+
+void test_outputs_json_per_poll_split_to_fit() {
+    OutputPipeline outputs;
+    JsonRecordingStage *json = new JsonRecordingStage();
+    outputs.add(json);
+
+    poll(outputs, 1700000000);
+    loopFor(outputs, 2);
+    TEST_ASSERT_EQUAL(1, json->messages.size());
+    TEST_ASSERT_EQUAL_STRING("{\"time\":1700000000,\"Pac\":1234.5,\"Etoday\":12.5,\"Vpv1\":351.2,\"2/Eac\":3.0,\"Status\":\"Normal\"}", json->messages[0].c_str());
+
+    // more fields than one message holds
+    json->messages.clear();
+    outputs.beginPoll(millis(), 5);
+    char name[16];
+    for (int i = 0; i < 100; i++) {
+        snprintf(name, sizeof(name), "Field%d", i);
+        outputs.emit(name, (uint32_t) i);
+    }
+    outputs.endPoll();
+    loopFor(outputs, 10);
+
+    TEST_ASSERT_TRUE(json->messages.size() > 1);
+    std::string all;
+    for (const std::string &m : json->messages) {
+        TEST_ASSERT_TRUE(m.size() < OUTPUT_JSON_SIZE);
+        TEST_ASSERT_EQUAL(0, m.find("{\"time\":5,"));
+        TEST_ASSERT_EQUAL('}', m.back());
+        all += m;
+    }
+    TEST_ASSERT_TRUE(all.find("\"Field0\":0") != std::string::npos);
+    TEST_ASSERT_TRUE(all.find("\"Field99\":99") != std::string::npos);
+}
+
+void test_outputs_mqtt_topics_json_and_history() {
+    HistoryBuffer history;
+    history.begin();
+    WiFiClient client;
+    MqttPublisher mqtt(client, "", "", "inverter", "127.0.0.1");
+    TEST_ASSERT_TRUE(mqttLoopUntilConnected(mqtt) > 0);
+    MqttBroker.published.clear();
+
+    OutputPipeline outputs;
+    MqttTopicOutput *topics = new MqttTopicOutput(&history);
+    MqttJsonOutput *json = new MqttJsonOutput();
+    topics->setPublisher(&mqtt);
+    json->setPublisher(&mqtt);
+    outputs.add(topics);
+    outputs.add(json);
+
+    poll(outputs, 100);
+    // the topics go first, then the JSON
+    for (int i = 0; i < 20; i++) {
+        mqtt.loop();
+        outputs.loop();
+        delay(MQTT_LOOP_STEP_MILLIS);
+    }
+    TEST_ASSERT_NOT_NULL(MqttBroker.lastPayload("inverter/Pac"));
+    TEST_ASSERT_EQUAL_STRING("1234.5", MqttBroker.lastPayload("inverter/Pac")->c_str());
+    const String *payload = MqttBroker.lastPayload("inverter/" MQTT_JSON_SUBTOPIC);
+    TEST_ASSERT_NOT_NULL(payload);
+    TEST_ASSERT_TRUE(payload->startsWith("{\"time\":100,\"Pac\":1234.5,"));
+    TEST_ASSERT_EQUAL_STRING("inverter/" MQTT_JSON_SUBTOPIC, MqttBroker.published.back().topic.c_str());
+
+    // broker down: the poll goes to the history, the JSON waits
+    MqttBroker.available = false;
+    mqtt.loop();
+    TEST_ASSERT_FALSE(mqtt.isConnected());
+    size_t published = MqttBroker.published.size();
+    poll(outputs, 200);
+    loopFor(outputs, 5);
+    TEST_ASSERT_EQUAL(published, MqttBroker.published.size());
+    // Pac and Etoday are history fields
+    TEST_ASSERT_EQUAL(2, history.getBacklog());
+    TEST_ASSERT_EQUAL(1, json->getQueueDepth());
+}
+
+void test_outputs_http_push() {
+    MqttWireClient client;
+    OutputPipeline outputs;
+    HttpPushOutput *http = new HttpPushOutput(client);
+    TEST_ASSERT_FALSE(http->begin("https://example.com/"));
+    TEST_ASSERT_FALSE(http->begin("http://:8080/"));
+    TEST_ASSERT_TRUE(http->begin("http://192.168.1.10:8080/api/solar"));
+    http->setInterval(0);
+    outputs.add(http);
+
+    poll(outputs, 100);
+    outputs.loop();
+    std::string request(client.tx.begin(), client.tx.end());
+    TEST_ASSERT_EQUAL(0, request.find("POST /api/solar HTTP/1.1\r\nHost: 192.168.1.10\r\n"));
+    TEST_ASSERT_TRUE(request.find("Connection: close\r\n") != std::string::npos);
+    size_t body = request.find("\r\n\r\n") + 4;
+    TEST_ASSERT_EQUAL(0, request.compare(body, std::string::npos, "{\"time\":100,\"Pac\":1234.5,\"Etoday\":12.5,\"Vpv1\":351.2,\"2/Eac\":3.0,\"Status\":\"Normal\"}"));
+    char length[32];
+    snprintf(length, sizeof(length), "Content-Length: %u\r\n", (unsigned) (request.size() - body));
+    TEST_ASSERT_TRUE(request.find(length) != std::string::npos);
+
+    std::string ok("HTTP/1.1 204 No Content\r\n\r\n");
+    client.feed(std::vector<uint8_t>(ok.begin(), ok.end()));
+    outputs.loop();
+    TEST_ASSERT_EQUAL(204, http->getLastStatus());
+    TEST_ASSERT_FALSE(client.connected());
+
+    // an error reply is counted, a reply that does not come too
+    client.tx.clear();
+    poll(outputs, 105);
+    outputs.loop();
+    std::string error("HTTP/1.1 500 Internal Server Error\r\n\r\n");
+    client.feed(std::vector<uint8_t>(error.begin(), error.end()));
+    outputs.loop();
+    TEST_ASSERT_EQUAL(500, http->getLastStatus());
+
+    poll(outputs, 110);
+    outputs.loop();
+    delay(HTTP_PUSH_TIMEOUT_MILLIS);
+    outputs.loop();
+    TEST_ASSERT_EQUAL(0, http->getLastStatus());
+
+    InverterData stats;
+    outputs.emitStats(stats);
+    // once each, the rejected ones are not sent
+    TEST_ASSERT_EQUAL_STRING("1", stats["Output/Http/Sent"].c_str());
+    TEST_ASSERT_EQUAL_STRING("2", stats["Output/Http/Failed"].c_str());
+}
+
+void test_outputs_http_server_down_keeps_the_poll() {
+    RefusedWireClient client;
+    OutputPipeline outputs;
+    HttpPushOutput *http = new HttpPushOutput(client);
+    TEST_ASSERT_TRUE(http->begin("http://collector/push"));
+    outputs.add(http);
+    RecordingStage *other = new RecordingStage("Other");
+    outputs.add(other);
+
+    poll(outputs, 100);
+    loopFor(outputs, 5);
+    TEST_ASSERT_EQUAL(1, http->getQueueDepth());
+    TEST_ASSERT_EQUAL(5, other->messages.size());
+
+    // the default interval: a poll per minute at most
+    delay(1000);
+    poll(outputs, 101);
+    TEST_ASSERT_EQUAL(1, http->getQueueDepth());
+
+    InverterData stats;
+    outputs.emitStats(stats);
+    TEST_ASSERT_EQUAL_STRING("1", stats["Output/Http/Failed"].c_str());
+    TEST_ASSERT_EQUAL_STRING("1", stats["Output/Http/Skipped"].c_str());
+}
+
+void test_outputs_influx_line_per_poll() {
+    UdpListener listener;
+    char server[32];
+    snprintf(server, sizeof(server), "127.0.0.1:%u", listener.port);
+
+    OutputPipeline outputs;
+    InfluxUdpOutput *influx = new InfluxUdpOutput();
+    TEST_ASSERT_FALSE(influx->begin(":8089", "garage"));
+    TEST_ASSERT_FALSE(influx->begin("127.0.0.1:x", "garage"));
+    TEST_ASSERT_TRUE(influx->begin(server, "my garage"));
+    outputs.add(influx);
+
+    outputs.beginPoll(millis(), 1700000000);
+    outputs.emit("Pac", 1234.5f);
+    outputs.emit("SOC", (uint16_t) 80);
+    outputs.emit("Status", "Fault \"E1\"");
+    outputs.emit("Derate mode", "None");
+    // a failed read, left out
+    outputs.emit("Vbat", NAN);
+    outputs.emit("Ibat", "-inf");
+    outputs.endPoll();
+
+    std::vector<std::string> datagrams = listener.receive();
+    TEST_ASSERT_EQUAL(1, datagrams.size());
+    TEST_ASSERT_EQUAL_STRING("inverter,device=my\\ garage Pac=1234.5,SOC=80,Status=\"Fault \\\"E1\\\"\",Derate\\ mode=\"None\" 1700000000000000000\n", datagrams[0].c_str());
+
+    // before the clock is set the server stamps it
+    outputs.beginPoll(millis(), 100);
+    outputs.emit("Pac", 1.0f);
+    outputs.endPoll();
+    datagrams = listener.receive();
+    TEST_ASSERT_EQUAL(1, datagrams.size());
+    TEST_ASSERT_EQUAL_STRING("inverter,device=my\\ garage Pac=1.0\n", datagrams[0].c_str());
+
+    InverterData stats;
+    outputs.emitStats(stats);
+    TEST_ASSERT_EQUAL_STRING("2", stats["Output/Influx/Sent"].c_str());
+    TEST_ASSERT_EQUAL_STRING("0", stats["Output/Influx/Failed"].c_str());
+}
+
+void test_outputs_influx_addr_tags_and_datagram_size() {
+    UdpListener listener;
+    char server[32];
+    snprintf(server, sizeof(server), "127.0.0.1:%u", listener.port);
+
+    OutputPipeline outputs;
+    InfluxUdpOutput *influx = new InfluxUdpOutput();
+    TEST_ASSERT_TRUE(influx->begin(server, ""));
+    outputs.add(influx);
+
+    // two inverters on the bus
+    outputs.beginPoll(millis(), 1700000000);
+    outputs.emit("1/Pac", 100.0f);
+    outputs.emit("1/Ppv1", 120.0f);
+    outputs.emit("2/Pac", 200.0f);
+    outputs.endPoll();
+
+    std::vector<std::string> datagrams = listener.receive();
+    TEST_ASSERT_EQUAL(1, datagrams.size());
+    TEST_ASSERT_EQUAL_STRING("inverter,addr=1 Pac=100.0,Ppv1=120.0 1700000000000000000\ninverter,addr=2 Pac=200.0 1700000000000000000\n", datagrams[0].c_str());
+
+    // more than a datagram holds: whole lines in each one, all the fields
+    outputs.beginPoll(millis(), 1700000005);
+    char name[24];
+    for (int addr = 1; addr <= 3; addr++) {
+        for (int i = 0; i < 60; i++) {
+            snprintf(name, sizeof(name), "%d/Field%d", addr, i);
+            outputs.emit(name, 1000.5f + i);
+        }
+    }
+    outputs.endPoll();
+
+    datagrams = listener.receive();
+    TEST_ASSERT_TRUE(datagrams.size() > 1);
+    size_t fields = 0;
+    for (const std::string &d : datagrams) {
+        TEST_ASSERT_TRUE(d.size() <= INFLUX_DATAGRAM_SIZE);
+        TEST_ASSERT_EQUAL(0, d.find("inverter,addr="));
+        TEST_ASSERT_EQUAL('\n', d.back());
+        for (size_t pos = 0; (pos = d.find("Field", pos)) != std::string::npos; pos++) {
+            fields++;
+        }
+        size_t line = 0;
+        for (size_t end; (end = d.find('\n', line)) != std::string::npos; line = end + 1) {
+            TEST_ASSERT_EQUAL(0, d.compare(end - 20, 20, " 1700000005000000000"));
+        }
+    }
+    TEST_ASSERT_EQUAL(180, fields);
+}
+
+void test_outputs_influx_unresolved_host_backs_off() {
+    OutputPipeline outputs;
+    InfluxUdpOutput *influx = new InfluxUdpOutput();
+    TEST_ASSERT_TRUE(influx->begin("influx.lan", ""));
+    outputs.add(influx);
+    WiFi.unresolvable = "influx.lan";
+    uint32_t lookups = WiFi.lookups;
+
+    // one lookup, then none for the polls before the retry
+    for (int i = 0; i < 5; i++) {
+        poll(outputs, 1700000000 + i);
+        delay(5000);
+    }
+    TEST_ASSERT_EQUAL(1, WiFi.lookups - lookups);
+    delay(INFLUX_DNS_RETRY_MILLIS);
+    poll(outputs, 1700000100);
+    TEST_ASSERT_EQUAL(2, WiFi.lookups - lookups);
+
+    // twice as long the next time
+    delay(INFLUX_DNS_RETRY_MILLIS);
+    poll(outputs, 1700000200);
+    TEST_ASSERT_EQUAL(2, WiFi.lookups - lookups);
+
+    // resolved at last, and kept
+    WiFi.unresolvable = NULL;
+    delay(INFLUX_DNS_RETRY_MILLIS);
+    poll(outputs, 1700000300);
+    poll(outputs, 1700000305);
+    TEST_ASSERT_EQUAL(3, WiFi.lookups - lookups);
+
+    InverterData stats;
+    outputs.emitStats(stats);
+    TEST_ASSERT_EQUAL_STRING("7", stats["Output/Influx/Failed"].c_str());
+    TEST_ASSERT_EQUAL_STRING("2", stats["Output/Influx/Sent"].c_str());
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_outputs_interval_and_filter_per_stage);
+    RUN_TEST(test_outputs_stage_down_does_not_hold_up_the_others);
+    RUN_TEST(test_outputs_failing_message_backs_off_then_dropped);
+    RUN_TEST(test_outputs_json_per_poll_split_to_fit);
+    RUN_TEST(test_outputs_mqtt_topics_json_and_history);
+    RUN_TEST(test_outputs_http_push);
+    RUN_TEST(test_outputs_http_server_down_keeps_the_poll);
+    RUN_TEST(test_outputs_influx_line_per_poll);
+    RUN_TEST(test_outputs_influx_addr_tags_and_datagram_size);
+    RUN_TEST(test_outputs_influx_unresolved_host_backs_off);
+
+    return UNITY_END();
+}
@@ -0,0 +1,186 @@
+/*
+  test_main.cpp - In-RAM time series: the three resolutions, buckets without
+  samples, the RAM budget and the chunked CSV/JSON replies,
+  pio test -e native -f test_series
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <unity.h>
+#include <string>
+
+#include "TimeSeries.h"
+#include "InverterData.h"
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+static void addSample(TimeSeries &series, uint32_t time, float pac) {
+    series.beginSample(time);
+    series.emit("Pac", pac);
+    series.emit("Vac1", 230.0f);
+}
+
+// the whole reply, read in chunks of the given size
+static std::string readAll(TimeSeries &series, const char *name, const char *resolution, const char *format, size_t chunk) {
+    TimeSeriesQuery query;
+    TEST_ASSERT_TRUE(series.beginQuery(query, name, resolution, format));
+
+    std::string reply;
+    char buffer[256];
+    size_t n;
+    while ((n = series.readQuery(query, buffer, chunk)) > 0) {
+        TEST_ASSERT_TRUE(n < chunk);
+        TEST_ASSERT_EQUAL(n, strlen(buffer));
+        reply += buffer;
+    }
+    return reply;
+}
+
+void test_series_raw_csv() {
+    TimeSeries series;
+    addSample(series, 100, 1234.4f);
+    addSample(series, 101, 1234.6f);
+    addSample(series, 102, -20.0f);
+
+    TEST_ASSERT_EQUAL(1, series.getSeriesCount());
+    TEST_ASSERT_EQUAL_STRING("time,Pac\n100,1234\n101,1235\n102,-20\n", readAll(series, "Pac", "raw", "csv", 256).c_str());
+}
+
+void test_series_minute_means_and_empty_buckets() {
+    TimeSeries series;
+    // two samples in minute 0, one in minute 1, nothing in minutes 2 and 3, one in minute 4
+    addSample(series, 10, 100.0f);
+    addSample(series, 50, 200.0f);
+    addSample(series, 70, 400.0f);
+    addSample(series, 250, 50.0f);
+    // minute 4 is closed by the next one
+    addSample(series, 300, 0.0f);
+
+    TEST_ASSERT_EQUAL_STRING("time,Pac\n0,150\n60,400\n120,\n180,\n240,50\n", readAll(series, "Pac", "1m", "csv", 256).c_str());
+    TEST_ASSERT_EQUAL_STRING("{\"field\":\"Pac\",\"resolution\":\"1m\",\"points\":[[0,150],[60,400],[120,null],[180,null],[240,50]]}",
+        readAll(series, "Pac", "1m", "json", 256).c_str());
+}
+
+void test_series_clock_step_starts_over() {
+    TimeSeries series;
+    // counted from boot until the first SNTP sync
+    addSample(series, 10, 100.0f);
+    addSample(series, 70, 200.0f);
+    addSample(series, 130, 300.0f);
+    addSample(series, 1700000000, 400.0f);
+    addSample(series, 1700000060, 500.0f);
+
+    TEST_ASSERT_EQUAL_STRING("time,Pac\n1699999980,400\n", readAll(series, "Pac", "1m", "csv", 256).c_str());
+    TEST_ASSERT_EQUAL(0, series.getPoints("Pac", TIMESERIES_QUARTER));
+    // the raw samples keep their own times
+    TEST_ASSERT_EQUAL(5, series.getPoints("Pac", TIMESERIES_RAW));
+
+    // a step back within the ring drops the bucket being filled, not the ring
+    addSample(series, 1700000010, 600.0f);
+    addSample(series, 1700000120, 700.0f);
+    addSample(series, 1700000180, 800.0f);
+    TEST_ASSERT_EQUAL_STRING("time,Pac\n1699999980,400\n1700000040,\n1700000100,700\n", readAll(series, "Pac", "1m", "csv", 256).c_str());
+}
+
+void test_series_quarter_means() {
+    TimeSeries series;
+    for (uint32_t t = 0; t < 3 * 900; t += 10) {
+        addSample(series, t, t < 900 ? 1000.0f : 500.0f);
+    }
+    addSample(series, 3 * 900, 0);
+
+    TEST_ASSERT_EQUAL(3, series.getPoints("Pac", TIMESERIES_QUARTER));
+    TEST_ASSERT_EQUAL_STRING("time,Pac\n0,1000\n900,500\n1800,500\n", readAll(series, "Pac", "15m", "csv", 256).c_str());
+}
+
+void test_series_stays_within_budget() {
+    TimeSeries series;
+    // a day at one sample per second
+    for (uint32_t t = 0; t < 86400; t++) {
+        addSample(series, t, t % 1000);
+    }
+
+    uint16_t raw = series.getPoints("Pac", TIMESERIES_RAW);
+    uint16_t minutes = series.getPoints("Pac", TIMESERIES_MINUTE);
+    uint16_t quarters = series.getPoints("Pac", TIMESERIES_QUARTER);
+    TEST_ASSERT_TRUE(raw > 30);
+    TEST_ASSERT_TRUE(minutes > 60);
+    // the last quarter is still being filled
+    TEST_ASSERT_EQUAL(TIMESERIES_QUARTER_POINTS - 1, quarters);
+    TEST_ASSERT_TRUE(raw * 6 + minutes * 2 + quarters * 2 <= TIMESERIES_RAM_BUDGET / TIMESERIES_MAX_SERIES);
+
+    // the newest raw point is the last sample
+    std::string csv = readAll(series, "Pac", "raw", "csv", 256);
+    TEST_ASSERT_TRUE(csv.size() > 12);
+    TEST_ASSERT_EQUAL_STRING("86399,399\n", csv.substr(csv.size() - 10).c_str());
+}
+
+void test_series_small_chunks_same_reply() {
+    TimeSeries series;
+    for (uint32_t t = 0; t < 40; t++) {
+        addSample(series, 1000 + t, t * 37.0f);
+    }
+
+    std::string whole = readAll(series, "Pac", "raw", "json", 256);
+    TEST_ASSERT_EQUAL_STRING(whole.c_str(), readAll(series, "Pac", "raw", "json", 64).c_str());
+    TEST_ASSERT_EQUAL_STRING(whole.c_str(), readAll(series, "Pac", "raw", "json", 100).c_str());
+}
+
+void test_series_saturates_and_rejects_bad_queries() {
+    TimeSeries series;
+    addSample(series, 0, 50000.0f);
+    addSample(series, 1, -50000.0f);
+    TEST_ASSERT_EQUAL_STRING("time,Pac\n0,32767\n1,-32767\n", readAll(series, "Pac", "raw", "csv", 256).c_str());
+
+    TimeSeriesQuery query;
+    TEST_ASSERT_FALSE(series.beginQuery(query, "Vac1", "raw", "csv"));
+    TEST_ASSERT_FALSE(series.beginQuery(query, "Pac", "5m", "csv"));
+    TEST_ASSERT_FALSE(series.beginQuery(query, "Pac", "raw", "xml"));
+
+    char list[128];
+    series.list(list, sizeof(list));
+    TEST_ASSERT_EQUAL_STRING("{\"series\":[\"Pac\"],\"budget\":4096}", list);
+}
+
+void test_series_prefixed_fields_and_limit() {
+    TimeSeries series;
+    series.beginSample(0);
+    char name[16];
+    for (int addr = 1; addr <= 3; addr++) {
+        snprintf(name, sizeof(name), "%d/Pac", addr);
+        series.emit(name, 100.0f);
+        snprintf(name, sizeof(name), "%d/Ppv1", addr);
+        series.emit(name, 100.0f);
+    }
+
+    TEST_ASSERT_EQUAL(TIMESERIES_MAX_SERIES, series.getSeriesCount());
+    TEST_ASSERT_EQUAL(1, series.getPoints("2/Ppv1", TIMESERIES_RAW));
+    TEST_ASSERT_EQUAL(0, series.getPoints("3/Ppv1", TIMESERIES_RAW));
+
+    // the value with no series left is counted, a NaN is not a value
+    series.emit("3/Pac", NAN);
+    InverterData stats;
+    series.emitStats(stats);
+    TEST_ASSERT_EQUAL_STRING("5", stats["Series/Count"].c_str());
+    TEST_ASSERT_EQUAL_STRING("1", stats["Series/Rejected"].c_str());
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_series_raw_csv);
+    RUN_TEST(test_series_minute_means_and_empty_buckets);
+    RUN_TEST(test_series_clock_step_starts_over);
+    RUN_TEST(test_series_quarter_means);
+    RUN_TEST(test_series_stays_within_budget);
+    RUN_TEST(test_series_small_chunks_same_reply);
+    RUN_TEST(test_series_saturates_and_rejects_bad_queries);
+    RUN_TEST(test_series_prefixed_fields_and_limit);
+
+    return UNITY_END();
+}
@@ -0,0 +1,166 @@
+/*
+  test_main.cpp - Double buffered register blocks: generations and times, views
+  that stay intact while the next copy is written, and the Growatt blocks
+  pio test -e native -f test_snapshot
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <unity.h>
+#include <MemoryStream.h>
+
+#include "BlockSnapshot.h"
+#include "InverterData.h"
+#include "growatt/GrowattInverter.h"
+
+static MemoryStream serial;
+
+struct TestBlock {
+    float a;
+    float b;
+};
+
+void setUp() {
+    ModbusBus.reset();
+    serial.clear();
+}
+
+void tearDown() {
+}
+
+void test_snapshot_commit_and_abort() {
+    BlockSnapshot<TestBlock> block;
+    TEST_ASSERT_EQUAL(0, block.getGeneration());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, block.get().a);
+
+    TestBlock &w = block.beginWrite();
+    w.a = 1.0f;
+    w.b = 2.0f;
+    // not there until the commit
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, block.get().a);
+    block.commit(1000);
+    TEST_ASSERT_EQUAL(1, block.getGeneration());
+    TEST_ASSERT_EQUAL(1000, block.getMillis());
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, block.get().a);
+
+    // a partial write keeps the other fields
+    block.beginWrite().a = 3.0f;
+    block.commit(2000);
+    TEST_ASSERT_EQUAL_FLOAT(3.0f, block.get().a);
+    TEST_ASSERT_EQUAL_FLOAT(2.0f, block.get().b);
+
+    // a failed decode leaves the block alone
+    block.beginWrite().a = 99.0f;
+    block.abort();
+    TEST_ASSERT_EQUAL(2, block.getGeneration());
+    TEST_ASSERT_EQUAL(2000, block.getMillis());
+    TEST_ASSERT_EQUAL_FLOAT(3.0f, block.get().a);
+}
+
+void test_snapshot_view_stays_intact_until_overwritten() {
+    BlockSnapshot<TestBlock> block;
+    block.beginWrite().a = 1.0f;
+    block.commit(1000);
+
+    BlockView<TestBlock> view = block.view();
+    TEST_ASSERT_EQUAL(1, view.generation);
+    TEST_ASSERT_EQUAL(1000, view.millis);
+
+    // the writer fills the other copy
+    TestBlock &w = block.beginWrite();
+    w.a = 2.0f;
+    TEST_ASSERT_TRUE(block.isValid(view));
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, view.data->a);
+    block.commit(2000);
+    // older, still whole
+    TEST_ASSERT_TRUE(block.isValid(view));
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, view.data->a);
+
+    // the next write takes the copy of the view
+    block.beginWrite().a = 3.0f;
+    TEST_ASSERT_FALSE(block.isValid(view));
+    block.commit(3000);
+    TEST_ASSERT_FALSE(block.isValid(view));
+
+    BlockView<TestBlock> fresh = block.view();
+    TEST_ASSERT_EQUAL(3, fresh.generation);
+    TEST_ASSERT_EQUAL_FLOAT(3.0f, fresh.data->a);
+    TEST_ASSERT_TRUE(block.isValid(fresh));
+}
+
+void test_snapshot_growatt_block_per_read() {
+    NativeModbusSlave &inv = ModbusBus.slave(1);
+    for (uint16_t r = 0; r < 125; r++) inv.inputRegisters[r] = r;
+    for (uint16_t r = 1000; r < 1125; r++) inv.inputRegisters[r] = r - 1000;
+    GrowattInverter inverter(&serial, false, 1, false, false);
+
+    delay(100);
+    unsigned long t = millis();
+    inverter.read();
+    BlockView<GrowattPvBlock> pv = inverter.getPvBlock().view();
+    TEST_ASSERT_EQUAL(1, pv.generation);
+    TEST_ASSERT_EQUAL(t, pv.millis);
+    TEST_ASSERT_EQUAL_FLOAT(0.3f, pv.data->Vpv1);
+    TEST_ASSERT_EQUAL(0, inverter.getAcBlock().getGeneration());
+
+    // the AC block does not touch the PV one
+    inverter.read();
+    TEST_ASSERT_EQUAL(1, inverter.getAcBlock().getGeneration());
+    TEST_ASSERT_EQUAL_FLOAT((35.0f * 65536 + 36) / 10, inverter.getAcBlock().get().Pac);
+    TEST_ASSERT_TRUE(inverter.getPvBlock().isValid(pv));
+
+    // the battery step, then PV again: a failed read keeps the last block and its time
+    inverter.read();
+    delay(100);
+    ModbusBus.failNext(ModbusMaster::ku8MBResponseTimedOut);
+    inverter.read();
+    TEST_ASSERT_FALSE(inverter.isDataValid());
+    BlockView<GrowattPvBlock> kept = inverter.getPvBlock().view();
+    TEST_ASSERT_EQUAL(1, kept.generation);
+    TEST_ASSERT_EQUAL(t, kept.millis);
+    TEST_ASSERT_EQUAL_FLOAT(0.3f, kept.data->Vpv1);
+    TEST_ASSERT_EQUAL_FLOAT((5.0f * 65536 + 6) / 10, kept.data->Ppv1);
+}
+
+void test_snapshot_growatt_power_sample_keeps_the_rest() {
+    NativeModbusSlave &inv = ModbusBus.slave(1);
+    for (uint16_t r = 0; r < 125; r++) inv.inputRegisters[r] = r;
+    for (uint16_t r = 1000; r < 1125; r++) inv.inputRegisters[r] = r - 1000;
+    GrowattInverter inverter(&serial, false, 1, false, false);
+    inverter.read();
+
+    unsigned long t = inverter.getPvBlock().getMillis();
+    delay(100);
+    inv.inputRegisters[6] = 500;
+    InverterData samples;
+    TEST_ASSERT_TRUE(inverter.samplePower(samples));
+
+    // the sample has its own block, the PV block stays as the full read left it
+    TEST_ASSERT_EQUAL(1, inverter.getPowerBlock().getGeneration());
+    TEST_ASSERT_EQUAL(millis(), inverter.getPowerBlock().getMillis());
+    TEST_ASSERT_EQUAL_FLOAT((5.0f * 65536 + 500) / 10, inverter.getPowerBlock().get().Ppv1);
+    const GrowattPvBlock &pv = inverter.getPvBlock().get();
+    TEST_ASSERT_EQUAL(1, inverter.getPvBlock().getGeneration());
+    TEST_ASSERT_EQUAL(t, inverter.getPvBlock().getMillis());
+    TEST_ASSERT_EQUAL_FLOAT((5.0f * 65536 + 6) / 10, pv.Ppv1);
+    TEST_ASSERT_EQUAL_FLOAT(0.3f, pv.Vpv1);
+    TEST_ASSERT_EQUAL(0, inverter.getAcBlock().getGeneration());
+    TEST_ASSERT_EQUAL(0, inverter.getBatteryBlock().getGeneration());
+
+    // the poll emits the values of its own read, Ppv1 next to its voltage
+    InverterData data = inverter.getData(true);
+    TEST_ASSERT_EQUAL_STRING("32768.6", data["Ppv1"].c_str());
+    TEST_ASSERT_EQUAL_STRING("0.3", data["Vpv1"].c_str());
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_snapshot_commit_and_abort);
+    RUN_TEST(test_snapshot_view_stays_intact_until_overwritten);
+    RUN_TEST(test_snapshot_growatt_block_per_read);
+    RUN_TEST(test_snapshot_growatt_power_sample_keeps_the_rest);
+
+    return UNITY_END();
+}
@@ -0,0 +1,188 @@
+/*
+  test_main.cpp - Soyosource display parser against generated line streams:
+  decoding, resynchronization after corruption, fuzz input replay and benchmark
+  pio test -e native -f test_soyosource_stream -v
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <unity.h>
+#include <chrono>
+#include <MemoryStream.h>
+#include <SoyosourceStreamGen.h>
+#include <SoyosourceFuzz.h>
+
+#include "soyosource/SoyosourceGTNInverter.h"
+
+#define STREAM_EVENTS 500
+#define BENCH_EVENTS 100000
+#define FUZZ_REPLAYS 300
+
+static MemoryStream serial;
+
+void setUp() {
+    serial.clear();
+}
+
+void tearDown() {
+}
+
+struct StreamResult {
+    uint32_t decoded;
+    uint32_t intactLost;
+};
+
+// feeds the events one by one like they arrive on the line
+static StreamResult runStream(SoyosourceStreamGen &gen, uint32_t events) {
+    SoyosourceGTNInverter inverter(&serial, false);
+    StreamResult result = { 0, 0 };
+
+    for (uint32_t i = 0; i < events; i++) {
+        SoyosourceStreamEvent event = gen.next();
+        delay(event.gapMillis);
+        serial.feed(event.bytes);
+        inverter.loop();
+
+        bool decoded = inverter.isDataValid();
+        if (decoded) {
+            InverterData data = inverter.getData();
+            decoded = data.count("Vbat") == 1;
+            result.decoded += decoded;
+        }
+        if (event.intactStatus && !decoded) {
+            result.intactLost++;
+        }
+    }
+
+    return result;
+}
+
+void test_clean_display_stream() {
+    SoyosourceStreamGen gen(1);
+    StreamResult r = runStream(gen, STREAM_EVENTS);
+
+    TEST_ASSERT_GREATER_THAN(0, gen.intactStatusFrames);
+    TEST_ASSERT_EQUAL(gen.intactStatusFrames, r.decoded);
+    TEST_ASSERT_EQUAL(0, r.intactLost);
+}
+
+void test_clean_ms51_stream() {
+    SoyosourceStreamGen gen(2);
+    gen.ms51Rate = 1.0;
+    StreamResult r = runStream(gen, STREAM_EVENTS);
+
+    TEST_ASSERT_EQUAL(gen.intactStatusFrames, r.decoded);
+}
+
+void test_generated_frame_values() {
+    SoyosourceGTNInverter inverter(&serial, false);
+
+    serial.feed(SoyosourceStreamGen::displayFrame(0x01, 300, 512, 65, 231, 50, 285));
+    inverter.loop();
+
+    InverterData data = inverter.getData();
+    TEST_ASSERT_EQUAL_STRING("300", data["PacMeter"].c_str());
+    TEST_ASSERT_EQUAL_STRING("51.2", data["Vbat"].c_str());
+    TEST_ASSERT_EQUAL_STRING("6.5", data["Ibat"].c_str());
+    TEST_ASSERT_EQUAL_STRING("231", data["Vac"].c_str());
+    TEST_ASSERT_EQUAL_STRING("50.0", data["Fac"].c_str());
+    TEST_ASSERT_EQUAL_STRING("28.5", data["Temp"].c_str());
+}
+
+void test_corrupted_frames_never_decode() {
+    SoyosourceStreamGen gen(3);
+    gen.bitFlipRate = 0.5;
+    gen.truncateRate = 0.2;
+    StreamResult r = runStream(gen, STREAM_EVENTS);
+
+    // with a gap before every poll only the corrupted frames are lost
+    TEST_ASSERT_EQUAL(gen.intactStatusFrames, r.decoded);
+    TEST_ASSERT_EQUAL(0, r.intactLost);
+}
+
+void test_resync_after_truncated_frame() {
+    SoyosourceGTNInverter inverter(&serial, false);
+    std::vector<uint8_t> frame = SoyosourceStreamGen::displayFrame(0x01, 300, 512, 65, 231, 50, 285);
+
+    serial.feed(frame.data(), 7);
+    inverter.loop();
+    delay(100);
+    serial.feed(frame);
+    inverter.loop();
+
+    TEST_ASSERT_TRUE(inverter.isDataValid());
+}
+
+void test_fuzz_replay() {
+    std::mt19937 rng(7);
+
+    for (int i = 0; i < FUZZ_REPLAYS; i++) {
+        // random bytes
+        std::vector<uint8_t> input(1 + rng() % 512);
+        for (auto &b : input) b = rng() & 0xff;
+        soyosourceFuzzOne(input.data(), input.size());
+
+        // corrupted generated streams, in random chunk sizes
+        SoyosourceStreamGen gen(i);
+        gen.ms51Rate = 0.5;
+        gen.noiseRate = 0.3;
+        gen.truncateRate = 0.2;
+        gen.bitFlipRate = 0.2;
+        gen.gapRate = 0.0;
+        input.assign(1, rng() & 0xff);
+        for (int e = 0; e < 20; e++) {
+            SoyosourceStreamEvent event = gen.next();
+            input.insert(input.end(), event.bytes.begin(), event.bytes.end());
+        }
+        soyosourceFuzzOne(input.data(), input.size());
+    }
+}
+
+static void benchStream(const char *name, SoyosourceStreamGen &gen) {
+    auto start = std::chrono::steady_clock::now();
+    StreamResult r = runStream(gen, BENCH_EVENTS);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    char msg[200];
+    snprintf(msg, sizeof(msg), "%-26s %9.0f frames/s %6.1f MB/s, %6u of %6u intact frames lost (%.2f%%)",
+        name, r.decoded / secs, gen.bytes / secs / 1e6, r.intactLost, gen.intactStatusFrames, 100.0 * r.intactLost / gen.intactStatusFrames);
+    TEST_MESSAGE(msg);
+}
+
+void test_bench_stream() {
+    SoyosourceStreamGen clean(10);
+    clean.gapRate = 0.0;
+    benchStream("clean, back to back", clean);
+
+    SoyosourceStreamGen noisy(11);
+    noisy.gapRate = 0.0;
+    noisy.noiseRate = 0.2;
+    benchStream("20% noise, back to back", noisy);
+
+    SoyosourceStreamGen corrupt(12);
+    corrupt.gapRate = 0.0;
+    corrupt.truncateRate = 0.1;
+    corrupt.bitFlipRate = 0.1;
+    benchStream("10% trunc 10% flip", corrupt);
+
+    SoyosourceStreamGen paced(13);
+    paced.noiseRate = 0.2;
+    paced.truncateRate = 0.1;
+    paced.bitFlipRate = 0.1;
+    benchStream("all faults, paced polls", paced);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_clean_display_stream);
+    RUN_TEST(test_clean_ms51_stream);
+    RUN_TEST(test_generated_frame_values);
+    RUN_TEST(test_corrupted_frames_never_decode);
+    RUN_TEST(test_resync_after_truncated_frame);
+    RUN_TEST(test_fuzz_replay);
+    RUN_TEST(test_bench_stream);
+
+    return UNITY_END();
+}
@@ -0,0 +1,232 @@
+/*
+  test_main.cpp - Regression tests and poll cycle timing of the Voltronic driver
+  talking to a simulated Axpert VM III over a pseudo-terminal
+  pio test -e native -f test_voltronic_sim -v
+
+  Written by agent (at) local
+  Licensed under GNU GPLv3
+*/
+
+#include <unity.h>
+#include <VoltronicSim.h>
+
+#include "voltronic/AxpertVMIII.h"
+
+// QMOD, QPIRI, QPIGS, QPIWS
+#define VOLTRONIC_CYCLE_LEN 4
+
+// fast line for the functional tests, the benchmark uses the real 2400 baud
+#define TEST_BAUD 115200
+
+static VoltronicSim *sim;
+
+void setUp() {
+    sim = new VoltronicSim(TEST_BAUD);
+}
+
+void tearDown() {
+    delete sim;
+}
+
+static void assertValue(const char *expected, InverterData &data, const char *name) {
+    TEST_ASSERT_TRUE_MESSAGE(data.count(name) == 1, name);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(expected, data[name].c_str(), name);
+}
+
+void test_voltronic_crc() {
+    // the CRC the driver appends to QPIGS, as found in every protocol document
+    TEST_ASSERT_EQUAL_HEX16(0xB7A9, voltronicCRC("QPIGS", 5));
+}
+
+void test_voltronic_mode() {
+    TEST_ASSERT_TRUE(sim->start());
+    VoltronicAxpertVMIIIInverter inverter(&sim->getStream(), false);
+
+    inverter.read();
+    TEST_ASSERT_TRUE(inverter.isDataValid());
+    InverterData data = inverter.getData();
+    assertValue("4", data, "InverterMode");
+}
+
+void test_voltronic_full_cycle() {
+    TEST_ASSERT_TRUE(sim->start());
+    VoltronicAxpertVMIIIInverter inverter(&sim->getStream(), false);
+
+    // QMOD
+    inverter.read();
+    TEST_ASSERT_TRUE(inverter.isDataValid());
+
+    // QPIRI
+    inverter.read();
+    TEST_ASSERT_TRUE(inverter.isDataValid());
+    InverterData data = inverter.getData();
+    assertValue("46.0", data, "VbatRecharge");
+    assertValue("42.0", data, "VbatUnderVoltage");
+    assertValue("56.4", data, "VbatBulkVoltage");
+    assertValue("54.0", data, "VbatFloatVoltage");
+    assertValue("30", data, "ImaxGridChargeCurrent");
+    assertValue("60", data, "ImaxChargeCurrent");
+    assertValue("2", data, "PrioritySourceOut");
+    assertValue("3", data, "PrioritySourceCharger");
+    assertValue("52.0", data, "VbatRedischargeVoltage");
+
+    // QPIGS
+    inverter.read();
+    TEST_ASSERT_TRUE(inverter.isDataValid());
+    data = inverter.getData();
+    assertValue("230.0", data, "VacOut");
+    assertValue("49.9", data, "FacOut");
+    assertValue("119", data, "Pload");
+    assertValue("161", data, "PloadVA");
+    assertValue("3", data, "LoadPercent");
+    assertValue("460", data, "Vbus");
+    assertValue("57.5", data, "Vbat");
+    assertValue("12", data, "IbatCharge");
+    assertValue("100", data, "BatteryCapacity");
+    assertValue("69", data, "TempHeatsink");
+    assertValue("14.0", data, "Ipv");
+    assertValue("103.8", data, "Vpv");
+    assertValue("57.5", data, "Vscc");
+    assertValue("0", data, "IbatDischarge");
+    assertValue("1", data, "LoadStatusON");
+    assertValue("1", data, "SCCchargeON");
+    assertValue("0", data, "ACchargeON");
+
+    // QPIWS, 36 warning bits are shorter than the longest reply the driver accepts
+    inverter.read();
+    TEST_ASSERT_TRUE(inverter.isDataValid());
+    data = inverter.getData();
+    assertValue("000000000000000000000000000000000000", data, "Warnings");
+
+    VoltronicSimStats stats = sim->getStats();
+    TEST_ASSERT_EQUAL(VOLTRONIC_CYCLE_LEN, stats.requests);
+    TEST_ASSERT_EQUAL(VOLTRONIC_CYCLE_LEN, stats.responses);
+    TEST_ASSERT_EQUAL(0, stats.naks);
+}
+
+void test_voltronic_changed_reply() {
+    sim->setReply("QMOD", "(L");
+    TEST_ASSERT_TRUE(sim->start());
+    VoltronicAxpertVMIIIInverter inverter(&sim->getStream(), false);
+
+    inverter.read();
+    TEST_ASSERT_TRUE(inverter.isDataValid());
+    InverterData data = inverter.getData();
+    assertValue("3", data, "InverterMode");
+}
+
+void test_voltronic_parallel_status() {
+    TEST_ASSERT_TRUE(sim->start());
+    Stream &line = sim->getStream();
+
+    // the driver has no QPGSn yet, talk to the simulator directly
+    String cmd = voltronicFrame("QPGS0");
+    line.write((const uint8_t *) cmd.c_str(), cmd.length());
+
+    String reply;
+    unsigned long start = millis();
+    while (!reply.endsWith("\r") && millis() - start < 2000) {
+        if (line.available() > 0) {
+            reply += (char) line.read();
+        }
+    }
+
+    TEST_ASSERT_TRUE(reply.startsWith("(1 92932004102443 B "));
+    uint16_t crc = voltronicCRC(reply.c_str(), reply.length() - 3);
+    TEST_ASSERT_EQUAL_HEX8(crc >> 8, (uint8_t) reply.charAt(reply.length() - 3));
+    TEST_ASSERT_EQUAL_HEX8(crc & 0xff, (uint8_t) reply.charAt(reply.length() - 2));
+}
+
+void test_voltronic_injected_faults() {
+    TEST_ASSERT_TRUE(sim->start());
+    VoltronicAxpertVMIIIInverter inverter(&sim->getStream(), false);
+
+    sim->failNext(SIM_FAULT_CRC);
+    inverter.read();
+    TEST_ASSERT_FALSE(inverter.isDataValid());
+
+    sim->failNext(SIM_FAULT_EXCEPTION);
+    inverter.read();
+    TEST_ASSERT_FALSE(inverter.isDataValid());
+
+    // a slow inverter is still within the 5s the driver waits
+    sim->setExtraDelay(200000);
+    unsigned long start = millis();
+    inverter.read();
+    TEST_ASSERT_TRUE(inverter.isDataValid());
+    TEST_ASSERT_TRUE(millis() - start >= 200);
+
+    VoltronicSimStats stats = sim->getStats();
+    TEST_ASSERT_EQUAL(3, stats.requests);
+    TEST_ASSERT_EQUAL(1, stats.crcErrors);
+    TEST_ASSERT_EQUAL(1, stats.naks);
+}
+
+void test_voltronic_unknown_command() {
+    // older firmware without QPIWS answers NAK
+    sim->setReply("QPIWS", "");
+    TEST_ASSERT_TRUE(sim->start());
+    VoltronicAxpertVMIIIInverter inverter(&sim->getStream(), false);
+
+    // QMOD, QPIRI and QPIGS are fine, a NAK is not data
+    for (int i = 0; i < VOLTRONIC_CYCLE_LEN - 1; i++) {
+        inverter.read();
+        TEST_ASSERT_TRUE(inverter.isDataValid());
+    }
+    inverter.read();
+    TEST_ASSERT_FALSE(inverter.isDataValid());
+}
+
+// polls full cycles back to back, like the main loop with no polling interval,
+// and reports the time per cycle against the wire time of the line
+static void benchCycle(const char *name, int cycles) {
+    sim->resetStats();
+    VoltronicAxpertVMIIIInverter inverter(&sim->getStream(), false);
+
+    int polls = cycles * VOLTRONIC_CYCLE_LEN;
+    int valid = 0;
+    unsigned long maxLatency = 0;
+    unsigned long start = micros();
+    for (int i = 0; i < polls; i++) {
+        unsigned long pollStart = micros();
+        inverter.read();
+        InverterData data = inverter.getData();
+        maxLatency = std::max(maxLatency, micros() - pollStart);
+        if (inverter.isDataValid()) valid++;
+    }
+    unsigned long elapsed = micros() - start;
+
+    VoltronicSimStats stats = sim->getStats();
+    char msg[200];
+    snprintf(msg, sizeof(msg), "%-18s %7.1f ms/cycle %5.1f%% valid, line %5.1f%% busy %6llu bytes, poll latency max %6.1f ms",
+        name, elapsed / 1000.0 / cycles, 100.0 * valid / polls, 100.0 * stats.wireMicros / elapsed,
+        (unsigned long long) stats.wireBytes, maxLatency / 1000.0);
+    TEST_MESSAGE(msg);
+}
+
+void test_bench_voltronic_cycle() {
+    delete sim;
+    sim = new VoltronicSim(VOLTRONIC_BAUD);
+    TEST_ASSERT_TRUE(sim->start());
+
+    benchCycle("2400 baud", 2);
+
+    // typical Axpert turnaround
+    sim->setExtraDelay(50000);
+    benchCycle("+50ms turnaround", 2);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_voltronic_crc);
+    RUN_TEST(test_voltronic_mode);
+    RUN_TEST(test_voltronic_full_cycle);
+    RUN_TEST(test_voltronic_changed_reply);
+    RUN_TEST(test_voltronic_parallel_status);
+    RUN_TEST(test_voltronic_injected_faults);
+    RUN_TEST(test_voltronic_unknown_command);
+    RUN_TEST(test_bench_voltronic_cycle);
+
+    return UNITY_END();
+}